@@ -44,117 +44,91 @@ std::string CFeeRate::ToString() const
 
 CAmountMap& operator+=(CAmountMap& a, const CAmountMap& b)
 {
-    for(std::map<CAsset, CAmount>::const_iterator it = b.begin(); it != b.end(); ++it)
+    for(CAmountMap::const_iterator it = b.begin(); it != b.end(); ++it)
         a[it->first] += it->second;
     return a;
 }
 
 CAmountMap& operator-=(CAmountMap& a, const CAmountMap& b)
 {
-    for(std::map<CAsset, CAmount>::const_iterator it = b.begin(); it != b.end(); ++it)
+    for(CAmountMap::const_iterator it = b.begin(); it != b.end(); ++it)
         a[it->first] -= it->second;
     return a;
 }
 
 CAmountMap operator+(const CAmountMap& a, const CAmountMap& b)
 {
-    CAmountMap c;
-    for(std::map<CAsset, CAmount>::const_iterator it = a.begin(); it != a.end(); ++it)
-        c[it->first] += it->second;
-    for(std::map<CAsset, CAmount>::const_iterator it = b.begin(); it != b.end(); ++it)
-        c[it->first] += it->second;
+    CAmountMap c(a);
+    c += b;
     return c;
 }
 
 CAmountMap operator-(const CAmountMap& a, const CAmountMap& b)
 {
-    CAmountMap c;
-    for(std::map<CAsset, CAmount>::const_iterator it = a.begin(); it != a.end(); ++it)
-        c[it->first] += it->second;
-    for(std::map<CAsset, CAmount>::const_iterator it = b.begin(); it != b.end(); ++it)
-        c[it->first] -= it->second;
+    CAmountMap c(a);
+    c -= b;
     return c;
 }
 
+/**
+ * Walk both maps in asset order, treating missing assets as zero, and find
+ * whether any asset has a smaller and whether any has a larger amount in a
+ * than in b. All the comparison operators follow from these two.
+ */
+static void CompareAmountMaps(const CAmountMap& a, const CAmountMap& b, bool& fSmaller, bool& fLarger)
+{
+    fSmaller = fLarger = false;
+    CAmountMap::const_iterator ia = a.begin(), ib = b.begin();
+    while (ia != a.end() || ib != b.end()) {
+        CAmount aValue = 0, bValue = 0;
+        if (ib == b.end() || (ia != a.end() && ia->first < ib->first)) {
+            aValue = (ia++)->second;
+        } else if (ia == a.end() || ib->first < ia->first) {
+            bValue = (ib++)->second;
+        } else {
+            aValue = (ia++)->second;
+            bValue = (ib++)->second;
+        }
+        if (aValue < bValue)
+            fSmaller = true;
+        if (aValue > bValue)
+            fLarger = true;
+    }
+}
+
 bool operator<(const CAmountMap& a, const CAmountMap& b)
 {
-    bool smallerElement = false;
-    for(std::map<CAsset, CAmount>::const_iterator it = b.begin(); it != b.end(); ++it) {
-        CAmount aValue = a.count(it->first) ? a.find(it->first)->second : 0;
-        if (aValue > it->second)
-            return false;
-        if (aValue < it->second)
-            smallerElement = true;
-    }
-    for(std::map<CAsset, CAmount>::const_iterator it = a.begin(); it != a.end(); ++it) {
-        CAmount bValue = b.count(it->first) ? b.find(it->first)->second : 0;
-        if (it->second > bValue)
-            return false;
-        if (it->second < bValue)
-            smallerElement = true;
-    }
-    return smallerElement;
+    bool fSmaller, fLarger;
+    CompareAmountMaps(a, b, fSmaller, fLarger);
+    return fSmaller && !fLarger;
 }
 
 bool operator<=(const CAmountMap& a, const CAmountMap& b)
 {
-    for(std::map<CAsset, CAmount>::const_iterator it = b.begin(); it != b.end(); ++it) {
-        CAmount aValue = a.count(it->first) ? a.find(it->first)->second : 0;
-        if (aValue > it->second)
-            return false;
-    }
-    for(std::map<CAsset, CAmount>::const_iterator it = a.begin(); it != a.end(); ++it) {
-        CAmount bValue = b.count(it->first) ? b.find(it->first)->second : 0;
-        if (it->second > bValue)
-            return false;
-    }
-    return true;
+    bool fSmaller, fLarger;
+    CompareAmountMaps(a, b, fSmaller, fLarger);
+    return !fLarger;
 }
 
 bool operator>(const CAmountMap& a, const CAmountMap& b)
 {
-    bool largerElement = false;
-    for(std::map<CAsset, CAmount>::const_iterator it = b.begin(); it != b.end(); ++it) {
-        CAmount aValue = a.count(it->first) ? a.find(it->first)->second : 0;
-        if (aValue < it->second)
-            return false;
-        if (aValue > it->second)
-            largerElement = true;
-    }
-    for(std::map<CAsset, CAmount>::const_iterator it = a.begin(); it != a.end(); ++it) {
-        CAmount bValue = b.count(it->first) ? b.find(it->first)->second : 0;
-        if (it->second < bValue)
-            return false;
-        if (it->second > bValue)
-            largerElement = true;
-    }
-    return largerElement;
+    bool fSmaller, fLarger;
+    CompareAmountMaps(a, b, fSmaller, fLarger);
+    return fLarger && !fSmaller;
 }
 
 bool operator>=(const CAmountMap& a, const CAmountMap& b)
 {
-    for(std::map<CAsset, CAmount>::const_iterator it = b.begin(); it != b.end(); ++it) {
-        if ((a.count(it->first) ? a.find(it->first)->second : 0) < it->second)
-            return false;
-    }
-    for(std::map<CAsset, CAmount>::const_iterator it = a.begin(); it != a.end(); ++it) {
-        if (it->second < (b.count(it->first) ? b.find(it->first)->second : 0))
-            return false;
-    }
-    return true;
+    bool fSmaller, fLarger;
+    CompareAmountMaps(a, b, fSmaller, fLarger);
+    return !fSmaller;
 }
 
 bool operator==(const CAmountMap& a, const CAmountMap& b)
 {
-    for(std::map<CAsset, CAmount>::const_iterator it = a.begin(); it != a.end(); ++it) {
-        if ((b.count(it->first) ? b.find(it->first)->second : 0) != it->second)
-            return false;
-    }
-    for(std::map<CAsset, CAmount>::const_iterator it = b.begin(); it != b.end(); ++it) {
-        if ((a.count(it->first) ? a.find(it->first)->second : 0) != it->second)
-            return false;
-    }
-    return true;
+    bool fSmaller, fLarger;
+    CompareAmountMaps(a, b, fSmaller, fLarger);
+    return !fSmaller && !fLarger;
 }
 
 bool operator!=(const CAmountMap& a, const CAmountMap& b)
@@ -172,7 +146,7 @@ bool operator!(const CAmountMap& a)
 
 bool hasNegativeValue(const CAmountMap& amount)
 {
-    for(std::map<CAsset, CAmount>::const_iterator it = amount.begin(); it != amount.end(); ++it) {
+    for(CAmountMap::const_iterator it = amount.begin(); it != amount.end(); ++it) {
         if (it->second < 0)
             return true;
     }
@@ -181,7 +155,7 @@ bool hasNegativeValue(const CAmountMap& amount)
 
 bool hasNonPostiveValue(const CAmountMap& amount)
 {
-    for(std::map<CAsset, CAmount>::const_iterator it = amount.begin(); it != amount.end(); ++it) {
+    for(CAmountMap::const_iterator it = amount.begin(); it != amount.end(); ++it) {
         if (it->second <= 0)
             return true;
     }
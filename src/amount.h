@@ -6,8 +6,12 @@
 #ifndef BITCOIN_AMOUNT_H
 #define BITCOIN_AMOUNT_H
 
+#include "prevector.h"
 #include "serialize.h"
 #include "uint256.h"
+
+#include <algorithm>
+#include <stdexcept>
 #include <stdlib.h>
 #include <string>
 
@@ -69,8 +73,94 @@ struct CAsset {
     }
 };
 
-/** Used for consensus fee and general wallet accounting*/
-typedef std::map<CAsset, CAmount> CAmountMap;
+/**
+ * Used for consensus fee and general wallet accounting.
+ *
+ * Behaves as the std::map<CAsset, CAmount> it replaced, with the subset of
+ * the interface used here, but keeps its entries in a vector sorted by asset
+ * with room for AMOUNTMAP_INLINE_ASSETS of them before allocating: almost
+ * every amount map holds one to three assets, and they are built and merged
+ * for every transaction. Iterators and references are invalidated by
+ * inserting or erasing.
+ */
+static const unsigned int AMOUNTMAP_INLINE_ASSETS = 3;
+
+class CAmountMap
+{
+public:
+    struct value_type {
+        CAsset first;
+        CAmount second;
+    };
+    typedef CAsset key_type;
+    typedef CAmount mapped_type;
+
+private:
+    typedef prevector<AMOUNTMAP_INLINE_ASSETS, value_type> vector_type;
+    vector_type entries;
+
+    static bool KeyLess(const value_type& entry, const CAsset& asset) { return entry.first < asset; }
+
+public:
+    typedef vector_type::iterator iterator;
+    typedef vector_type::const_iterator const_iterator;
+    typedef vector_type::size_type size_type;
+
+    iterator begin() { return entries.begin(); }
+    iterator end() { return entries.end(); }
+    const_iterator begin() const { return entries.begin(); }
+    const_iterator end() const { return entries.end(); }
+
+    size_type size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    void clear() { entries.clear(); }
+    size_t allocated_memory() const { return entries.allocated_memory(); }
+
+    iterator lower_bound(const CAsset& asset) { return std::lower_bound(entries.begin(), entries.end(), asset, KeyLess); }
+    const_iterator lower_bound(const CAsset& asset) const { return std::lower_bound(entries.begin(), entries.end(), asset, KeyLess); }
+
+    iterator find(const CAsset& asset)
+    {
+        iterator it = lower_bound(asset);
+        return it != end() && it->first == asset ? it : end();
+    }
+    const_iterator find(const CAsset& asset) const
+    {
+        const_iterator it = lower_bound(asset);
+        return it != end() && it->first == asset ? it : end();
+    }
+    size_type count(const CAsset& asset) const { return find(asset) != end(); }
+
+    CAmount& operator[](const CAsset& asset)
+    {
+        iterator it = lower_bound(asset);
+        if (it == end() || it->first != asset) {
+            value_type entry;
+            entry.first = asset;
+            entry.second = 0;
+            it = entries.insert(it, entry);
+        }
+        return it->second;
+    }
+
+    const CAmount& at(const CAsset& asset) const
+    {
+        const_iterator it = find(asset);
+        if (it == end())
+            throw std::out_of_range("CAmountMap::at");
+        return it->second;
+    }
+
+    iterator erase(iterator it) { return entries.erase(it); }
+    size_type erase(const CAsset& asset)
+    {
+        iterator it = find(asset);
+        if (it == end())
+            return 0;
+        entries.erase(it);
+        return 1;
+    }
+};
 
 CAmountMap& operator+=(CAmountMap& a, const CAmountMap& b);
 CAmountMap& operator-=(CAmountMap& a, const CAmountMap& b);
@@ -121,7 +211,7 @@ static const CAmount MAX_MONEY = 21000000 * COIN;
 inline bool MoneyRange(const CAmount& nValue) { return (nValue >= 0 && nValue <= MAX_MONEY); }
 
 inline bool MoneyRange(const CAmountMap& mapValue) {
-    for(CAmountMap::const_iterator it = mapValue.begin(); it != mapValue.end(); it++)
+    for(CAmountMap::const_iterator it = mapValue.begin(); it != mapValue.end(); ++it)
         if (it->second < 0 || it->second > MAX_MONEY)
             return false;
    return true;
@@ -0,0 +1,48 @@
+// Copyright (c) 2017 The Elements Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "amount.h"
+
+#include <map>
+
+// Fee accumulation as done by ConnectBlock: every transaction's fee map is
+// built and merged into the block total, most of them in the policy asset
+// and a few with fees in other assets. Run with CAmountMap and with the
+// std::map it replaced, which allocates a node per asset per map.
+template <typename Map>
+static void AccumulateFees(benchmark::State& state)
+{
+    CAsset assets[3];
+    for (int i = 0; i < 3; i++)
+        assets[i].begin()[0] = i + 1;
+
+    while (state.KeepRunning()) {
+        Map mapFees;
+        for (int i = 0; i < 1000; i++) {
+            Map fee;
+            fee[assets[0]] += 1000 + i;
+            if (i % 8 == 0)
+                fee[assets[i % 3]] += 1;
+            for (typename Map::const_iterator it = fee.begin(); it != fee.end(); ++it)
+                mapFees[it->first] += it->second;
+        }
+        for (typename Map::const_iterator it = mapFees.begin(); it != mapFees.end(); ++it)
+            assert(MoneyRange(it->second));
+    }
+}
+
+static void AmountMapFees(benchmark::State& state)
+{
+    AccumulateFees<CAmountMap>(state);
+}
+
+static void AmountMapFeesStdMap(benchmark::State& state)
+{
+    AccumulateFees<std::map<CAsset, CAmount> >(state);
+}
+
+BENCHMARK(AmountMapFees);
+BENCHMARK(AmountMapFeesStdMap);
@@ -4,7 +4,11 @@
 
 #include "bench.h"
 
+#include "chainparams.h"
 #include "key.h"
+#include "pow.h"
+#include "pubkey.h"
+#include "script/sigcache.h"
 #include "validation.h"
 #include "util.h"
 
@@ -12,8 +16,16 @@ int
 main(int argc, char** argv)
 {
     ECC_Start();
+    ECCVerifyHandle globalVerifyHandle;
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
+    // Confidential transactions and blocks are checked against regtest rules
+    SelectParams(CBaseChainParams::REGTEST);
+    InitSignatureCache();
+    InitRangeproofCache();
+    InitSurjectionproofCache();
+    InitPAKProofCache();
+    InitBlockProofCache();
 
     benchmark::BenchRunner::RunAll();
 
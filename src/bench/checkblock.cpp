@@ -5,22 +5,29 @@
 #include "bench.h"
 
 #include "chainparams.h"
+#include "coins.h"
 #include "validation.h"
 #include "streams.h"
 #include "consensus/validation.h"
 
 namespace block_bench {
-#include "bench/data/block413567.raw.h"
+#include "bench/data/ctblock.raw.h"
+#include "bench/data/ctblock_funding.raw.h"
 }
 
+// ctblock is a regtest block of confidential transactions: 1-in 2-out,
+// a blinded issuance, 5-in 5-out, a two asset spend of the issuance and
+// a 2-in 1-out consolidation. ctblock_funding is the block before it,
+// creating the blinded outputs ctblock spends.
+
 // These are the two major time-sinks which happen after we have fully received
 // a block off the wire, but before we can relay the block on to peers using
 // compact block relay.
 
 static void DeserializeBlockTest(benchmark::State& state)
 {
-    CDataStream stream((const char*)block_bench::block413567,
-            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+    CDataStream stream((const char*)block_bench::ctblock,
+            (const char*)&block_bench::ctblock[sizeof(block_bench::ctblock)],
             SER_NETWORK, PROTOCOL_VERSION);
     char a;
     stream.write(&a, 1); // Prevent compaction
@@ -28,29 +35,56 @@ static void DeserializeBlockTest(benchmark::State& state)
     while (state.KeepRunning()) {
         CBlock block;
         stream >> block;
-        assert(stream.Rewind(sizeof(block_bench::block413567)));
+        assert(stream.Rewind(sizeof(block_bench::ctblock)));
     }
 }
 
 static void DeserializeAndCheckBlockTest(benchmark::State& state)
 {
-    CDataStream stream((const char*)block_bench::block413567,
-            (const char*)&block_bench::block413567[sizeof(block_bench::block413567)],
+    CDataStream stream((const char*)block_bench::ctblock,
+            (const char*)&block_bench::ctblock[sizeof(block_bench::ctblock)],
             SER_NETWORK, PROTOCOL_VERSION);
     char a;
     stream.write(&a, 1); // Prevent compaction
 
-    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+    const CChainParams& chainParams = Params();
 
     while (state.KeepRunning()) {
         CBlock block; // Note that CBlock caches its checked state, so we need to recreate it here
         stream >> block;
-        assert(stream.Rewind(sizeof(block_bench::block413567)));
+        assert(stream.Rewind(sizeof(block_bench::ctblock)));
 
         CValidationState validationState;
-        assert(CheckBlock(block, validationState, chainParams->GetConsensus()));
+        assert(CheckBlock(block, validationState, chainParams.GetConsensus()));
+    }
+}
+
+// Balance, range and surjection proof checks of every transaction in the block
+static void VerifyAmountsBlockTest(benchmark::State& state)
+{
+    CBlock funding, block;
+    CDataStream((const char*)block_bench::ctblock_funding,
+            (const char*)&block_bench::ctblock_funding[sizeof(block_bench::ctblock_funding)],
+            SER_NETWORK, PROTOCOL_VERSION) >> funding;
+    CDataStream((const char*)block_bench::ctblock,
+            (const char*)&block_bench::ctblock[sizeof(block_bench::ctblock)],
+            SER_NETWORK, PROTOCOL_VERSION) >> block;
+
+    CCoinsView viewDummy;
+    CCoinsViewCache coins(&viewDummy);
+    for (const CBlock* pblock : {&funding, &block}) {
+        for (const CTransactionRef& tx : pblock->vtx) {
+            AddCoins(coins, *tx, 0);
+        }
+    }
+
+    while (state.KeepRunning()) {
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            assert(VerifyAmounts(coins, *block.vtx[i]));
+        }
     }
 }
 
 BENCHMARK(DeserializeBlockTest);
 BENCHMARK(DeserializeAndCheckBlockTest);
+BENCHMARK(VerifyAmountsBlockTest);
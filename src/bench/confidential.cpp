@@ -0,0 +1,325 @@
+// Copyright (c) 2017 The Elements Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blind.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "issuance.h"
+#include "key.h"
+#include "primitives/block.h"
+#include "script/script.h"
+#include "util.h"
+#include "validation.h"
+
+#include <vector>
+
+#include <secp256k1.h>
+#include <secp256k1_rangeproof.h>
+#include <secp256k1_surjectionproof.h>
+#include <secp256k1_whitelist.h>
+
+// Confidential transactions of various shapes. Keys, assets and amounts are
+// derived from counters so every run verifies the same kind of work; the
+// blinding factors are drawn by BlindTransaction, which doesn't change the
+// cost of verification.
+
+static CKey BenchKey(unsigned char n)
+{
+    std::vector<unsigned char> vch(32, 0);
+    vch[0] = 0x42;
+    vch[31] = n;
+    CKey key;
+    key.Set(vch.begin(), vch.end(), true);
+    return key;
+}
+
+static CAsset BenchAsset(unsigned char n)
+{
+    CAsset asset;
+    asset.begin()[0] = 0xa5;
+    asset.begin()[31] = n;
+    return asset;
+}
+
+static CScript BenchScript(unsigned char n)
+{
+    return CScript() << OP_0 << ToByteVector(BenchKey(n).GetPubKey().GetID());
+}
+
+/**
+ * A transaction spending nInputs blinded outputs of nAssets assets into
+ * nOutputs blinded outputs and an explicit fee, optionally with a blinded
+ * issuance on its first input, with the spent outputs in a coins view.
+ */
+class ConfidentialTransaction
+{
+public:
+    CCoinsView viewDummy;
+    CCoinsViewCache coins;
+    CKey blindingKey;
+
+    //! Transaction and blinding data before BlindTransaction
+    CMutableTransaction mtxUnblinded;
+    std::vector<uint256> input_blinds, input_asset_blinds;
+    std::vector<CAsset> input_assets;
+    std::vector<CAmount> input_amounts;
+    std::vector<CPubKey> output_pubkeys;
+    std::vector<CKey> vBlindIssuanceAsset, vBlindIssuanceToken;
+
+    CTransactionRef tx;
+
+    ConfidentialTransaction(int nInputs, int nOutputs, int nAssets, bool fIssuance) : coins(&viewDummy)
+    {
+        assert(nAssets >= 1 && nInputs >= nAssets && nOutputs >= nAssets);
+        blindingKey = BenchKey(0);
+        const CAmount nFee = 5000;
+
+        // Blinded outputs to spend, one explicit input per asset
+        CMutableTransaction mtxFunding;
+        std::vector<uint256> funding_blinds(nAssets), funding_asset_blinds(nAssets), output_blinds, output_asset_blinds;
+        std::vector<CAsset> funding_assets;
+        std::vector<CAmount> funding_amounts(nAssets, 0);
+        std::vector<CKey> vDummy;
+        for (int i = 0; i < nAssets; i++) {
+            mtxFunding.vin.push_back(CTxIn(COutPoint(uint256S("f00d"), i)));
+            funding_assets.push_back(BenchAsset(i));
+        }
+        for (int i = 0; i < nInputs; i++) {
+            CAmount nValue = 100000000 * (i + 1);
+            mtxFunding.vout.push_back(CTxOut(BenchAsset(i % nAssets), nValue, BenchScript(i)));
+            funding_amounts[i % nAssets] += nValue;
+        }
+        // Explicit inputs need two blinded outputs to hide their amounts
+        mtxFunding.vout.push_back(CTxOut(BenchAsset(0), 1, BenchScript(99)));
+        funding_amounts[0] += 1;
+        std::vector<CPubKey> funding_pubkeys(nInputs + 1, blindingKey.GetPubKey());
+        int nBlinded = BlindTransaction(funding_blinds, funding_asset_blinds, funding_assets, funding_amounts, output_blinds, output_asset_blinds, funding_pubkeys, vDummy, vDummy, mtxFunding);
+        assert(nBlinded == nInputs + 1);
+        AddCoins(coins, mtxFunding, 0);
+
+        // The spend, splitting each asset evenly over its outputs
+        std::vector<CAmount> totals(nAssets, 0);
+        for (int i = 0; i < nInputs; i++) {
+            mtxUnblinded.vin.push_back(CTxIn(COutPoint(mtxFunding.GetHash(), i)));
+            input_blinds.push_back(output_blinds[i]);
+            input_asset_blinds.push_back(output_asset_blinds[i]);
+            input_assets.push_back(BenchAsset(i % nAssets));
+            input_amounts.push_back(100000000 * (i + 1));
+            totals[i % nAssets] += input_amounts.back();
+        }
+        totals[0] -= nFee;
+        for (int i = 0; i < nOutputs; i++) {
+            int nAsset = i % nAssets;
+            int nAssetOutputs = nOutputs / nAssets + (nAsset < nOutputs % nAssets ? 1 : 0);
+            CAmount nValue = totals[nAsset] / nAssetOutputs;
+            if (i + nAssets >= nOutputs)
+                nValue += totals[nAsset] % nAssetOutputs;
+            mtxUnblinded.vout.push_back(CTxOut(BenchAsset(nAsset), nValue, BenchScript(100 + i)));
+            output_pubkeys.push_back(blindingKey.GetPubKey());
+        }
+        if (fIssuance) {
+            CAssetIssuance& issuance = mtxUnblinded.vin[0].assetIssuance;
+            issuance.nAmount = CConfidentialValue(1000000);
+            issuance.nInflationKeys = CConfidentialValue(1);
+            uint256 entropy;
+            CAsset asset, token;
+            GenerateAssetEntropy(entropy, mtxUnblinded.vin[0].prevout, issuance.assetEntropy);
+            CalculateAsset(asset, entropy);
+            CalculateReissuanceToken(token, entropy, true);
+            mtxUnblinded.vout.push_back(CTxOut(asset, 1000000, BenchScript(200)));
+            mtxUnblinded.vout.push_back(CTxOut(token, 1, BenchScript(201)));
+            output_pubkeys.push_back(blindingKey.GetPubKey());
+            output_pubkeys.push_back(blindingKey.GetPubKey());
+            vBlindIssuanceAsset.push_back(BenchKey(1));
+            vBlindIssuanceToken.push_back(BenchKey(2));
+        }
+        mtxUnblinded.vout.push_back(CTxOut(BenchAsset(0), nFee, CScript()));
+        output_pubkeys.push_back(CPubKey());
+
+        CMutableTransaction mtx(mtxUnblinded);
+        nBlinded = Blind(mtx);
+        assert(nBlinded == (int)output_pubkeys.size() - 1 + (fIssuance ? 2 : 0));
+        tx = MakeTransactionRef(std::move(mtx));
+        assert(VerifyAmounts(coins, *tx));
+    }
+
+    int Blind(CMutableTransaction& mtx)
+    {
+        std::vector<uint256> blinds(input_blinds), output_blinds, output_asset_blinds;
+        return BlindTransaction(blinds, input_asset_blinds, input_assets, input_amounts, output_blinds, output_asset_blinds, output_pubkeys, vBlindIssuanceAsset, vBlindIssuanceToken, mtx);
+    }
+};
+
+static void VerifyAmountsSimple(benchmark::State& state)
+{
+    ConfidentialTransaction ct(1, 2, 1, false);
+    while (state.KeepRunning()) {
+        assert(VerifyAmounts(ct.coins, *ct.tx));
+    }
+}
+
+static void VerifyAmountsLarge(benchmark::State& state)
+{
+    ConfidentialTransaction ct(10, 10, 3, false);
+    while (state.KeepRunning()) {
+        assert(VerifyAmounts(ct.coins, *ct.tx));
+    }
+}
+
+static void VerifyAmountsIssuance(benchmark::State& state)
+{
+    ConfidentialTransaction ct(2, 2, 1, true);
+    while (state.KeepRunning()) {
+        assert(VerifyAmounts(ct.coins, *ct.tx));
+    }
+}
+
+static void BlindTransactionSimple(benchmark::State& state)
+{
+    ConfidentialTransaction ct(1, 2, 1, false);
+    while (state.KeepRunning()) {
+        CMutableTransaction mtx(ct.mtxUnblinded);
+        assert(ct.Blind(mtx) == 2);
+    }
+}
+
+static void BlindTransactionLarge(benchmark::State& state)
+{
+    ConfidentialTransaction ct(10, 10, 3, false);
+    while (state.KeepRunning()) {
+        CMutableTransaction mtx(ct.mtxUnblinded);
+        assert(ct.Blind(mtx) == 10);
+    }
+}
+
+static void RangeproofVerify(benchmark::State& state)
+{
+    ConfidentialTransaction ct(1, 2, 1, false);
+    const CTxOut& out = ct.tx->vout[0];
+    const std::vector<unsigned char>& proof = ct.tx->wit.vtxoutwit[0].vchRangeproof;
+    secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+    secp256k1_pedersen_commitment commit;
+    secp256k1_generator gen;
+    assert(secp256k1_pedersen_commitment_parse(ctx, &commit, &out.nValue.vchCommitment[0]));
+    assert(secp256k1_generator_parse(ctx, &gen, &out.nAsset.vchCommitment[0]));
+    while (state.KeepRunning()) {
+        uint64_t min_value, max_value;
+        assert(secp256k1_rangeproof_verify(ctx, &min_value, &max_value, &commit, proof.data(), proof.size(), out.scriptPubKey.data(), out.scriptPubKey.size(), &gen));
+    }
+    secp256k1_context_destroy(ctx);
+}
+
+static void RangeproofRewind(benchmark::State& state)
+{
+    ConfidentialTransaction ct(1, 2, 1, false);
+    const CTxOut& out = ct.tx->vout[0];
+    while (state.KeepRunning()) {
+        CAmount amount;
+        uint256 blind, asset_blind;
+        CAsset asset;
+        assert(UnblindConfidentialPair(ct.blindingKey, out.nValue, out.nAsset, out.nNonce, out.scriptPubKey, ct.tx->wit.vtxoutwit[0].vchRangeproof, amount, blind, asset, asset_blind));
+    }
+}
+
+static void SurjectionproofVerify(benchmark::State& state)
+{
+    // Surjection over the 10 inputs of a 3 asset transaction
+    ConfidentialTransaction ct(10, 10, 3, false);
+    secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+    std::vector<secp256k1_generator> inputs(ct.tx->vin.size());
+    for (size_t i = 0; i < ct.tx->vin.size(); i++) {
+        assert(secp256k1_generator_parse(ctx, &inputs[i], &ct.coins.AccessCoin(ct.tx->vin[i].prevout).out.nAsset.vchCommitment[0]));
+    }
+    secp256k1_generator output;
+    assert(secp256k1_generator_parse(ctx, &output, &ct.tx->vout[0].nAsset.vchCommitment[0]));
+    const std::vector<unsigned char>& vchProof = ct.tx->wit.vtxoutwit[0].vchSurjectionproof;
+    while (state.KeepRunning()) {
+        secp256k1_surjectionproof proof;
+        assert(secp256k1_surjectionproof_parse(ctx, &proof, vchProof.data(), vchProof.size()));
+        assert(secp256k1_surjectionproof_verify(ctx, &proof, inputs.data(), inputs.size(), &output));
+    }
+    secp256k1_context_destroy(ctx);
+}
+
+static void PedersenVerifyTally(benchmark::State& state)
+{
+    ConfidentialTransaction ct(10, 10, 3, false);
+    secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+    std::vector<secp256k1_pedersen_commitment> vIn(ct.tx->vin.size()), vOut(ct.tx->vout.size());
+    std::vector<const secp256k1_pedersen_commitment*> vpIn, vpOut;
+    for (size_t i = 0; i < ct.tx->vin.size(); i++) {
+        assert(secp256k1_pedersen_commitment_parse(ctx, &vIn[i], &ct.coins.AccessCoin(ct.tx->vin[i].prevout).out.nValue.vchCommitment[0]));
+        vpIn.push_back(&vIn[i]);
+    }
+    for (size_t i = 0; i < ct.tx->vout.size(); i++) {
+        const CTxOut& out = ct.tx->vout[i];
+        if (out.nValue.IsExplicit()) {
+            // The fee, committed to with a zero blinding factor
+            secp256k1_context* ctx_sign = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+            secp256k1_generator gen;
+            GetAssetGenerator(gen, out.nAsset.GetAsset());
+            unsigned char zero[32] = {0};
+            assert(secp256k1_pedersen_commit(ctx_sign, &vOut[i], zero, out.nValue.GetAmount(), &gen));
+            secp256k1_context_destroy(ctx_sign);
+        } else {
+            assert(secp256k1_pedersen_commitment_parse(ctx, &vOut[i], &out.nValue.vchCommitment[0]));
+        }
+        vpOut.push_back(&vOut[i]);
+    }
+    while (state.KeepRunning()) {
+        assert(secp256k1_pedersen_verify_tally(ctx, vpIn.data(), vpIn.size(), vpOut.data(), vpOut.size()));
+    }
+    secp256k1_context_destroy(ctx);
+}
+
+static void PAKWhitelistVerify(benchmark::State& state)
+{
+    secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
+
+    // A 15 entry PAK list, signed for by the first entry
+    const int nKeys = 15;
+    std::vector<secp256k1_pubkey> offline_keys(nKeys), online_keys(nKeys);
+    for (int i = 0; i < nKeys; i++) {
+        assert(secp256k1_ec_pubkey_create(ctx, &offline_keys[i], BenchKey(10 + i).begin()));
+        assert(secp256k1_ec_pubkey_create(ctx, &online_keys[i], BenchKey(50 + i).begin()));
+    }
+    CKey destKey = BenchKey(100);
+    CPubKey destPubKey = destKey.GetPubKey();
+    secp256k1_pubkey sub_pubkey;
+    assert(secp256k1_ec_pubkey_parse(ctx, &sub_pubkey, destPubKey.begin(), destPubKey.size()));
+    unsigned char summed_seckey[32];
+    memcpy(summed_seckey, BenchKey(10).begin(), 32);
+    assert(secp256k1_ec_privkey_tweak_add(ctx, summed_seckey, destKey.begin()));
+    secp256k1_whitelist_signature sig;
+    assert(secp256k1_whitelist_sign(ctx, &sig, online_keys.data(), offline_keys.data(), nKeys, &sub_pubkey, BenchKey(50).begin(), summed_seckey, 0, NULL, NULL));
+    std::vector<unsigned char> vchSig(1 + 32 * (1 + nKeys));
+    size_t nSigLen = vchSig.size();
+    assert(secp256k1_whitelist_signature_serialize(ctx, vchSig.data(), &nSigLen, &sig));
+    vchSig.resize(nSigLen);
+    secp256k1_context_destroy(ctx);
+
+    const uint256& genesis = Params().ParentGenesisBlockHash();
+    CScript destination = CScript() << OP_DUP << OP_HASH160 << ToByteVector(destPubKey.GetID()) << OP_EQUALVERIFY << OP_CHECKSIG;
+    CScript pegout = CScript() << OP_RETURN << ToByteVector(genesis) << ToByteVector(destination) << ToByteVector(destPubKey) << vchSig;
+
+    boost::optional<CPAKList> paklist_config = g_paklist_config;
+    g_paklist_config = CPAKList(offline_keys, online_keys, false);
+    while (state.KeepRunning()) {
+        assert(pegout.HasValidWhitelistPegoutProof(genesis));
+    }
+    g_paklist_config = paklist_config;
+}
+
+BENCHMARK(VerifyAmountsSimple);
+BENCHMARK(VerifyAmountsLarge);
+BENCHMARK(VerifyAmountsIssuance);
+BENCHMARK(BlindTransactionSimple);
+BENCHMARK(BlindTransactionLarge);
+BENCHMARK(RangeproofVerify);
+BENCHMARK(RangeproofRewind);
+BENCHMARK(SurjectionproofVerify);
+BENCHMARK(PedersenVerifyTally);
+BENCHMARK(PAKWhitelistVerify);
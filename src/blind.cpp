@@ -1,15 +1,21 @@
 #include "blind.h"
 
+#include "checkqueue.h"
 #include "hash.h"
 #include "primitives/transaction.h"
 #include "random.h"
 #include "util.h"
 #include "issuance.h"
+#include "sync.h"
 
 #include <secp256k1.h>
 #include <secp256k1_rangeproof.h>
 #include <secp256k1_surjectionproof.h>
 
+#include <atomic>
+#include <deque>
+#include <map>
+
 static secp256k1_context* secp256k1_blind_context = NULL;
 
 class Blind_ECC_Init {
@@ -35,6 +41,96 @@ public:
 
 static Blind_ECC_Init ecc_init_on_load;
 
+int nBlindThreads = 0;
+
+namespace {
+
+/**
+ * Explicit asset generators are a hash-to-curve of the asset id, and nearly
+ * every explicit asset seen is one of a handful of assets. Keep the most
+ * recently added ones around, evicting the oldest entry when full.
+ */
+class CAssetGeneratorCache
+{
+private:
+    struct Entry {
+        secp256k1_generator gen;
+        unsigned char serialized[CConfidentialAsset::nCommittedSize];
+    };
+
+    CCriticalSection cs;
+    std::map<CAsset, Entry> mapGenerators;
+    std::deque<CAsset> vInsertionOrder;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+
+public:
+    CAssetGeneratorCache() : nHits(0), nMisses(0) {}
+
+    bool Get(secp256k1_generator& gen, const CAsset& asset, unsigned char* serialized)
+    {
+        {
+            LOCK(cs);
+            std::map<CAsset, Entry>::const_iterator it = mapGenerators.find(asset);
+            if (it != mapGenerators.end()) {
+                gen = it->second.gen;
+                if (serialized) {
+                    memcpy(serialized, it->second.serialized, sizeof(it->second.serialized));
+                }
+                nHits++;
+                return true;
+            }
+        }
+
+        nMisses++;
+        Entry entry;
+        if (secp256k1_generator_generate(secp256k1_blind_context, &entry.gen, asset.begin()) != 1) {
+            return false;
+        }
+        int ret = secp256k1_generator_serialize(secp256k1_blind_context, entry.serialized, &entry.gen);
+        assert(ret == 1);
+        gen = entry.gen;
+        if (serialized) {
+            memcpy(serialized, entry.serialized, sizeof(entry.serialized));
+        }
+
+        LOCK(cs);
+        if (mapGenerators.insert(std::make_pair(asset, entry)).second) {
+            vInsertionOrder.push_back(asset);
+            if (vInsertionOrder.size() > MAX_ASSET_GENERATOR_CACHE_SIZE) {
+                mapGenerators.erase(vInsertionOrder.front());
+                vInsertionOrder.pop_front();
+            }
+        }
+        return true;
+    }
+
+    AssetGeneratorCacheStats Stats()
+    {
+        LOCK(cs);
+        AssetGeneratorCacheStats stats;
+        stats.entries = mapGenerators.size();
+        stats.capacity = MAX_ASSET_GENERATOR_CACHE_SIZE;
+        stats.hits = nHits;
+        stats.misses = nMisses;
+        return stats;
+    }
+};
+
+CAssetGeneratorCache assetGeneratorCache;
+
+} // namespace
+
+bool GetAssetGenerator(secp256k1_generator& gen, const CAsset& asset, unsigned char* serialized)
+{
+    return assetGeneratorCache.Get(gen, asset, serialized);
+}
+
+AssetGeneratorCacheStats GetAssetGeneratorCacheStats()
+{
+    return assetGeneratorCache.Stats();
+}
+
 bool UnblindConfidentialPair(const CKey &key, const CConfidentialValue& confValue, const CConfidentialAsset& confAsset, const CConfidentialNonce& nNonce, const CScript& committedScript, const std::vector<unsigned char>& vchRangeproof, CAmount& amount_out, uint256& blinding_factor_out, CAsset& asset_out, uint256& asset_blinding_factor_out)
 {
     if (!key.IsValid() || vchRangeproof.size() == 0) {
@@ -74,7 +170,7 @@ bool UnblindConfidentialPair(const CKey &key, const CConfidentialValue& confValu
         if (secp256k1_generator_parse(secp256k1_blind_context, &observed_gen, &confAsset.vchCommitment[0]) != 1)
             return false;
     } else if (confAsset.IsExplicit()) {
-        if (secp256k1_generator_generate(secp256k1_blind_context, &observed_gen, confAsset.GetAsset().begin()) != 1)
+        if (!GetAssetGenerator(observed_gen, confAsset.GetAsset()))
             return false;
     }
 
@@ -120,33 +216,46 @@ bool UnblindConfidentialPair(const CKey &key, const CConfidentialValue& confValu
     return true;
 }
 
-// Create surjection proof
-bool SurjectOutput(CTxOutWitness& txoutwit, const std::vector<secp256k1_fixed_asset_tag>& surjectionTargets, const std::vector<secp256k1_generator>& targetAssetGenerators, const std::vector<uint256 >& targetAssetBlinders, const std::vector<const unsigned char*> assetblindptrs, const secp256k1_generator& gen, const CAsset& asset)
+// Create surjection proof, with all randomness taken from randseed
+static bool SurjectOutput(const secp256k1_context* ctx, CTxOutWitness& txoutwit, const std::vector<secp256k1_fixed_asset_tag>& surjectionTargets, const std::vector<secp256k1_generator>& targetAssetGenerators, const std::vector<uint256 >& targetAssetBlinders, const unsigned char* assetblindptr, const secp256k1_generator& gen, const CAsset& asset, const unsigned char* randseed)
 {
     int ret;
     size_t nInputsToSelect = std::min((size_t)3, surjectionTargets.size());
     size_t surjection_target_size = std::min(surjectionTargets.size(), (size_t)SECP256K1_SURJECTIONPROOF_MAX_N_INPUTS);
-    unsigned char randseed[32];
-    GetRandBytes(randseed, 32);
     size_t input_index;
     secp256k1_surjectionproof proof;
     secp256k1_fixed_asset_tag tag;
     memcpy(&tag, asset.begin(), 32);
-    if (secp256k1_surjectionproof_initialize(secp256k1_blind_context, &proof, &input_index, &surjectionTargets[0], surjection_target_size, nInputsToSelect, &tag, 10000, randseed) == 0) {
+    if (secp256k1_surjectionproof_initialize(ctx, &proof, &input_index, &surjectionTargets[0], surjection_target_size, nInputsToSelect, &tag, 10000, randseed) == 0) {
         return false;
     }
-    ret = secp256k1_surjectionproof_generate(secp256k1_blind_context, &proof, &targetAssetGenerators[0], surjection_target_size, &gen, input_index, targetAssetBlinders[input_index].begin(), assetblindptrs[assetblindptrs.size()-1]);
+    ret = secp256k1_surjectionproof_generate(ctx, &proof, &targetAssetGenerators[0], surjection_target_size, &gen, input_index, targetAssetBlinders[input_index].begin(), assetblindptr);
     assert(ret == 1);
-    ret = secp256k1_surjectionproof_verify(secp256k1_blind_context, &proof, &targetAssetGenerators[0], surjection_target_size, &gen);
+    ret = secp256k1_surjectionproof_verify(ctx, &proof, &targetAssetGenerators[0], surjection_target_size, &gen);
     assert(ret != 0);
 
-    size_t output_len = secp256k1_surjectionproof_serialized_size(secp256k1_blind_context, &proof);
+    size_t output_len = secp256k1_surjectionproof_serialized_size(ctx, &proof);
     txoutwit.vchSurjectionproof.resize(output_len);
-    secp256k1_surjectionproof_serialize(secp256k1_blind_context, &txoutwit.vchSurjectionproof[0], &output_len, &proof);
+    secp256k1_surjectionproof_serialize(ctx, &txoutwit.vchSurjectionproof[0], &output_len, &proof);
     assert(output_len == txoutwit.vchSurjectionproof.size());
     return true;
 }
 
+// The surjection proof's input selection only has to be unpredictable, so seed it from the secret
+// asset blinding factor. This keeps proof generation deterministic once the blinding factors are drawn.
+static void GetSurjectionSeed(unsigned char* randseed, const unsigned char* assetblindptr)
+{
+    static const unsigned char tag[] = "SurjectionSeed";
+    CSHA256().Write(tag, sizeof(tag) - 1).Write(assetblindptr, 32).Finalize(randseed);
+}
+
+bool SurjectOutput(CTxOutWitness& txoutwit, const std::vector<secp256k1_fixed_asset_tag>& surjectionTargets, const std::vector<secp256k1_generator>& targetAssetGenerators, const std::vector<uint256 >& targetAssetBlinders, const std::vector<const unsigned char*> assetblindptrs, const secp256k1_generator& gen, const CAsset& asset)
+{
+    unsigned char randseed[32];
+    GetSurjectionSeed(randseed, assetblindptrs.back());
+    return SurjectOutput(secp256k1_blind_context, txoutwit, surjectionTargets, targetAssetGenerators, targetAssetBlinders, assetblindptrs.back(), gen, asset, randseed);
+}
+
 // Creates ECDH nonce commitment using ephemeral key and output_pubkey
 uint256 GenerateOutputRangeproofNonce(CTxOut& out, const CPubKey output_pubkey)
 {
@@ -163,7 +272,7 @@ uint256 GenerateOutputRangeproofNonce(CTxOut& out, const CPubKey output_pubkey)
     return nonce;
 }
 
-bool GenerateRangeproof(std::vector<unsigned char>& vchRangeproof, const std::vector<unsigned char*>& blindptrs, const uint256& nonce, const CAmount amount, const CScript& scriptPubKey, const secp256k1_pedersen_commitment& commit, const secp256k1_generator& gen, const CAsset& asset, std::vector<const unsigned char*>& assetblindptrs)
+static bool GenerateRangeproof(const secp256k1_context* ctx, std::vector<unsigned char>& vchRangeproof, const unsigned char* blindptr, const uint256& nonce, const CAmount amount, const CScript& scriptPubKey, const secp256k1_pedersen_commitment& commit, const secp256k1_generator& gen, const CAsset& asset, const unsigned char* assetblindptr, int ct_exponent, int ct_bits)
 {
     // Prep range proof
     size_t nRangeProofLen = 5134;
@@ -173,16 +282,31 @@ bool GenerateRangeproof(std::vector<unsigned char>& vchRangeproof, const std::ve
     // Compose sidechannel message to convey asset info (ID and asset blinds)
     unsigned char assetsMessage[64];
     memcpy(assetsMessage, asset.begin(), 32);
-    memcpy(assetsMessage+32, assetblindptrs[assetblindptrs.size()-1], 32);
+    memcpy(assetsMessage+32, assetblindptr, 32);
 
     // Sign rangeproof
     // If min_value is 0, scriptPubKey must be unspendable
-    int res = secp256k1_rangeproof_sign(secp256k1_blind_context, &vchRangeproof[0], &nRangeProofLen, scriptPubKey.IsUnspendable() ? 0 : 1, &commit, blindptrs.back(), nonce.begin(), std::min(std::max((int)GetArg("-ct_exponent", 0), -1),18), std::min(std::max((int)GetArg("-ct_bits", 36), 1), 51), amount, assetsMessage, sizeof(assetsMessage), scriptPubKey.size() ? &scriptPubKey.front() : NULL, scriptPubKey.size(), &gen);
+    int res = secp256k1_rangeproof_sign(ctx, &vchRangeproof[0], &nRangeProofLen, scriptPubKey.IsUnspendable() ? 0 : 1, &commit, blindptr, nonce.begin(), ct_exponent, ct_bits, amount, assetsMessage, sizeof(assetsMessage), scriptPubKey.size() ? &scriptPubKey.front() : NULL, scriptPubKey.size(), &gen);
     vchRangeproof.resize(nRangeProofLen);
     // TODO: do something smarter here
     return (res == 1);
 }
 
+static int GetRangeproofExponent()
+{
+    return std::min(std::max((int)GetArg("-ct_exponent", 0), -1),18);
+}
+
+static int GetRangeproofBits()
+{
+    return std::min(std::max((int)GetArg("-ct_bits", 36), 1), 51);
+}
+
+bool GenerateRangeproof(std::vector<unsigned char>& vchRangeproof, const std::vector<unsigned char*>& blindptrs, const uint256& nonce, const CAmount amount, const CScript& scriptPubKey, const secp256k1_pedersen_commitment& commit, const secp256k1_generator& gen, const CAsset& asset, std::vector<const unsigned char*>& assetblindptrs)
+{
+    return GenerateRangeproof(secp256k1_blind_context, vchRangeproof, blindptrs.back(), nonce, amount, scriptPubKey, commit, gen, asset, assetblindptrs.back(), GetRangeproofExponent(), GetRangeproofBits());
+}
+
 void BlindAsset(CConfidentialAsset& confAsset, secp256k1_generator& gen, const CAsset& asset, const unsigned char* assetblindptr)
 {
     confAsset.vchCommitment.resize(CConfidentialAsset::nCommittedSize);
@@ -218,6 +342,131 @@ size_t GetNumIssuances(const CMutableTransaction& tx)
     return numIssuances;
 }
 
+namespace {
+
+/**
+ * The range proof, and for outputs the surjection proof, of one newly
+ * blinded output or issuance. Everything random is drawn before the proofs
+ * are generated, so the result does not depend on how they are scheduled.
+ */
+struct CBlindProofJob
+{
+    // Output index, or input index for issuance pseudo-inputs
+    size_t nIndex;
+    // -1 for outputs, 0 for an issuance amount, 1 for its inflation keys
+    int nPseudo;
+    const unsigned char* blindptr;
+    const unsigned char* assetblindptr;
+    uint256 nonce;
+    CAmount amount;
+    CScript scriptPubKey;
+    secp256k1_pedersen_commitment commit;
+    secp256k1_generator gen;
+    CAsset asset;
+    unsigned char surjectionseed[32];
+    bool fSuccess;
+};
+
+class CBlindProofGenerator;
+
+/** Generates one job's proofs on the blinding thread pool */
+class CBlindProofCheck
+{
+private:
+    CBlindProofGenerator* generator;
+    CBlindProofJob* job;
+
+public:
+    CBlindProofCheck(CBlindProofGenerator* generatorIn, CBlindProofJob* jobIn) : generator(generatorIn), job(jobIn) {}
+
+    // Always succeeds, so that a failed proof does not stop the queue from running the remaining jobs
+    bool operator()();
+};
+
+/**
+ * Proofs are expensive, so the workers take one at a time. The proving functions
+ * take a const context, so the pool shares secp256k1_blind_context.
+ */
+CCheckQueue<CBlindProofCheck> blindproofqueue(1);
+
+/** Generates the proofs of a BlindTransaction call, on the blinding threads if there are any */
+class CBlindProofGenerator
+{
+private:
+    CMutableTransaction& tx;
+    const std::vector<secp256k1_fixed_asset_tag>& surjectionTargets;
+    const std::vector<secp256k1_generator>& targetAssetGenerators;
+    const std::vector<uint256>& targetAssetBlinders;
+    const int ct_exponent;
+    const int ct_bits;
+    std::vector<CBlindProofJob> vJobs;
+
+public:
+    CBlindProofGenerator(CMutableTransaction& txIn, const std::vector<secp256k1_fixed_asset_tag>& surjectionTargetsIn, const std::vector<secp256k1_generator>& targetAssetGeneratorsIn, const std::vector<uint256>& targetAssetBlindersIn) :
+        tx(txIn), surjectionTargets(surjectionTargetsIn), targetAssetGenerators(targetAssetGeneratorsIn), targetAssetBlinders(targetAssetBlindersIn),
+        ct_exponent(GetRangeproofExponent()), ct_bits(GetRangeproofBits()) {}
+
+    CBlindProofJob& Add()
+    {
+        vJobs.push_back(CBlindProofJob());
+        return vJobs.back();
+    }
+
+    void Prove(CBlindProofJob& job)
+    {
+        if (job.nPseudo < 0) {
+            CTxOutWitness& txoutwit = tx.wit.vtxoutwit[job.nIndex];
+            bool rangeresult = GenerateRangeproof(secp256k1_blind_context, txoutwit.vchRangeproof, job.blindptr, job.nonce, job.amount, job.scriptPubKey, job.commit, job.gen, job.asset, job.assetblindptr, ct_exponent, ct_bits);
+            assert(rangeresult);
+            job.fSuccess = SurjectOutput(secp256k1_blind_context, txoutwit, surjectionTargets, targetAssetGenerators, targetAssetBlinders, job.assetblindptr, job.gen, job.asset, job.surjectionseed);
+        } else {
+            CTxInWitness& txinwit = tx.wit.vtxinwit[job.nIndex];
+            bool rangeresult = GenerateRangeproof(secp256k1_blind_context, (job.nPseudo ? txinwit.vchInflationKeysRangeproof : txinwit.vchIssuanceAmountRangeproof), job.blindptr, job.nonce, job.amount, CScript(), job.commit, job.gen, job.asset, job.assetblindptr, ct_exponent, ct_bits);
+            assert(rangeresult);
+            job.fSuccess = true;
+        }
+    }
+
+    //! Generate all proofs added so far, returning the number of outputs and issuances successfully blinded
+    int Generate()
+    {
+        if (nBlindThreads > 1 && vJobs.size() > 1) {
+            CCheckQueueControl<CBlindProofCheck> control(&blindproofqueue);
+            std::vector<CBlindProofCheck*> vChecks;
+            for (CBlindProofJob& job : vJobs) {
+                vChecks.push_back(new CBlindProofCheck(this, &job));
+            }
+            control.Add(vChecks);
+            control.Wait();
+        } else {
+            for (CBlindProofJob& job : vJobs) {
+                Prove(job);
+            }
+        }
+
+        int nSuccess = 0;
+        for (const CBlindProofJob& job : vJobs) {
+            nSuccess += job.fSuccess;
+        }
+        vJobs.clear();
+        return nSuccess;
+    }
+};
+
+bool CBlindProofCheck::operator()()
+{
+    generator->Prove(*job);
+    return true;
+}
+
+} // namespace
+
+void ThreadBlindProofs()
+{
+    RenameThread("bitcoin-blind");
+    blindproofqueue.Thread();
+}
+
 int BlindTransaction(std::vector<uint256 >& input_blinding_factors, const std::vector<uint256 >& input_asset_blinding_factors, const std::vector<CAsset >& input_assets, const std::vector<CAmount >& input_amounts, std::vector<uint256 >& output_blinding_factors, std::vector<uint256 >& output_asset_blinding_factors, const std::vector<CPubKey>& output_pubkeys, const std::vector<CKey>& vBlindIssuanceAsset, const std::vector<CKey>& vBlindIssuanceToken, CMutableTransaction& tx, std::vector<std::vector<unsigned char> >* auxiliary_generators)
 {
     // Sanity check input data and output_pubkey size, clear other output data
@@ -275,8 +524,13 @@ int BlindTransaction(std::vector<uint256 >& input_blinding_factors, const std::v
                 return -1;
             }
         } else {
-            ret = secp256k1_generator_generate_blinded(secp256k1_blind_context, &targetAssetGenerators[totalTargets], input_assets[i].begin(), input_asset_blinding_factors[i].begin());
-            assert(ret == 1);
+            if (input_asset_blinding_factors[i].IsNull()) {
+                ret = GetAssetGenerator(targetAssetGenerators[totalTargets], input_assets[i]);
+                assert(ret);
+            } else {
+                ret = secp256k1_generator_generate_blinded(secp256k1_blind_context, &targetAssetGenerators[totalTargets], input_assets[i].begin(), input_asset_blinding_factors[i].begin());
+                assert(ret == 1);
+            }
         }
         memcpy(&surjectionTargets[totalTargets], input_assets[i].begin(), 32);
         targetAssetBlinders.push_back(input_asset_blinding_factors[i]);
@@ -303,8 +557,8 @@ int BlindTransaction(std::vector<uint256 >& input_blinding_factors, const std::v
 
             if (!issuance.nAmount.IsNull()) {
                 memcpy(&surjectionTargets[totalTargets], asset.begin(), 32);
-                ret = secp256k1_generator_generate(secp256k1_blind_context, &targetAssetGenerators[totalTargets], asset.begin());
-                assert(ret != 0);
+                ret = GetAssetGenerator(targetAssetGenerators[totalTargets], asset);
+                assert(ret);
                 // Issuance asset cannot be blinded by definition
                 targetAssetBlinders.push_back(uint256());
                 totalTargets++;
@@ -312,8 +566,8 @@ int BlindTransaction(std::vector<uint256 >& input_blinding_factors, const std::v
             if (!issuance.nInflationKeys.IsNull()) {
                 assert(!token.IsNull());
                 memcpy(&surjectionTargets[totalTargets], token.begin(), 32);
-                ret = secp256k1_generator_generate(secp256k1_blind_context, &targetAssetGenerators[totalTargets], token.begin());
-                assert(ret != 0);
+                ret = GetAssetGenerator(targetAssetGenerators[totalTargets], token);
+                assert(ret);
                 // Issuance asset cannot be blinded by definition
                 targetAssetBlinders.push_back(uint256());
                 totalTargets++;
@@ -340,6 +594,9 @@ int BlindTransaction(std::vector<uint256 >& input_blinding_factors, const std::v
     surjectionTargets.resize(totalTargets);
     targetAssetGenerators.resize(totalTargets);
 
+    // Proofs are generated once all commitments, and so all blinding factors, are final
+    CBlindProofGenerator proofs(tx, surjectionTargets, targetAssetGenerators, targetAssetBlinders);
+
     //Total blinded inputs that you own (that you are balancing against)
     int nBlindsIn = 0;
     //Number of outputs and issuances to blind
@@ -445,13 +702,12 @@ int BlindTransaction(std::vector<uint256 >& input_blinding_factors, const std::v
                 if (nBlindAttempts == nToBlind) {
                     // All outputs we own are unblinded, we don't support this type of blinding
                     // though it is possible. No privacy gained here, incompatible with secp api
-                    return nSuccessfullyBlinded;
+                    return nSuccessfullyBlinded + proofs.Generate();
                 }
 
                 if (tx.wit.vtxinwit.size() <= nIn) {
                     tx.wit.vtxinwit.resize(tx.vin.size());
                 }
-                CTxInWitness& txinwit = tx.wit.vtxinwit[nIn];
 
                 // TODO Store the blinding factors of issuance
 
@@ -465,12 +721,17 @@ int BlindTransaction(std::vector<uint256 >& input_blinding_factors, const std::v
                 // nonce should just be blinding key
                 uint256 nonce = nPseudo ? uint256(std::vector<unsigned char>(vBlindIssuanceToken[nIn].begin(), vBlindIssuanceToken[nIn].end())) : uint256(std::vector<unsigned char>(vBlindIssuanceAsset[nIn].begin(), vBlindIssuanceAsset[nIn].end()));
 
-                // Generate rangeproof, no script committed for issuances
-                bool rangeresult = GenerateRangeproof((nPseudo ? txinwit.vchInflationKeysRangeproof : txinwit.vchIssuanceAmountRangeproof), blindptrs, nonce, amount, CScript(), commit, gen, asset, assetblindptrs);
-                assert(rangeresult);
-
-                // Successfully blinded this issuance
-                nSuccessfullyBlinded++;
+                // Queue rangeproof, no script committed for issuances
+                CBlindProofJob& job = proofs.Add();
+                job.nIndex = nIn;
+                job.nPseudo = nPseudo;
+                job.blindptr = blindptrs.back();
+                job.assetblindptr = assetblindptrs.back();
+                job.nonce = nonce;
+                job.amount = amount;
+                job.commit = commit;
+                job.gen = gen;
+                job.asset = asset;
 
             }
         }
@@ -504,7 +765,7 @@ int BlindTransaction(std::vector<uint256 >& input_blinding_factors, const std::v
                 // Adversary would need to create all input blinds
                 // therefore would already know all your summed output amount anyways.
                 if (nBlindAttempts == 1 && nBlindsIn == 0) {
-                    return nSuccessfullyBlinded;
+                    return nSuccessfullyBlinded + proofs.Generate();
                 }
 
                 // Generate value we intend to insert
@@ -520,14 +781,13 @@ int BlindTransaction(std::vector<uint256 >& input_blinding_factors, const std::v
                 // abort and not blind and the math adds up.
                 // Count as success(to signal caller that nothing wrong) and return early
                 if (memcmp(diff_zero, &blind[nBlindAttempts-1][0], 32) == 0) {
-                   return ++nSuccessfullyBlinded;
+                   return ++nSuccessfullyBlinded + proofs.Generate();
                 }
             }
 
             if (tx.wit.vtxoutwit.size() <= nOut) {
                 tx.wit.vtxoutwit.resize(tx.vout.size());
             }
-            CTxOutWitness& txoutwit = tx.wit.vtxoutwit[nOut];
 
             output_blinding_factors[nOut] = uint256(std::vector<unsigned char>(blindptrs[blindptrs.size()-1], blindptrs[blindptrs.size()-1]+32));
             output_asset_blinding_factors[nOut] = uint256(std::vector<unsigned char>(assetblindptrs[assetblindptrs.size()-1], assetblindptrs[assetblindptrs.size()-1]+32));
@@ -538,22 +798,21 @@ int BlindTransaction(std::vector<uint256 >& input_blinding_factors, const std::v
             // Create value commitment
             CreateValueCommitment(confValue, commit, blindptrs.back(), gen, amount);
 
-            // Generate nonce for rewind by owner
-            uint256 nonce = GenerateOutputRangeproofNonce(out, output_pubkeys[nOut]);
-
-            // Generate rangeproof
-            bool rangeresult = GenerateRangeproof(txoutwit.vchRangeproof, blindptrs, nonce, amount, out.scriptPubKey, commit, gen, asset, assetblindptrs);
-            assert(rangeresult);
-
-            // Create surjection proof for this output
-            if (!SurjectOutput(txoutwit, surjectionTargets, targetAssetGenerators, targetAssetBlinders, assetblindptrs, gen, asset)) {
-                continue;
-            }
-
-            // Successfully blinded this output
-            nSuccessfullyBlinded++;
+            // Queue rangeproof and surjection proof, with the nonce for rewind by owner
+            CBlindProofJob& job = proofs.Add();
+            job.nIndex = nOut;
+            job.nPseudo = -1;
+            job.blindptr = blindptrs.back();
+            job.assetblindptr = assetblindptrs.back();
+            job.nonce = GenerateOutputRangeproofNonce(out, output_pubkeys[nOut]);
+            job.amount = amount;
+            job.scriptPubKey = out.scriptPubKey;
+            job.commit = commit;
+            job.gen = gen;
+            job.asset = asset;
+            GetSurjectionSeed(job.surjectionseed, job.assetblindptr);
         }
     }
 
-    return nSuccessfullyBlinded;
+    return nSuccessfullyBlinded + proofs.Generate();
 }
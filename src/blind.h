@@ -9,6 +9,38 @@
 #include <secp256k1_rangeproof.h>
 #include <secp256k1_surjectionproof.h>
 
+/** Maximum number of threads generating proofs in BlindTransaction */
+static const int MAX_BLIND_THREADS = 16;
+/** -blindthreads default (0 = auto) */
+static const int DEFAULT_BLIND_THREADS = 0;
+
+/** Number of threads BlindTransaction generates range and surjection proofs on, 0 or 1 for none */
+extern int nBlindThreads;
+
+/** Run instances of this in background threads to generate BlindTransaction proofs in parallel */
+void ThreadBlindProofs();
+
+/** Maximum number of explicit asset generators kept by the asset generator cache */
+static const size_t MAX_ASSET_GENERATOR_CACHE_SIZE = 4096;
+
+struct AssetGeneratorCacheStats
+{
+    size_t entries;
+    size_t capacity;
+    uint64_t hits;
+    uint64_t misses;
+};
+
+/*
+ * Get the unblinded generator of an explicit asset, from a bounded cache
+ * shared by the whole process. If serialized is non-NULL it receives the
+ * CConfidentialAsset::nCommittedSize byte serialization of the generator.
+ * Returns false if no generator could be derived from the asset.
+ */
+bool GetAssetGenerator(secp256k1_generator& gen, const CAsset& asset, unsigned char* serialized = NULL);
+
+AssetGeneratorCacheStats GetAssetGeneratorCacheStats();
+
 bool GenerateRangeproof(std::vector<unsigned char>& vchRangeproof, const std::vector<unsigned char*>& blindptrs, const uint256& nonce, const CAmount amount, const CScript& scriptPubKey, const secp256k1_pedersen_commitment& commit, const secp256k1_generator& gen, const CAsset& asset, std::vector<const unsigned char*>& assetblindptrs);
 
 bool SurjectOutput(CTxOutWitness& txoutwit, const std::vector<secp256k1_fixed_asset_tag>& inputAssets, const std::vector<secp256k1_generator>& inputAssetGenerators, const std::vector<uint256 >& input_asset_blinding_factors, const std::vector<const unsigned char*> assetblindptrs, const secp256k1_generator& gen, const CAsset& asset);
@@ -76,7 +76,7 @@ static void http_error_cb(enum evhttp_request_error err, void *ctx)
 }
 #endif
 
-UniValue CallRPC(const std::string& strMethod, const UniValue& params, bool connectToMainchain)
+UniValue CallRPC(const std::string& strMethod, const UniValue& params, bool connectToMainchain, int nTimeout)
 {
     std::string strhost = "-rpcconnect";
     std::string strport = "-rpcport";
@@ -99,7 +99,7 @@ UniValue CallRPC(const std::string& strMethod, const UniValue& params, bool conn
 
     // Synchronously look up hostname
     raii_evhttp_connection evcon = obtain_evhttp_connection_base(base.get(), host, port);
-    evhttp_connection_set_timeout(evcon.get(), GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
+    evhttp_connection_set_timeout(evcon.get(), nTimeout > 0 ? nTimeout : GetArg("-rpcclienttimeout", DEFAULT_HTTP_CLIENT_TIMEOUT));
 
     HTTPReply response;
     raii_evhttp_request req = obtain_evhttp_request(http_request_done, (void*)&response);
@@ -34,7 +34,8 @@ public:
 
 };
 
-UniValue CallRPC(const std::string& strMethod, const UniValue& params, bool connectToMainchain=false);
+/** Call an RPC method, timing out after nTimeout seconds, or after -rpcclienttimeout seconds if nTimeout is 0 */
+UniValue CallRPC(const std::string& strMethod, const UniValue& params, bool connectToMainchain=false, int nTimeout=0);
 bool IsConfirmedBitcoinBlock(const uint256& hash, int nMinConfirmationDepth);
 
 #endif // BITCOIN_CALLRPC_H
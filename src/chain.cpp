@@ -5,6 +5,64 @@
 
 #include "chain.h"
 
+#include "hash.h"
+#include "memusage.h"
+#include "sync.h"
+
+#include <algorithm>
+#include <map>
+
+namespace {
+
+CCriticalSection cs_blockchallenges;
+//! Interned challenges by hash. Entries of released challenges are pruned
+//! once the table has doubled in size since the last pruning.
+std::map<uint256, std::weak_ptr<const CScript> > mapBlockChallenges;
+size_t nBlockChallengesPruneSize = 8;
+
+} // namespace
+
+uint256 GetBlockChallengeHash(const CScript& challenge)
+{
+    return Hash(challenge.begin(), challenge.end());
+}
+
+std::shared_ptr<const CScript> InternBlockChallenge(const CScript& challenge)
+{
+    uint256 hash = GetBlockChallengeHash(challenge);
+    LOCK(cs_blockchallenges);
+    std::weak_ptr<const CScript>& entry = mapBlockChallenges[hash];
+    std::shared_ptr<const CScript> pchallenge = entry.lock();
+    if (!pchallenge) {
+        // Allocated apart from the reference count, so that the script is
+        // freed as soon as it is released, not when the table entry is
+        pchallenge.reset(new CScript(challenge));
+        entry = pchallenge;
+    }
+    if (mapBlockChallenges.size() >= nBlockChallengesPruneSize) {
+        for (std::map<uint256, std::weak_ptr<const CScript> >::iterator it = mapBlockChallenges.begin(); it != mapBlockChallenges.end(); ) {
+            if (it->second.expired())
+                mapBlockChallenges.erase(it++);
+            else
+                ++it;
+        }
+        nBlockChallengesPruneSize = std::max<size_t>(8, 2 * mapBlockChallenges.size());
+    }
+    return pchallenge;
+}
+
+size_t BlockChallengesDynamicUsage()
+{
+    LOCK(cs_blockchallenges);
+    size_t nUsage = memusage::DynamicUsage(mapBlockChallenges);
+    for (std::map<uint256, std::weak_ptr<const CScript> >::const_iterator it = mapBlockChallenges.begin(); it != mapBlockChallenges.end(); ++it) {
+        std::shared_ptr<const CScript> pchallenge = it->second.lock();
+        if (pchallenge)
+            nUsage += memusage::DynamicUsage(pchallenge) + memusage::DynamicUsage(*pchallenge);
+    }
+    return nUsage;
+}
+
 /**
  * CChain implementation
  */
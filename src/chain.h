@@ -12,8 +12,24 @@
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <memory>
 #include <vector>
 
+/** Hash under which a block challenge script is interned and stored. */
+uint256 GetBlockChallengeHash(const CScript& challenge);
+
+/**
+ * Return a copy of a block challenge script that is shared by every caller
+ * passing an equal script. It is released once the last reference is gone.
+ * The challenge almost never changes between blocks, so the block index
+ * and the block tree database refer to it instead of storing one copy per
+ * entry.
+ */
+std::shared_ptr<const CScript> InternBlockChallenge(const CScript& challenge);
+
+/** Memory used by the interned block challenges. */
+size_t BlockChallengesDynamicUsage();
+
 class CBlockFileInfo
 {
 public:
@@ -196,7 +212,14 @@ public:
     int nVersion;
     uint256 hashMerkleRoot;
     unsigned int nTime;
-    CProof proof;
+
+    //! block proof challenge, see InternBlockChallenge
+    std::shared_ptr<const CScript> pchallenge;
+
+    //! block proof solution, only kept in memory until the entry has been
+    //! written to the block tree database. Use ReadBlockHeader to get the
+    //! full header.
+    std::shared_ptr<const CScript> psolution;
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     int32_t nSequenceId;
@@ -223,7 +246,8 @@ public:
         nVersion       = 0;
         hashMerkleRoot = uint256();
         nTime          = 0;
-        proof.SetNull();
+        pchallenge.reset();
+        psolution.reset();
     }
 
     CBlockIndex()
@@ -239,7 +263,8 @@ public:
         hashMerkleRoot = block.hashMerkleRoot;
         nTime          = block.nTime;
         nHeight        = block.nHeight;
-        proof          = block.proof;
+        pchallenge     = InternBlockChallenge(block.proof.challenge);
+        psolution      = std::make_shared<const CScript>(block.proof.solution);
     }
 
     CDiskBlockPos GetBlockPos() const {
@@ -260,6 +285,7 @@ public:
         return ret;
     }
 
+    //! Header without the proof solution, see ReadBlockHeader
     CBlockHeader GetBlockHeader() const
     {
         CBlockHeader block;
@@ -269,7 +295,8 @@ public:
         block.hashMerkleRoot = hashMerkleRoot;
         block.nTime          = nTime;
         block.nHeight        = nHeight;
-        block.proof          = proof;
+        if (pchallenge)
+            block.proof.challenge = *pchallenge;
         return block;
     }
 
@@ -352,13 +379,20 @@ class CDiskBlockIndex : public CBlockIndex
 {
 public:
     uint256 hashPrev;
+    //! hash of the proof challenge, which is stored once on its own
+    uint256 hashChallenge;
+    CScript solution;
 
     CDiskBlockIndex() {
         hashPrev = uint256();
+        hashChallenge = uint256();
     }
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        hashChallenge = (pchallenge ? GetBlockChallengeHash(*pchallenge) : uint256());
+        if (psolution)
+            solution = *psolution;
     }
 
     ADD_SERIALIZE_METHODS;
@@ -384,9 +418,11 @@ public:
         READWRITE(hashPrev);
         READWRITE(hashMerkleRoot);
         READWRITE(nTime);
-        READWRITE(proof);
+        READWRITE(hashChallenge);
+        READWRITE(*(CScriptBase*)(&solution));
     }
 
+    //! Requires pchallenge to be set to the challenge of hashChallenge
     uint256 GetBlockHash() const
     {
         CBlockHeader block;
@@ -394,7 +430,8 @@ public:
         block.hashPrevBlock   = hashPrev;
         block.hashMerkleRoot  = hashMerkleRoot;
         block.nTime           = nTime;
-        block.proof           = proof;
+        if (pchallenge)
+            block.proof.challenge = *pchallenge;
         block.nHeight         = nHeight;
         return block.GetHash();
     }
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chainparams.h"
+#include "compressor.h"
 #include "consensus/merkle.h"
 #include "issuance.h"
 
@@ -491,6 +492,7 @@ void SelectParams(const std::string& network)
 {
     SelectBaseParams(network);
     globalChainParams = CreateChainParams(network);
+    CTxOutCompressor::SetDefaultPeggedAsset(globalChainParams->GetConsensus().pegged_asset);
 }
 
 void UpdateBIP9Parameters(Consensus::DeploymentPos d, int64_t nStartTime, int64_t nTimeout)
@@ -130,6 +130,115 @@ bool CScriptCompressor::Decompress(unsigned int nSize, const std::vector<unsigne
     return false;
 }
 
+namespace {
+
+// The header of the compact output layout is
+// nLegacyHeaders + value + VALUE_ENCODINGS * (asset + ASSET_ENCODINGS * has_nonce)
+enum ValueEncoding {
+    VALUE_EXPLICIT = 0,
+    VALUE_COMMITMENT_A, // commitment prefix 0x08
+    VALUE_COMMITMENT_B, // commitment prefix 0x09
+    VALUE_NULL,
+    VALUE_ENCODINGS
+};
+
+enum AssetEncoding {
+    ASSET_PEGGED = 0,
+    ASSET_EXPLICIT,
+    ASSET_COMMITMENT_A, // commitment prefix 0x0a
+    ASSET_COMMITMENT_B, // commitment prefix 0x0b
+    ASSET_NULL,
+    ASSET_ENCODINGS
+};
+
+} // namespace
+
+CAsset CTxOutCompressor::defaultPeggedAsset;
+
+void CTxOutCompressor::SetDefaultPeggedAsset(const CAsset &asset)
+{
+    defaultPeggedAsset = asset;
+}
+
+bool CTxOutCompressor::IsPeggedAsset() const
+{
+    return txout.nAsset.IsExplicit() && txout.nAsset.GetAsset() == peggedAsset;
+}
+
+bool CTxOutCompressor::GetHeader(unsigned char &nHeader) const
+{
+    unsigned int nValueCode;
+    if (txout.nValue.IsExplicit())
+        nValueCode = VALUE_EXPLICIT;
+    else if (txout.nValue.IsCommitment())
+        nValueCode = txout.nValue.vchCommitment[0] == 0x08 ? VALUE_COMMITMENT_A : VALUE_COMMITMENT_B;
+    else if (txout.nValue.IsNull())
+        nValueCode = VALUE_NULL;
+    else
+        return false;
+
+    unsigned int nAssetCode;
+    if (IsPeggedAsset())
+        nAssetCode = ASSET_PEGGED;
+    else if (txout.nAsset.IsExplicit())
+        nAssetCode = ASSET_EXPLICIT;
+    else if (txout.nAsset.IsCommitment())
+        nAssetCode = txout.nAsset.vchCommitment[0] == 0x0a ? ASSET_COMMITMENT_A : ASSET_COMMITMENT_B;
+    else if (txout.nAsset.IsNull())
+        nAssetCode = ASSET_NULL;
+    else
+        return false;
+
+    if (!txout.nNonce.IsValid())
+        return false;
+
+    nHeader = nLegacyHeaders + nValueCode + VALUE_ENCODINGS * (nAssetCode + ASSET_ENCODINGS * !txout.nNonce.IsNull());
+    return true;
+}
+
+void CTxOutCompressor::SetFromHeader(unsigned char nHeader, bool &fExplicitValue, bool &fAssetData, bool &fNonce)
+{
+    unsigned int nCode = nHeader - nLegacyHeaders;
+    unsigned int nValueCode = nCode % VALUE_ENCODINGS;
+    nCode /= VALUE_ENCODINGS;
+    unsigned int nAssetCode = nCode % ASSET_ENCODINGS;
+    nCode /= ASSET_ENCODINGS;
+    if (nCode > 1)
+        throw std::ios_base::failure("Unknown output compression header");
+    fNonce = nCode == 1;
+
+    std::vector<unsigned char> &vchValue = txout.nValue.vchCommitment;
+    fExplicitValue = nValueCode == VALUE_EXPLICIT;
+    switch (nValueCode) {
+    case VALUE_COMMITMENT_A:
+    case VALUE_COMMITMENT_B:
+        vchValue.assign(CConfidentialValue::nCommittedSize, 0);
+        vchValue[0] = nValueCode == VALUE_COMMITMENT_A ? 0x08 : 0x09;
+        break;
+    default:
+        txout.nValue.SetNull();
+    }
+
+    std::vector<unsigned char> &vchAsset = txout.nAsset.vchCommitment;
+    fAssetData = nAssetCode != ASSET_PEGGED && nAssetCode != ASSET_NULL;
+    switch (nAssetCode) {
+    case ASSET_PEGGED:
+        txout.nAsset.SetToAsset(peggedAsset);
+        break;
+    case ASSET_EXPLICIT:
+        vchAsset.assign(CConfidentialAsset::nExplicitSize, 0);
+        vchAsset[0] = 1;
+        break;
+    case ASSET_COMMITMENT_A:
+    case ASSET_COMMITMENT_B:
+        vchAsset.assign(CConfidentialAsset::nCommittedSize, 0);
+        vchAsset[0] = nAssetCode == ASSET_COMMITMENT_A ? 0x0a : 0x0b;
+        break;
+    default:
+        txout.nAsset.SetNull();
+    }
+}
+
 // Amount compression:
 // * If the amount is 0, output 0
 // * first, divide the amount (in base units) by the largest power of 10 possible; call the exponent e (e is max 9)
@@ -89,46 +89,112 @@ public:
     }
 };
 
-/** wrapper for CTxOut that provides a more compact serialization */
+/** Wrapper for CTxOut that provides a more compact serialization.
+ *
+ *  A header byte tells how the value, asset and nonce are stored, followed
+ *  by what is left of them and the compressed script:
+ *  * the value is an explicit amount (compressed as below), a commitment
+ *    (32 bytes, the prefix is in the header), or null
+ *  * the asset is the pegged asset (not stored), another explicit asset
+ *    (32 bytes), a commitment (32 bytes), or null
+ *  * the nonce is null (not stored) or stored in full
+ *
+ *  Headers 0 and 1 are the layout of earlier versions, still read: an
+ *  explicit amount or a full value, the full asset, and no nonce. It is also
+ *  written for outputs with malformed commitments.
+ */
 class CTxOutCompressor
 {
 private:
+    static const unsigned char nLegacyHeaders = 2;
+    //! Pegged asset of the chain, set by SelectParams
+    static CAsset defaultPeggedAsset;
+
     CTxOut &txout;
+    const CAsset &peggedAsset;
+
+protected:
+    /** Header of the compact layout, or false if the output needs the legacy one. */
+    bool GetHeader(unsigned char &nHeader) const;
+    /** Set up the value and asset the header describes, and tell what follows it. */
+    void SetFromHeader(unsigned char nHeader, bool &fExplicitValue, bool &fAssetData, bool &fNonce);
+    bool IsPeggedAsset() const;
 
 public:
     static uint64_t CompressAmount(uint64_t nAmount);
     static uint64_t DecompressAmount(uint64_t nAmount);
 
-    CTxOutCompressor(CTxOut &txoutIn) : txout(txoutIn) { }
+    /** Set the pegged asset outputs are compressed against unless one is given. */
+    static void SetDefaultPeggedAsset(const CAsset &asset);
 
-    ADD_SERIALIZE_METHODS;
+    CTxOutCompressor(CTxOut &txoutIn) : txout(txoutIn), peggedAsset(defaultPeggedAsset) { }
+    CTxOutCompressor(CTxOut &txoutIn, const CAsset &peggedAssetIn) : txout(txoutIn), peggedAsset(peggedAssetIn) { }
 
-    template <typename Stream, typename Operation>
-    inline void SerializationOp(Stream& s, Operation ser_action) {
-        if (!ser_action.ForRead()) {
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        unsigned char nHeader;
+        if (!GetHeader(nHeader)) {
+            if (txout.nValue.IsExplicit()) {
+                uint64_t nVal = CompressAmount(txout.nValue.GetAmount());
+                s << (unsigned char)0;
+                s << VARINT(nVal);
+            } else {
+                s << (unsigned char)1;
+                s << txout.nValue;
+            }
+            s << txout.nAsset;
+        } else {
+            s << nHeader;
+            const std::vector<unsigned char> &vchValue = txout.nValue.vchCommitment;
             if (txout.nValue.IsExplicit()) {
-                uint8_t b = 0;
-                READWRITE(b);
                 uint64_t nVal = CompressAmount(txout.nValue.GetAmount());
-                READWRITE(VARINT(nVal));
+                s << VARINT(nVal);
+            } else if (!vchValue.empty()) {
+                s.write((const char*)&vchValue[1], vchValue.size() - 1);
+            }
+            const std::vector<unsigned char> &vchAsset = txout.nAsset.vchCommitment;
+            if (!vchAsset.empty() && !IsPeggedAsset())
+                s.write((const char*)&vchAsset[1], vchAsset.size() - 1);
+            if (!txout.nNonce.IsNull())
+                s << txout.nNonce;
+        }
+        s << CScriptCompressor(REF(txout.scriptPubKey));
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        unsigned char nHeader = 0;
+        s >> nHeader;
+        if (nHeader < nLegacyHeaders) {
+            if (nHeader == 0) {
+                uint64_t nVal = 0;
+                s >> VARINT(nVal);
+                txout.nValue = DecompressAmount(nVal);
             } else {
-                uint8_t b = 1;
-                READWRITE(b);
-                READWRITE(txout.nValue);
+                s >> txout.nValue;
             }
+            s >> txout.nAsset;
+            txout.nNonce.SetNull();
         } else {
-            uint8_t type;
-            READWRITE(type);
-            if (type == 0) {
+            bool fExplicitValue, fAssetData, fNonce;
+            SetFromHeader(nHeader, fExplicitValue, fAssetData, fNonce);
+            std::vector<unsigned char> &vchValue = txout.nValue.vchCommitment;
+            if (fExplicitValue) {
                 uint64_t nVal = 0;
-                READWRITE(VARINT(nVal));
+                s >> VARINT(nVal);
                 txout.nValue = DecompressAmount(nVal);
-            } else
-                READWRITE(txout.nValue);
+            } else if (!vchValue.empty()) {
+                s >> REF(CFlatData(&vchValue[1], &vchValue[vchValue.size()]));
+            }
+            std::vector<unsigned char> &vchAsset = txout.nAsset.vchCommitment;
+            if (fAssetData)
+                s >> REF(CFlatData(&vchAsset[1], &vchAsset[vchAsset.size()]));
+            if (fNonce)
+                s >> txout.nNonce;
+            else
+                txout.nNonce.SetNull();
         }
-        READWRITE(txout.nAsset);
-        CScriptCompressor cscript(REF(txout.scriptPubKey));
-        READWRITE(cscript);
+        s >> REF(CScriptCompressor(txout.scriptPubKey));
     }
 };
 
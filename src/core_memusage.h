@@ -48,6 +48,10 @@ static inline size_t RecursiveDynamicUsage(const ::CTxWitness& wit) {
     return mem;
 }
 
+static inline size_t RecursiveDynamicUsage(const CAmountMap& map) {
+    return memusage::MallocUsage(map.allocated_memory());
+}
+
 static inline size_t RecursiveDynamicUsage(const CTransaction& tx) {
     size_t mem = memusage::DynamicUsage(tx.vin) + memusage::DynamicUsage(tx.vout);
     for (const CTxIn& txi : tx.vin) {
@@ -57,6 +61,7 @@ static inline size_t RecursiveDynamicUsage(const CTransaction& tx) {
         mem += RecursiveDynamicUsage(txo);
     }
     mem += RecursiveDynamicUsage(tx.wit);
+    mem += RecursiveDynamicUsage(tx.GetFee());
     return mem;
 }
 
@@ -122,6 +122,7 @@ public:
  *
  *  Read Operations:
  *      - contains(*, false)
+ *      - for_each()
  *
  *  Read+Erase Operations:
  *      - contains(*, true)
@@ -451,6 +452,21 @@ public:
             }
         return false;
     }
+
+    /* for_each calls f on every element in the table that is not marked for
+     * garbage collection, in table order.
+     *
+     * Like contains, it is a Read and requires no concurrent Write.
+     *
+     * @param f a callable taking a const Element&
+     */
+    template <typename F>
+    void for_each(F f) const
+    {
+        for (uint32_t loc = 0; loc < size; ++loc)
+            if (!collection_flags.bit_is_set(loc))
+                f(table[loc]);
+    }
 };
 } // namespace CuckooCache
 
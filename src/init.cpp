@@ -11,6 +11,7 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "blind.h"
 #include "callrpc.h"
 #include "chain.h"
 #include "chainparams.h"
@@ -21,12 +22,14 @@
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
+#include "mainchain.h"
 #include "validation.h"
 #include "miner.h"
 #include "netbase.h"
 #include "net.h"
 #include "net_processing.h"
 #include "policy/policy.h"
+#include "pow.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
 #include "script/standard.h"
@@ -35,6 +38,7 @@
 #include "timedata.h"
 #include "txdb.h"
 #include "txmempool.h"
+#include "txprevalidation.h"
 #include "torcontrol.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -68,6 +72,7 @@
 #endif
 
 bool fFeeEstimatesInitialized = false;
+static bool fPersistVerifyCache = false;
 static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
 static const bool DEFAULT_DISABLE_SAFEMODE = false;
@@ -150,9 +155,9 @@ class CCoinsViewErrorCatcher : public CCoinsViewBacked
 {
 public:
     CCoinsViewErrorCatcher(CCoinsView* view) : CCoinsViewBacked(view) {}
-    bool GetCoins(const uint256 &txid, CCoins &coins) const {
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const {
         try {
-            return CCoinsViewBacked::GetCoins(txid, coins);
+            return CCoinsViewBacked::GetCoin(outpoint, coin);
         } catch(const std::runtime_error& e) {
             uiInterface.ThreadSafeMessageBox(_("Error reading from database, shutting down."), "", CClientUIInterface::MSG_ERROR);
             LogPrintf("Error reading from database: %s\n", e.what());
@@ -166,7 +171,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -214,6 +218,8 @@ void Shutdown()
     UnregisterNodeSignals(GetNodeSignals());
     if (fDumpMempoolLater)
         DumpMempool();
+    if (fPersistVerifyCache)
+        DumpVerifyCaches();
 
     if (fFeeEstimatesInitialized)
     {
@@ -240,6 +246,8 @@ void Shutdown()
         delete pblocktree;
         pblocktree = NULL;
     }
+    g_mainchain_tracker.reset();
+    g_txprevalidation.reset();
 #ifdef ENABLE_WALLET
     if (pwalletMain)
         pwalletMain->Flush(true);
@@ -328,6 +336,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-?", _("Print this help message and exit"));
     strUsage += HelpMessageOpt("-version", _("Print version and exit"));
     strUsage += HelpMessageOpt("-alertnotify=<cmd>", _("Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)"));
+    strUsage += HelpMessageOpt("-blindthreads=<n>", strprintf(_("Set the number of threads generating range and surjection proofs when blinding transactions (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+        -GetNumCores(), MAX_BLIND_THREADS, DEFAULT_BLIND_THREADS));
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
@@ -350,6 +360,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
+    strUsage += HelpMessageOpt("-txprevalidationthreads=<n>", strprintf("Set the number of threads verifying the proofs and scripts of received transactions before they are accepted to the mempool (0 to %d, 0 = verify on the message handler thread, default: %d)",
+        MAX_TXPREVALIDATION_THREADS, DEFAULT_TXPREVALIDATION_THREADS));
+    strUsage += HelpMessageOpt("-persistverifycache", strprintf("Save the signature, rangeproof and surjection proof caches on shutdown and load them on startup (default: %u)", DEFAULT_PERSIST_VERIFY_CACHE));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-pid=<file>", strprintf(_("Specify pid file (default: %s)"), BITCOIN_PID_FILENAME));
 #endif
@@ -441,7 +454,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-bip9params=deployment:start:end", "Use given start/end times for specified BIP9 deployment (regtest-only)");
         strUsage += HelpMessageOpt("-assetdir=hexidstr:label", "For naming known assets");
     }
-    std::string debugCategories = "addrman, alert, bench, cmpctblock, coindb, db, http, libevent, lock, mempool, mempoolrej, net, proxy, prune, rand, reindex, rpc, selectcoins, tor, zmq"; // Don't translate these and qt below
+    std::string debugCategories = "addrman, alert, bench, cmpctblock, coindb, db, http, libevent, lock, mainchain, mempool, mempoolrej, net, proxy, prune, rand, reindex, rpc, selectcoins, tor, zmq"; // Don't translate these and qt below
     if (mode == HMM_BITCOIN_QT)
         debugCategories += ", qt";
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
@@ -529,6 +542,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-mainchainrpcuser=<username>", strprintf("The rpc username that the daemon will use to connect to validate peg-ins, if enabled. (default: cookie auth)"));
     strUsage += HelpMessageOpt("-mainchainrpcpassword=<password>", strprintf("The rpc password which the daemon will use to connect to validate peg-ins, if enabled. (default: cookie auth)"));
     strUsage += HelpMessageOpt("-mainchainrpccookiefile=<path>", strprintf("The bitcoind cookie auth path which the daemon will use to connect to validate peg-ins, if enabled. (default: default bitcoind datadir)"));
+    strUsage += HelpMessageOpt("-mainchainpollinterval=<n>", strprintf("The interval in seconds at which bitcoind's best chain is polled to answer peg-in depth checks from memory, if enabled. 0 means querying bitcoind for every peg-in. (default: %u)", DEFAULT_MAINCHAIN_POLL_INTERVAL));
 
 
     return strUsage;
@@ -999,6 +1013,15 @@ bool AppInitParameterInteraction()
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
 
+    // -blindthreads=0 means autodetect, but nBlindThreads<=1 means no concurrency
+    nBlindThreads = GetArg("-blindthreads", DEFAULT_BLIND_THREADS);
+    if (nBlindThreads <= 0)
+        nBlindThreads += GetNumCores();
+    if (nBlindThreads <= 1)
+        nBlindThreads = 0;
+    else if (nBlindThreads > MAX_BLIND_THREADS)
+        nBlindThreads = MAX_BLIND_THREADS;
+
     // block pruning; get the amount of disk space (in MiB) to allot for block & undo files
     int64_t nPruneArg = GetArg("-prune", 0);
     if (nPruneArg < 0) {
@@ -1213,6 +1236,12 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     InitSignatureCache();
     InitRangeproofCache();
     InitSurjectionproofCache();
+    InitPAKProofCache();
+    InitPeginWitnessCache();
+    InitBlockProofCache();
+    fPersistVerifyCache = GetBoolArg("-persistverifycache", DEFAULT_PERSIST_VERIFY_CACHE);
+    if (fPersistVerifyCache)
+        LoadVerifyCaches();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
@@ -1220,6 +1249,20 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
 
+    if (nBlindThreads) {
+        for (int i=0; i<nBlindThreads-1; i++)
+            threadGroup.create_thread(&ThreadBlindProofs);
+    }
+
+    int nTxPreValidationThreads = std::max(0, std::min((int)GetArg("-txprevalidationthreads", DEFAULT_TXPREVALIDATION_THREADS), MAX_TXPREVALIDATION_THREADS));
+    LogPrintf("Using %u threads for transaction pre-validation\n", nTxPreValidationThreads);
+    if (nTxPreValidationThreads) {
+        g_txprevalidation.reset(new CTxPreValidationQueue());
+        boost::function<void()> txPreValidationLoop = boost::bind(&CTxPreValidationQueue::Thread, g_txprevalidation.get());
+        for (int i = 0; i < nTxPreValidationThreads; i++)
+            threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "txprevalid", txPreValidationLoop));
+    }
+
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>, "scheduler", serviceLoop));
@@ -1497,6 +1540,12 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
 
+                // If necessary, upgrade from older database format.
+                if (!pcoinsdbview->Upgrade()) {
+                    strLoadError = _("Error upgrading chainstate database");
+                    break;
+                }
+
                 // Check for changed -prune state.  What we are concerned about is a user who has pruned blocks
                 // in the past, but is now trying to run unpruned.
                 if (fHavePruned && !fPruneMode) {
@@ -1765,6 +1814,13 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         + strprintf(_("If you haven't setup a %s please get the latest stable version from %s or if you do not need to validate pegins set in your liquid configuration %s"), "bitcoind", "https://bitcoincore.org/en/download/", "validatepegin=0"));
     }
 
+    unsigned int nMainchainPollInterval = GetArg("-mainchainpollinterval", DEFAULT_MAINCHAIN_POLL_INTERVAL);
+    if (GetBoolArg("-validatepegin", DEFAULT_VALIDATE_PEGIN) && nMainchainPollInterval) {
+        g_mainchain_tracker.reset(new CMainchainTracker(std::unique_ptr<CMainchainBackend>(new CMainchainRPCBackend())));
+        boost::function<void()> mainchainLoop = boost::bind(&ThreadMainchainTracker, nMainchainPollInterval);
+        threadGroup.create_thread(boost::bind(&TraceThread<boost::function<void()> >, "mainchain", mainchainLoop));
+    }
+
     uiInterface.InitMessage(_("Done loading"));
 
 #ifdef ENABLE_WALLET
@@ -0,0 +1,205 @@
+// Copyright (c) 2017 The Elements Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mainchain.h"
+
+#include "callrpc.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <algorithm>
+
+#include <boost/thread.hpp>
+
+std::unique_ptr<CMainchainTracker> g_mainchain_tracker;
+
+static bool CallMainchainRPC(const std::string& strMethod, const UniValue& params, UniValue& result, int nTimeout = 0)
+{
+    try {
+        UniValue reply = CallRPC(strMethod, params, true, nTimeout);
+        if (!find_value(reply, "error").isNull())
+            return false;
+        result = find_value(reply, "result");
+        return true;
+    } catch (const std::exception& e) {
+        LogPrint("mainchain", "%s: %s failed: %s\n", __func__, strMethod, e.what());
+        return false;
+    }
+}
+
+bool CMainchainRPCBackend::GetBestBlock(uint256& hash, int& nHeight)
+{
+    UniValue result;
+    if (!CallMainchainRPC("getblockchaininfo", UniValue(UniValue::VARR), result, MAINCHAIN_POLL_RPC_TIMEOUT) || !result.isObject())
+        return false;
+    const UniValue& best = find_value(result, "bestblockhash");
+    const UniValue& blocks = find_value(result, "blocks");
+    if (!best.isStr() || !blocks.isNum())
+        return false;
+    hash.SetHex(best.get_str());
+    nHeight = blocks.get_int();
+    return true;
+}
+
+bool CMainchainRPCBackend::GetBlockHash(int nHeight, uint256& hash)
+{
+    UniValue params(UniValue::VARR);
+    params.push_back(nHeight);
+    UniValue result;
+    if (!CallMainchainRPC("getblockhash", params, result, MAINCHAIN_POLL_RPC_TIMEOUT) || !result.isStr())
+        return false;
+    hash.SetHex(result.get_str());
+    return true;
+}
+
+bool CMainchainRPCBackend::GetBlockHeader(const uint256& hash, int& nHeight, int& nConfirmations)
+{
+    UniValue params(UniValue::VARR);
+    params.push_back(hash.GetHex());
+    UniValue result;
+    if (!CallMainchainRPC("getblockheader", params, result) || !result.isObject())
+        return false;
+    const UniValue& height = find_value(result, "height");
+    const UniValue& confirmations = find_value(result, "confirmations");
+    if (!height.isNum() || !confirmations.isNum())
+        return false;
+    nHeight = height.get_int();
+    nConfirmations = confirmations.get_int();
+    return true;
+}
+
+CMainchainTracker::CMainchainTracker(std::unique_ptr<CMainchainBackend> backendIn, int nWindowIn) :
+    backend(std::move(backendIn)), nWindow(std::max(1, nWindowIn)), fSynced(false), nBaseHeight(0), nLastPoll(0), nHits(0), nLookups(0)
+{
+}
+
+bool CMainchainTracker::Poll()
+{
+    // Only the polling thread modifies vChain, so it can be read here without
+    // cs while the backend is being queried.
+    uint256 hashBest;
+    int nBestHeight;
+    if (!backend->GetBestBlock(hashBest, nBestHeight) || nBestHeight < 0) {
+        LOCK(cs);
+        fSynced = false;
+        return false;
+    }
+
+    if (vChain.empty() || vChain.back() != hashBest) {
+        // Find the last indexed block still in the best chain
+        int nFork = std::min(TipHeight(), nBestHeight);
+        while (nFork >= nBaseHeight) {
+            boost::this_thread::interruption_point();
+            uint256 hash;
+            if (!backend->GetBlockHash(nFork, hash)) {
+                LOCK(cs);
+                fSynced = false;
+                return false;
+            }
+            if (hash == vChain[nFork - nBaseHeight])
+                break;
+            nFork--;
+        }
+
+        // Fetch the blocks connected since, keeping at most nWindow of them
+        int nFirst = std::max(nFork + 1, nBestHeight - nWindow + 1);
+        std::vector<uint256> vConnected;
+        for (int nHeight = nFirst; nHeight <= nBestHeight; nHeight++) {
+            boost::this_thread::interruption_point();
+            uint256 hash;
+            if (nHeight == nBestHeight) {
+                hash = hashBest;
+            } else if (!backend->GetBlockHash(nHeight, hash)) {
+                LOCK(cs);
+                fSynced = false;
+                return false;
+            }
+            vConnected.push_back(hash);
+        }
+
+        LOCK(cs);
+        if (nFirst > nFork + 1) {
+            // Everything indexed is out of the window (or reorganized away)
+            vChain.clear();
+            mapHeight.clear();
+        } else {
+            while (TipHeight() > nFork) {
+                mapHeight.erase(vChain.back());
+                vChain.pop_back();
+            }
+        }
+        if (vChain.empty())
+            nBaseHeight = nFirst;
+        for (const uint256& hash : vConnected) {
+            mapHeight[hash] = nBaseHeight + (int)vChain.size();
+            vChain.push_back(hash);
+        }
+        size_t nTrim = vChain.size() > (size_t)nWindow ? vChain.size() - nWindow : 0;
+        for (size_t i = 0; i < nTrim; i++)
+            mapHeight.erase(vChain[i]);
+        vChain.erase(vChain.begin(), vChain.begin() + nTrim);
+        nBaseHeight += nTrim;
+    }
+
+    LOCK(cs);
+    if (!fSynced)
+        LogPrint("mainchain", "Mainchain tracker synced at height %d (%s)\n", TipHeight(), hashBest.GetHex());
+    fSynced = true;
+    nLastPoll = GetTime();
+    return true;
+}
+
+bool CMainchainTracker::IsConfirmed(const uint256& hash, int nMinConfirmationDepth)
+{
+    {
+        LOCK(cs);
+        nLookups++;
+        if (fSynced) {
+            std::map<uint256, int>::const_iterator it = mapHeight.find(hash);
+            if (it != mapHeight.end() || (it = mapDeepHeight.find(hash)) != mapDeepHeight.end()) {
+                nHits++;
+                return TipHeight() - it->second + 1 >= nMinConfirmationDepth;
+            }
+        }
+    }
+
+    // Not synced, or the block isn't indexed: ask bitcoind
+    int nHeight, nConfirmations;
+    if (!backend->GetBlockHeader(hash, nHeight, nConfirmations)) {
+        LogPrint("mainchain", "%s: could not look up block %s\n", __func__, hash.GetHex());
+        return false;
+    }
+    if (nConfirmations > 0) {
+        LOCK(cs);
+        if (fSynced && nHeight < nBaseHeight) {
+            if (mapDeepHeight.size() >= MAX_MAINCHAIN_LOOKUP_CACHE)
+                mapDeepHeight.clear();
+            mapDeepHeight[hash] = nHeight;
+        }
+    }
+    return nConfirmations >= nMinConfirmationDepth;
+}
+
+CMainchainTrackerStats CMainchainTracker::GetStats() const
+{
+    LOCK(cs);
+    CMainchainTrackerStats stats;
+    stats.fSynced = fSynced;
+    stats.nTipHeight = vChain.empty() ? -1 : TipHeight();
+    stats.hashTip = vChain.empty() ? uint256() : vChain.back();
+    stats.nIndexed = vChain.size() + mapDeepHeight.size();
+    stats.nLastPoll = nLastPoll;
+    stats.nHits = nHits;
+    stats.nLookups = nLookups;
+    return stats;
+}
+
+void ThreadMainchainTracker(unsigned int nInterval)
+{
+    while (true) {
+        boost::this_thread::interruption_point();
+        g_mainchain_tracker->Poll();
+        MilliSleep(nInterval * 1000);
+    }
+}
@@ -0,0 +1,115 @@
+// Copyright (c) 2017 The Elements Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MAINCHAIN_H
+#define BITCOIN_MAINCHAIN_H
+
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+//! -mainchainpollinterval default, in seconds (0 = query bitcoind for every peg-in)
+static const unsigned int DEFAULT_MAINCHAIN_POLL_INTERVAL = 5;
+//! Number of blocks below the parent chain tip kept in the header index
+static const int MAINCHAIN_TRACKER_WINDOW = 2016;
+//! Maximum number of deeper blocks remembered from individual lookups
+static const size_t MAX_MAINCHAIN_LOOKUP_CACHE = 10000;
+//! Timeout in seconds of the RPC calls made to poll the parent chain, short so that shutdown isn't held up
+static const int MAINCHAIN_POLL_RPC_TIMEOUT = 10;
+
+/** Source of parent chain block hashes. */
+class CMainchainBackend
+{
+public:
+    virtual ~CMainchainBackend() {}
+
+    /** Get the best block of the parent chain. */
+    virtual bool GetBestBlock(uint256& hash, int& nHeight) = 0;
+    /** Get the hash of the block at nHeight in the parent chain's best chain. */
+    virtual bool GetBlockHash(int nHeight, uint256& hash) = 0;
+    /** Get the height and confirmation count (-1 if not in the best chain) of a block. */
+    virtual bool GetBlockHeader(const uint256& hash, int& nHeight, int& nConfirmations) = 0;
+};
+
+/**
+ * Backend querying bitcoind through the -mainchainrpc* connection. The calls
+ * only made by polling time out after MAINCHAIN_POLL_RPC_TIMEOUT, block header
+ * lookups for peg-in validation after -rpcclienttimeout as before.
+ */
+class CMainchainRPCBackend : public CMainchainBackend
+{
+public:
+    bool GetBestBlock(uint256& hash, int& nHeight) override;
+    bool GetBlockHash(int nHeight, uint256& hash) override;
+    bool GetBlockHeader(const uint256& hash, int& nHeight, int& nConfirmations) override;
+};
+
+struct CMainchainTrackerStats
+{
+    bool fSynced;
+    int nTipHeight;
+    uint256 hashTip;
+    size_t nIndexed;
+    int64_t nLastPoll;
+    uint64_t nHits;
+    uint64_t nLookups;
+};
+
+/**
+ * Follows the parent chain's best chain by polling the backend, and keeps the
+ * hashes of its last nWindow blocks indexed by height, so that peg-in depth
+ * checks are answered from memory instead of a blocking RPC call.
+ *
+ * Until the first successful poll, or after a poll failed, the tracker is not
+ * synced and every depth check is passed through to the backend, which is the
+ * behaviour of a node without a tracker. Blocks deeper than the window are
+ * looked up through the backend once and then remembered; reorganizations
+ * deeper than the window are not followed.
+ */
+class CMainchainTracker
+{
+private:
+    mutable CCriticalSection cs;
+    std::unique_ptr<CMainchainBackend> backend;
+    const int nWindow;
+
+    bool fSynced;
+    //! Height of vChain[0]
+    int nBaseHeight;
+    std::vector<uint256> vChain;
+    std::map<uint256, int> mapHeight;
+    //! Blocks below nBaseHeight found in the best chain by GetBlockHeader
+    std::map<uint256, int> mapDeepHeight;
+    int64_t nLastPoll;
+    uint64_t nHits;
+    uint64_t nLookups;
+
+    int TipHeight() const { return nBaseHeight + (int)vChain.size() - 1; }
+
+public:
+    CMainchainTracker(std::unique_ptr<CMainchainBackend> backendIn, int nWindowIn = MAINCHAIN_TRACKER_WINDOW);
+
+    /** Bring the index up to date with the backend's best chain. Returns whether the tracker is synced. */
+    bool Poll();
+
+    /** Whether the block is in the parent chain's best chain with at least nMinConfirmationDepth confirmations. */
+    bool IsConfirmed(const uint256& hash, int nMinConfirmationDepth);
+
+    CMainchainTrackerStats GetStats() const;
+};
+
+/** Created in init when peg-ins are validated and -mainchainpollinterval is non-zero. */
+extern std::unique_ptr<CMainchainTracker> g_mainchain_tracker;
+
+/**
+ * Poll g_mainchain_tracker every nInterval seconds until interrupted; run through TraceThread.
+ * Polling is interrupted between RPC calls, each of which is bounded by MAINCHAIN_POLL_RPC_TIMEOUT.
+ */
+void ThreadMainchainTracker(unsigned int nInterval);
+
+#endif // BITCOIN_MAINCHAIN_H
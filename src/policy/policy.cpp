@@ -8,6 +8,7 @@
 #include "policy/policy.h"
 
 #include "validation.h"
+#include "script/sigcache.h"
 #include "tinyformat.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -95,7 +96,7 @@ bool IsStandardTx(const CTransaction& tx, std::string& reason, const bool witnes
         // Check for valid peg-out proof
         if (whichType == TX_NULL_DATA) {
             if (txout.scriptPubKey.IsPegoutScript(Params().ParentGenesisBlockHash()) &&
-                (!txout.scriptPubKey.HasValidWhitelistPegoutProof(Params().ParentGenesisBlockHash())
+                (!CachingHasValidWhitelistPegoutProof(txout.scriptPubKey, Params().ParentGenesisBlockHash())
                  || !txout.nAsset.IsExplicit() || !txout.nValue.IsExplicit())) {
                 return false;
             }
@@ -123,7 +124,7 @@ bool AreInputsStandard(const CTransaction& tx, const CCoinsViewCache& mapInputs)
             // This deals with p2sh in general only
             continue;
         }
-        const CTxOut& prev = mapInputs.GetOutputFor(tx.vin[i]);
+        const CTxOut& prev = mapInputs.AccessCoin(tx.vin[i].prevout).out;
 
         // Biggest 'standard' txin is a 15-of-15 P2SH multisig with compressed
         // keys. (remember the 520 byte limit on redeemScript size) That works
@@ -172,7 +173,7 @@ bool IsWitnessStandard(const CTransaction& tx, const CCoinsViewCache& mapInputs)
         if (tx.wit.vtxinwit.size() <= i || tx.wit.vtxinwit[i].scriptWitness.IsNull())
             continue;
 
-        const CTxOut &prev = tx.vin[i].m_is_pegin ? GetPeginOutputFromWitness(tx.wit.vtxinwit[i].m_pegin_witness) :  mapInputs.GetOutputFor(tx.vin[i]);
+        const CTxOut &prev = tx.vin[i].m_is_pegin ? GetPeginOutputFromWitness(tx.wit.vtxinwit[i].m_pegin_witness) :  mapInputs.AccessCoin(tx.vin[i].prevout).out;
 
         // get the scriptPubKey corresponding to this input:
         CScript prevScript = prev.scriptPubKey;
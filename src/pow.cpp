@@ -9,13 +9,24 @@
 #include "chain.h"
 #include "chainparams.h"
 #include "core_io.h"
+#include "crypto/common.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "hash.h"
 #include "keystore.h"
 #include "primitives/block.h"
 #include "primitives/bitcoin/block.h"
+#include "random.h"
 #include "script/generic.hpp"
+#include "script/sigcache.h"
 #include "script/standard.h"
+#include "sync.h"
 #include "uint256.h"
+#include "util.h"
+
+#include <memory>
+
+#include <boost/thread.hpp>
 
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
@@ -30,12 +41,12 @@ CScript CombineBlockSignatures(const CBlockHeader& header, const CScript& script
 
 bool CheckChallenge(const CBlockHeader& block, const CBlockIndex& indexLast, const Consensus::Params& params)
 {
-    return block.proof.challenge == indexLast.proof.challenge;
+    return block.proof.challenge == *indexLast.pchallenge;
 }
 
 void ResetChallenge(CBlockHeader& block, const CBlockIndex& indexLast, const Consensus::Params& params)
 {
-    block.proof.challenge = indexLast.proof.challenge;
+    block.proof.challenge = *indexLast.pchallenge;
 }
 
 bool CheckBitcoinProof(uint256 hash, unsigned int nBits)
@@ -57,32 +68,198 @@ bool CheckBitcoinProof(uint256 hash, unsigned int nBits)
     return true;
 }
 
+namespace {
+
+// Some important anti-DoS flags.
+// Note: Blockhashes do not commit to the proof.
+// Therefore we may have a signature be mealleated
+// to stay valid, but cause the block to fail
+// validation, in this case, block weight.
+// In that case, the block will be marked as permanently
+// invalid and not processed.
+// NOTE: These have only been deemed sufficient for OP_CMS
+// ANY OTHER SCRIPT TYPE MAY REQUIRE DIFFERENT FLAGS/CONSIDERATIONS
+// TODO: Better design to not have to worry about script specifics
+// i.e. Keep track of blocks by witness block hash.
+static const unsigned int PROOF_FLAGS = SCRIPT_VERIFY_P2SH // Just allows P2SH evaluation
+    | SCRIPT_VERIFY_STRICTENC // Minimally-sized DER sigs
+    | SCRIPT_VERIFY_NULLDUMMY // No extra data stuffed into OP_CMS witness
+    | SCRIPT_VERIFY_CLEANSTACK // No extra pushes leftover in witness
+    | SCRIPT_VERIFY_MINIMALDATA // Pushes are minimally-sized
+    | SCRIPT_VERIFY_SIGPUSHONLY // Witness is push-only
+    | SCRIPT_VERIFY_LOW_S // Stop easiest signature fiddling
+    | SCRIPT_VERIFY_WITNESS // Required for cleanstack eval in VerifyScript
+    | SCRIPT_NO_SIGHASH_BYTE; // non-Check(Multi)Sig signatures will not have sighash byte
+
+/**
+ * Valid block proofs, so that a header is verified once no matter how often
+ * it is checked again on the way from header sync to block connection.
+ * Entries are SHA256(nonce || block hash || challenge || solution), as the
+ * block hash does not commit to the solution.
+ */
+class CBlockProofCache
+{
+private:
+    uint256 nonce;
+    CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
+    boost::shared_mutex cs_blockproofcache;
+
+public:
+    CBlockProofCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const uint256& hash, const CProof& proof)
+    {
+        unsigned char n[4];
+        CSHA256 hasher;
+        hasher.Write(nonce.begin(), 32).Write(hash.begin(), 32);
+        WriteLE32(n, proof.challenge.size());
+        hasher.Write(n, 4).Write(proof.challenge.data(), proof.challenge.size());
+        hasher.Write(proof.solution.data(), proof.solution.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_blockproofcache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_blockproofcache);
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+};
+
+CBlockProofCache blockProofCache;
+
+/**
+ * A challenge parsed as the m-of-n CHECKMULTISIG template signblockscript
+ * uses. fValid is only set if the script matches the template with minimal
+ * pushes and every key is encoded as STRICTENC requires, so that the
+ * interpreter would reach the signature checks.
+ */
+struct CMultisigChallenge
+{
+    CScript script;
+    bool fValid;
+    unsigned int nRequired;
+    std::vector<CPubKey> vKeys;
+
+    explicit CMultisigChallenge(const CScript& scriptIn) : script(scriptIn), fValid(false), nRequired(0)
+    {
+        txnouttype type;
+        std::vector<std::vector<unsigned char> > vSolutions;
+        if (!Solver(script, type, vSolutions) || type != TX_MULTISIG)
+            return;
+
+        CScript::const_iterator pc = script.begin();
+        opcodetype opcode;
+        std::vector<unsigned char> vch;
+        while (pc < script.end()) {
+            if (!script.GetOp(pc, opcode, vch))
+                return;
+            if (opcode <= OP_PUSHDATA4 && !CheckMinimalPush(vch, opcode))
+                return;
+        }
+
+        for (size_t i = 1; i + 1 < vSolutions.size(); i++) {
+            const std::vector<unsigned char>& vchPubKey = vSolutions[i];
+            if (!(vchPubKey.size() == 33 && (vchPubKey[0] == 0x02 || vchPubKey[0] == 0x03)) &&
+                !(vchPubKey.size() == 65 && vchPubKey[0] == 0x04))
+                return;
+            vKeys.push_back(CPubKey(vchPubKey));
+        }
+        nRequired = vSolutions.front()[0];
+        fValid = true;
+    }
+};
+
+// The challenge rarely changes, so only the last one seen is kept parsed
+CCriticalSection cs_multisigchallenge;
+std::shared_ptr<const CMultisigChallenge> multisigChallenge;
+
+std::shared_ptr<const CMultisigChallenge> GetMultisigChallenge(const CScript& challenge)
+{
+    LOCK(cs_multisigchallenge);
+    if (!multisigChallenge || multisigChallenge->script != challenge) {
+        multisigChallenge = std::make_shared<const CMultisigChallenge>(challenge);
+    }
+    return multisigChallenge;
+}
+
+/**
+ * Verify a solution to a multisig challenge without the script interpreter.
+ * Only accepts a null dummy followed by exactly nRequired minimally pushed,
+ * strictly encoded signatures, paired with the keys in the same order as
+ * CHECKMULTISIG pairs them, so anything it accepts the interpreter accepts.
+ * A false result means the interpreter has to decide.
+ */
+bool VerifyMultisigProof(const CMultisigChallenge& challenge, const CScript& solution, const uint256& hash)
+{
+    std::vector<std::vector<unsigned char> > vSigs;
+    CScript::const_iterator pc = solution.begin();
+    opcodetype opcode;
+    std::vector<unsigned char> vch;
+    if (!solution.GetOp(pc, opcode, vch) || opcode != OP_0)
+        return false;
+    while (pc < solution.end()) {
+        if (!solution.GetOp(pc, opcode, vch) || opcode > OP_PUSHDATA4 || !CheckMinimalPush(vch, opcode))
+            return false;
+        if (vch.empty() || !CheckSignatureEncoding(vch, PROOF_FLAGS, NULL))
+            return false;
+        vSigs.push_back(vch);
+    }
+    if (vSigs.size() != challenge.nRequired)
+        return false;
+
+    // CHECKMULTISIG starts from the last signature and the last key
+    size_t nSigs = vSigs.size();
+    size_t nKeys = challenge.vKeys.size();
+    while (nSigs > 0) {
+        if (nSigs > nKeys)
+            return false;
+        if (CachingVerifySignature(vSigs[nSigs - 1], challenge.vKeys[nKeys - 1], hash, true))
+            nSigs--;
+        nKeys--;
+    }
+    return true;
+}
+
+} // namespace
+
+void InitBlockProofCache()
+{
+    size_t nElems = blockProofCache.setup_bytes(BLOCK_PROOF_CACHE_BYTES);
+    LogPrintf("Using %zu KiB for block proof cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >> 10, nElems);
+}
+
 bool CheckProof(const CBlockHeader& block, const Consensus::Params& params)
 {
-    if (block.GetHash() == params.hashGenesisBlock)
+    const uint256 hash = block.GetHash();
+    if (hash == params.hashGenesisBlock)
        return true;
 
-    // Some important anti-DoS flags.
-    // Note: Blockhashes do not commit to the proof.
-    // Therefore we may have a signature be mealleated
-    // to stay valid, but cause the block to fail
-    // validation, in this case, block weight.
-    // In that case, the block will be marked as permanently
-    // invalid and not processed.
-    // NOTE: These have only been deemed sufficient for OP_CMS
-    // ANY OTHER SCRIPT TYPE MAY REQUIRE DIFFERENT FLAGS/CONSIDERATIONS
-    // TODO: Better design to not have to worry about script specifics
-    // i.e. Keep track of blocks by witness block hash.
-    unsigned int proof_flags = SCRIPT_VERIFY_P2SH // Just allows P2SH evaluation
-        | SCRIPT_VERIFY_STRICTENC // Minimally-sized DER sigs
-        | SCRIPT_VERIFY_NULLDUMMY // No extra data stuffed into OP_CMS witness
-        | SCRIPT_VERIFY_CLEANSTACK // No extra pushes leftover in witness
-        | SCRIPT_VERIFY_MINIMALDATA // Pushes are minimally-sized
-        | SCRIPT_VERIFY_SIGPUSHONLY // Witness is push-only
-        | SCRIPT_VERIFY_LOW_S // Stop easiest signature fiddling
-        | SCRIPT_VERIFY_WITNESS // Required for cleanstack eval in VerifyScript
-        | SCRIPT_NO_SIGHASH_BYTE; // non-Check(Multi)Sig signatures will not have sighash byte
-    return GenericVerifyScript(block.proof.solution, block.proof.challenge, proof_flags, block);
+    uint256 entry;
+    blockProofCache.ComputeEntry(entry, hash, block.proof);
+    if (blockProofCache.Get(entry))
+        return true;
+
+    std::shared_ptr<const CMultisigChallenge> multisig = GetMultisigChallenge(block.proof.challenge);
+    if (!(multisig->fValid && VerifyMultisigProof(*multisig, block.proof.solution, hash)) &&
+        !GenericVerifyScript(block.proof.solution, block.proof.challenge, PROOF_FLAGS, block))
+        return false;
+
+    blockProofCache.Set(entry);
+    return true;
 }
 
 bool MaybeGenerateProof(CBlockHeader *pblock, CWallet *pwallet)
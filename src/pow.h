@@ -19,9 +19,15 @@ class CScript;
 class CWallet;
 class uint256;
 
+/** Size of the cache of verified block proofs (4 MiB, about 130k headers) */
+static const size_t BLOCK_PROOF_CACHE_BYTES = 4 << 20;
+
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckBitcoinProof(uint256 hash, unsigned int nBits);
+/** Check the signed block proof, consulting and filling the block proof cache */
 bool CheckProof(const CBlockHeader& block, const Consensus::Params&);
+/** To be called once at startup, before any CheckProof() */
+void InitBlockProofCache();
 void ResetProof(CBlockHeader& block);
 bool CheckChallenge(const CBlockHeader& block, const CBlockIndex& indexLast, const Consensus::Params&);
 void ResetChallenge(CBlockHeader& block, const CBlockIndex& indexLast, const Consensus::Params&);
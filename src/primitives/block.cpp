@@ -88,6 +88,19 @@ void CPAKList::CreateCommitments(std::vector<CScript> &commitments) const
     }
 }
 
+void CPAKList::UpdateHash()
+{
+    // The keys are hashed in the parsed form they are verified in. That form
+    // is only stable within this process, which is all the caches need.
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << reject;
+    for (unsigned int i = 0; i < m_offline_keys.size(); i++) {
+        ss.write((const char*)m_offline_keys[i].data, sizeof(m_offline_keys[i].data));
+        ss.write((const char*)m_online_keys[i].data, sizeof(m_online_keys[i].data));
+    }
+    m_hash = ss.GetHash();
+}
+
 bool CPAKList::operator==(const CPAKList &other) const
 {
     if (this->reject != other.reject) {
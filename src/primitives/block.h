@@ -18,13 +18,17 @@ private:
     std::vector<secp256k1_pubkey> m_offline_keys;
     std::vector<secp256k1_pubkey> m_online_keys;
     bool reject;
+    //! Identifies the list, so that results verified against it can be cached
+    uint256 m_hash;
 
+    void UpdateHash();
     std::vector<CScript> GenerateCoinbasePAKCommitments() const;
     CScript GenerateCoinbasePAKReject() const;
 
 public:
     CPAKList()
     {
+        // No proof is valid against a reject list, so its hash is never used
         reject = true;
     }
     /**
@@ -35,6 +39,7 @@ public:
         m_offline_keys(offline_keys), m_online_keys(online_keys), reject(reject) {
             assert(m_offline_keys.size() == m_online_keys.size());
             assert(m_offline_keys.size() <= SECP256K1_WHITELIST_MAX_N_KEYS);
+            UpdateHash();
        }
 
     bool operator==(const CPAKList &other) const;
@@ -50,14 +55,18 @@ public:
     {
         return !reject && this->size() == 0;
     }
-    std::vector<secp256k1_pubkey> OnlineKeys() const
+    const std::vector<secp256k1_pubkey>& OnlineKeys() const
     {
         return m_online_keys;
     }
-    std::vector<secp256k1_pubkey> OfflineKeys() const
+    const std::vector<secp256k1_pubkey>& OfflineKeys() const
     {
         return m_offline_keys;
     }
+    const uint256& GetHash() const
+    {
+        return m_hash;
+    }
     size_t size() const
     {
         return m_offline_keys.size();
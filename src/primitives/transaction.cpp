@@ -170,7 +170,7 @@ uint256 CTransaction::ComputeWitnessHash() const
     return ComputeFastMerkleRoot(leaves);
 }
 
-bool CTransaction::HasValidFee() const
+bool CTransaction::ComputeHasValidFee() const
 {
     CAmountMap totalFee;
     for (unsigned int i = 0; i < vout.size(); i++) {
@@ -179,15 +179,22 @@ bool CTransaction::HasValidFee() const
             fee = vout[i].nValue.GetAmount();
             if (fee == 0 || !MoneyRange(fee))
                 return false;
-            totalFee[vout[i].nAsset.GetAsset()] += fee;
+            // Both terms are in range, so the sum cannot overflow before it is checked
+            CAmount& total = totalFee[vout[i].nAsset.GetAsset()];
+            total += fee;
+            if (!MoneyRange(total))
+                return false;
         }
     }
-    return MoneyRange(totalFee);
+    return true;
 }
 
-CAmountMap CTransaction::GetFee() const
+CAmountMap CTransaction::ComputeFee() const
 {
+    // Only sum fees that passed ComputeHasValidFee, which also rules out overflow
     CAmountMap fee;
+    if (!fValidFee)
+        return fee;
     for (unsigned int i = 0; i < vout.size(); i++)
         if (vout[i].IsFee()) {
             fee[vout[i].nAsset.GetAsset()] += vout[i].nValue.GetAmount();
@@ -196,9 +203,9 @@ CAmountMap CTransaction::GetFee() const
 }
 
 /* For backward compatibility, the hash is initialized to 0. TODO: remove the need for this default constructor entirely. */
-CTransaction::CTransaction() : nVersion(CTransaction::CURRENT_VERSION), vin(), vout(), wit(), nLockTime(0), hash() {}
-CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion), vin(tx.vin), vout(tx.vout), wit(tx.wit), nLockTime(tx.nLockTime), hash(ComputeHash()) {}
-CTransaction::CTransaction(CMutableTransaction &&tx) : nVersion(tx.nVersion), vin(std::move(tx.vin)), vout(std::move(tx.vout)), wit(tx.wit), nLockTime(tx.nLockTime), hash(ComputeHash()) {}
+CTransaction::CTransaction() : nVersion(CTransaction::CURRENT_VERSION), vin(), vout(), wit(), nLockTime(0), hash(), fValidFee(true), mapFee() {}
+CTransaction::CTransaction(const CMutableTransaction &tx) : nVersion(tx.nVersion), vin(tx.vin), vout(tx.vout), wit(tx.wit), nLockTime(tx.nLockTime), hash(ComputeHash()), fValidFee(ComputeHasValidFee()), mapFee(ComputeFee()) {}
+CTransaction::CTransaction(CMutableTransaction &&tx) : nVersion(tx.nVersion), vin(std::move(tx.vin)), vout(std::move(tx.vout)), wit(tx.wit), nLockTime(tx.nLockTime), hash(ComputeHash()), fValidFee(ComputeHasValidFee()), mapFee(ComputeFee()) {}
 
 double CTransaction::ComputePriority(double dPriorityInputs, unsigned int nTxSize) const
 {
@@ -715,8 +715,13 @@ public:
 private:
     /** Memory only. */
     const uint256 hash;
+    const bool fValidFee;
+    //! Empty if the fee is not valid. Declared after fValidFee, which ComputeFee reads.
+    const CAmountMap mapFee;
 
     uint256 ComputeHash() const;
+    CAmountMap ComputeFee() const;
+    bool ComputeHasValidFee() const;
 
 public:
     /** Construct a CTransaction that qualifies as IsNull() */
@@ -751,10 +756,20 @@ public:
     uint256 ComputeWitnessHash() const;
 
     // Check if explicit TX fees overflow or are negative
-    bool HasValidFee() const;
+    bool HasValidFee() const {
+        return fValidFee;
+    }
+
+    // The fee from the explicit fee outputs, empty unless HasValidFee
+    const CAmountMap& GetFee() const {
+        return mapFee;
+    }
 
-    // Compute the fee from the explicit fee outputs. Must call HasValidFee first
-    CAmountMap GetFee() const;
+    // The fee paid in a single asset, zero if none
+    CAmount GetFee(const CAsset& asset) const {
+        CAmountMap::const_iterator it = mapFee.find(asset);
+        return it == mapFee.end() ? 0 : it->second;
+    }
 
     // Compute priority, given priority of inputs and (optionally) tx size
     double ComputePriority(double dPriorityInputs, unsigned int nTxSize=0) const;
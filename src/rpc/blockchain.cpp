@@ -10,6 +10,7 @@
 #include "coins.h"
 #include "consensus/validation.h"
 #include "core_io.h"
+#include "mainchain.h"
 #include "validation.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
@@ -17,7 +18,9 @@
 #include "pow.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
+#include "txprevalidation.h"
 #include "util.h"
 #include "utiltime.h"
 #include "utilstrencodings.h"
@@ -49,6 +52,10 @@ void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fInclud
 
 UniValue blockheaderToJSON(const CBlockIndex* blockindex)
 {
+    CBlockHeader header;
+    if (!ReadBlockHeader(header, blockindex))
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Can't read block header from disk");
+
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
@@ -62,8 +69,8 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     result.push_back(Pair("merkleroot", blockindex->hashMerkleRoot.GetHex()));
     result.push_back(Pair("time", (int64_t)blockindex->nTime));
     result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
-    result.push_back(Pair("signblock_witness_asm", ScriptToAsmStr(blockindex->proof.solution)));
-    result.push_back(Pair("signblock_witness_hex", HexStr(blockindex->proof.solution.begin(), blockindex->proof.solution.end())));
+    result.push_back(Pair("signblock_witness_asm", ScriptToAsmStr(header.proof.solution)));
+    result.push_back(Pair("signblock_witness_hex", HexStr(header.proof.solution.begin(), header.proof.solution.end())));
 
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
@@ -104,8 +111,8 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("tx", txs));
     result.push_back(Pair("time", block.GetBlockTime()));
     result.push_back(Pair("mediantime", (int64_t)blockindex->GetMedianTimePast()));
-    result.push_back(Pair("signblock_witness_asm", ScriptToAsmStr(blockindex->proof.solution)));
-    result.push_back(Pair("signblock_witness_hex", HexStr(blockindex->proof.solution.begin(), blockindex->proof.solution.end())));
+    result.push_back(Pair("signblock_witness_asm", ScriptToAsmStr(block.proof.solution)));
+    result.push_back(Pair("signblock_witness_hex", HexStr(block.proof.solution.begin(), block.proof.solution.end())));
 
     if (blockindex->pprev)
         result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
@@ -633,8 +640,11 @@ UniValue getblockheader(const JSONRPCRequest& request)
 
     if (!fVerbose)
     {
+        CBlockHeader header;
+        if (!ReadBlockHeader(header, pblockindex))
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Can't read block header from disk");
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
-        ssBlock << pblockindex->GetBlockHeader();
+        ssBlock << header;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
@@ -753,6 +763,20 @@ struct CCoinsStats
     CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {}
 };
 
+static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    ss << hash;
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out;
+        stats.nTransactionOutputs++;
+        if (output.second.out.nValue.IsExplicit())
+            stats.nTotalAmount += output.second.out.nValue.GetAmount();
+    }
+    ss << VARINT(0);
+}
+
 //! Calculate statistics about the unspent transaction output set
 static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
 {
@@ -765,33 +789,32 @@ static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
         stats.nHeight = mapBlockIndex.find(stats.hashBlock)->second->nHeight;
     }
     ss << stats.hashBlock;
-    CAmount nTotalAmount = 0;
+    // Outputs are hashed grouped by transaction, as when they were stored that way
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
     while (pcursor->Valid()) {
         boost::this_thread::interruption_point();
-        uint256 key;
-        CCoins coins;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coins)) {
-            stats.nTransactions++;
-            ss << key;
-            for (unsigned int i=0; i<coins.vout.size(); i++) {
-                const CTxOut &out = coins.vout[i];
-                if (!out.IsNull()) {
-                    stats.nTransactionOutputs++;
-                    ss << VARINT(i+1);
-                    ss << out;
-                    if (out.nValue.IsExplicit())
-                        nTotalAmount += out.nValue.GetAmount();
-                }
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (!outputs.empty() && key.hash != prevkey) {
+                ApplyStats(stats, ss, prevkey, outputs);
+                outputs.clear();
             }
+            if (outputs.empty())
+                stats.nTransactions++;
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
             stats.nSerializedSize += 32 + pcursor->GetValueSize();
-            ss << VARINT(0);
         } else {
             return error("%s: unable to read value", __func__);
         }
         pcursor->Next();
     }
+    if (!outputs.empty()) {
+        ApplyStats(stats, ss, prevkey, outputs);
+    }
     stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
     return true;
 }
 
@@ -859,6 +882,9 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
             "  \"txouts\": n,            (numeric) The number of output transactions\n"
             "  \"bytes_serialized\": n,  (numeric) The serialized size\n"
             "  \"hash_serialized\": \"hash\",   (string) The serialized hash\n"
+            "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
+            "  \"cache_hits\": n,        (numeric) Coin lookups answered by the coins cache since startup\n"
+            "  \"cache_misses\": n,      (numeric) Coin lookups the coins cache passed on to the database since startup\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("gettxoutsetinfo", "")
@@ -876,6 +902,10 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
         ret.push_back(Pair("txouts", (int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bytes_serialized", (int64_t)stats.nSerializedSize));
         ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        LOCK(cs_main);
+        ret.push_back(Pair("disk_size", (uint64_t)pcoinsTip->EstimateSize()));
+        ret.push_back(Pair("cache_hits", pcoinsTip->GetCacheHits()));
+        ret.push_back(Pair("cache_misses", pcoinsTip->GetCacheMisses()));
     } else {
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read UTXO set");
     }
@@ -910,7 +940,6 @@ UniValue gettxout(const JSONRPCRequest& request)
             "        ,...\n"
             "     ]\n"
             "  },\n"
-            "  \"version\" : n,            (numeric) The version\n"
             "  \"coinbase\" : true|false   (boolean) Coinbase or not\n"
             "}\n"
 
@@ -934,43 +963,43 @@ UniValue gettxout(const JSONRPCRequest& request)
     if (request.params.size() > 2)
         fMempool = request.params[2].get_bool();
 
-    CCoins coins;
+    COutPoint out(hash, n);
+
+    Coin coin;
     if (fMempool) {
         LOCK(mempool.cs);
         CCoinsViewMemPool view(pcoinsTip, mempool);
-        if (!view.GetCoins(hash, coins))
+        if (!view.GetCoin(out, coin) || mempool.isSpent(out)) { // TODO: filtering spent coins should be done by the CCoinsViewMemPool
             return NullUniValue;
-        mempool.pruneSpent(hash, coins); // TODO: this should be done by the CCoinsViewMemPool
+        }
     } else {
-        if (!pcoinsTip->GetCoins(hash, coins))
+        if (!pcoinsTip->GetCoin(out, coin)) {
             return NullUniValue;
+        }
     }
-    if (n<0 || (unsigned int)n>=coins.vout.size() || coins.vout[n].IsNull())
-        return NullUniValue;
 
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     CBlockIndex *pindex = it->second;
     ret.push_back(Pair("bestblock", pindex->GetBlockHash().GetHex()));
-    if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+    if (coin.nHeight == MEMPOOL_HEIGHT)
         ret.push_back(Pair("confirmations", 0));
     else
-        ret.push_back(Pair("confirmations", pindex->nHeight - coins.nHeight + 1));
-    if (coins.vout[n].nValue.IsExplicit()) {
-        ret.push_back(Pair("value", ValueFromAmount(coins.vout[n].nValue.GetAmount())));
+        ret.push_back(Pair("confirmations", (int64_t)(pindex->nHeight - coin.nHeight + 1)));
+    if (coin.out.nValue.IsExplicit()) {
+        ret.push_back(Pair("value", ValueFromAmount(coin.out.nValue.GetAmount())));
     } else {
-        ret.push_back(Pair("amountcommitment", HexStr(coins.vout[n].nValue.vchCommitment)));
+        ret.push_back(Pair("amountcommitment", HexStr(coin.out.nValue.vchCommitment)));
     }
-    if (coins.vout[n].nAsset.IsExplicit()) {
-        ret.push_back(Pair("asset", coins.vout[n].nAsset.GetAsset().GetHex()));
+    if (coin.out.nAsset.IsExplicit()) {
+        ret.push_back(Pair("asset", coin.out.nAsset.GetAsset().GetHex()));
     } else {
-        ret.push_back(Pair("assetcommitment", HexStr(coins.vout[n].nAsset.vchCommitment)));
+        ret.push_back(Pair("assetcommitment", HexStr(coin.out.nAsset.vchCommitment)));
     }
 
     UniValue o(UniValue::VOBJ);
-    ScriptPubKeyToJSON(coins.vout[n].scriptPubKey, o, true);
+    ScriptPubKeyToJSON(coin.out.scriptPubKey, o, true);
     ret.push_back(Pair("scriptPubKey", o));
-    ret.push_back(Pair("version", coins.nVersion));
-    ret.push_back(Pair("coinbase", coins.fCoinBase));
+    ret.push_back(Pair("coinbase", (bool)coin.fCoinBase));
 
     return ret;
 }
@@ -1078,8 +1107,8 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
     obj.push_back(Pair("mediantime",            (int64_t)tip->GetMedianTimePast()));
     obj.push_back(Pair("verificationprogress",  GuessVerificationProgress(tip, Params().GetConsensus().nPowTargetSpacing)));
     obj.push_back(Pair("pruned",                fPruneMode));
-    obj.push_back(Pair("signblock_asm", ScriptToAsmStr(tip->proof.challenge)));
-    obj.push_back(Pair("signblock_hex", HexStr(tip->proof.challenge.begin(), tip->proof.challenge.end())));
+    obj.push_back(Pair("signblock_asm", ScriptToAsmStr(*tip->pchallenge)));
+    obj.push_back(Pair("signblock_hex", HexStr(tip->pchallenge->begin(), tip->pchallenge->end())));
     obj.push_back(Pair("initialblockdownload",  IsInitialBlockDownload()));
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -1130,6 +1159,80 @@ UniValue getsidechaininfo(const JSONRPCRequest& request)
     return obj;
 }
 
+UniValue getpegininfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getpegininfo\n"
+            "Returns an object containing information about claimed peg-ins and the index used to look them up.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"claims\": n,            (numeric) Peg-ins claimed in the chainstate database, not counting unflushed blocks\n"
+            "  \"mempool_claims\": n,    (numeric) Peg-ins claimed by transactions in the mempool\n"
+            "  \"filter_capacity\": n,   (numeric) Claims the in-memory claim filter holds before it is rebuilt\n"
+            "  \"lookups\": n,           (numeric) Claim lookups that reached the chainstate database since startup\n"
+            "  \"filtered\": n,          (numeric) Lookups answered by the claim filter without reading the disk\n"
+            "  \"disk_reads\": n,        (numeric) Lookups the claim filter passed on to the disk\n"
+            "  \"false_positives\": n,   (numeric) Disk reads that found no claim\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getpegininfo", "")
+            + HelpExampleRpc("getpegininfo", "")
+        );
+
+    LOCK2(cs_main, mempool.cs);
+
+    CPeginClaimStats stats;
+    pcoinsdbview->GetPeginClaimStats(stats);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("claims", stats.nClaims));
+    obj.push_back(Pair("mempool_claims", (uint64_t)mempool.mapWithdrawsSpentToTxid.size()));
+    obj.push_back(Pair("filter_capacity", (uint64_t)stats.nFilterCapacity));
+    obj.push_back(Pair("lookups", stats.nLookups));
+    obj.push_back(Pair("filtered", stats.nLookups - stats.nReads));
+    obj.push_back(Pair("disk_reads", stats.nReads));
+    obj.push_back(Pair("false_positives", stats.nFalsePositives));
+    return obj;
+}
+
+UniValue getmainchaintrackerinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getmainchaintrackerinfo\n"
+            "Returns an object containing information about the in-memory index of the parent chain used for peg-in depth checks.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,   (boolean) Whether the parent chain is tracked, see -mainchainpollinterval\n"
+            "  \"synced\": true|false,    (boolean) Whether the last poll of the parent chain succeeded\n"
+            "  \"height\": n,             (numeric) Height of the tracked parent chain tip, -1 if none\n"
+            "  \"bestblockhash\": \"hash\", (string) Hash of the tracked parent chain tip\n"
+            "  \"indexed\": n,            (numeric) Parent chain blocks held in memory\n"
+            "  \"lastpoll\": n,           (numeric) Time of the last successful poll in seconds since epoch (Jan 1 1970 GMT), 0 if none\n"
+            "  \"lookups\": n,            (numeric) Peg-in depth checks since startup\n"
+            "  \"hits\": n,               (numeric) Depth checks answered from memory without calling bitcoind\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getmainchaintrackerinfo", "")
+            + HelpExampleRpc("getmainchaintrackerinfo", "")
+        );
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("enabled", g_mainchain_tracker != nullptr));
+    if (!g_mainchain_tracker)
+        return obj;
+
+    CMainchainTrackerStats stats = g_mainchain_tracker->GetStats();
+    obj.push_back(Pair("synced", stats.fSynced));
+    obj.push_back(Pair("height", stats.nTipHeight));
+    obj.push_back(Pair("bestblockhash", stats.hashTip.GetHex()));
+    obj.push_back(Pair("indexed", (uint64_t)stats.nIndexed));
+    obj.push_back(Pair("lastpoll", stats.nLastPoll));
+    obj.push_back(Pair("lookups", stats.nLookups));
+    obj.push_back(Pair("hits", stats.nHits));
+    return obj;
+}
 
 /** Comparison function for sorting the getchaintips heads.  */
 struct CompareBlocksByHeight
@@ -1259,6 +1362,21 @@ UniValue mempoolInfoToJSON()
     ret.push_back(Pair("maxmempool", (int64_t) maxmempool));
     ret.push_back(Pair("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK())));
 
+    if (g_txprevalidation) {
+        CTxPreValidationStats stats = g_txprevalidation->GetStats();
+        UniValue prevalidation(UniValue::VOBJ);
+        prevalidation.push_back(Pair("queued", (uint64_t) stats.nQueued));
+        prevalidation.push_back(Pair("running", (uint64_t) stats.nRunning));
+        prevalidation.push_back(Pair("done", stats.nDone));
+        prevalidation.push_back(Pair("valid", stats.nValid));
+        prevalidation.push_back(Pair("queuefull", stats.nRejectedFull));
+        prevalidation.push_back(Pair("avgwait", stats.nDone ? 0.001 * stats.nTimeWait / stats.nDone : 0.0));
+        prevalidation.push_back(Pair("avgverify", stats.nDone ? 0.001 * stats.nTimeVerify / stats.nDone : 0.0));
+        prevalidation.push_back(Pair("committed", stats.nCommitted));
+        prevalidation.push_back(Pair("avgcommit", stats.nCommitted ? 0.001 * stats.nTimeCommit / stats.nCommitted : 0.0));
+        ret.push_back(Pair("prevalidation", prevalidation));
+    }
+
     return ret;
 }
 
@@ -1274,7 +1392,18 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
             "  \"bytes\": xxxxx,              (numeric) Sum of all virtual transaction sizes as defined in BIP 141. Differs from actual serialized size because witness data is discounted\n"
             "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
-            "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to be accepted\n"
+            "  \"mempoolminfee\": xxxxx,      (numeric) Minimum fee for tx to be accepted\n"
+            "  \"prevalidation\": {           (json object) Received transactions verified ahead of mempool acceptance, if -txprevalidationthreads is non-zero\n"
+            "    \"queued\": xxxxx,             (numeric) Transactions waiting for a pre-validation thread\n"
+            "    \"running\": xxxxx,            (numeric) Transactions being pre-validated\n"
+            "    \"done\": xxxxx,               (numeric) Transactions pre-validated since startup\n"
+            "    \"valid\": xxxxx,              (numeric) How many of them passed\n"
+            "    \"queuefull\": xxxxx,          (numeric) Transactions verified on the message handler thread because the queue was full\n"
+            "    \"avgwait\": x.xxx,            (numeric) Average time spent waiting for a thread, in milliseconds\n"
+            "    \"avgverify\": x.xxx,          (numeric) Average pre-validation time, in milliseconds\n"
+            "    \"committed\": xxxxx,          (numeric) Transactions through the final stage under the chainstate lock\n"
+            "    \"avgcommit\": x.xxx           (numeric) Average final stage time, in milliseconds\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
@@ -1700,10 +1829,12 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
+    { "blockchain",         "getmainchaintrackerinfo", &getmainchaintrackerinfo, true, {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,  {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
+    { "blockchain",         "getpegininfo",           &getpegininfo,           true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "getsidechaininfo",       &getsidechaininfo,       true,  {} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
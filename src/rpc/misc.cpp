@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "blind.h"
 #include "clientversion.h"
 #include "init.h"
 #include "validation.h"
@@ -542,6 +543,26 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCAssetGeneratorCacheInfo()
+{
+    AssetGeneratorCacheStats stats = GetAssetGeneratorCacheStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("entries", uint64_t(stats.entries)));
+    obj.push_back(Pair("capacity", uint64_t(stats.capacity)));
+    obj.push_back(Pair("hits", stats.hits));
+    obj.push_back(Pair("misses", stats.misses));
+    return obj;
+}
+
+static UniValue RPCBlockIndexInfo()
+{
+    LOCK(cs_main);
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("entries", uint64_t(mapBlockIndex.size())));
+    obj.push_back(Pair("usage", uint64_t(BlockIndexDynamicUsage())));
+    return obj;
+}
+
 UniValue getmemoryinfo(const JSONRPCRequest& request)
 {
     /* Please, avoid using the word "pool" here in the RPC interface or help,
@@ -560,6 +581,16 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"assetgenerators\": {      (json object) Information about the explicit asset generator cache\n"
+            "    \"entries\": xxxxx,       (numeric) Number of cached generators\n"
+            "    \"capacity\": xxxxx,      (numeric) Maximum number of cached generators\n"
+            "    \"hits\": xxxxx,          (numeric) Number of lookups served from the cache\n"
+            "    \"misses\": xxxxx,        (numeric) Number of lookups that had to compute the generator\n"
+            "  },\n"
+            "  \"blockindex\": {           (json object) Information about the in-memory block index\n"
+            "    \"entries\": xxxxx,       (numeric) Number of block index entries\n"
+            "    \"usage\": xxxxx,         (numeric) Estimated number of bytes used by the block index\n"
             "  }\n"
             "}\n"
             "\nExamples:\n"
@@ -568,6 +599,8 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
         );
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+    obj.push_back(Pair("assetgenerators", RPCAssetGeneratorCacheInfo()));
+    obj.push_back(Pair("blockindex", RPCBlockIndexInfo()));
     return obj;
 }
 
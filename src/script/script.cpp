@@ -338,14 +338,12 @@ static CSecp256k1Init instance_of_csecp256k1_ver;
 // in multiple pushes: <full_pubkey> <proof>
 bool CScript::HasValidWhitelistPegoutProof(const uint256& genesis_hash) const
 {
-    assert(IsPegoutScript(genesis_hash));
+    return HasValidWhitelistPegoutProof(genesis_hash, g_paklist_config ? *g_paklist_config : g_paklist_blockchain);
+}
 
-    CPAKList paklist;
-    if (g_paklist_config) {
-        paklist = *g_paklist_config;
-    } else {
-        paklist = g_paklist_blockchain;
-    }
+bool CScript::HasValidWhitelistPegoutProof(const uint256& genesis_hash, const CPAKList& paklist) const
+{
+    assert(IsPegoutScript(genesis_hash));
 
     if (paklist.IsReject() || paklist.IsEmpty()) {
         return false;
@@ -402,7 +400,7 @@ bool CScript::HasValidWhitelistPegoutProof(const uint256& genesis_hash) const
         return false;
     }
 
-    if (secp256k1_whitelist_verify(secp256k1_ctx_ver, &sig, &paklist.OnlineKeys()[0], &paklist.OfflineKeys()[0], paklist.size(), &pubkey) != 1) {
+    if (secp256k1_whitelist_verify(secp256k1_ctx_ver, &sig, paklist.OnlineKeys().data(), paklist.OfflineKeys().data(), paklist.size(), &pubkey) != 1) {
         return false;
     }
 
@@ -38,6 +38,7 @@ static const unsigned int DEFAULT_PEGIN_CONFIRMATION_DEPTH = 8;
 static const int MAX_SCRIPT_SIZE = 10000;
 class uint256;
 class COutPoint;
+class CPAKList;
 
 // Threshold for nLockTime: below this value it is interpreted as block number,
 // otherwise as UNIX timestamp.
@@ -646,6 +647,7 @@ public:
      * <full_pubkey> <proof>
      */
     bool HasValidWhitelistPegoutProof(const uint256& genesis_hash) const;
+    bool HasValidWhitelistPegoutProof(const uint256& genesis_hash, const CPAKList& paklist) const;
 
     /**
      * Returns true if script follows OP_RETURN <genesis_block_hash> <pegout_scriptpubkey>
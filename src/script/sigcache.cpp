@@ -5,37 +5,27 @@
 
 #include "sigcache.h"
 
+#include "clientversion.h"
+#include "crypto/hmac_sha256.h"
 #include "memusage.h"
+#include "primitives/block.h"
 #include "pubkey.h"
 #include "random.h"
+#include "streams.h"
 #include "uint256.h"
 #include "util.h"
+#include "utilstrencodings.h"
 
 #include "cuckoocache.h"
+#include <algorithm>
+#include <atomic>
+#include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
 namespace {
 
-/**
- * We're hashing a nonce into the entries themselves, so we don't need extra
- * blinding in the set hash computation.
- *
- * This may exhibit platform endian dependent behavior but because these are
- * nonced hashes (random) and this state is only ever used locally it is safe.
- * All that matters is local consistency.
- */
-class SignatureCacheHasher
-{
-public:
-    template <uint8_t hash_select>
-    uint32_t operator()(const uint256& key) const
-    {
-        static_assert(hash_select <8, "SignatureCacheHasher only has 8 hashes available.");
-        uint32_t u;
-        std::memcpy(&u, key.begin()+4*hash_select, 4);
-        return u;
-    }
-};
+//! Whether the caches count lookups and hits, only needed for the hit rates logged by DumpVerifyCaches
+static bool fCountLookups = false;
 
 /**
  * Valid signature cache, to avoid doing expensive ECDSA signature checking
@@ -50,9 +40,12 @@ private:
     typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
     map_type setValid;
     boost::shared_mutex cs_sigcache;
+    std::atomic<uint64_t> nLookups;
+    std::atomic<uint64_t> nHits;
+    uint64_t nRestored;
 
 public:
-    CSignatureCache()
+    CSignatureCache() : nLookups(0), nHits(0), nRestored(0)
     {
         GetRandBytes(nonce.begin(), 32);
     }
@@ -67,7 +60,13 @@ public:
     Get(const uint256& entry, const bool erase)
     {
         boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.contains(entry, erase);
+        if (!fCountLookups)
+            return setValid.contains(entry, erase);
+        nLookups.fetch_add(1, std::memory_order_relaxed);
+        if (!setValid.contains(entry, erase))
+            return false;
+        nHits.fetch_add(1, std::memory_order_relaxed);
+        return true;
     }
 
     void Set(uint256& entry)
@@ -79,6 +78,51 @@ public:
     {
         return setValid.setup_bytes(n);
     }
+
+    //! Write the nonce, the usage counters and the live entries to a snapshot
+    template<typename Stream>
+    void WriteSnapshot(Stream& s)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        uint64_t nEntries = 0;
+        setValid.for_each([&nEntries](const uint256&) { nEntries++; });
+        s << nonce << (uint64_t)nLookups << (uint64_t)nHits << nRestored << nEntries;
+        setValid.for_each([&s](const uint256& entry) { s << entry; });
+    }
+
+    //! Adopt the nonce and entries of an authenticated snapshot. Entries computed before with the old nonce become unreachable.
+    template<typename Stream>
+    void ReadSnapshot(Stream& s, CVerifyCacheStats& statsPrev)
+    {
+        uint256 nonceIn;
+        uint64_t nEntries;
+        s >> nonceIn >> statsPrev.nLookups >> statsPrev.nHits >> statsPrev.nRestored >> nEntries;
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce = nonceIn;
+        uint256 entry;
+        for (uint64_t i = 0; i < nEntries; i++) {
+            s >> entry;
+            setValid.insert(entry);
+        }
+        nRestored = nEntries;
+    }
+
+    //! Switch to a new nonce, which leaves all current entries unreachable
+    void ResetNonce()
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        GetRandBytes(nonce.begin(), 32);
+        nRestored = 0;
+    }
+
+    CVerifyCacheStats GetStats() const
+    {
+        CVerifyCacheStats stats;
+        stats.nLookups = nLookups;
+        stats.nHits = nHits;
+        stats.nRestored = nRestored;
+        return stats;
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -93,6 +137,60 @@ static CSignatureCache rangeProofCache;
 
 static CSignatureCache surjectionProofCache;
 
+static CSignatureCache pakProofCache;
+
+//! The caches kept in the verification cache snapshot, in file order
+static const struct {
+    CSignatureCache* cache;
+    const char* name;
+} persistedCaches[] = {
+    {&signatureCache, "signature"},
+    {&rangeProofCache, "rangeproof"},
+    {&surjectionProofCache, "surjectionproof"},
+};
+
+//! Usage of the persisted caches in the run that wrote the snapshot they were loaded from
+static CVerifyCacheStats persistedCachesPrevStats[ARRAYLEN(persistedCaches)];
+
+//! When the salts of the persisted caches were created, 0 until they are loaded or first written
+static int64_t nVerifyCacheSaltTime = 0;
+
+static const uint64_t VERIFY_CACHE_DUMP_VERSION = 2;
+
+/** Writes to a file while feeding the written bytes to an HMAC */
+class CHMACFileWriter
+{
+private:
+    CAutoFile& file;
+    CHMAC_SHA256 hmac;
+
+public:
+    CHMACFileWriter(CAutoFile& fileIn, const uint256& key) : file(fileIn), hmac(key.begin(), key.size()) {}
+
+    int GetType() const { return file.GetType(); }
+    int GetVersion() const { return file.GetVersion(); }
+
+    void write(const char* pch, size_t nSize)
+    {
+        hmac.Write((const unsigned char*)pch, nSize);
+        file.write(pch, nSize);
+    }
+
+    template<typename T>
+    CHMACFileWriter& operator<<(const T& obj)
+    {
+        ::Serialize(*this, obj);
+        return *this;
+    }
+
+    // invalidates the object
+    uint256 GetHMAC()
+    {
+        uint256 result;
+        hmac.Finalize(result.begin());
+        return result;
+    }
+};
 
 }
 
@@ -129,6 +227,159 @@ void InitSurjectionproofCache()
             (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
 }
 
+// To be called once in AppInit2/TestingSetup to initialize the PAK proof cache
+void InitPAKProofCache()
+{
+    size_t nElems = pakProofCache.setup_bytes(PAK_PROOF_CACHE_BYTES);
+    LogPrintf("Using %zu KiB for PAK proof cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >> 10, nElems);
+}
+
+bool GetVerifyCacheKey(uint256& key)
+{
+    boost::filesystem::path path = GetDataDir() / "verifycache.key";
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (!filein.IsNull()) {
+        try {
+            filein >> key;
+            return true;
+        } catch (const std::exception& e) {
+            LogPrintf("%s: Failed to read %s: %s\n", __func__, path.string(), e.what());
+            return false;
+        }
+    }
+
+    GetStrongRandBytes(key.begin(), 32);
+    CAutoFile fileout(fopen(path.string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull()) {
+        LogPrintf("%s: Failed to create %s\n", __func__, path.string());
+        return false;
+    }
+    try {
+        fileout << key;
+        FileCommit(fileout.Get());
+    } catch (const std::exception& e) {
+        LogPrintf("%s: Failed to write %s: %s\n", __func__, path.string(), e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadVerifyCaches()
+{
+    fCountLookups = true;
+
+    int64_t nStart = GetTimeMicros();
+    boost::filesystem::path path = GetDataDir() / "verifycache.dat";
+    CAutoFile filein(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        LogPrintf("No verification cache snapshot found, starting with empty caches\n");
+        return false;
+    }
+
+    uint256 key;
+    if (!GetVerifyCacheKey(key))
+        return false;
+
+    try {
+        // The snapshot is larger than fits a single serialized object, so its
+        // HMAC is checked in a first pass over the file, before any of it is used.
+        uint64_t nSize = boost::filesystem::file_size(path);
+        if (nSize < sizeof(uint256))
+            throw std::ios_base::failure("snapshot too short");
+        CHMAC_SHA256 hmac(key.begin(), key.size());
+        std::vector<unsigned char> vchChunk(1 << 20);
+        for (uint64_t nRemaining = nSize - sizeof(uint256); nRemaining > 0; ) {
+            size_t nChunk = std::min(nRemaining, (uint64_t)vchChunk.size());
+            filein.read((char*)vchChunk.data(), nChunk);
+            hmac.Write(vchChunk.data(), nChunk);
+            nRemaining -= nChunk;
+        }
+        uint256 hmacFile, hmacExpected;
+        filein >> hmacFile;
+        hmac.Finalize(hmacExpected.begin());
+        if (hmacFile != hmacExpected) {
+            LogPrintf("Verification cache snapshot %s is corrupt or was written by another node, ignoring it\n", path.string());
+            return false;
+        }
+
+        if (fseek(filein.Get(), 0, SEEK_SET) != 0)
+            throw std::ios_base::failure("cannot rewind snapshot");
+        uint64_t nVersion;
+        int nClientVersion;
+        int64_t nSaltTime;
+        filein >> nVersion >> nClientVersion >> nSaltTime;
+        // Validity rules may change between releases, so only trust results from this one
+        if (nVersion != VERIFY_CACHE_DUMP_VERSION || nClientVersion != CLIENT_VERSION) {
+            LogPrintf("Verification cache snapshot was written by a different version, ignoring it\n");
+            return false;
+        }
+        if (nSaltTime + MAX_VERIFY_CACHE_SALT_AGE < GetTime()) {
+            LogPrintf("Verification cache snapshot salts are older than %d days, starting with new ones\n", MAX_VERIFY_CACHE_SALT_AGE / (24 * 60 * 60));
+            return false;
+        }
+
+        for (size_t i = 0; i < ARRAYLEN(persistedCaches); i++) {
+            persistedCaches[i].cache->ReadSnapshot(filein, persistedCachesPrevStats[i]);
+        }
+        nVerifyCacheSaltTime = nSaltTime;
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to read verification cache snapshot: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    LogPrintf("Loaded verification caches: %u signature, %u rangeproof and %u surjectionproof entries in %.2fs\n",
+        signatureCache.GetStats().nRestored, rangeProofCache.GetStats().nRestored, surjectionProofCache.GetStats().nRestored, (GetTimeMicros() - nStart) * 0.000001);
+    return true;
+}
+
+bool DumpVerifyCaches()
+{
+    for (size_t i = 0; i < ARRAYLEN(persistedCaches); i++) {
+        const CVerifyCacheStats stats = persistedCaches[i].cache->GetStats();
+        const CVerifyCacheStats& statsPrev = persistedCachesPrevStats[i];
+        LogPrintf("%s cache hit rate: %.1f%% of %u lookups, %u entries restored at startup (previous run: %.1f%% of %u lookups, %u entries restored)\n",
+            persistedCaches[i].name, stats.GetHitRate(), stats.nLookups, stats.nRestored, statsPrev.GetHitRate(), statsPrev.nLookups, statsPrev.nRestored);
+    }
+
+    uint256 key;
+    if (!GetVerifyCacheKey(key))
+        return false;
+
+    int64_t nStart = GetTimeMicros();
+    try {
+        if (nVerifyCacheSaltTime == 0)
+            nVerifyCacheSaltTime = GetTime();
+
+        FILE* filestr = fopen((GetDataDir() / "verifycache.dat.new").string().c_str(), "wb");
+        if (!filestr) {
+            return false;
+        }
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        CHMACFileWriter writer(file, key);
+        writer << VERIFY_CACHE_DUMP_VERSION << CLIENT_VERSION << nVerifyCacheSaltTime;
+        for (size_t i = 0; i < ARRAYLEN(persistedCaches); i++) {
+            persistedCaches[i].cache->WriteSnapshot(writer);
+        }
+        file << writer.GetHMAC();
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "verifycache.dat.new", GetDataDir() / "verifycache.dat");
+        LogPrintf("Dumped verification caches in %.2fs\n", (GetTimeMicros() - nStart) * 0.000001);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump verification caches: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+void ResetVerifyCacheSalts()
+{
+    for (size_t i = 0; i < ARRAYLEN(persistedCaches); i++) {
+        persistedCaches[i].cache->ResetNonce();
+    }
+    nVerifyCacheSaltTime = 0;
+}
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
@@ -143,6 +394,38 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
     return true;
 }
 
+bool CachingVerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& hash, bool store)
+{
+    uint256 entry;
+    signatureCache.ComputeEntry(entry, hash, vchSig, pubkey, vchSig, CScript());
+    if (signatureCache.Get(entry, !store))
+        return true;
+    if (!pubkey.Verify(hash, vchSig))
+        return false;
+    if (store)
+        signatureCache.Set(entry);
+    return true;
+}
+
+bool CachingHasValidWhitelistPegoutProof(const CScript& scriptPubKey, const uint256& genesis_hash)
+{
+    return CachingHasValidWhitelistPegoutProof(scriptPubKey, genesis_hash, g_paklist_config ? *g_paklist_config : g_paklist_blockchain);
+}
+
+bool CachingHasValidWhitelistPegoutProof(const CScript& scriptPubKey, const uint256& genesis_hash, const CPAKList& paklist)
+{
+    std::vector<unsigned char> vchGenesis(genesis_hash.begin(), genesis_hash.end());
+
+    uint256 entry;
+    pakProofCache.ComputeEntry(entry, paklist.GetHash(), vchGenesis, CPubKey(), vchGenesis, scriptPubKey);
+    if (pakProofCache.Get(entry, false))
+        return true;
+    if (!scriptPubKey.HasValidWhitelistPegoutProof(genesis_hash, paklist))
+        return false;
+    pakProofCache.Set(entry);
+    return true;
+}
+
 bool CachingRangeProofChecker::VerifyRangeProof(const std::vector<unsigned char>& vchRangeProof, const std::vector<unsigned char>& vchValueCommitment, const std::vector<unsigned char>& vchAssetCommitment, const CScript& scriptPubKey, const secp256k1_context* secp256k1_ctx_verify_amounts) const
 {
     CPubKey pubkey(vchValueCommitment);
@@ -186,41 +469,140 @@ bool CachingRangeProofChecker::VerifyRangeProof(const std::vector<unsigned char>
     return true;
 }
 
-bool CachingSurjectionProofChecker::VerifySurjectionProof(secp256k1_surjectionproof& proof, std::vector<secp256k1_generator>& vTags, secp256k1_generator& gen, const secp256k1_context* secp256k1_ctx_verify_amounts) const
+void CachingRangeProofChecker::StoreRangeProof(const std::vector<unsigned char>& vchRangeProof, const std::vector<unsigned char>& vchValueCommitment, const std::vector<unsigned char>& vchAssetCommitment, const CScript& scriptPubKey) const
 {
-    // Serialize objects
-    std::vector<unsigned char> vchproof;
-    size_t proof_len = secp256k1_surjectionproof_serialized_size(secp256k1_ctx_verify_amounts, &proof);
-    vchproof.resize(proof_len);
-    assert(secp256k1_surjectionproof_serialize(secp256k1_ctx_verify_amounts, &vchproof[0], &proof_len, &proof) == 1);
+    CPubKey pubkey(vchValueCommitment);
+    uint256 entry;
+    rangeProofCache.ComputeEntry(entry, uint256(), vchRangeProof, pubkey, vchAssetCommitment, scriptPubKey);
+    rangeProofCache.Set(entry);
+}
+
+bool CachingRangeProofChecker::VerifyRangeProofBatch(const std::vector<CRangeProofRef>& vProofs, std::vector<bool>& vResults, const secp256k1_context* secp256k1_ctx_verify_amounts) const
+{
+    vResults.assign(vProofs.size(), false);
+
+    std::vector<uint256> vEntries(vProofs.size());
+    std::vector<size_t> vPending;
+    std::vector<secp256k1_pedersen_commitment> vCommits(vProofs.size());
+    std::vector<secp256k1_generator> vTags(vProofs.size());
+    for (size_t i = 0; i < vProofs.size(); i++) {
+        const CRangeProofRef& proof = vProofs[i];
+        CPubKey pubkey(*proof.vchValueCommitment);
+        rangeProofCache.ComputeEntry(vEntries[i], uint256(), *proof.vchRangeProof, pubkey, *proof.vchAssetCommitment, *proof.scriptPubKey);
+
+        if (rangeProofCache.Get(vEntries[i], !store)) {
+            vResults[i] = true;
+            continue;
+        }
+
+        if (proof.vchRangeProof->size() == 0) {
+            continue;
+        }
+        if (secp256k1_pedersen_commitment_parse(secp256k1_ctx_verify_amounts, &vCommits[vPending.size()], &(*proof.vchValueCommitment)[0]) != 1) {
+            continue;
+        }
+        if (secp256k1_generator_parse(secp256k1_ctx_verify_amounts, &vTags[vPending.size()], &(*proof.vchAssetCommitment)[0]) != 1) {
+            continue;
+        }
+        vPending.push_back(i);
+    }
 
+    if (!vPending.empty()) {
+        std::vector<const secp256k1_pedersen_commitment*> vpCommits(vPending.size());
+        std::vector<const secp256k1_generator*> vpTags(vPending.size());
+        std::vector<const unsigned char*> vpProofs(vPending.size());
+        std::vector<size_t> vProofLens(vPending.size());
+        std::vector<const unsigned char*> vpExtraCommits(vPending.size());
+        std::vector<size_t> vExtraCommitLens(vPending.size());
+        std::vector<uint64_t> vMinValues(vPending.size()), vMaxValues(vPending.size());
+        std::vector<int> vBatchResults(vPending.size());
+        for (size_t j = 0; j < vPending.size(); j++) {
+            const CRangeProofRef& proof = vProofs[vPending[j]];
+            vpCommits[j] = &vCommits[j];
+            vpTags[j] = &vTags[j];
+            vpProofs[j] = proof.vchRangeProof->data();
+            vProofLens[j] = proof.vchRangeProof->size();
+            vpExtraCommits[j] = proof.scriptPubKey->size() ? &proof.scriptPubKey->front() : NULL;
+            vExtraCommitLens[j] = proof.scriptPubKey->size();
+        }
+
+        if (secp256k1_rangeproof_verify_batch(secp256k1_ctx_verify_amounts, vBatchResults.data(), vMinValues.data(), vMaxValues.data(), vpCommits.data(), vpProofs.data(), vProofLens.data(), vpExtraCommits.data(), vExtraCommitLens.data(), vpTags.data(), vPending.size())) {
+            for (size_t j = 0; j < vPending.size(); j++) {
+                const size_t i = vPending[j];
+                // Same zero-minimum rule as in VerifyRangeProof
+                if (vMinValues[j] == 0 && !vProofs[i].scriptPubKey->IsUnspendable()) {
+                    continue;
+                }
+                vResults[i] = true;
+                if (store) {
+                    rangeProofCache.Set(vEntries[i]);
+                }
+            }
+        } else {
+            // Fall back to verifying each proof on its own, so a single bad proof
+            // is identified by the same code path that checks unbatched proofs.
+            for (size_t j = 0; j < vPending.size(); j++) {
+                const CRangeProofRef& proof = vProofs[vPending[j]];
+                vResults[vPending[j]] = VerifyRangeProof(*proof.vchRangeProof, *proof.vchValueCommitment, *proof.vchAssetCommitment, *proof.scriptPubKey, secp256k1_ctx_verify_amounts);
+            }
+        }
+    }
+
+    return std::find(vResults.begin(), vResults.end(), false) == vResults.end();
+}
+
+CSurjectionGeneratorTable::CSurjectionGeneratorTable(const std::vector<secp256k1_generator>& vTagsIn, const secp256k1_context* ctx)
+{
     // libsecp API only supports up to 256 indices for surjection, so we truncate
     // commitment list to that size. Assets must be proven against the first 256 inputs.
-    size_t surjection_size = std::min(vTags.size(), (size_t)SECP256K1_SURJECTIONPROOF_MAX_N_INPUTS);
+    vTags.assign(vTagsIn.begin(), vTagsIn.begin() + std::min(vTagsIn.size(), (size_t)SECP256K1_SURJECTIONPROOF_MAX_N_INPUTS));
+    table = secp256k1_surjectionproof_input_table_create(ctx, vTags.data(), vTags.size());
+    assert(table != NULL);
 
-    std::vector<unsigned char> tagCommit;
-    tagCommit.resize(33);
+    unsigned char tagCommit[33];
     CSHA256 sha2;
-    for (unsigned int i = 0; i < surjection_size; i++) {
-        assert(secp256k1_generator_serialize(secp256k1_ctx_verify_amounts, tagCommit.data(), &vTags[i]) == 1);
-        sha2.Write(tagCommit.data(), tagCommit.size());
+    for (unsigned int i = 0; i < vTags.size(); i++) {
+        assert(secp256k1_generator_serialize(ctx, tagCommit, &vTags[i]) == 1);
+        sha2.Write(tagCommit, sizeof(tagCommit));
     }
-    tagCommit.resize(32);
-    sha2.Finalize(tagCommit.data());
+    sha2.Finalize(hashTags.begin());
+}
+
+CSurjectionGeneratorTable::~CSurjectionGeneratorTable()
+{
+    secp256k1_surjectionproof_input_table_destroy(table);
+}
+
+namespace {
+
+void ComputeSurjectionProofEntry(uint256& entry, const secp256k1_surjectionproof& proof, const CSurjectionGeneratorTable& table, const secp256k1_generator& gen, const secp256k1_context* secp256k1_ctx_verify_amounts)
+{
+    // Serialize objects
+    std::vector<unsigned char> vchproof;
+    size_t proof_len = secp256k1_surjectionproof_serialized_size(secp256k1_ctx_verify_amounts, &proof);
+    vchproof.resize(proof_len);
+    assert(secp256k1_surjectionproof_serialize(secp256k1_ctx_verify_amounts, &vchproof[0], &proof_len, &proof) == 1);
 
     std::vector<unsigned char> vchGen;
     vchGen.resize(CConfidentialValue::nCommittedSize);
     assert(secp256k1_generator_serialize(secp256k1_ctx_verify_amounts, &vchGen[0], &gen) == 1);
 
     CPubKey pubkey(vchGen);
+    surjectionProofCache.ComputeEntry(entry, table.GetHash(), vchproof, pubkey, vchGen, CScript());
+}
+
+}
+
+bool CachingSurjectionProofChecker::VerifySurjectionProof(const secp256k1_surjectionproof& proof, const CSurjectionGeneratorTable& table, const secp256k1_generator& gen, const secp256k1_context* secp256k1_ctx_verify_amounts) const
+{
     uint256 entry;
-    surjectionProofCache.ComputeEntry(entry, uint256(tagCommit), vchproof, pubkey, vchGen, CScript());
+    ComputeSurjectionProofEntry(entry, proof, table, gen, secp256k1_ctx_verify_amounts);
 
     if (surjectionProofCache.Get(entry, !store)) {
         return true;
     }
 
-    if (secp256k1_surjectionproof_verify(secp256k1_ctx_verify_amounts, &proof, vTags.data(), surjection_size, &gen) != 1) {
+    if (secp256k1_surjectionproof_verify(secp256k1_ctx_verify_amounts, &proof, table.GetTags().data(), table.GetTags().size(), &gen) != 1) {
         return false;
     }
 
@@ -230,3 +612,50 @@ bool CachingSurjectionProofChecker::VerifySurjectionProof(secp256k1_surjectionpr
 
     return true;
 }
+
+void CachingSurjectionProofChecker::StoreSurjectionProof(const secp256k1_surjectionproof& proof, const CSurjectionGeneratorTable& table, const secp256k1_generator& gen, const secp256k1_context* secp256k1_ctx_verify_amounts) const
+{
+    uint256 entry;
+    ComputeSurjectionProofEntry(entry, proof, table, gen, secp256k1_ctx_verify_amounts);
+    surjectionProofCache.Set(entry);
+}
+
+bool CachingSurjectionProofChecker::VerifySurjectionProofBatch(const std::vector<const secp256k1_surjectionproof*>& vProofs, const std::vector<const secp256k1_generator*>& vGens, const CSurjectionGeneratorTable& table, std::vector<bool>& vResults, const secp256k1_context* secp256k1_ctx_verify_amounts) const
+{
+    assert(vProofs.size() == vGens.size());
+    vResults.assign(vProofs.size(), false);
+
+    std::vector<uint256> vEntries(vProofs.size());
+    std::vector<size_t> vPending;
+    std::vector<const secp256k1_surjectionproof*> vpPendingProofs;
+    std::vector<const secp256k1_generator*> vpPendingGens;
+    for (size_t i = 0; i < vProofs.size(); i++) {
+        ComputeSurjectionProofEntry(vEntries[i], *vProofs[i], table, *vGens[i], secp256k1_ctx_verify_amounts);
+        if (surjectionProofCache.Get(vEntries[i], !store)) {
+            vResults[i] = true;
+            continue;
+        }
+        vPending.push_back(i);
+        vpPendingProofs.push_back(vProofs[i]);
+        vpPendingGens.push_back(vGens[i]);
+    }
+
+    if (!vPending.empty()) {
+        std::vector<int> vBatchResults(vPending.size());
+        if (secp256k1_surjectionproof_verify_batch(secp256k1_ctx_verify_amounts, vBatchResults.data(), vpPendingProofs.data(), vpPendingGens.data(), vPending.size(), table.GetTable())) {
+            for (size_t j = 0; j < vPending.size(); j++) {
+                vResults[vPending[j]] = true;
+                if (store) {
+                    surjectionProofCache.Set(vEntries[vPending[j]]);
+                }
+            }
+        } else {
+            // Fall back to verifying each proof on its own, as in VerifyRangeProofBatch
+            for (size_t j = 0; j < vPending.size(); j++) {
+                vResults[vPending[j]] = VerifySurjectionProof(*vpPendingProofs[j], table, *vpPendingGens[j], secp256k1_ctx_verify_amounts);
+            }
+        }
+    }
+
+    return std::find(vResults.begin(), vResults.end(), false) == vResults.end();
+}
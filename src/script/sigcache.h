@@ -8,6 +8,8 @@
 
 #include "script/interpreter.h"
 
+#include <cstring>
+
 #include <secp256k1.h>
 #include <secp256k1_rangeproof.h>
 #include <secp256k1_surjectionproof.h>
@@ -20,7 +22,38 @@ static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 32;
 // Maximum sig cache size allowed
 static const int64_t MAX_MAX_SIG_CACHE_SIZE = 16384;
 
+class CPAKList;
 class CPubKey;
+class CScript;
+
+/** Default for -persistverifycache */
+static const bool DEFAULT_PERSIST_VERIFY_CACHE = false;
+/** Verification cache snapshots with salts older than this (in seconds) are not loaded, so the salts get renewed */
+static const int64_t MAX_VERIFY_CACHE_SALT_AGE = 14 * 24 * 60 * 60;
+
+/** Size of the cache of valid PAK whitelist proofs (1 MiB, about 32k outputs) */
+static const size_t PAK_PROOF_CACHE_BYTES = 1 << 20;
+
+/**
+ * We're hashing a nonce into the entries themselves, so we don't need extra
+ * blinding in the set hash computation.
+ *
+ * This may exhibit platform endian dependent behavior but because these are
+ * nonced hashes (random) and this state is only ever used locally it is safe.
+ * All that matters is local consistency.
+ */
+class SignatureCacheHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        static_assert(hash_select <8, "SignatureCacheHasher only has 8 hashes available.");
+        uint32_t u;
+        std::memcpy(&u, key.begin()+4*hash_select, 4);
+        return u;
+    }
+};
 
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
@@ -33,6 +66,32 @@ public:
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
 };
 
+/**
+ * Verify an ECDSA signature over an arbitrary hash, such as a signed block
+ * proof, through the signature cache.
+ */
+bool CachingVerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& hash, bool store);
+
+/**
+ * Check the whitelist proof of a peg-out script against the active PAK list,
+ * through a cache of valid proofs. Entries commit to the hash of the list, so
+ * a new list never finds results verified against an earlier one.
+ */
+bool CachingHasValidWhitelistPegoutProof(const CScript& scriptPubKey, const uint256& genesis_hash);
+bool CachingHasValidWhitelistPegoutProof(const CScript& scriptPubKey, const uint256& genesis_hash, const CPAKList& paklist);
+
+// Maximum number of range proofs verified together by VerifyRangeProofBatch
+static const size_t MAX_RANGEPROOF_BATCH_SIZE = 64;
+
+/** A range proof and the data it commits to, referenced rather than copied. */
+struct CRangeProofRef
+{
+    const std::vector<unsigned char>* vchRangeProof;
+    const std::vector<unsigned char>* vchValueCommitment;
+    const std::vector<unsigned char>* vchAssetCommitment;
+    const CScript* scriptPubKey;
+};
+
 class CachingRangeProofChecker
 {
 private:
@@ -44,6 +103,43 @@ public:
 
     bool VerifyRangeProof(const std::vector<unsigned char>& vchRangeProof, const std::vector<unsigned char>& vchValueCommitment, const std::vector<unsigned char>& vchAssetCommitment, const CScript& scriptPubKey, const secp256k1_context* ctx) const;
 
+    /**
+     * Verify a batch of range proofs with the same acceptance rules and cache
+     * behaviour as VerifyRangeProof. Proofs missing from the cache are handed to
+     * secp256k1 as one batch; if that batch fails, its proofs are re-verified
+     * one by one so that vResults reflects exactly which proofs are invalid.
+     * Returns true if all proofs are valid.
+     */
+    bool VerifyRangeProofBatch(const std::vector<CRangeProofRef>& vProofs, std::vector<bool>& vResults, const secp256k1_context* ctx) const;
+
+    /** Record a range proof as valid without verifying it. Only for proofs this node has verified before. */
+    void StoreRangeProof(const std::vector<unsigned char>& vchRangeProof, const std::vector<unsigned char>& vchValueCommitment, const std::vector<unsigned char>& vchAssetCommitment, const CScript& scriptPubKey) const;
+
+};
+
+/**
+ * The input generators a transaction's surjection proofs are verified against.
+ * Built once per transaction and shared by all of its surjection checks, with
+ * the parsed secp256k1 input table and the hash the cache entries commit to
+ * computed up front.
+ */
+class CSurjectionGeneratorTable
+{
+private:
+    std::vector<secp256k1_generator> vTags;
+    secp256k1_surjectionproof_input_table* table;
+    uint256 hashTags;
+
+    CSurjectionGeneratorTable(const CSurjectionGeneratorTable&) = delete;
+    CSurjectionGeneratorTable& operator=(const CSurjectionGeneratorTable&) = delete;
+
+public:
+    CSurjectionGeneratorTable(const std::vector<secp256k1_generator>& vTagsIn, const secp256k1_context* ctx);
+    ~CSurjectionGeneratorTable();
+
+    const std::vector<secp256k1_generator>& GetTags() const { return vTags; }
+    const secp256k1_surjectionproof_input_table* GetTable() const { return table; }
+    const uint256& GetHash() const { return hashTags; }
 };
 
 class CachingSurjectionProofChecker
@@ -55,12 +151,60 @@ public:
         store = storeIn;
     };
 
-    bool VerifySurjectionProof(secp256k1_surjectionproof& proof, std::vector<secp256k1_generator>& vTags, secp256k1_generator& gen, const secp256k1_context* ctx) const;
+    bool VerifySurjectionProof(const secp256k1_surjectionproof& proof, const CSurjectionGeneratorTable& table, const secp256k1_generator& gen, const secp256k1_context* ctx) const;
+
+    /**
+     * Verify the surjection proofs of several outputs against the same
+     * generator table, with the same cache behaviour as VerifySurjectionProof.
+     * vResults receives one entry per proof. Returns true if all proofs are valid.
+     */
+    bool VerifySurjectionProofBatch(const std::vector<const secp256k1_surjectionproof*>& vProofs, const std::vector<const secp256k1_generator*>& vGens, const CSurjectionGeneratorTable& table, std::vector<bool>& vResults, const secp256k1_context* ctx) const;
+
+    /** Record a surjection proof as valid without verifying it. Only for proofs this node has verified before. */
+    void StoreSurjectionProof(const secp256k1_surjectionproof& proof, const CSurjectionGeneratorTable& table, const secp256k1_generator& gen, const secp256k1_context* ctx) const;
+
+};
+
+/** Usage counters of a verification cache, for comparing hit rates across restarts */
+struct CVerifyCacheStats
+{
+    uint64_t nLookups;
+    uint64_t nHits;
+    //! Entries loaded from the snapshot at startup
+    uint64_t nRestored;
+
+    CVerifyCacheStats() : nLookups(0), nHits(0), nRestored(0) {}
 
+    double GetHitRate() const { return nLookups ? 100.0 * nHits / nLookups : 0.0; }
 };
 
 void InitSignatureCache();
 void InitRangeproofCache();
 void InitSurjectionproofCache();
+void InitPAKProofCache();
+
+/**
+ * Secret that keys the validation results this node writes to disk, so that
+ * it only trusts results it wrote itself. Kept in the data directory and
+ * created on first use. Returns false if it can be neither read nor created.
+ */
+bool GetVerifyCacheKey(uint256& key);
+
+/**
+ * Fill the signature, rangeproof and surjection proof caches from the snapshot
+ * in the data directory, adopting the salts they were written with. To be
+ * called after the caches are set up and before anything is verified. The
+ * snapshot is only used if it is authenticated by GetVerifyCacheKey, comes from
+ * this client version and its salts are not too old; otherwise the caches are
+ * left as they are and false is returned. Either way, the caches start counting
+ * lookups for the hit rates DumpVerifyCaches logs.
+ */
+bool LoadVerifyCaches();
+
+/** Log the hit rates of the persisted caches and write their snapshot for LoadVerifyCaches. */
+bool DumpVerifyCaches();
+
+/** Give the persisted caches new salts, which leaves them empty in effect. For tests. */
+void ResetVerifyCacheSalts();
 
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
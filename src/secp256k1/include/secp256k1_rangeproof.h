@@ -189,6 +189,38 @@ SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_rangeproof_verify(
   const secp256k1_generator* gen
 ) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4) SECP256K1_ARG_NONNULL(5) SECP256K1_ARG_NONNULL(9);
 
+/** Verify a batch of range proofs.
+ *  Returns 1: All proofs are valid.
+ *          0: At least one proof failed; consult results to find out which.
+ * In:   ctx: pointer to a context object, initialized for range-proof and commitment (cannot be NULL)
+ *       commit: array of n pointers to the commitments being proved. (cannot be NULL)
+ *       proof: array of n pointers to character arrays with the proofs. (cannot be NULL)
+ *       plen: array of n proof lengths in bytes. (cannot be NULL)
+ *       extra_commit: array of n pointers to additional data covered in each rangeproof signature (NULL if none of the proofs commit to extra data)
+ *       extra_commit_len: array of n lengths of the extra_commit byte arrays (may be NULL if extra_commit is NULL)
+ *       gen: array of n pointers to the additional generators 'h' (cannot be NULL)
+ *       n: number of proofs in the batch.
+ * Out:  results: array of n ints, each set to 1 if the corresponding proof is valid and 0 otherwise. (cannot be NULL)
+ *       min_value: array of n unsigned int64s updated with the minimum value each commit could have. (cannot be NULL)
+ *       max_value: array of n unsigned int64s updated with the maximum value each commit could have. (cannot be NULL)
+ *
+ *  The Borromean ring signatures of the batch are verified in lockstep so that the conversion
+ *  of their intermediate points to affine coordinates is shared across the whole batch.
+ */
+SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_rangeproof_verify_batch(
+  const secp256k1_context* ctx,
+  int *results,
+  uint64_t *min_value,
+  uint64_t *max_value,
+  const secp256k1_pedersen_commitment * const *commit,
+  const unsigned char * const *proof,
+  const size_t *plen,
+  const unsigned char * const *extra_commit,
+  const size_t *extra_commit_len,
+  const secp256k1_generator * const *gen,
+  size_t n
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4) SECP256K1_ARG_NONNULL(5) SECP256K1_ARG_NONNULL(6) SECP256K1_ARG_NONNULL(7) SECP256K1_ARG_NONNULL(10);
+
 /** Verify a range proof proof and rewind the proof to recover information sent by its author.
  *  Returns 1: Value is within the range [0..2^64), the specifically proven range is in the min/max value outputs, and the value and blinding were recovered.
  *          0: Proof failed, rewind failed, or other error.
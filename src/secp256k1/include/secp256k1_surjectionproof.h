@@ -205,6 +205,59 @@ SECP256K1_API int secp256k1_surjectionproof_verify(
   const secp256k1_generator* ephemeral_output_tag
 ) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(5);
 
+/** Opaque data structure holding the parsed input tags shared by all outputs of a transaction.
+ *
+ *  Created with secp256k1_surjectionproof_input_table_create, which also precomputes
+ *  the part of the proof message that only depends on the input tags.
+ */
+typedef struct secp256k1_surjectionproof_input_table_struct secp256k1_surjectionproof_input_table;
+
+/** Create an input table for batched surjection proof verification
+ * Returns: a newly created input table, or NULL if too many input tags are given.
+ *
+ * In:     ctx: pointer to a context object
+ *      ephemeral_input_tags: the ephemeral asset tag of all inputs
+ *    n_ephemeral_input_tags: the number of entries in the ephemeral_input_tags array
+ */
+SECP256K1_API secp256k1_surjectionproof_input_table* secp256k1_surjectionproof_input_table_create(
+  const secp256k1_context* ctx,
+  const secp256k1_generator* ephemeral_input_tags,
+  size_t n_ephemeral_input_tags
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2);
+
+/** Destroy an input table (created using secp256k1_surjectionproof_input_table_create).
+ *
+ *  The table pointer may not be used afterwards.
+ *  In:   table: an existing input table (can be NULL)
+ */
+SECP256K1_API void secp256k1_surjectionproof_input_table_destroy(
+  secp256k1_surjectionproof_input_table* table
+);
+
+/** Batched surjection proof verification function
+ * Returns 0: at least one proof was invalid; consult results to find out which
+ *         1: all proofs were valid
+ *
+ * In:     ctx: pointer to a context object, initialized for signing and verification
+ *         proofs: array of n_proofs pointers to the proofs to be verified
+ *   ephemeral_output_tags: array of n_proofs pointers to the ephemeral asset tag of each proof's output
+ *        n_proofs: the number of proofs in the batch
+ *           table: the input tags all proofs are verified against
+ * Out:  results: array of n_proofs ints, each set to 1 if the corresponding proof is valid and 0 otherwise
+ *
+ *  Equivalent to calling secp256k1_surjectionproof_verify for every proof with the tags
+ *  the table was created from, but the input tags are parsed and hashed only once and
+ *  the Borromean signatures of the batch are verified together.
+ */
+SECP256K1_API int secp256k1_surjectionproof_verify_batch(
+  const secp256k1_context* ctx,
+  int *results,
+  const secp256k1_surjectionproof * const *proofs,
+  const secp256k1_generator * const *ephemeral_output_tags,
+  size_t n_proofs,
+  const secp256k1_surjectionproof_input_table* table
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3) SECP256K1_ARG_NONNULL(4) SECP256K1_ARG_NONNULL(6);
+
 #ifdef __cplusplus
 }
 #endif
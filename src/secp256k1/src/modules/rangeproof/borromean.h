@@ -17,6 +17,10 @@
 int secp256k1_borromean_verify(const secp256k1_ecmult_context* ecmult_ctx, secp256k1_scalar *evalues, const unsigned char *e0, const secp256k1_scalar *s,
  const secp256k1_gej *pubs, const size_t *rsizes, size_t nrings, const unsigned char *m, size_t mlen);
 
+int secp256k1_borromean_verify_batch(const secp256k1_ecmult_context* ecmult_ctx, const secp256k1_callback* cb, int *results,
+ const unsigned char * const *e0, const secp256k1_scalar * const *s, const secp256k1_gej * const *pubs, const size_t * const *rsizes,
+ const size_t *nrings, const unsigned char * const *m, size_t mlen, size_t n);
+
 int secp256k1_borromean_sign(const secp256k1_ecmult_context* ecmult_ctx, const secp256k1_ecmult_gen_context *ecmult_gen_ctx,
  unsigned char *e0, secp256k1_scalar *s, const secp256k1_gej *pubs, const secp256k1_scalar *k, const secp256k1_scalar *sec,
  const size_t *rsizes, const size_t *secidx, size_t nrings, const unsigned char *m, size_t mlen);
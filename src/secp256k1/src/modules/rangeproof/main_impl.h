@@ -270,6 +270,45 @@ int secp256k1_rangeproof_verify(const secp256k1_context* ctx, uint64_t *min_valu
      NULL, NULL, NULL, NULL, NULL, min_value, max_value, &commitp, proof, plen, extra_commit, extra_commit_len, &genp);
 }
 
+int secp256k1_rangeproof_verify_batch(const secp256k1_context* ctx, int *results, uint64_t *min_value, uint64_t *max_value,
+ const secp256k1_pedersen_commitment * const *commit, const unsigned char * const *proof, const size_t *plen,
+ const unsigned char * const *extra_commit, const size_t *extra_commit_len, const secp256k1_generator * const *gen, size_t n) {
+    secp256k1_ge *commitp;
+    secp256k1_ge *genp;
+    size_t i;
+    int ret;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(results != NULL);
+    ARG_CHECK(min_value != NULL);
+    ARG_CHECK(max_value != NULL);
+    ARG_CHECK(commit != NULL);
+    ARG_CHECK(proof != NULL);
+    ARG_CHECK(plen != NULL);
+    ARG_CHECK(extra_commit == NULL || extra_commit_len != NULL);
+    ARG_CHECK(gen != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    if (n == 0) {
+        return 1;
+    }
+    for (i = 0; i < n; i++) {
+        ARG_CHECK(commit[i] != NULL);
+        ARG_CHECK(proof[i] != NULL);
+        ARG_CHECK(extra_commit == NULL || extra_commit[i] != NULL || extra_commit_len[i] == 0);
+        ARG_CHECK(gen[i] != NULL);
+    }
+    commitp = (secp256k1_ge *)checked_malloc(&ctx->error_callback, sizeof(secp256k1_ge) * n);
+    genp = (secp256k1_ge *)checked_malloc(&ctx->error_callback, sizeof(secp256k1_ge) * n);
+    for (i = 0; i < n; i++) {
+        secp256k1_pedersen_commitment_load(&commitp[i], commit[i]);
+        secp256k1_generator_load(&genp[i], gen[i]);
+    }
+    ret = secp256k1_rangeproof_verify_batch_impl(&ctx->ecmult_ctx, &ctx->error_callback,
+     results, min_value, max_value, commitp, proof, plen, extra_commit, extra_commit_len, genp, n);
+    free(commitp);
+    free(genp);
+    return ret;
+}
+
 int secp256k1_rangeproof_sign(const secp256k1_context* ctx, unsigned char *proof, size_t *plen, uint64_t min_value,
  const secp256k1_pedersen_commitment *commit, const unsigned char *blind, const unsigned char *nonce, int exp, int min_bits, uint64_t value,
  const unsigned char *message, size_t msg_len, const unsigned char *extra_commit, size_t extra_commit_len, const secp256k1_generator* gen){
@@ -18,4 +18,8 @@ static int secp256k1_rangeproof_verify_impl(const secp256k1_ecmult_context* ecmu
  uint64_t *min_value, uint64_t *max_value, const secp256k1_ge *commit, const unsigned char *proof, size_t plen,
  const unsigned char *extra_commit, size_t extra_commit_len, const secp256k1_ge* genp);
 
+static int secp256k1_rangeproof_verify_batch_impl(const secp256k1_ecmult_context* ecmult_ctx, const secp256k1_callback* cb,
+ int *results, uint64_t *min_value, uint64_t *max_value, const secp256k1_ge *commit, const unsigned char * const *proof, const size_t *plen,
+ const unsigned char * const *extra_commit, const size_t *extra_commit_len, const secp256k1_ge *genp, size_t n);
+
 #endif
@@ -537,19 +537,15 @@ SECP256K1_INLINE static int secp256k1_rangeproof_getheader_impl(size_t *offset,
     return 1;
 }
 
-/* Verifies range proof (len plen) for commit, the min/max values proven are put in the min/max arguments; returns 0 on failure 1 on success.*/
-SECP256K1_INLINE static int secp256k1_rangeproof_verify_impl(const secp256k1_ecmult_context* ecmult_ctx,
- const secp256k1_ecmult_gen_context* ecmult_gen_ctx,
- unsigned char *blindout, uint64_t *value_out, unsigned char *message_out, size_t *outlen, const unsigned char *nonce,
+/* Parses a proof and derives everything secp256k1_borromean_verify checks it against:
+ * the ring public keys, the s values, the ring sizes, the message hash m and e0.
+ * pubs and s must have room for 128 entries, rsizes for 32 and m for 33 bytes. */
+SECP256K1_INLINE static int secp256k1_rangeproof_verify_setup(secp256k1_gej *pubs, secp256k1_scalar *s, size_t *rsizes, size_t *rings_out,
+ unsigned char *m, const unsigned char **e0, int *offset_post_header, uint64_t *scale,
  uint64_t *min_value, uint64_t *max_value, const secp256k1_ge *commit, const unsigned char *proof, size_t plen, const unsigned char *extra_commit, size_t extra_commit_len, const secp256k1_ge* genp) {
     secp256k1_gej accj;
-    secp256k1_gej pubs[128];
     secp256k1_ge c;
-    secp256k1_scalar s[128];
-    secp256k1_scalar evalues[128]; /* Challenges, only used during proof rewind. */
     secp256k1_sha256 sha256_m;
-    size_t rsizes[32];
-    int ret;
     size_t i;
     int exp;
     int mantissa;
@@ -557,16 +553,12 @@ SECP256K1_INLINE static int secp256k1_rangeproof_verify_impl(const secp256k1_ecm
     size_t rings;
     int overflow;
     size_t npub;
-    int offset_post_header;
-    uint64_t scale;
     unsigned char signs[31];
-    unsigned char m[33];
-    const unsigned char *e0;
     offset = 0;
-    if (!secp256k1_rangeproof_getheader_impl(&offset, &exp, &mantissa, &scale, min_value, max_value, proof, plen)) {
+    if (!secp256k1_rangeproof_getheader_impl(&offset, &exp, &mantissa, scale, min_value, max_value, proof, plen)) {
         return 0;
     }
-    offset_post_header = offset;
+    *offset_post_header = offset;
     rings = 1;
     rsizes[0] = 1;
     npub = 1;
@@ -632,7 +624,7 @@ SECP256K1_INLINE static int secp256k1_rangeproof_verify_impl(const secp256k1_ecm
     }
     secp256k1_rangeproof_pub_expand(pubs, exp, rsizes, rings, genp);
     npub += rsizes[rings - 1];
-    e0 = &proof[offset];
+    *e0 = &proof[offset];
     offset += 32;
     for (i = 0; i < npub; i++) {
         secp256k1_scalar_set_b32(&s[i], &proof[offset], &overflow);
@@ -649,6 +641,30 @@ SECP256K1_INLINE static int secp256k1_rangeproof_verify_impl(const secp256k1_ecm
         secp256k1_sha256_write(&sha256_m, extra_commit, extra_commit_len);
     }
     secp256k1_sha256_finalize(&sha256_m, m);
+    *rings_out = rings;
+    return 1;
+}
+
+/* Verifies range proof (len plen) for commit, the min/max values proven are put in the min/max arguments; returns 0 on failure 1 on success.*/
+SECP256K1_INLINE static int secp256k1_rangeproof_verify_impl(const secp256k1_ecmult_context* ecmult_ctx,
+ const secp256k1_ecmult_gen_context* ecmult_gen_ctx,
+ unsigned char *blindout, uint64_t *value_out, unsigned char *message_out, size_t *outlen, const unsigned char *nonce,
+ uint64_t *min_value, uint64_t *max_value, const secp256k1_ge *commit, const unsigned char *proof, size_t plen, const unsigned char *extra_commit, size_t extra_commit_len, const secp256k1_ge* genp) {
+    secp256k1_gej accj;
+    secp256k1_gej pubs[128];
+    secp256k1_scalar s[128];
+    secp256k1_scalar evalues[128]; /* Challenges, only used during proof rewind. */
+    size_t rsizes[32];
+    int ret;
+    size_t rings;
+    int offset_post_header;
+    uint64_t scale;
+    unsigned char m[33];
+    const unsigned char *e0;
+    if (!secp256k1_rangeproof_verify_setup(pubs, s, rsizes, &rings, m, &e0, &offset_post_header, &scale,
+     min_value, max_value, commit, proof, plen, extra_commit, extra_commit_len, genp)) {
+        return 0;
+    }
     ret = secp256k1_borromean_verify(ecmult_ctx, nonce ? evalues : NULL, e0, s, pubs, rsizes, rings, m, 32);
     if (ret && nonce) {
         /* Given the nonce, try rewinding the witness to recover its initial state. */
@@ -682,4 +698,79 @@ SECP256K1_INLINE static int secp256k1_rangeproof_verify_impl(const secp256k1_ecm
     return ret;
 }
 
+/* Verifies n range proofs, batching their Borromean signatures; results[i] is set to 1 if proof i is valid, 0 otherwise.
+ * Returns 1 if all proofs are valid. */
+SECP256K1_INLINE static int secp256k1_rangeproof_verify_batch_impl(const secp256k1_ecmult_context* ecmult_ctx, const secp256k1_callback* cb,
+ int *results, uint64_t *min_value, uint64_t *max_value, const secp256k1_ge *commit, const unsigned char * const *proof, const size_t *plen,
+ const unsigned char * const *extra_commit, const size_t *extra_commit_len, const secp256k1_ge *genp, size_t n) {
+    secp256k1_gej *pubs;
+    secp256k1_scalar *s;
+    size_t *rsizes;
+    size_t *rings;
+    unsigned char *m;
+    const unsigned char **e0;
+    const secp256k1_gej **bpubs;
+    const secp256k1_scalar **bs;
+    const size_t **brsizes;
+    const unsigned char **bm;
+    size_t *bidx;
+    int *bresults;
+    int offset_post_header;
+    uint64_t scale;
+    size_t nbatch;
+    size_t i;
+    int ret;
+    if (n == 0) {
+        return 1;
+    }
+    pubs = (secp256k1_gej *)checked_malloc(cb, sizeof(secp256k1_gej) * 128 * n);
+    s = (secp256k1_scalar *)checked_malloc(cb, sizeof(secp256k1_scalar) * 128 * n);
+    rsizes = (size_t *)checked_malloc(cb, sizeof(size_t) * 32 * n);
+    rings = (size_t *)checked_malloc(cb, sizeof(size_t) * n);
+    m = (unsigned char *)checked_malloc(cb, 33 * n);
+    e0 = (const unsigned char **)checked_malloc(cb, sizeof(const unsigned char *) * n);
+    bpubs = (const secp256k1_gej **)checked_malloc(cb, sizeof(const secp256k1_gej *) * n);
+    bs = (const secp256k1_scalar **)checked_malloc(cb, sizeof(const secp256k1_scalar *) * n);
+    brsizes = (const size_t **)checked_malloc(cb, sizeof(const size_t *) * n);
+    bm = (const unsigned char **)checked_malloc(cb, sizeof(const unsigned char *) * n);
+    bidx = (size_t *)checked_malloc(cb, sizeof(size_t) * n);
+    bresults = (int *)checked_malloc(cb, sizeof(int) * n);
+    /* Proofs that fail to parse are rejected here and kept out of the batch. */
+    nbatch = 0;
+    for (i = 0; i < n; i++) {
+        results[i] = secp256k1_rangeproof_verify_setup(&pubs[128 * nbatch], &s[128 * nbatch], &rsizes[32 * nbatch], &rings[nbatch],
+         &m[33 * nbatch], &e0[nbatch], &offset_post_header, &scale, &min_value[i], &max_value[i], &commit[i], proof[i], plen[i],
+         extra_commit != NULL ? extra_commit[i] : NULL, extra_commit != NULL ? extra_commit_len[i] : 0, &genp[i]);
+        if (results[i]) {
+            bpubs[nbatch] = &pubs[128 * nbatch];
+            bs[nbatch] = &s[128 * nbatch];
+            brsizes[nbatch] = &rsizes[32 * nbatch];
+            bm[nbatch] = &m[33 * nbatch];
+            bidx[nbatch] = i;
+            nbatch++;
+        }
+    }
+    secp256k1_borromean_verify_batch(ecmult_ctx, cb, bresults, e0, bs, bpubs, brsizes, rings, bm, 32, nbatch);
+    for (i = 0; i < nbatch; i++) {
+        results[bidx[i]] = bresults[i];
+    }
+    ret = 1;
+    for (i = 0; i < n; i++) {
+        ret &= results[i];
+    }
+    free(pubs);
+    free(s);
+    free(rsizes);
+    free(rings);
+    free(m);
+    free(e0);
+    free(bpubs);
+    free(bs);
+    free(brsizes);
+    free(bm);
+    free(bidx);
+    free(bresults);
+    return ret;
+}
+
 #endif
@@ -607,6 +607,70 @@ void test_multiple_generators(void) {
     }
 }
 
+void test_rangeproof_batch(void) {
+    const size_t n = 1 + (secp256k1_rand32() % 8);
+    unsigned char proof_data[8][5134];
+    const unsigned char *proof[8];
+    size_t plen[8];
+    secp256k1_pedersen_commitment commit[8];
+    const secp256k1_pedersen_commitment *commit_ptr[8];
+    secp256k1_generator gen[8];
+    const secp256k1_generator *gen_ptr[8];
+    const unsigned char extra[32] = "extra data for the odd proofs";
+    const unsigned char *extra_ptr[8];
+    size_t extra_len[8];
+    uint64_t minv[8];
+    uint64_t maxv[8];
+    uint64_t single_minv;
+    uint64_t single_maxv;
+    int results[8];
+    unsigned char blind[32];
+    unsigned char seed[32];
+    uint64_t v;
+    size_t bad;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        secp256k1_rand256(seed);
+        secp256k1_rand256(blind);
+        CHECK(secp256k1_generator_generate(ctx, &gen[i], seed));
+        v = secp256k1_rands64(3, INT64_MAX);
+        CHECK(secp256k1_pedersen_commit(ctx, &commit[i], blind, v, &gen[i]));
+        extra_ptr[i] = (i & 1) ? extra : NULL;
+        extra_len[i] = (i & 1) ? sizeof(extra) : 0;
+        plen[i] = sizeof(proof_data[i]);
+        CHECK(secp256k1_rangeproof_sign(ctx, proof_data[i], &plen[i], i & 2, &commit[i], blind, commit[i].data, i % 3, secp256k1_rand32() % 64, v, NULL, 0, extra_ptr[i], extra_len[i], &gen[i]));
+        proof[i] = proof_data[i];
+        commit_ptr[i] = &commit[i];
+        gen_ptr[i] = &gen[i];
+    }
+
+    /* The batch accepts exactly what individual verification accepts */
+    CHECK(secp256k1_rangeproof_verify_batch(ctx, results, minv, maxv, commit_ptr, proof, plen, extra_ptr, extra_len, gen_ptr, n));
+    for (i = 0; i < n; i++) {
+        CHECK(results[i] == 1);
+        CHECK(secp256k1_rangeproof_verify(ctx, &single_minv, &single_maxv, &commit[i], proof[i], plen[i], extra_ptr[i], extra_len[i], &gen[i]));
+        CHECK(minv[i] == single_minv);
+        CHECK(maxv[i] == single_maxv);
+    }
+    CHECK(secp256k1_rangeproof_verify_batch(ctx, results, minv, maxv, commit_ptr, proof, plen, NULL, NULL, gen_ptr, 0));
+
+    /* A corrupted proof only fails its own result */
+    bad = secp256k1_rand32() % n;
+    proof_data[bad][plen[bad] - 1 - (secp256k1_rand32() % 32)] ^= 1 << (secp256k1_rand32() % 8);
+    CHECK(!secp256k1_rangeproof_verify_batch(ctx, results, minv, maxv, commit_ptr, proof, plen, extra_ptr, extra_len, gen_ptr, n));
+    for (i = 0; i < n; i++) {
+        CHECK(results[i] == (i != bad));
+    }
+
+    /* As does a proof that does not even parse */
+    plen[bad] = 1;
+    CHECK(!secp256k1_rangeproof_verify_batch(ctx, results, minv, maxv, commit_ptr, proof, plen, extra_ptr, extra_len, gen_ptr, n));
+    for (i = 0; i < n; i++) {
+        CHECK(results[i] == (i != bad));
+    }
+}
+
 void test_rangeproof_fixed_vectors(void) {
     const unsigned char vector_1[] = {
         0x62, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x56, 0x02, 0x2a, 0x5c, 0x42, 0x0e, 0x1d,
@@ -704,6 +768,9 @@ void run_rangeproof_tests(void) {
     }
     test_rangeproof();
     test_multiple_generators();
+    for (i = 0; i < count; i++) {
+        test_rangeproof_batch();
+    }
 }
 
 #endif
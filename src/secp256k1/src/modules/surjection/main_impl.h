@@ -15,6 +15,13 @@
 #include "include/secp256k1_rangeproof.h"
 #include "include/secp256k1_surjectionproof.h"
 
+struct secp256k1_surjectionproof_input_table_struct {
+    size_t n_inputs;
+    secp256k1_ge inputs[SECP256K1_SURJECTIONPROOF_MAX_N_INPUTS];
+    /* Proof message hash state after writing all input tags, see secp256k1_surjection_genmessage */
+    secp256k1_sha256 sha256_inputs;
+};
+
 static size_t secp256k1_count_bits_set(const unsigned char* data, size_t count) {
     size_t ret = 0;
     size_t i;
@@ -335,4 +342,157 @@ int secp256k1_surjectionproof_verify(const secp256k1_context* ctx, const secp256
     return secp256k1_borromean_verify(&ctx->ecmult_ctx, NULL, &proof->data[0], borromean_s, ring_pubkeys, rsizes, 1, msg32, 32);
 }
 
+secp256k1_surjectionproof_input_table* secp256k1_surjectionproof_input_table_create(const secp256k1_context* ctx, const secp256k1_generator* ephemeral_input_tags, size_t n_ephemeral_input_tags) {
+    secp256k1_surjectionproof_input_table* table;
+    unsigned char pk_ser[33];
+    size_t pk_len = sizeof(pk_ser);
+    size_t i;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(ephemeral_input_tags != NULL);
+    ARG_CHECK(n_ephemeral_input_tags <= SECP256K1_SURJECTIONPROOF_MAX_N_INPUTS);
+
+    table = (secp256k1_surjectionproof_input_table*)checked_malloc(&ctx->error_callback, sizeof(*table));
+    table->n_inputs = n_ephemeral_input_tags;
+    secp256k1_sha256_initialize(&table->sha256_inputs);
+    for (i = 0; i < n_ephemeral_input_tags; i++) {
+        secp256k1_generator_load(&table->inputs[i], &ephemeral_input_tags[i]);
+        /* Same serialization as secp256k1_surjection_genmessage */
+        secp256k1_eckey_pubkey_serialize(&table->inputs[i], pk_ser, &pk_len, 1);
+        assert(pk_len == sizeof(pk_ser));
+        secp256k1_sha256_write(&table->sha256_inputs, pk_ser, pk_len);
+    }
+    return table;
+}
+
+void secp256k1_surjectionproof_input_table_destroy(secp256k1_surjectionproof_input_table* table) {
+    free(table);
+}
+
+int secp256k1_surjectionproof_verify_batch(const secp256k1_context* ctx, int *results, const secp256k1_surjectionproof * const *proofs, const secp256k1_generator * const *ephemeral_output_tags, size_t n_proofs, const secp256k1_surjectionproof_input_table* table) {
+    secp256k1_gej *ring_pubkeys;
+    secp256k1_scalar *borromean_s;
+    unsigned char *msg32;
+    size_t *n_used;
+    const unsigned char **e0;
+    const secp256k1_gej **bpubs;
+    const secp256k1_scalar **bs;
+    const size_t **brsizes;
+    const unsigned char **bm;
+    size_t *nrings;
+    size_t *bidx;
+    int *bresults;
+    size_t n_total_used;
+    size_t nbatch;
+    size_t offset;
+    size_t i;
+    size_t j;
+    int ret;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(results != NULL);
+    ARG_CHECK(proofs != NULL);
+    ARG_CHECK(ephemeral_output_tags != NULL);
+    ARG_CHECK(table != NULL);
+    if (n_proofs == 0) {
+        return 1;
+    }
+
+    /* Size the key storage by the inputs each proof actually uses */
+    n_total_used = 0;
+    for (i = 0; i < n_proofs; i++) {
+        ARG_CHECK(proofs[i] != NULL);
+        ARG_CHECK(ephemeral_output_tags[i] != NULL);
+        n_total_used += secp256k1_surjectionproof_n_used_inputs(ctx, proofs[i]);
+    }
+
+    ring_pubkeys = (secp256k1_gej *)checked_malloc(&ctx->error_callback, sizeof(secp256k1_gej) * (n_total_used + 1));
+    borromean_s = (secp256k1_scalar *)checked_malloc(&ctx->error_callback, sizeof(secp256k1_scalar) * (n_total_used + 1));
+    msg32 = (unsigned char *)checked_malloc(&ctx->error_callback, 32 * n_proofs);
+    n_used = (size_t *)checked_malloc(&ctx->error_callback, sizeof(size_t) * n_proofs);
+    e0 = (const unsigned char **)checked_malloc(&ctx->error_callback, sizeof(const unsigned char *) * n_proofs);
+    bpubs = (const secp256k1_gej **)checked_malloc(&ctx->error_callback, sizeof(const secp256k1_gej *) * n_proofs);
+    bs = (const secp256k1_scalar **)checked_malloc(&ctx->error_callback, sizeof(const secp256k1_scalar *) * n_proofs);
+    brsizes = (const size_t **)checked_malloc(&ctx->error_callback, sizeof(const size_t *) * n_proofs);
+    bm = (const unsigned char **)checked_malloc(&ctx->error_callback, sizeof(const unsigned char *) * n_proofs);
+    nrings = (size_t *)checked_malloc(&ctx->error_callback, sizeof(size_t) * n_proofs);
+    bidx = (size_t *)checked_malloc(&ctx->error_callback, sizeof(size_t) * n_proofs);
+    bresults = (int *)checked_malloc(&ctx->error_callback, sizeof(int) * n_proofs);
+
+    /* Proofs that fail the structural checks of secp256k1_surjectionproof_verify are kept out of the batch */
+    nbatch = 0;
+    offset = 0;
+    for (i = 0; i < n_proofs; i++) {
+        secp256k1_sha256 sha256_en;
+        secp256k1_ge output;
+        unsigned char pk_ser[33];
+        size_t pk_len = sizeof(pk_ser);
+        size_t n_total_pubkeys = secp256k1_surjectionproof_n_total_inputs(ctx, proofs[i]);
+        size_t n_used_pubkeys = secp256k1_surjectionproof_n_used_inputs(ctx, proofs[i]);
+
+        results[i] = 0;
+        if (n_used_pubkeys == 0 || n_used_pubkeys > n_total_pubkeys || n_total_pubkeys != table->n_inputs) {
+            continue;
+        }
+
+        secp256k1_generator_load(&output, ephemeral_output_tags[i]);
+        if (secp256k1_surjection_compute_public_keys(&ring_pubkeys[offset], n_used_pubkeys, table->inputs, n_total_pubkeys, proofs[i]->used_inputs, &output, 0, NULL) == 0) {
+            continue;
+        }
+        for (j = 0; j < n_used_pubkeys; j++) {
+            int overflow = 0;
+            secp256k1_scalar_set_b32(&borromean_s[offset + j], &proofs[i]->data[32 + 32 * j], &overflow);
+            if (overflow == 1) {
+                break;
+            }
+        }
+        if (j != n_used_pubkeys) {
+            continue;
+        }
+
+        /* The message only needs the output tag appended to the precomputed input tag hash */
+        sha256_en = table->sha256_inputs;
+        secp256k1_eckey_pubkey_serialize(&output, pk_ser, &pk_len, 1);
+        assert(pk_len == sizeof(pk_ser));
+        secp256k1_sha256_write(&sha256_en, pk_ser, pk_len);
+        secp256k1_sha256_finalize(&sha256_en, &msg32[32 * nbatch]);
+
+        results[i] = 1;
+        n_used[nbatch] = n_used_pubkeys;
+        e0[nbatch] = &proofs[i]->data[0];
+        bpubs[nbatch] = &ring_pubkeys[offset];
+        bs[nbatch] = &borromean_s[offset];
+        brsizes[nbatch] = &n_used[nbatch];
+        bm[nbatch] = &msg32[32 * nbatch];
+        nrings[nbatch] = 1;
+        bidx[nbatch] = i;
+        nbatch++;
+        offset += n_used_pubkeys;
+    }
+
+    secp256k1_borromean_verify_batch(&ctx->ecmult_ctx, &ctx->error_callback, bresults, e0, bs, bpubs, brsizes, nrings, bm, 32, nbatch);
+    for (i = 0; i < nbatch; i++) {
+        results[bidx[i]] = bresults[i];
+    }
+    ret = 1;
+    for (i = 0; i < n_proofs; i++) {
+        ret &= results[i];
+    }
+
+    free(ring_pubkeys);
+    free(borromean_s);
+    free(msg32);
+    free(n_used);
+    free(e0);
+    free(bpubs);
+    free(bs);
+    free(brsizes);
+    free(bm);
+    free(nrings);
+    free(bidx);
+    free(bresults);
+    return ret;
+}
+
 #endif
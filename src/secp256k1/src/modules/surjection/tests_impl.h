@@ -471,6 +471,69 @@ void test_bad_parse(void) {
     CHECK(secp256k1_surjectionproof_parse(ctx, &proof, serialized_proof2, sizeof(serialized_proof2)) == 0);
 }
 
+static void test_verify_batch(size_t n_inputs, size_t n_outputs) {
+    unsigned char seed[32];
+    secp256k1_fixed_asset_tag fixed_input_tags[16];
+    secp256k1_generator ephemeral_input_tags[16];
+    unsigned char input_blinding_key[16][32];
+    secp256k1_generator ephemeral_output_tags[8];
+    const secp256k1_generator *output_tag_ptrs[8];
+    unsigned char output_blinding_key[32];
+    secp256k1_surjectionproof proofs[8];
+    const secp256k1_surjectionproof *proof_ptrs[8];
+    secp256k1_surjectionproof_input_table *table;
+    int results[8];
+    size_t input_index;
+    size_t bad;
+    size_t i;
+
+    CHECK(n_inputs > 0 && n_inputs <= 16);
+    CHECK(n_outputs > 0 && n_outputs <= 8);
+    for (i = 0; i < n_inputs; i++) {
+        secp256k1_rand256(fixed_input_tags[i].data);
+        secp256k1_rand256(input_blinding_key[i]);
+        CHECK(secp256k1_generator_generate_blinded(ctx, &ephemeral_input_tags[i], fixed_input_tags[i].data, input_blinding_key[i]));
+    }
+    for (i = 0; i < n_outputs; i++) {
+        const size_t key_index = secp256k1_rand32() % n_inputs;
+        secp256k1_rand256(seed);
+        secp256k1_rand256(output_blinding_key);
+        CHECK(secp256k1_generator_generate_blinded(ctx, &ephemeral_output_tags[i], fixed_input_tags[key_index].data, output_blinding_key));
+        CHECK(secp256k1_surjectionproof_initialize(ctx, &proofs[i], &input_index, fixed_input_tags, n_inputs, n_inputs < 3 ? n_inputs : 3, &fixed_input_tags[key_index], 100, seed) > 0);
+        CHECK(secp256k1_surjectionproof_generate(ctx, &proofs[i], ephemeral_input_tags, n_inputs, &ephemeral_output_tags[i], input_index, input_blinding_key[input_index], output_blinding_key));
+        proof_ptrs[i] = &proofs[i];
+        output_tag_ptrs[i] = &ephemeral_output_tags[i];
+    }
+
+    table = secp256k1_surjectionproof_input_table_create(ctx, ephemeral_input_tags, n_inputs);
+    CHECK(table != NULL);
+    CHECK(secp256k1_surjectionproof_verify_batch(ctx, results, proof_ptrs, output_tag_ptrs, n_outputs, table) == 1);
+    for (i = 0; i < n_outputs; i++) {
+        CHECK(results[i] == 1);
+    }
+    CHECK(secp256k1_surjectionproof_verify_batch(ctx, results, proof_ptrs, output_tag_ptrs, 0, table) == 1);
+
+    /* A proof checked against the wrong output tag only fails its own result */
+    bad = secp256k1_rand32() % n_outputs;
+    output_tag_ptrs[bad] = &ephemeral_input_tags[0];
+    CHECK(secp256k1_surjectionproof_verify_batch(ctx, results, proof_ptrs, output_tag_ptrs, n_outputs, table) == 0);
+    for (i = 0; i < n_outputs; i++) {
+        CHECK(results[i] == (i != bad));
+        CHECK(secp256k1_surjectionproof_verify(ctx, proof_ptrs[i], ephemeral_input_tags, n_inputs, output_tag_ptrs[i]) == results[i]);
+    }
+    secp256k1_surjectionproof_input_table_destroy(table);
+
+    /* A table over a different number of inputs rejects every proof */
+    if (n_inputs > 1) {
+        table = secp256k1_surjectionproof_input_table_create(ctx, ephemeral_input_tags, n_inputs - 1);
+        CHECK(secp256k1_surjectionproof_verify_batch(ctx, results, proof_ptrs, output_tag_ptrs, n_outputs, table) == 0);
+        for (i = 0; i < n_outputs; i++) {
+            CHECK(results[i] == 0);
+        }
+        secp256k1_surjectionproof_input_table_destroy(table);
+    }
+}
+
 void run_surjection_tests(void) {
     int i;
     for (i = 0; i < count; i++) {
@@ -487,6 +550,9 @@ void run_surjection_tests(void) {
     test_gen_verify(10, 3);
     test_gen_verify(SECP256K1_SURJECTIONPROOF_MAX_N_INPUTS, SECP256K1_SURJECTIONPROOF_MAX_N_INPUTS);
     test_no_used_inputs_verify();
+    test_verify_batch(1, 1);
+    test_verify_batch(3, 8);
+    test_verify_batch(16, 5);
     test_bad_serialize();
     test_bad_parse();
 }
@@ -68,4 +68,60 @@ BOOST_AUTO_TEST_CASE(GetFeeTest)
     CFeeRate(MAX_MONEY, std::numeric_limits<size_t>::max() >> 1).GetFeePerK();
 }
 
+BOOST_AUTO_TEST_CASE(AmountMapTest)
+{
+    CAsset a, b, c, d, e;
+    a.begin()[0] = 1; b.begin()[0] = 2; c.begin()[0] = 3; d.begin()[0] = 4; e.begin()[0] = 5;
+
+    // Entries stay sorted by asset past the inline capacity
+    CAmountMap map;
+    map[e] = 5;
+    map[b] = 2;
+    map[d] = 4;
+    map[a] = 1;
+    map[c] = 3;
+    BOOST_CHECK_EQUAL(map.size(), 5U);
+    CAmount n = 1;
+    for (CAmountMap::const_iterator it = map.begin(); it != map.end(); ++it, ++n) {
+        BOOST_CHECK_EQUAL(it->second, n);
+        BOOST_CHECK(it == map.begin() || std::prev(it)->first < it->first);
+    }
+    BOOST_CHECK(map.find(c) != map.end() && map.at(c) == 3);
+    BOOST_CHECK_EQUAL(map.erase(c), 1U);
+    BOOST_CHECK_EQUAL(map.erase(c), 0U);
+    BOOST_CHECK(map.find(c) == map.end());
+    BOOST_CHECK_EQUAL(map.count(c), 0U);
+    BOOST_CHECK_THROW(map.at(c), std::out_of_range);
+
+    // Missing assets count as zero
+    CAmountMap ab, abc;
+    ab[a] = 1; ab[b] = 2;
+    abc[a] = 1; abc[b] = 2; abc[c] = 1;
+    BOOST_CHECK(ab <= abc && ab < abc && !(ab == abc) && ab != abc);
+    BOOST_CHECK(abc >= ab && abc > ab);
+    BOOST_CHECK(ab <= ab && ab >= ab && ab == ab && !(ab < ab) && !(ab > ab));
+    CAmountMap zero;
+    zero[c] = 0;
+    BOOST_CHECK(zero == CAmountMap() && !zero);
+
+    // Incomparable maps
+    CAmountMap bc;
+    bc[b] = 2; bc[c] = 1;
+    BOOST_CHECK(!(ab == bc) && !(ab >= bc) && !(ab <= bc) && !(ab < bc) && !(ab > bc));
+    BOOST_CHECK(ab != bc);
+    CAmountMap bminusc;
+    bminusc[b] = 2; bminusc[c] = -1;
+
+    // Arithmetic keeps every asset touched
+    CAmountMap sum = ab + bminusc;
+    BOOST_CHECK_EQUAL(sum.size(), 3U);
+    BOOST_CHECK_EQUAL(sum[a], 1);
+    BOOST_CHECK_EQUAL(sum[b], 4);
+    BOOST_CHECK_EQUAL(sum[c], -1);
+    sum -= bminusc;
+    BOOST_CHECK(sum == ab);
+    BOOST_CHECK_EQUAL(sum.size(), 3U);
+    BOOST_CHECK(MoneyRange(sum) && !MoneyRange(bminusc));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
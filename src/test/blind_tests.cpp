@@ -14,6 +14,7 @@
 #include "test/test_bitcoin.h"
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 
 BOOST_FIXTURE_TEST_SUITE(blind_tests, TestingSetup)
@@ -51,26 +52,9 @@ BOOST_AUTO_TEST_CASE(naive_blinding_test)
 
     uint256 blind3, blind4, blindDummy;
 
-    {
-        CCoinsModifier tx1 = cache.ModifyCoins(ArithToUint256(1));
-        tx1->vout.resize(1);
-        tx1->vout[0].nValue = 11;
-        tx1->vout[0].nAsset = bitcoinID;
-    }
-
-    {
-        CCoinsModifier tx2 = cache.ModifyCoins(ArithToUint256(2));
-        tx2->vout.resize(2);
-        tx2->vout[0].nValue = 111;
-        tx2->vout[0].nAsset = bitcoinID;
-    }
-
-    {
-        CCoinsModifier tx2_2 = cache.ModifyCoins(ArithToUint256(5));
-        tx2_2->vout.resize(1);
-        tx2_2->vout[0].nValue = 500;
-        tx2_2->vout[0].nAsset = otherID;
-    }
+    cache.AddCoin(COutPoint(ArithToUint256(1), 0), Coin(CTxOut(bitcoinID, 11, CScript() << OP_TRUE), 1, false), false);
+    cache.AddCoin(COutPoint(ArithToUint256(2), 0), Coin(CTxOut(bitcoinID, 111, CScript() << OP_TRUE), 1, false), false);
+    cache.AddCoin(COutPoint(ArithToUint256(5), 0), Coin(CTxOut(otherID, 500, CScript() << OP_TRUE), 1, false), false);
 
     {
         // Build a transaction that spends 2 unblinded coins (11, 111), and produces a single blinded one (100) and fee (22).
@@ -87,6 +71,15 @@ BOOST_AUTO_TEST_CASE(naive_blinding_test)
         tx3.vout.push_back(CTxOut(bitcoinID, 22, CScript()));
         BOOST_CHECK(VerifyAmounts(cache, tx3));
 
+        // The same check against a snapshot of the spent outputs
+        std::vector<CTxOut> vSpent = GetSpentOutputs(cache, tx3);
+        BOOST_CHECK_EQUAL(vSpent.size(), 2U);
+        BOOST_CHECK(vSpent[0] == cache.AccessCoin(tx3.vin[0].prevout).out);
+        BOOST_CHECK(VerifyAmounts(vSpent, tx3));
+        BOOST_CHECK(!VerifyAmounts(std::vector<CTxOut>(vSpent.begin(), vSpent.begin() + 1), tx3));
+        vSpent[0].nValue = 12;
+        BOOST_CHECK(!VerifyAmounts(vSpent, tx3));
+
         // Malleate the output and check for correct handling of bad commitments
         // These will fail IsValid checks
         std::vector<unsigned char> asset_copy(tx3.vout[0].nAsset.vchCommitment);
@@ -154,11 +147,8 @@ BOOST_AUTO_TEST_CASE(naive_blinding_test)
         BOOST_CHECK(UnblindConfidentialPair(keyDummy, tx3.vout[2].nValue, tx3.vout[2].nAsset, tx3.vout[2].nNonce, CScript() << OP_RETURN, tx3.wit.vtxoutwit[2].vchRangeproof, unblinded_amount, blindDummy, temp_asset, temp_asset_blinder) == 1);
         BOOST_CHECK(unblinded_amount == 0);
 
-        CCoinsModifier in3 = cache.ModifyCoins(ArithToUint256(3));
-        in3->vout.resize(3);
-        in3->vout[0] = tx3.vout[0];
-        in3->vout[1] = tx3.vout[1];
-        in3->vout[2] = tx3.vout[2];
+        for (size_t i = 0; i < tx3.vout.size(); i++)
+            cache.AddCoin(COutPoint(ArithToUint256(3), i), Coin(tx3.vout[i], 1, false), false);
 
         tx3.vout[1].nValue = CConfidentialValue(tx3.vout[1].nValue.GetAmount() - 1);
         BOOST_CHECK(!VerifyAmounts(cache, tx3));
@@ -319,12 +309,8 @@ BOOST_AUTO_TEST_CASE(naive_blinding_test)
         BOOST_CHECK(UnblindConfidentialPair(key2, tx4.vout[2].nValue, tx4.vout[2].nAsset, tx4.vout[2].nNonce, scriptCommit, tx4.wit.vtxoutwit[2].vchRangeproof, unblinded_amount, blind4, asset_out, asset_blinder_out) == 0);
 
 
-        CCoinsModifier in4 = cache.ModifyCoins(ArithToUint256(4));
-        in4->vout.resize(4);
-        in4->vout[0] = tx4.vout[0];
-        in4->vout[1] = tx4.vout[1];
-        in4->vout[2] = tx4.vout[2];
-        in4->vout[3] = tx4.vout[3];
+        for (size_t i = 0; i < tx4.vout.size(); i++)
+            cache.AddCoin(COutPoint(ArithToUint256(4), i), Coin(tx4.vout[i], 1, false), false);
 
         tx4.vout[3].nValue = CConfidentialValue(tx4.vout[3].nValue.GetAmount() - 1);
         BOOST_CHECK(!VerifyAmounts(cache, tx4));
@@ -416,4 +402,114 @@ BOOST_AUTO_TEST_CASE(naive_blinding_test)
         
     }
 }
+
+BOOST_AUTO_TEST_CASE(parallel_blinding_test)
+{
+    CCoinsView viewBase;
+    CCoinsViewCache cache(&viewBase);
+    secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_NONE);
+
+    CAsset bitcoinID(GetRandHash());
+    std::vector<CKey> vDummy;
+
+    cache.AddCoin(COutPoint(ArithToUint256(1), 0), Coin(CTxOut(bitcoinID, 1000, CScript() << OP_TRUE), 1, false), false);
+    cache.AddCoin(COutPoint(ArithToUint256(1), 1), Coin(CTxOut(bitcoinID, 1000, CScript() << OP_TRUE), 1, false), false);
+
+    // Spend both coins to a dozen outputs to be blinded, and a fee
+    const size_t nOutputs = 12;
+    CMutableTransaction tx;
+    tx.vin.resize(2);
+    tx.vin[0].prevout.hash = ArithToUint256(1);
+    tx.vin[0].prevout.n = 0;
+    tx.vin[1].prevout.hash = ArithToUint256(1);
+    tx.vin[1].prevout.n = 1;
+    std::vector<CKey> keys(nOutputs);
+    std::vector<CPubKey> output_pubkeys;
+    for (size_t i = 0; i < nOutputs; i++) {
+        keys[i].MakeNewKey(true);
+        output_pubkeys.push_back(keys[i].GetPubKey());
+        tx.vout.push_back(CTxOut(bitcoinID, 100 + i, CScript() << OP_TRUE));
+    }
+    tx.vout.push_back(CTxOut(bitcoinID, 2000 - 100 * nOutputs - (nOutputs - 1) * nOutputs / 2, CScript()));
+    BOOST_CHECK(VerifyAmounts(cache, tx));
+
+    std::vector<uint256> input_blinds(2), input_asset_blinds(2), output_blinds, output_asset_blinds;
+    std::vector<CAsset> input_assets(2, bitcoinID);
+    std::vector<CAmount> input_amounts(2, 1000);
+    nBlindThreads = 4;
+    boost::thread_group threadGroup;
+    for (int i = 0; i < nBlindThreads - 1; i++)
+        threadGroup.create_thread(&ThreadBlindProofs);
+    BOOST_CHECK_EQUAL(BlindTransaction(input_blinds, input_asset_blinds, input_assets, input_amounts, output_blinds, output_asset_blinds, output_pubkeys, vDummy, vDummy, tx), (int)nOutputs);
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    nBlindThreads = 0;
+    BOOST_CHECK(VerifyAmounts(cache, tx));
+
+    // Surjection targets as BlindTransaction sees them: both inputs are the unblinded asset
+    std::vector<secp256k1_fixed_asset_tag> input_tags(2);
+    std::vector<secp256k1_generator> input_generators(2);
+    for (size_t i = 0; i < 2; i++) {
+        memcpy(&input_tags[i], bitcoinID.begin(), 32);
+        BOOST_CHECK(secp256k1_generator_generate(ctx, &input_generators[i], bitcoinID.begin()) == 1);
+    }
+
+    for (size_t i = 0; i < nOutputs; i++) {
+        CAmount amount;
+        uint256 blind, asset_blind;
+        CAsset asset;
+        BOOST_CHECK(UnblindConfidentialPair(keys[i], tx.vout[i].nValue, tx.vout[i].nAsset, tx.vout[i].nNonce, tx.vout[i].scriptPubKey, tx.wit.vtxoutwit[i].vchRangeproof, amount, blind, asset, asset_blind));
+        BOOST_CHECK_EQUAL(amount, (CAmount)(100 + i));
+        BOOST_CHECK(asset == bitcoinID);
+        BOOST_CHECK(blind == output_blinds[i]);
+        BOOST_CHECK(asset_blind == output_asset_blinds[i]);
+
+        // The proofs only depend on randomness drawn before proving, so proving the output
+        // again serially from its blinding factors gives the same bytes as the blinding threads
+        uint256 nonce = keys[i].ECDH(CPubKey(tx.vout[i].nNonce.vchCommitment));
+        CSHA256().Write(nonce.begin(), 32).Finalize(nonce.begin());
+        secp256k1_generator gen;
+        secp256k1_pedersen_commitment commit;
+        BOOST_CHECK(secp256k1_generator_parse(ctx, &gen, &tx.vout[i].nAsset.vchCommitment[0]) == 1);
+        BOOST_CHECK(secp256k1_pedersen_commitment_parse(ctx, &commit, &tx.vout[i].nValue.vchCommitment[0]) == 1);
+        std::vector<unsigned char*> blindptrs(1, output_blinds[i].begin());
+        std::vector<const unsigned char*> assetblindptrs(1, output_asset_blinds[i].begin());
+        std::vector<unsigned char> vchRangeproof;
+        BOOST_CHECK(GenerateRangeproof(vchRangeproof, blindptrs, nonce, amount, tx.vout[i].scriptPubKey, commit, gen, asset, assetblindptrs));
+        BOOST_CHECK(vchRangeproof == tx.wit.vtxoutwit[i].vchRangeproof);
+        CTxOutWitness txoutwit;
+        BOOST_CHECK(SurjectOutput(txoutwit, input_tags, input_generators, input_asset_blinds, assetblindptrs, gen, asset));
+        BOOST_CHECK(txoutwit.vchSurjectionproof == tx.wit.vtxoutwit[i].vchSurjectionproof);
+    }
+
+    secp256k1_context_destroy(ctx);
+}
+
+BOOST_AUTO_TEST_CASE(asset_generator_cache)
+{
+    secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_NONE);
+    CAsset asset(GetRandHash());
+
+    secp256k1_generator expected;
+    unsigned char vchExpected[CConfidentialAsset::nCommittedSize];
+    BOOST_CHECK(secp256k1_generator_generate(ctx, &expected, asset.begin()) == 1);
+    BOOST_CHECK(secp256k1_generator_serialize(ctx, vchExpected, &expected) == 1);
+
+    // The first lookup computes the generator, the second one is served from the cache
+    AssetGeneratorCacheStats before = GetAssetGeneratorCacheStats();
+    for (int i = 0; i < 2; i++) {
+        secp256k1_generator gen;
+        unsigned char vchGen[CConfidentialAsset::nCommittedSize];
+        GetAssetGenerator(gen, asset, vchGen);
+        BOOST_CHECK(memcmp(&gen, &expected, sizeof(gen)) == 0);
+        BOOST_CHECK(memcmp(vchGen, vchExpected, sizeof(vchGen)) == 0);
+    }
+    AssetGeneratorCacheStats after = GetAssetGeneratorCacheStats();
+    BOOST_CHECK_EQUAL(after.misses, before.misses + 1);
+    BOOST_CHECK_EQUAL(after.hits, before.hits + 1);
+    BOOST_CHECK(after.entries <= after.capacity);
+
+    secp256k1_context_destroy(ctx);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -3,7 +3,10 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "coins.h"
+#include "compressor.h"
+#include "dbwrapper.h"
 #include "script/standard.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "undo.h"
 #include "utilstrencodings.h"
@@ -878,3 +881,151 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
 BOOST_AUTO_TEST_SUITE_END()
 
 */
+
+BOOST_FIXTURE_TEST_SUITE(coins_tests, BasicTestingSetup)
+
+static CTxOut CoinsTestOutput(CAmount nValue)
+{
+    return CTxOut(CAsset(uint256S("01")), nValue, CScript() << OP_TRUE);
+}
+
+BOOST_AUTO_TEST_CASE(coin_serialization)
+{
+    CTxOut out = CoinsTestOutput(50 * COIN);
+    out.nValue.vchCommitment.assign(33, 0x08);
+    Coin coin(out, 120891, true);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << coin;
+    Coin coin2;
+    ss >> coin2;
+    BOOST_CHECK(coin2.out == out);
+    BOOST_CHECK_EQUAL(coin2.nHeight, 120891U);
+    BOOST_CHECK(coin2.IsCoinBase());
+
+    // The undo records of the spent outputs are readable as coins
+    CTxUndo txundo;
+    txundo.vprevout.push_back(coin);
+    txundo.vprevout.push_back(Coin(CoinsTestOutput(1), 7, false));
+    CDataStream ssUndo(SER_DISK, CLIENT_VERSION);
+    ssUndo << txundo;
+    CTxUndo txundo2;
+    ssUndo >> txundo2;
+    BOOST_CHECK_EQUAL(txundo2.vprevout.size(), 2U);
+    BOOST_CHECK(txundo2.vprevout[0].out == out);
+    BOOST_CHECK_EQUAL(txundo2.vprevout[1].nHeight, 7U);
+    BOOST_CHECK(!txundo2.vprevout[1].IsCoinBase());
+}
+
+BOOST_AUTO_TEST_CASE(coins_cache_add_spend)
+{
+    CCoinsView viewDummy;
+    CCoinsViewCache base(&viewDummy);
+    CCoinsViewCache cache(&base);
+    COutPoint outpoint(uint256S("02"), 3);
+
+    CTxOut out = CoinsTestOutput(10);
+    out.nNonce.vchCommitment.assign(33, 0x02);
+    cache.AddCoin(outpoint, Coin(out, 5, false), false);
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    BOOST_CHECK(!cache.HaveCoin(COutPoint(outpoint.hash, 2)));
+    // Only the recipient has any use for the nonce
+    BOOST_CHECK(cache.AccessCoin(outpoint).out.nNonce.IsNull());
+    BOOST_CHECK_THROW(cache.AddCoin(outpoint, Coin(out, 5, false), false), std::logic_error);
+
+    // Unspendable outputs are not added
+    COutPoint fee(outpoint.hash, 4);
+    cache.AddCoin(fee, Coin(CTxOut(CAsset(uint256S("01")), 1, CScript()), 5, false), false);
+    BOOST_CHECK(!cache.HaveCoin(fee));
+
+    // A coin created and spent in the same cache never reaches the parent
+    Coin moved;
+    BOOST_CHECK(cache.SpendCoin(outpoint, &moved));
+    BOOST_CHECK_EQUAL(moved.nHeight, 5U);
+    BOOST_CHECK(!cache.SpendCoin(outpoint));
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!base.HaveCoinInCache(outpoint));
+
+    cache.AddCoin(outpoint, std::move(moved), false);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(base.HaveCoinInCache(outpoint));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    BOOST_CHECK(cache.AccessCoin(outpoint).out.nValue == out.nValue);
+    cache.Uncache(outpoint);
+    BOOST_CHECK(!cache.HaveCoinInCache(outpoint));
+    BOOST_CHECK(!AccessByTxid(cache, outpoint.hash).IsSpent());
+}
+
+namespace {
+
+//! Output in the layout CTxOutCompressor wrote before it learned the compact one
+struct LegacyTxOut
+{
+    const CTxOut &txout;
+
+    LegacyTxOut(const CTxOut &txoutIn) : txout(txoutIn) {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        uint64_t nVal = CTxOutCompressor::CompressAmount(txout.nValue.GetAmount());
+        ::Serialize(s, (unsigned char)0);
+        ::Serialize(s, VARINT(nVal));
+        ::Serialize(s, txout.nAsset);
+        ::Serialize(s, CScriptCompressor(REF(txout.scriptPubKey)));
+    }
+};
+
+//! Per-transaction coins record in the format of chainstates older than
+//! the per-output one: outputs 0, 1 and 3 are unspent, output 2 is spent.
+struct LegacyCoinsRecord
+{
+    CTxOut vout[4];
+    int nHeight;
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        ::Serialize(s, VARINT(1)); // version
+        ::Serialize(s, VARINT(2 + 4 + 8)); // outputs 0 and 1, one non-zero mask byte
+        ::Serialize(s, (unsigned char)0x02); // output 3
+        ::Serialize(s, LegacyTxOut(vout[0]));
+        ::Serialize(s, LegacyTxOut(vout[1]));
+        ::Serialize(s, LegacyTxOut(vout[3]));
+        ::Serialize(s, VARINT(nHeight));
+    }
+};
+
+} // namespace
+
+BOOST_FIXTURE_TEST_CASE(coins_db_upgrade, TestingSetup)
+{
+    uint256 txid = uint256S("03");
+    LegacyCoinsRecord record;
+    for (int i = 0; i < 4; i++)
+        record.vout[i] = CoinsTestOutput(1000 + i);
+    record.nHeight = 42;
+    {
+        CDBWrapper db(GetDataDir() / "chainstate", 1 << 20, false, true, true);
+        BOOST_CHECK(db.Write(std::make_pair('c', txid), record));
+    }
+
+    CCoinsViewDB view(1 << 20, false, false);
+    BOOST_CHECK(!view.HaveCoin(COutPoint(txid, 0)));
+    BOOST_CHECK(view.Upgrade());
+    for (int i = 0; i < 4; i++) {
+        Coin coin;
+        BOOST_CHECK_EQUAL(view.GetCoin(COutPoint(txid, i), coin), i != 2);
+        if (i != 2) {
+            BOOST_CHECK(coin.out == record.vout[i]);
+            BOOST_CHECK_EQUAL(coin.nHeight, 42U);
+            BOOST_CHECK(!coin.IsCoinBase());
+        }
+    }
+    // Nothing left to upgrade
+    BOOST_CHECK(view.Upgrade());
+    std::unique_ptr<CCoinsViewCursor> pcursor(view.Cursor());
+    size_t nCoins = 0;
+    for (; pcursor->Valid(); pcursor->Next())
+        nCoins++;
+    BOOST_CHECK_EQUAL(nCoins, 3U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
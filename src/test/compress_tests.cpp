@@ -2,7 +2,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainparams.h"
 #include "compressor.h"
+#include "streams.h"
 #include "util.h"
 #include "test/test_bitcoin.h"
 
@@ -62,4 +64,109 @@ BOOST_AUTO_TEST_CASE(compress_amounts)
         BOOST_CHECK(TestDecode(i));
 }
 
+static CTxOut CompressTestOutput()
+{
+    return CTxOut(Params().GetConsensus().pegged_asset, 50 * COIN, CScript() << OP_TRUE);
+}
+
+static void SetCommitment(std::vector<unsigned char>& vchCommitment, unsigned char prefix, unsigned char fill)
+{
+    vchCommitment.assign(33, fill);
+    vchCommitment[0] = prefix;
+}
+
+// Compress txout, check that it comes back unchanged, and return the compressed size
+static size_t RoundTrip(CTxOut txout)
+{
+    CDataStream ss(SER_DISK, 0);
+    ss << CTxOutCompressor(txout);
+    size_t nSize = ss.size();
+    CTxOut txoutOut;
+    ss >> REF(CTxOutCompressor(txoutOut));
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK(txoutOut == txout);
+    return nSize;
+}
+
+// Size of txout in the layout CTxOutCompressor wrote before the compact one
+static size_t LegacySize(const CTxOut& txout)
+{
+    CDataStream ss(SER_DISK, 0);
+    ss << (unsigned char)(txout.nValue.IsExplicit() ? 0 : 1);
+    if (txout.nValue.IsExplicit())
+        ss << VARINT(CTxOutCompressor::CompressAmount(txout.nValue.GetAmount()));
+    else
+        ss << txout.nValue;
+    ss << txout.nAsset;
+    ss << CScriptCompressor(REF(txout.scriptPubKey));
+    return ss.size();
+}
+
+BOOST_AUTO_TEST_CASE(compress_txout_explicit)
+{
+    // The pegged asset is implied by the header
+    CTxOut txout = CompressTestOutput();
+    BOOST_CHECK_EQUAL(RoundTrip(txout), LegacySize(txout) - 33);
+
+    // Any other explicit asset is stored without its prefix
+    txout.nAsset = CAsset(uint256S("01"));
+    BOOST_CHECK_EQUAL(RoundTrip(txout), LegacySize(txout) - 1);
+
+    // unless it is the pegged asset the compressor is given
+    CAsset asset(uint256S("01"));
+    CDataStream ss(SER_DISK, 0);
+    ss << CTxOutCompressor(txout, asset);
+    BOOST_CHECK_EQUAL(ss.size(), LegacySize(txout) - 33);
+    CTxOut txoutOut;
+    ss >> REF(CTxOutCompressor(txoutOut, asset));
+    BOOST_CHECK(txoutOut == txout);
+
+    txout.nValue = 0;
+    RoundTrip(txout);
+    txout.nValue = MAX_MONEY;
+    RoundTrip(txout);
+}
+
+BOOST_AUTO_TEST_CASE(compress_txout_confidential)
+{
+    CTxOut txout = CompressTestOutput();
+    SetCommitment(txout.nValue.vchCommitment, 0x08, 0x11);
+    BOOST_CHECK_EQUAL(RoundTrip(txout), LegacySize(txout) - 34);
+    SetCommitment(txout.nValue.vchCommitment, 0x09, 0x22);
+    RoundTrip(txout);
+
+    SetCommitment(txout.nAsset.vchCommitment, 0x0a, 0x33);
+    BOOST_CHECK_EQUAL(RoundTrip(txout), LegacySize(txout) - 2);
+    SetCommitment(txout.nAsset.vchCommitment, 0x0b, 0x44);
+    RoundTrip(txout);
+
+    // A nonce is kept when present
+    SetCommitment(txout.nNonce.vchCommitment, 0x02, 0x55);
+    BOOST_CHECK_EQUAL(RoundTrip(txout), LegacySize(txout) - 2 + 33);
+    txout.nNonce.vchCommitment[0] = 0x03;
+    RoundTrip(txout);
+
+    txout.nValue.SetNull();
+    txout.nAsset.SetNull();
+    RoundTrip(txout);
+}
+
+BOOST_AUTO_TEST_CASE(compress_txout_legacy)
+{
+    // Outputs written before the compact layout are still read, without their nonce
+    CTxOut txout = CompressTestOutput();
+    CDataStream ss(SER_DISK, 0);
+    ss << (unsigned char)0 << VARINT(CTxOutCompressor::CompressAmount(txout.nValue.GetAmount())) << txout.nAsset;
+    ss << CScriptCompressor(REF(txout.scriptPubKey));
+    CTxOut txoutOut;
+    SetCommitment(txoutOut.nNonce.vchCommitment, 0x02, 0x55);
+    ss >> REF(CTxOutCompressor(txoutOut));
+    BOOST_CHECK(txoutOut == txout);
+
+    // Unknown headers are rejected
+    CDataStream ssBad(SER_DISK, 0);
+    ssBad << (unsigned char)0xff << VARINT(CTxOutCompressor::CompressAmount(1));
+    BOOST_CHECK_THROW(ssBad >> REF(CTxOutCompressor(txoutOut)), std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
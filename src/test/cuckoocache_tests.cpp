@@ -391,4 +391,44 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, uint256Hasher>>();
 }
 
+/* Test that for_each visits exactly the elements that are in the cache and
+ * not marked for erasure, so that they can be copied into another cache.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_for_each)
+{
+    insecure_rand = FastRandomContext(true);
+    CuckooCache::cache<uint256, uint256Hasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> hashes(4000);
+    for (uint256& h : hashes) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    size_t nContained = 0;
+    for (const uint256& h : hashes)
+        nContained += cc.contains(h, false);
+
+    std::vector<uint256> visited;
+    cc.for_each([&visited](const uint256& h) { visited.push_back(h); });
+    BOOST_CHECK_EQUAL(visited.size(), nContained);
+    for (const uint256& h : visited)
+        BOOST_CHECK(std::find(hashes.begin(), hashes.end(), h) != hashes.end());
+
+    // Erased elements are skipped
+    size_t nErased = 0;
+    for (size_t i = 0; i < hashes.size(); i += 2)
+        nErased += cc.contains(hashes[i], true);
+    visited.clear();
+    cc.for_each([&visited](const uint256& h) { visited.push_back(h); });
+    BOOST_CHECK_EQUAL(visited.size(), nContained - nErased);
+
+    // and the rest can be moved to a new cache
+    CuckooCache::cache<uint256, uint256Hasher> cc2{};
+    cc2.setup_bytes(1 << 20);
+    for (const uint256& h : visited)
+        cc2.insert(h);
+    for (size_t i = 1; i < hashes.size(); i += 2)
+        BOOST_CHECK_EQUAL(cc2.contains(hashes[i], false), cc.contains(hashes[i], false));
+}
+
 BOOST_AUTO_TEST_SUITE_END();
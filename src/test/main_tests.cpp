@@ -2,7 +2,9 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chain.h"
 #include "chainparams.h"
+#include "txdb.h"
 #include "validation.h"
 #include "net.h"
 
@@ -75,4 +77,148 @@ BOOST_AUTO_TEST_CASE(test_combiner_all)
     Test.disconnect(&ReturnTrue);
     BOOST_CHECK(Test());
 }
+
+BOOST_AUTO_TEST_CASE(block_index_proof)
+{
+    CBlockHeader block;
+    block.nTime = 1234;
+    block.proof.challenge = CScript() << OP_TRUE;
+    block.proof.solution = CScript() << std::vector<unsigned char>(72, 0x30);
+    uint256 hash = block.GetHash();
+
+    // Equal challenges share one copy
+    CBlockIndex index(block);
+    BOOST_CHECK(index.pchallenge == InternBlockChallenge(CScript() << OP_TRUE));
+    BOOST_CHECK(index.pchallenge != InternBlockChallenge(CScript() << OP_FALSE));
+    std::weak_ptr<const CScript> pchallengeReleased = InternBlockChallenge(CScript() << OP_2);
+    BOOST_CHECK(pchallengeReleased.expired());
+    index.phashBlock = &hash;
+
+    CBlockHeader header;
+    BOOST_CHECK(ReadBlockHeader(header, &index));
+    BOOST_CHECK(header.proof.solution == block.proof.solution);
+    BOOST_CHECK(index.GetBlockHeader().proof.solution.empty());
+
+    // Once written, the solution is loaded from the block tree database,
+    // also across later writes of the entry
+    std::vector<const CBlockIndex*> vBlocks(1, &index);
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, vBlocks));
+    index.psolution.reset();
+    index.nStatus |= BLOCK_FAILED_VALID;
+    BOOST_CHECK(pblocktree->WriteBatchSync(std::vector<std::pair<int, const CBlockFileInfo*> >(), 0, vBlocks));
+    BOOST_CHECK(ReadBlockHeader(header, &index));
+    BOOST_CHECK(header.proof.solution == block.proof.solution);
+    BOOST_CHECK(header.proof.challenge == block.proof.challenge);
+    BOOST_CHECK(header.GetHash() == hash);
+
+    // Loading refers to the stored challenge
+    std::map<uint256, CBlockIndex*> mapLoaded;
+    BOOST_CHECK(pblocktree->LoadBlockIndexGuts([&mapLoaded](const uint256& hashIndex) -> CBlockIndex* {
+        if (hashIndex.IsNull())
+            return NULL;
+        CBlockIndex*& pindex = mapLoaded[hashIndex];
+        if (!pindex)
+            pindex = new CBlockIndex();
+        return pindex;
+    }));
+    BOOST_CHECK(mapLoaded.count(hash));
+    BOOST_CHECK(mapLoaded[hash]->pchallenge == index.pchallenge);
+    BOOST_CHECK(mapLoaded[hash]->nStatus == index.nStatus);
+    for (std::map<uint256, CBlockIndex*>::iterator it = mapLoaded.begin(); it != mapLoaded.end(); ++it)
+        delete it->second;
+
+    // Without a stored record or block data there is nothing to load
+    uint256 hashUnknown = GetRandHash();
+    index.phashBlock = &hashUnknown;
+    BOOST_CHECK(!ReadBlockHeader(header, &index));
+}
+
+namespace {
+
+//! Entry without block data with the full proof inline, as stored by earlier versions
+class LegacyDiskBlockIndex : public CDiskBlockIndex
+{
+public:
+    CProof proof;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        int nVersion = s.GetVersion();
+        READWRITE(VARINT(nVersion));
+        READWRITE(VARINT(nHeight));
+        READWRITE(VARINT(nStatus));
+        READWRITE(VARINT(nTx));
+        READWRITE(this->nVersion);
+        READWRITE(hashPrev);
+        READWRITE(hashMerkleRoot);
+        READWRITE(nTime);
+        READWRITE(proof);
+    }
+};
+
+CBlockIndex* InsertBlockIndex(std::map<uint256, std::unique_ptr<CBlockIndex> >& mapLoaded, const uint256& hash)
+{
+    if (hash.IsNull())
+        return NULL;
+    std::unique_ptr<CBlockIndex>& pindex = mapLoaded[hash];
+    if (!pindex)
+        pindex.reset(new CBlockIndex());
+    return pindex.get();
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(block_index_upgrade)
+{
+    CBlockTreeDB db(1 << 20, true);
+    std::vector<uint256> vHashes;
+    LegacyDiskBlockIndex legacy;
+    legacy.nTime = 1234;
+    legacy.proof.challenge = CScript() << OP_TRUE;
+    for (int i = 0; i < 3; i++) {
+        legacy.nHeight = i;
+        legacy.proof.solution = CScript() << std::vector<unsigned char>(72, i);
+        CBlockHeader block;
+        block.nTime = legacy.nTime;
+        block.nHeight = i;
+        block.hashPrevBlock = legacy.hashPrev;
+        block.proof = legacy.proof;
+        vHashes.push_back(block.GetHash());
+        BOOST_CHECK(db.Write(std::make_pair('b', vHashes.back()), legacy));
+        legacy.hashPrev = vHashes.back();
+    }
+
+    std::map<uint256, std::unique_ptr<CBlockIndex> > mapLoaded;
+    auto insert = [&mapLoaded](const uint256& hash) { return InsertBlockIndex(mapLoaded, hash); };
+    BOOST_CHECK(db.LoadBlockIndexGuts(insert));
+    BOOST_CHECK_EQUAL(mapLoaded.size(), 3U);
+    BOOST_CHECK(db.Exists(std::make_pair('h', GetBlockChallengeHash(legacy.proof.challenge))));
+    for (int i = 0; i < 3; i++) {
+        const uint256& hash = vHashes[i];
+        BOOST_CHECK(!db.Exists(std::make_pair('b', hash)));
+        BOOST_CHECK(db.Exists(std::make_pair('i', hash)));
+        BOOST_CHECK_EQUAL(mapLoaded[hash]->nHeight, i);
+        BOOST_CHECK(*mapLoaded[hash]->pchallenge == legacy.proof.challenge);
+        CScript solution;
+        BOOST_CHECK(db.ReadBlockProofSolution(hash, solution));
+        BOOST_CHECK(solution == CScript() << std::vector<unsigned char>(72, i));
+    }
+
+    // Versions that load legacy entries fail on the version marker
+    BOOST_CHECK(db.Exists(std::make_pair('b', uint256())));
+    BOOST_CHECK(!db.Read(std::make_pair('b', uint256()), legacy));
+
+    // Nothing left to upgrade
+    mapLoaded.clear();
+    BOOST_CHECK(db.LoadBlockIndexGuts(insert));
+    BOOST_CHECK_EQUAL(mapLoaded.size(), 3U);
+
+    // A new database gets the marker as well
+    CBlockTreeDB dbNew(1 << 20, true);
+    BOOST_CHECK(dbNew.LoadBlockIndexGuts(insert));
+    BOOST_CHECK(dbNew.Exists(std::make_pair('b', uint256())));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,192 @@
+// Copyright (c) 2017 The Elements Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mainchain.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+#include "utiltime.h"
+
+#include <chrono>
+#include <set>
+#include <thread>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+/** In-memory stand-in for bitcoind. */
+class CMockMainchainBackend : public CMainchainBackend
+{
+public:
+    std::vector<uint256> vChain;
+    std::set<uint256> setStale;
+    bool fOnline;
+    int nCalls;
+    //! Time each block hash lookup takes, without being an interruption point
+    int nDelayMs;
+
+    CMockMainchainBackend() : fOnline(true), nCalls(0), nDelayMs(0) {}
+
+    void Mine(int n)
+    {
+        for (int i = 0; i < n; i++)
+            vChain.push_back(GetRandHash());
+    }
+
+    void Reorg(int nDepth, int nNew)
+    {
+        for (int i = 0; i < nDepth; i++) {
+            setStale.insert(vChain.back());
+            vChain.pop_back();
+        }
+        Mine(nNew);
+    }
+
+    bool GetBestBlock(uint256& hash, int& nHeight) override
+    {
+        nCalls++;
+        if (!fOnline || vChain.empty())
+            return false;
+        hash = vChain.back();
+        nHeight = vChain.size() - 1;
+        return true;
+    }
+
+    bool GetBlockHash(int nHeight, uint256& hash) override
+    {
+        nCalls++;
+        if (nDelayMs)
+            std::this_thread::sleep_for(std::chrono::milliseconds(nDelayMs));
+        if (!fOnline || nHeight < 0 || nHeight >= (int)vChain.size())
+            return false;
+        hash = vChain[nHeight];
+        return true;
+    }
+
+    bool GetBlockHeader(const uint256& hash, int& nHeight, int& nConfirmations) override
+    {
+        nCalls++;
+        if (!fOnline)
+            return false;
+        for (size_t i = 0; i < vChain.size(); i++) {
+            if (vChain[i] == hash) {
+                nHeight = i;
+                nConfirmations = vChain.size() - i;
+                return true;
+            }
+        }
+        if (setStale.count(hash)) {
+            nHeight = 0;
+            nConfirmations = -1;
+            return true;
+        }
+        return false;
+    }
+};
+
+BOOST_FIXTURE_TEST_SUITE(mainchain_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(mainchain_tracker)
+{
+    CMockMainchainBackend* mock = new CMockMainchainBackend();
+    mock->Mine(50);
+    CMainchainTracker tracker(std::unique_ptr<CMainchainBackend>(mock), 20);
+
+    // Unsynced: every check goes to the backend
+    mock->nCalls = 0;
+    BOOST_CHECK(tracker.IsConfirmed(mock->vChain[40], 10));
+    BOOST_CHECK(!tracker.IsConfirmed(mock->vChain[45], 10));
+    BOOST_CHECK(!tracker.IsConfirmed(GetRandHash(), 1));
+    BOOST_CHECK_EQUAL(mock->nCalls, 3);
+    BOOST_CHECK(!tracker.GetStats().fSynced);
+
+    // Synced: blocks in the window are answered from memory
+    BOOST_CHECK(tracker.Poll());
+    CMainchainTrackerStats stats = tracker.GetStats();
+    BOOST_CHECK(stats.fSynced);
+    BOOST_CHECK_EQUAL(stats.nTipHeight, 49);
+    BOOST_CHECK(stats.hashTip == mock->vChain.back());
+    BOOST_CHECK_EQUAL(stats.nIndexed, 20U);
+    mock->nCalls = 0;
+    BOOST_CHECK(tracker.IsConfirmed(mock->vChain[40], 10));
+    BOOST_CHECK(!tracker.IsConfirmed(mock->vChain[41], 10));
+    BOOST_CHECK(tracker.IsConfirmed(mock->vChain[49], 1));
+    BOOST_CHECK_EQUAL(mock->nCalls, 0);
+
+    // Deeper blocks are looked up once, then remembered
+    BOOST_CHECK(tracker.IsConfirmed(mock->vChain[5], 10));
+    BOOST_CHECK_EQUAL(mock->nCalls, 1);
+    BOOST_CHECK(tracker.IsConfirmed(mock->vChain[5], 10));
+    BOOST_CHECK_EQUAL(mock->nCalls, 1);
+
+    // Unknown blocks always go to the backend and aren't confirmed
+    BOOST_CHECK(!tracker.IsConfirmed(GetRandHash(), 1));
+    BOOST_CHECK_EQUAL(mock->nCalls, 2);
+
+    // New blocks deepen existing ones
+    mock->Mine(5);
+    BOOST_CHECK(tracker.Poll());
+    BOOST_CHECK_EQUAL(tracker.GetStats().nTipHeight, 54);
+    mock->nCalls = 0;
+    BOOST_CHECK(tracker.IsConfirmed(mock->vChain[41], 10));
+    BOOST_CHECK(tracker.IsConfirmed(mock->vChain[45], 10));
+    BOOST_CHECK_EQUAL(mock->nCalls, 0);
+
+    // A reorg drops the stale blocks from the index
+    uint256 hashStale = mock->vChain[53];
+    mock->Reorg(3, 4);
+    BOOST_CHECK(tracker.Poll());
+    stats = tracker.GetStats();
+    BOOST_CHECK_EQUAL(stats.nTipHeight, 55);
+    BOOST_CHECK(stats.hashTip == mock->vChain.back());
+    BOOST_CHECK(!tracker.IsConfirmed(hashStale, 1));
+    BOOST_CHECK(tracker.IsConfirmed(mock->vChain[53], 3));
+    BOOST_CHECK(!tracker.IsConfirmed(mock->vChain[53], 4));
+
+    // A jump longer than the window replaces the whole index
+    mock->Mine(100);
+    BOOST_CHECK(tracker.Poll());
+    stats = tracker.GetStats();
+    BOOST_CHECK_EQUAL(stats.nTipHeight, 155);
+    mock->nCalls = 0;
+    BOOST_CHECK(tracker.IsConfirmed(mock->vChain[136], 20));
+    BOOST_CHECK(!tracker.IsConfirmed(mock->vChain[137], 20));
+    BOOST_CHECK_EQUAL(mock->nCalls, 0);
+
+    // Losing bitcoind unsyncs the tracker: checks fail like a direct query would
+    mock->fOnline = false;
+    BOOST_CHECK(!tracker.Poll());
+    BOOST_CHECK(!tracker.GetStats().fSynced);
+    BOOST_CHECK(!tracker.IsConfirmed(mock->vChain[136], 20));
+    mock->fOnline = true;
+    BOOST_CHECK(tracker.Poll());
+    BOOST_CHECK(tracker.IsConfirmed(mock->vChain[136], 20));
+}
+
+BOOST_AUTO_TEST_CASE(mainchain_tracker_interrupt)
+{
+    CMockMainchainBackend* mock = new CMockMainchainBackend();
+    mock->Mine(1000);
+    mock->nDelayMs = 5;
+    CMainchainTracker tracker(std::unique_ptr<CMainchainBackend>(mock), 1000);
+
+    // The first poll looks up 999 block hashes; an interruption stops it between two of them
+    bool fInterrupted = false;
+    boost::thread thread([&tracker, &fInterrupted] {
+        try {
+            tracker.Poll();
+        } catch (const boost::thread_interrupted&) {
+            fInterrupted = true;
+        }
+    });
+    MilliSleep(50);
+    int64_t nStart = GetTimeMillis();
+    thread.interrupt();
+    thread.join();
+    BOOST_CHECK(fInterrupted);
+    BOOST_CHECK(GetTimeMillis() - nStart < 1000);
+    BOOST_CHECK(!tracker.GetStats().fSynced);
+    BOOST_CHECK_EQUAL(tracker.GetStats().nIndexed, 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
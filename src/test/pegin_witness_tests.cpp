@@ -128,4 +128,49 @@ BOOST_AUTO_TEST_CASE(witness_valid)
 
 }
 
+BOOST_AUTO_TEST_CASE(witness_cache)
+{
+    CScriptWitness witness;
+    witness.stack = witness_stack;
+
+    // Second check of the same claim is answered from the cache
+    BOOST_CHECK(IsValidPeginWitness(witness, prevout, false));
+    BOOST_CHECK(IsValidPeginWitness(witness, prevout, false));
+
+    // A cached witness doesn't validate a claim on another output
+    COutPoint fake_prevout = prevout;
+    fake_prevout.n = 0;
+    BOOST_CHECK(!IsValidPeginWitness(witness, fake_prevout, false));
+    BOOST_CHECK(!IsValidPeginWitness(witness, fake_prevout, false));
+
+    // Nor does it cover a tampered witness
+    witness.stack[5].back() ^= 1;
+    BOOST_CHECK(!IsValidPeginWitness(witness, prevout, false));
+    witness.stack = witness_stack;
+    witness.stack[0][0] ^= 1;
+    BOOST_CHECK(!IsValidPeginWitness(witness, prevout, false));
+    witness.stack = witness_stack;
+    BOOST_CHECK(IsValidPeginWitness(witness, prevout, false));
+}
+
+BOOST_AUTO_TEST_CASE(contract_cache)
+{
+    const CScript& fedpegscript = Params().GetConsensus().fedpegScript;
+    CScript claim_script = CScript() << OP_0 << ParseHex("3fd9e2dd6fddb292c1756ea8a4232bdc4778fdfa");
+    CScript contract = calculate_contract(fedpegscript, claim_script);
+    BOOST_CHECK(contract != fedpegscript);
+    BOOST_CHECK(calculate_contract(fedpegscript, claim_script) == contract);
+
+    // Another federation script gets its own tweaks, and doesn't break the original's
+    CScript op_true = CScript() << OP_TRUE;
+    BOOST_CHECK(calculate_contract(op_true, claim_script) == op_true);
+    BOOST_CHECK(calculate_contract(fedpegscript, claim_script) == contract);
+
+    // Evicted claim scripts are recomputed identically
+    for (unsigned int i = 0; i <= MAX_CONTRACT_CACHE_SIZE; i++) {
+        calculate_contract(fedpegscript, CScript() << OP_0 << std::vector<unsigned char>(20, i & 0xff) << i);
+    }
+    BOOST_CHECK(calculate_contract(fedpegscript, claim_script) == contract);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,9 +4,13 @@
 
 #include "chain.h"
 #include "chainparams.h"
+#include "key.h"
 #include "pow.h"
+#include "primitives/block.h"
 #include "random.h"
+#include "script/standard.h"
 #include "util.h"
+#include "validation.h"
 #include "test/test_bitcoin.h"
 
 #include <boost/test/unit_test.hpp>
@@ -17,6 +21,127 @@ BOOST_AUTO_TEST_CASE(dummy_case)
 {
 
 }
+
+static CScript SignBlockProof(const CBlockHeader& block, const std::vector<CKey>& keys)
+{
+    CScript solution;
+    solution << OP_0;
+    for (const CKey& key : keys) {
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(key.Sign(block.GetHash(), vchSig));
+        solution << vchSig;
+    }
+    return solution;
+}
+
+BOOST_AUTO_TEST_CASE(check_proof_multisig)
+{
+    std::vector<CKey> keys(3);
+    std::vector<CPubKey> pubkeys;
+    for (CKey& key : keys) {
+        key.MakeNewKey(true);
+        pubkeys.push_back(key.GetPubKey());
+    }
+
+    CBlockHeader block;
+    block.nTime = 1234;
+    block.proof.challenge = GetScriptForMultisig(2, pubkeys);
+    const Consensus::Params& params = Params().GetConsensus();
+
+    // Signatures in key order pass, also when checked again from the cache
+    std::vector<CKey> signers;
+    signers.push_back(keys[0]);
+    signers.push_back(keys[2]);
+    block.proof.solution = SignBlockProof(block, signers);
+    BOOST_CHECK(CheckProof(block, params));
+    BOOST_CHECK(CheckProof(block, params));
+    CScript solutionValid = block.proof.solution;
+
+    // A different solution for the same block hash is checked on its own
+    std::swap(signers[0], signers[1]);
+    block.proof.solution = SignBlockProof(block, signers);
+    BOOST_CHECK(!CheckProof(block, params));
+    signers.pop_back();
+    block.proof.solution = SignBlockProof(block, signers);
+    BOOST_CHECK(!CheckProof(block, params));
+    signers.push_back(keys[1]);
+    signers.push_back(keys[2]);
+    block.proof.solution = SignBlockProof(block, signers);
+    BOOST_CHECK(!CheckProof(block, params));
+
+    // The dummy must be null and signatures minimally pushed
+    block.proof.solution = solutionValid;
+    block.proof.solution[0] = OP_1;
+    BOOST_CHECK(!CheckProof(block, params));
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(keys[0].Sign(block.GetHash(), vchSig));
+    block.proof.solution = CScript() << OP_0;
+    block.proof.solution.push_back(OP_PUSHDATA1);
+    block.proof.solution.push_back(vchSig.size());
+    block.proof.solution.insert(block.proof.solution.end(), vchSig.begin(), vchSig.end());
+    BOOST_CHECK(keys[1].Sign(block.GetHash(), vchSig));
+    block.proof.solution << vchSig;
+    BOOST_CHECK(!CheckProof(block, params));
+
+    // Signing another header invalidates the proof
+    block.proof.solution = solutionValid;
+    BOOST_CHECK(CheckProof(block, params));
+    block.nTime++;
+    BOOST_CHECK(!CheckProof(block, params));
+    block.nTime--;
+
+    // A challenge with a non-minimal key push fails in the interpreter
+    CScript challenge = CScript() << OP_1;
+    challenge.push_back(OP_PUSHDATA1);
+    challenge.push_back(pubkeys[0].size());
+    challenge.insert(challenge.end(), pubkeys[0].begin(), pubkeys[0].end());
+    challenge << OP_1 << OP_CHECKMULTISIG;
+    block.proof.challenge = challenge;
+    block.proof.solution = SignBlockProof(block, std::vector<CKey>(1, keys[0]));
+    BOOST_CHECK(!CheckProof(block, params));
+    block.proof.challenge = GetScriptForMultisig(1, std::vector<CPubKey>(1, pubkeys[0]));
+    block.proof.solution = SignBlockProof(block, std::vector<CKey>(1, keys[0]));
+    BOOST_CHECK(CheckProof(block, params));
+
+    // Other challenges are still verified by the interpreter
+    block.proof.challenge = GetScriptForRawPubKey(pubkeys[1]);
+    BOOST_CHECK(keys[1].Sign(block.GetHash(), vchSig));
+    block.proof.solution = CScript() << vchSig;
+    BOOST_CHECK(CheckProof(block, params));
+    BOOST_CHECK(keys[0].Sign(block.GetHash(), vchSig));
+    block.proof.solution = CScript() << vchSig;
+    BOOST_CHECK(!CheckProof(block, params));
+}
+BOOST_FIXTURE_TEST_CASE(check_block_header_proofs, TestingSetup)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    const Consensus::Params& params = Params().GetConsensus();
+
+    std::vector<CBlockHeader> headers(50);
+    std::vector<const CBlockHeader*> vpheaders;
+    for (size_t i = 0; i < headers.size(); i++) {
+        headers[i].nTime = 1000 + i;
+        headers[i].proof.challenge = GetScriptForMultisig(1, std::vector<CPubKey>(1, key.GetPubKey()));
+        headers[i].proof.solution = SignBlockProof(headers[i], std::vector<CKey>(1, key));
+        vpheaders.push_back(&headers[i]);
+    }
+    BOOST_CHECK(CheckBlockHeaderProofs(vpheaders, params));
+    for (const CBlockHeader& header : headers)
+        BOOST_CHECK(CheckProof(header, params));
+
+    // A single invalid proof fails the batch
+    headers[17].proof.solution = SignBlockProof(headers[18], std::vector<CKey>(1, key));
+    BOOST_CHECK(!CheckBlockHeaderProofs(vpheaders, params));
+    BOOST_CHECK(!CheckProof(headers[17], params));
+
+    // Without script check threads the headers are left to the caller
+    int nScriptCheckThreadsOld = nScriptCheckThreads;
+    nScriptCheckThreads = 0;
+    BOOST_CHECK(CheckBlockHeaderProofs(vpheaders, params));
+    nScriptCheckThreads = nScriptCheckThreadsOld;
+}
+
 #if 0
 // TODO: Re-enable when we re-add bitcoin stuff
 
@@ -14,6 +14,7 @@
 #include "validation.h"
 #include "miner.h"
 #include "net_processing.h"
+#include "pow.h"
 #include "pubkey.h"
 #include "random.h"
 #include "txdb.h"
@@ -45,6 +46,9 @@ BasicTestingSetup::BasicTestingSetup(const std::string& chainName, const std::st
         InitSignatureCache();
         InitRangeproofCache();
         InitSurjectionproofCache();
+        InitPAKProofCache();
+        InitPeginWitnessCache();
+        InitBlockProofCache();
         fPrintToDebugLog = false; // don't want to write to debug.log file
         fCheckBlockIndex = true;
         // Hack to allow testing of fedpeg args
@@ -148,6 +152,21 @@ TestChain100Setup::CreateAndProcessBlock(const std::vector<CMutableTransaction>&
     block.vtx.resize(1);
     BOOST_FOREACH(const CMutableTransaction& tx, txns)
         block.vtx.push_back(MakeTransactionRef(tx));
+    // Recompute the witness commitment over the passed-in txns
+    if (!pblocktemplate->vchCoinbaseCommitment.empty()) {
+        CMutableTransaction coinbase(*block.vtx[0]);
+        const CScript commitment(pblocktemplate->vchCoinbaseCommitment.begin(), pblocktemplate->vchCoinbaseCommitment.end());
+        for (size_t i = 0; i < coinbase.vout.size(); i++) {
+            if (coinbase.vout[i].scriptPubKey == commitment) {
+                coinbase.vout.erase(coinbase.vout.begin() + i);
+                if (coinbase.wit.vtxoutwit.size() > i)
+                    coinbase.wit.vtxoutwit.erase(coinbase.wit.vtxoutwit.begin() + i);
+                break;
+            }
+        }
+        block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+        GenerateCoinbaseCommitment(block, chainActive.Tip(), chainparams.GetConsensus());
+    }
     // IncrementExtraNonce creates a valid coinbase and merkleRoot
     unsigned int extraNonce = 0;
     IncrementExtraNonce(&block, chainActive.Tip(), extraNonce);
@@ -16,6 +16,7 @@
 #include "validation.h" // For CheckTransaction
 #include "policy/policy.h"
 #include "script/script.h"
+#include "script/sigcache.h"
 #include "script/sign.h"
 #include "script/script_error.h"
 #include "script/standard.h"
@@ -310,7 +311,7 @@ SetupDummyInputs(CBasicKeyStore& keystoreRet, CCoinsViewCache& coinsRet)
     dummyTransactions[0].vout[1].nValue = 50*CENT;
     dummyTransactions[0].vout[1].scriptPubKey << ToByteVector(key[1].GetPubKey()) << OP_CHECKSIG;
     dummyTransactions[0].vout[1].nAsset = Params().GetConsensus().pegged_asset;
-    coinsRet.ModifyCoins(dummyTransactions[0].GetHash())->FromTx(dummyTransactions[0], 0);
+    AddCoins(coinsRet, dummyTransactions[0], 0);
 
     dummyTransactions[1].vout.resize(2);
     dummyTransactions[1].vout[0].nValue = 21*CENT;
@@ -319,7 +320,7 @@ SetupDummyInputs(CBasicKeyStore& keystoreRet, CCoinsViewCache& coinsRet)
     dummyTransactions[1].vout[1].nValue = 22*CENT;
     dummyTransactions[1].vout[1].scriptPubKey = GetScriptForDestination(key[3].GetPubKey().GetID());
     dummyTransactions[1].vout[1].nAsset = Params().GetConsensus().pegged_asset;
-    coinsRet.ModifyCoins(dummyTransactions[1].GetHash())->FromTx(dummyTransactions[1], 0);
+    AddCoins(coinsRet, dummyTransactions[1], 0);
 
     return dummyTransactions;
 }
@@ -349,12 +350,66 @@ BOOST_AUTO_TEST_CASE(test_Get)
     t1.vout[1].nValue = (50+21+22)*CENT - 90*CENT;
     t1.vout[1].scriptPubKey = CScript();
     t1.vout[1].nAsset = Params().GetConsensus().pegged_asset;
-    BOOST_CHECK(CTransaction(t1).GetFee()[Params().GetConsensus().pegged_asset] == (50+21+22)*CENT - 90*CENT);
+    BOOST_CHECK(CTransaction(t1).GetFee(Params().GetConsensus().pegged_asset) == (50+21+22)*CENT - 90*CENT);
 
     BOOST_CHECK(AreInputsStandard(t1, coins));
     BOOST_CHECK(VerifyAmounts(coins, t1));
 }
 
+BOOST_AUTO_TEST_CASE(test_cached_fee)
+{
+    const CAsset& pegged = Params().GetConsensus().pegged_asset;
+    CAsset other;
+    other.begin()[0] = 1;
+
+    CMutableTransaction mtx;
+    mtx.vout.resize(3);
+    mtx.vout[0].nValue = 10;
+    mtx.vout[0].nAsset = pegged;
+    mtx.vout[1].nValue = 20;
+    mtx.vout[1].nAsset = pegged;
+    mtx.vout[2].nValue = 5;
+    mtx.vout[2].nAsset = other;
+    CTransaction tx(mtx);
+    BOOST_CHECK(tx.HasValidFee());
+    BOOST_CHECK_EQUAL(tx.GetFee().size(), 2U);
+    BOOST_CHECK_EQUAL(tx.GetFee(pegged), 30);
+    BOOST_CHECK_EQUAL(tx.GetFee(other), 5);
+    BOOST_CHECK_EQUAL(tx.GetFee(CAsset()), 0);
+
+    // Copies and deserialized transactions carry the same fee
+    CTransaction txCopy(tx);
+    BOOST_CHECK(txCopy.GetFee() == tx.GetFee());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << tx;
+    CTransaction txDeserialized(deserialize, ss);
+    BOOST_CHECK(txDeserialized.GetFee() == tx.GetFee());
+    BOOST_CHECK(txDeserialized.HasValidFee());
+
+    // A zero or out of range fee output invalidates the fee
+    mtx.vout[2].nValue = 0;
+    BOOST_CHECK(!CTransaction(mtx).HasValidFee());
+    mtx.vout[2].nValue = MAX_MONEY + 1;
+    BOOST_CHECK(!CTransaction(mtx).HasValidFee());
+    mtx.vout[2].nAsset = pegged;
+    mtx.vout[2].nValue = MAX_MONEY - 30;
+    BOOST_CHECK(CTransaction(mtx).HasValidFee());
+    mtx.vout[2].nValue = MAX_MONEY - 29;
+    BOOST_CHECK(!CTransaction(mtx).HasValidFee());
+    BOOST_CHECK(CTransaction(mtx).GetFee().empty());
+
+    // Fee outputs that would overflow when summed are rejected before summing
+    mtx.vout.assign(5000, CTxOut(pegged, MAX_MONEY, CScript()));
+    BOOST_CHECK(!CTransaction(mtx).HasValidFee());
+    BOOST_CHECK(CTransaction(mtx).GetFee().empty());
+    mtx.vout.assign(2, CTxOut(pegged, std::numeric_limits<CAmount>::max(), CScript()));
+    BOOST_CHECK(!CTransaction(mtx).HasValidFee());
+    BOOST_CHECK(CTransaction(mtx).GetFee().empty());
+
+    BOOST_CHECK(CTransaction().HasValidFee());
+    BOOST_CHECK(CTransaction().GetFee().empty());
+}
+
 void CreateCreditAndSpend(const CKeyStore& keystore, const CScript& outscript, CTransactionRef& output, CMutableTransaction& input, bool success = true)
 {
     CMutableTransaction outputm;
@@ -483,20 +538,14 @@ BOOST_AUTO_TEST_CASE(test_big_witness_transaction) {
     for (int i=0; i<20; i++)
         threadGroup.create_thread(boost::bind(&CCheckQueue<CScriptCheck>::Thread, boost::ref(scriptcheckqueue)));
 
-    CCoins coins;
-    coins.nVersion = 1;
-    coins.fCoinBase = false;
-    for(uint32_t i = 0; i < mtx.vin.size(); i++) {
-        CTxOut txout;
-        txout.nValue = 1000;
-        txout.scriptPubKey = scriptPubKey;
-        coins.vout.push_back(txout);
-    }
+    CTxOut txout;
+    txout.nValue = 1000;
+    txout.scriptPubKey = scriptPubKey;
 
     CScriptCheck* checks[mtx.vin.size()];
     for(uint32_t i = 0; i < mtx.vin.size(); i++) {
         std::vector<CScriptCheck*> vChecks;
-        checks[i] = new CScriptCheck(coins, tx, i, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS, false, &txdata);
+        checks[i] = new CScriptCheck(txout, tx, i, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_WITNESS, false, &txdata);
         vChecks.push_back(checks[i]);
         control.Add(vChecks);
     }
@@ -775,4 +824,72 @@ return; // Higher dust limit due to bigger outputs
     BOOST_CHECK(!IsStandardTx(t, reason));
 }
 
+BOOST_AUTO_TEST_CASE(test_pak_proof_cache)
+{
+    secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN | SECP256K1_CONTEXT_VERIFY);
+
+    // Two PAK lists of three entries that share their online keys; the
+    // proof is signed for by the first entry of the first list.
+    const int nKeys = 3;
+    std::vector<CKey> vOffline(2 * nKeys), vOnline(nKeys);
+    std::vector<secp256k1_pubkey> offline_keys(2 * nKeys), online_keys(nKeys);
+    for (int i = 0; i < 2 * nKeys; i++) {
+        vOffline[i].MakeNewKey(true);
+        BOOST_CHECK(secp256k1_ec_pubkey_create(ctx, &offline_keys[i], vOffline[i].begin()));
+    }
+    for (int i = 0; i < nKeys; i++) {
+        vOnline[i].MakeNewKey(true);
+        BOOST_CHECK(secp256k1_ec_pubkey_create(ctx, &online_keys[i], vOnline[i].begin()));
+    }
+    CPAKList paklistA(std::vector<secp256k1_pubkey>(offline_keys.begin(), offline_keys.begin() + nKeys), online_keys, false);
+    CPAKList paklistB(std::vector<secp256k1_pubkey>(offline_keys.begin() + nKeys, offline_keys.end()), online_keys, false);
+    CPAKList paklistReject(paklistA.OfflineKeys(), paklistA.OnlineKeys(), true);
+    BOOST_CHECK(paklistA.GetHash() == CPAKList(paklistA).GetHash());
+    BOOST_CHECK(paklistA.GetHash() != paklistB.GetHash());
+    BOOST_CHECK(paklistA.GetHash() != paklistReject.GetHash());
+
+    CKey destKey;
+    destKey.MakeNewKey(true);
+    CPubKey destPubKey = destKey.GetPubKey();
+    secp256k1_pubkey sub_pubkey;
+    BOOST_CHECK(secp256k1_ec_pubkey_parse(ctx, &sub_pubkey, destPubKey.begin(), destPubKey.size()));
+    unsigned char summed_seckey[32];
+    memcpy(summed_seckey, vOffline[0].begin(), 32);
+    BOOST_CHECK(secp256k1_ec_privkey_tweak_add(ctx, summed_seckey, destKey.begin()));
+    secp256k1_whitelist_signature sig;
+    BOOST_CHECK(secp256k1_whitelist_sign(ctx, &sig, paklistA.OnlineKeys().data(), paklistA.OfflineKeys().data(), nKeys, &sub_pubkey, vOnline[0].begin(), summed_seckey, 0, NULL, NULL));
+    std::vector<unsigned char> vchSig(1 + 32 * (1 + nKeys));
+    size_t nSigLen = vchSig.size();
+    BOOST_CHECK(secp256k1_whitelist_signature_serialize(ctx, vchSig.data(), &nSigLen, &sig));
+    vchSig.resize(nSigLen);
+    secp256k1_context_destroy(ctx);
+
+    const uint256& genesis = Params().ParentGenesisBlockHash();
+    CScript destination = GetScriptForDestination(destPubKey.GetID());
+    CScript pegout = CScript() << OP_RETURN << ToByteVector(genesis) << ToByteVector(destination) << ToByteVector(destPubKey) << vchSig;
+    BOOST_CHECK(pegout.IsPegoutScript(genesis));
+
+    boost::optional<CPAKList> paklist_config = g_paklist_config;
+
+    g_paklist_config = paklistA;
+    BOOST_CHECK(pegout.HasValidWhitelistPegoutProof(genesis));
+    BOOST_CHECK(CachingHasValidWhitelistPegoutProof(pegout, genesis));
+    // Served from the cache
+    BOOST_CHECK(CachingHasValidWhitelistPegoutProof(pegout, genesis));
+
+    // Results verified against one list do not carry over to another
+    g_paklist_config = paklistB;
+    BOOST_CHECK(!pegout.HasValidWhitelistPegoutProof(genesis));
+    BOOST_CHECK(!CachingHasValidWhitelistPegoutProof(pegout, genesis));
+    g_paklist_config = paklistReject;
+    BOOST_CHECK(!CachingHasValidWhitelistPegoutProof(pegout, genesis));
+
+    g_paklist_config = paklistA;
+    BOOST_CHECK(CachingHasValidWhitelistPegoutProof(pegout, genesis));
+    BOOST_CHECK(pegout.HasValidWhitelistPegoutProof(genesis, paklistA));
+    BOOST_CHECK(!pegout.HasValidWhitelistPegoutProof(genesis, paklistB));
+
+    g_paklist_config = paklist_config;
+}
+
 BOOST_AUTO_TEST_SUITE_END()
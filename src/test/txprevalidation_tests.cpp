@@ -0,0 +1,208 @@
+// Copyright (c) 2017 The Elements Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "key.h"
+#include "policy/policy.h"
+#include "random.h"
+#include "script/standard.h"
+#include "test/test_bitcoin.h"
+#include "txprevalidation.h"
+#include "validation.h"
+
+#include <condition_variable>
+#include <mutex>
+
+#include <boost/thread.hpp>
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(txprevalidation_tests)
+
+static CMutableTransaction SpendCoinbase(const CTransaction& coinbase, uint32_t n, const CKey& key, CAmount nFee = MAX_MONEY/100-11*CENT, int32_t nVersion = 1)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.nVersion = nVersion;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbase.GetHash();
+    spend.vin[0].prevout.n = n;
+    spend.vout.resize(2);
+    spend.vout[0].nValue = MAX_MONEY/100-nFee;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    spend.vout[0].nAsset = Params().GetConsensus().pegged_asset;
+    spend.vout[1].nValue = nFee;
+    spend.vout[1].nAsset = Params().GetConsensus().pegged_asset;
+    spend.vout[1].scriptPubKey = CScript();
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    return spend;
+}
+
+BOOST_FIXTURE_TEST_CASE(prevalidate_snapshot, TestChain100Setup)
+{
+    // Fees are counted in the policy asset, set by init
+    CAsset policyAssetOld = policyAsset;
+    policyAsset = Params().GetConsensus().pegged_asset;
+
+    CMutableTransaction spend = SpendCoinbase(coinbaseTxns[0], 0, coinbaseKey);
+
+    CTxPreValidationJob job(MakeTransactionRef(spend));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(job.TakeSnapshot());
+    }
+    BOOST_CHECK(!job.paklist);
+    BOOST_CHECK_EQUAL(job.vSpent.size(), 1U);
+    BOOST_CHECK(job.vSpent[0] == coinbaseTxns[0].vout[0]);
+    BOOST_CHECK_EQUAL(job.nScriptVerifyFlags, GetMempoolScriptVerifyFlags());
+    CValidationState state;
+    BOOST_CHECK(PreValidateTransaction(*job.tx, job.vSpent, NULL, job.nScriptVerifyFlags, state));
+    BOOST_CHECK(state.IsValid());
+
+    // Signed by the wrong key: turned down the way AcceptToMemoryPool would
+    CKey key;
+    key.MakeNewKey(true);
+    CMutableTransaction badspend = SpendCoinbase(coinbaseTxns[0], 0, key);
+    std::vector<CTxOut> vSpent(job.vSpent);
+    BOOST_CHECK(!PreValidateTransaction(badspend, vSpent, NULL, job.nScriptVerifyFlags, state));
+    int nDoS = 0;
+    BOOST_CHECK(state.IsInvalid(nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 100);
+    BOOST_CHECK_EQUAL(state.GetRejectReason().find("mandatory-script-verify-flag-failed"), 0U);
+    CValidationState stateATMP;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(!AcceptToMemoryPool(mempool, stateATMP, MakeTransactionRef(badspend), true, NULL));
+    }
+    BOOST_CHECK_EQUAL(stateATMP.GetRejectReason(), state.GetRejectReason());
+
+    // A signature pushed with a non-minimal opcode breaks a policy-only rule
+    CMutableTransaction nonminimal(spend);
+    CScript::const_iterator pc = spend.vin[0].scriptSig.begin();
+    opcodetype opcode;
+    std::vector<unsigned char> vchSig;
+    BOOST_CHECK(spend.vin[0].scriptSig.GetOp(pc, opcode, vchSig));
+    nonminimal.vin[0].scriptSig = CScript();
+    nonminimal.vin[0].scriptSig.push_back(OP_PUSHDATA1);
+    nonminimal.vin[0].scriptSig.push_back((unsigned char)vchSig.size());
+    nonminimal.vin[0].scriptSig.insert(nonminimal.vin[0].scriptSig.end(), vchSig.begin(), vchSig.end());
+    vSpent = job.vSpent;
+    CValidationState stateNonMinimal;
+    BOOST_CHECK(!PreValidateTransaction(nonminimal, vSpent, NULL, job.nScriptVerifyFlags, stateNonMinimal));
+    BOOST_CHECK(stateNonMinimal.IsInvalid(nDoS));
+    BOOST_CHECK_EQUAL(nDoS, 0);
+    BOOST_CHECK_EQUAL(stateNonMinimal.GetRejectReason().find("non-mandatory-script-verify-flag"), 0U);
+
+    // which -promiscuousmempoolflags can turn off, for pre-validation as for AcceptToMemoryPool
+    ForceSetArg("-promiscuousmempoolflags", std::to_string(SCRIPT_VERIFY_P2SH));
+    CTxPreValidationJob jobPromiscuous(MakeTransactionRef(nonminimal));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(jobPromiscuous.TakeSnapshot());
+    }
+    BOOST_CHECK_EQUAL(jobPromiscuous.nScriptVerifyFlags, (unsigned int)SCRIPT_VERIFY_P2SH);
+    CValidationState statePromiscuous;
+    BOOST_CHECK(PreValidateTransaction(*jobPromiscuous.tx, jobPromiscuous.vSpent, NULL, jobPromiscuous.nScriptVerifyFlags, statePromiscuous));
+    ForceSetArg("-promiscuousmempoolflags", std::to_string(STANDARD_SCRIPT_VERIFY_FLAGS));
+
+    // Spends an output that does not exist
+    CMutableTransaction orphan(spend);
+    orphan.vin[0].prevout.hash = GetRandHash();
+    CTxPreValidationJob jobOrphan(MakeTransactionRef(orphan));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(!jobOrphan.TakeSnapshot());
+    }
+
+    // Non-standard, or paying too little, and left to AcceptToMemoryPool
+    // without being verified
+    CTxPreValidationJob jobNonStandard(MakeTransactionRef(SpendCoinbase(coinbaseTxns[0], 0, coinbaseKey, 11*CENT, 3)));
+    CTxPreValidationJob jobNoFee(MakeTransactionRef(SpendCoinbase(coinbaseTxns[0], 0, coinbaseKey, 0)));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(!jobNonStandard.TakeSnapshot());
+        BOOST_CHECK(!jobNoFee.TakeSnapshot());
+    }
+
+    // Conflicts with a mempool transaction
+    CTxPreValidationJob jobConflict(MakeTransactionRef(SpendCoinbase(coinbaseTxns[0], 0, coinbaseKey, 12*CENT)));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(AcceptToMemoryPool(mempool, state, job.tx, true, NULL));
+        BOOST_CHECK(!jobConflict.TakeSnapshot());
+        mempool.clear();
+    }
+    policyAsset = policyAssetOld;
+}
+
+BOOST_FIXTURE_TEST_CASE(prevalidation_queue, TestChain100Setup)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CAsset policyAssetOld = policyAsset;
+    policyAsset = Params().GetConsensus().pegged_asset;
+    std::vector<std::shared_ptr<CTxPreValidationJob> > vJobs;
+    vJobs.push_back(std::make_shared<CTxPreValidationJob>(MakeTransactionRef(SpendCoinbase(coinbaseTxns[0], 0, coinbaseKey))));
+    vJobs.push_back(std::make_shared<CTxPreValidationJob>(MakeTransactionRef(SpendCoinbase(coinbaseTxns[0], 1, key))));
+    vJobs.push_back(std::make_shared<CTxPreValidationJob>(MakeTransactionRef(SpendCoinbase(coinbaseTxns[0], 2, coinbaseKey))));
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    int nDone = 0;
+    for (const std::shared_ptr<CTxPreValidationJob>& job : vJobs) {
+        LOCK(cs_main);
+        BOOST_CHECK(job->TakeSnapshot());
+        job->fnDone = [&] { std::lock_guard<std::mutex> lock(mutex); nDone++; cond.notify_one(); };
+    }
+
+    // Only room for two jobs
+    CTxPreValidationQueue queue(2);
+    BOOST_CHECK(queue.Add(vJobs[0]));
+    BOOST_CHECK(queue.Add(vJobs[1]));
+    BOOST_CHECK(!queue.Add(vJobs[2]));
+    CTxPreValidationStats stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.nQueued, 2U);
+    BOOST_CHECK_EQUAL(stats.nRejectedFull, 1U);
+
+    boost::thread_group threadGroup;
+    for (int i = 0; i < 2; i++)
+        threadGroup.create_thread(boost::bind(&CTxPreValidationQueue::Thread, &queue));
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&] { return nDone == 2; });
+    }
+    BOOST_CHECK(queue.Add(vJobs[2]));
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&] { return nDone == 3; });
+    }
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    for (const std::shared_ptr<CTxPreValidationJob>& job : vJobs) {
+        BOOST_CHECK(job->fDone);
+        BOOST_CHECK(job->fPreValidated);
+    }
+    BOOST_CHECK(vJobs[0]->fValid);
+    BOOST_CHECK(!vJobs[1]->fValid);
+    BOOST_CHECK(vJobs[1]->state.IsInvalid());
+    BOOST_CHECK(vJobs[2]->fValid);
+
+    queue.AddCommitTime(5);
+    stats = queue.GetStats();
+    BOOST_CHECK_EQUAL(stats.nQueued, 0U);
+    BOOST_CHECK_EQUAL(stats.nRunning, 0U);
+    BOOST_CHECK_EQUAL(stats.nDone, 3U);
+    BOOST_CHECK_EQUAL(stats.nValid, 2U);
+    BOOST_CHECK_EQUAL(stats.nCommitted, 1U);
+    BOOST_CHECK_EQUAL(stats.nTimeCommit, 5);
+    policyAsset = policyAssetOld;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
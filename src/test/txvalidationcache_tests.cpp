@@ -2,16 +2,20 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blind.h"
 #include "chainparams.h"
 #include "consensus/validation.h"
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
+#include "policy/policy.h"
 #include "pubkey.h"
 #include "txmempool.h"
 #include "random.h"
 #include "script/standard.h"
+#include "streams.h"
 #include "test/test_bitcoin.h"
+#include "util.h"
 #include "utiltime.h"
 
 #include <boost/test/unit_test.hpp>
@@ -89,4 +93,172 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(tx_mempool_spent_inputs, TestChain100Setup)
+{
+    // A confirmed transaction whose outputs have all been spent looks like
+    // any transaction with missing inputs, and goes to orphan handling.
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    std::vector<CMutableTransaction> txs(2);
+    for (int i = 0; i < 2; i++)
+    {
+        txs[i].nVersion = 1;
+        txs[i].vin.resize(1);
+        txs[i].vin[0].prevout.hash = i == 0 ? coinbaseTxns[0].GetHash() : txs[0].GetHash();
+        txs[i].vin[0].prevout.n = 0;
+        txs[i].vout.resize(2);
+        txs[i].vout[0].nValue = (11 - i)*CENT;
+        txs[i].vout[0].scriptPubKey = scriptPubKey;
+        txs[i].vout[0].nAsset = Params().GetConsensus().pegged_asset;
+        txs[i].vout[1].nValue = i == 0 ? MAX_MONEY/100-11*CENT : CENT;
+        txs[i].vout[1].nAsset = Params().GetConsensus().pegged_asset;
+        txs[i].vout[1].scriptPubKey = CScript();
+
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, txs[i], 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        txs[i].vin[0].scriptSig << vchSig;
+
+        std::vector<CMutableTransaction> blockTxns(1, txs[i]);
+        CBlock block = CreateAndProcessBlock(blockTxns, scriptPubKey);
+        BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    }
+
+    LOCK(cs_main);
+    pcoinsTip->Flush();
+    CValidationState state;
+    bool fMissingInputs = false;
+    BOOST_CHECK(!AcceptToMemoryPool(mempool, state, MakeTransactionRef(txs[0]), false, &fMissingInputs));
+    BOOST_CHECK(fMissingInputs);
+    BOOST_CHECK(state.IsValid());
+}
+
+/**
+ * Spend a genesis output to two blinded outputs and explicit change. If fBadProof, the first
+ * output's script is swapped after blinding, so its range proof no longer verifies.
+ */
+static CMutableTransaction BlindedSpend(const CTransaction& genesisTx, uint32_t n, const CKey& key, bool fBadProof)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    const CAsset& asset = Params().GetConsensus().pegged_asset;
+    CAmount nValue = genesisTx.vout[n].nValue.GetAmount();
+    CAmount nFee = CENT;
+
+    CKey blindingKey;
+    blindingKey.MakeNewKey(true);
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = genesisTx.GetHash();
+    spend.vin[0].prevout.n = n;
+    spend.vout.push_back(CTxOut(asset, COIN, scriptPubKey));
+    spend.vout.push_back(CTxOut(asset, COIN, scriptPubKey));
+    spend.vout.push_back(CTxOut(asset, nValue - 2 * COIN - nFee, scriptPubKey));
+    spend.vout.push_back(CTxOut(asset, nFee, CScript()));
+
+    std::vector<uint256> input_blinds(1), input_asset_blinds(1), output_blinds, output_asset_blinds;
+    std::vector<CAsset> input_assets(1, asset);
+    std::vector<CAmount> input_amounts(1, nValue);
+    std::vector<CPubKey> output_pubkeys(spend.vout.size());
+    output_pubkeys[0] = output_pubkeys[1] = blindingKey.GetPubKey();
+    std::vector<CKey> vDummy;
+    BOOST_CHECK_EQUAL(BlindTransaction(input_blinds, input_asset_blinds, input_assets, input_amounts, output_blinds, output_asset_blinds, output_pubkeys, vDummy, vDummy, spend), 2);
+    if (fBadProof) {
+        CKey otherKey;
+        otherKey.MakeNewKey(true);
+        spend.vout[0].scriptPubKey = CScript() << ToByteVector(otherKey.GetPubKey()) << OP_CHECKSIG;
+    }
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    return spend;
+}
+
+// Put a transaction in the mempool without validating it, then dump the mempool and empty it
+static void DumpUnchecked(const CMutableTransaction& tx)
+{
+    TestMemPoolEntryHelper entry;
+    mempool.addUnchecked(tx.GetHash(), entry.Fee(CENT).Time(GetTime()).FromTx(tx));
+    DumpMempool();
+    mempool.clear();
+}
+
+static bool InMempool(const CMutableTransaction& tx)
+{
+    LOCK(mempool.cs);
+    return mempool.exists(tx.GetHash());
+}
+
+BOOST_FIXTURE_TEST_CASE(mempool_dump_seeds_proofs, TestChain100Setup)
+{
+    // Fees are counted in the policy asset, set by init
+    CAsset policyAssetOld = policyAsset;
+    policyAsset = Params().GetConsensus().pegged_asset;
+
+    // Only the bad range proof keeps these from the mempool
+    CMutableTransaction good = BlindedSpend(coinbaseTxns[0], 0, coinbaseKey, false);
+    CMutableTransaction bad = BlindedSpend(coinbaseTxns[0], 0, coinbaseKey, true);
+    BOOST_CHECK(ToMemPool(good));
+    mempool.clear();
+    BOOST_CHECK(!ToMemPool(bad));
+
+    // A dump under another node's key is verified in full
+    DumpUnchecked(bad);
+    uint256 otherKey = GetRandHash();
+    CAutoFile keyfile(fopen((GetDataDir() / "verifycache.key").string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+    keyfile << otherKey;
+    keyfile.fclose();
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK(!InMempool(bad));
+
+    // So is one written at another tip
+    bad = BlindedSpend(coinbaseTxns[0], 1, coinbaseKey, true);
+    DumpUnchecked(bad);
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG);
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK(!InMempool(bad));
+
+    // A version 1 file has no digests, so nothing in it is trusted
+    bad = BlindedSpend(coinbaseTxns[0], 2, coinbaseKey, true);
+    good = BlindedSpend(coinbaseTxns[0], 3, coinbaseKey, false);
+    {
+        CAutoFile file(fopen((GetDataDir() / "mempool.dat").string().c_str(), "wb"), SER_DISK, CLIENT_VERSION);
+        file << (uint64_t)1;
+        file << (uint64_t)2;
+        file << bad << GetTime() << (int64_t)0;
+        file << good << GetTime() << (int64_t)0;
+        file << std::map<uint256, CAmount>();
+    }
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK(!InMempool(bad));
+    BOOST_CHECK(InMempool(good));
+    mempool.clear();
+
+    // Our own dump at the current tip seeds the proofs it vouches for, so the
+    // transaction is accepted without them being verified again
+    bad = BlindedSpend(coinbaseTxns[0], 4, coinbaseKey, true);
+    DumpUnchecked(bad);
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK(InMempool(bad));
+    mempool.clear();
+
+    policyAsset = policyAssetOld;
+}
+
+BOOST_FIXTURE_TEST_CASE(blinded_block_proofs, TestChain100Setup)
+{
+    // The amount checks run on the check queue and hand their proofs over to
+    // be verified in a second round, so a bad range proof still fails the block
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    int nHeight = chainActive.Height();
+    CreateAndProcessBlock({BlindedSpend(coinbaseTxns[0], 0, coinbaseKey, true)}, scriptPubKey);
+    BOOST_CHECK_EQUAL(chainActive.Height(), nHeight);
+
+    CreateAndProcessBlock({BlindedSpend(coinbaseTxns[0], 0, coinbaseKey, false), BlindedSpend(coinbaseTxns[0], 1, coinbaseKey, false)}, scriptPubKey);
+    BOOST_CHECK_EQUAL(chainActive.Height(), nHeight + 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,10 +4,14 @@
 
 #include "arith_uint256.h"
 #include "blind.h"
+#include "consensus/validation.h"
+#include "issuance.h"
+#include "script/sigcache.h"
 #include "uint256.h"
 #include "validation.h"
 
 #include "test/test_bitcoin.h"
+#include "test/test_random.h"
 
 #include <boost/test/unit_test.hpp>
 
@@ -90,4 +94,471 @@ BOOST_AUTO_TEST_CASE(verify_coinbase_test)
     tx.vout.pop_back();
 }
 
+BOOST_AUTO_TEST_CASE(rangeproof_batch_test)
+{
+    secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY | SECP256K1_CONTEXT_SIGN);
+
+    // Build a handful of blinded values with range proofs, half of them issuance-style (empty script)
+    const size_t nProofs = 6;
+    std::vector<std::vector<unsigned char> > vRangeproofs(nProofs), vValueCommitments(nProofs), vAssetCommitments(nProofs);
+    std::vector<CScript> vScripts(nProofs);
+    for (size_t i = 0; i < nProofs; i++) {
+        CAsset asset(GetRandHash());
+        uint256 blind = GetRandHash();
+        uint256 assetblind = GetRandHash();
+        std::vector<unsigned char*> blindptrs(1, blind.begin());
+        std::vector<const unsigned char*> assetblindptrs(1, assetblind.begin());
+        if (i % 2) {
+            vScripts[i] = CScript() << OP_TRUE;
+        }
+
+        CConfidentialAsset confAsset;
+        CConfidentialValue confValue;
+        secp256k1_generator gen;
+        secp256k1_pedersen_commitment commit;
+        BlindAsset(confAsset, gen, asset, assetblindptrs.back());
+        CreateValueCommitment(confValue, commit, blindptrs.back(), gen, 1000 + i);
+        BOOST_CHECK(GenerateRangeproof(vRangeproofs[i], blindptrs, GetRandHash(), 1000 + i, vScripts[i], commit, gen, asset, assetblindptrs));
+        vValueCommitments[i] = confValue.vchCommitment;
+        vAssetCommitments[i] = confAsset.vchCommitment;
+    }
+
+    std::vector<CRangeProofRef> vProofs;
+    for (size_t i = 0; i < nProofs; i++) {
+        vProofs.push_back(CRangeProofRef{&vRangeproofs[i], &vValueCommitments[i], &vAssetCommitments[i], &vScripts[i]});
+    }
+
+    std::vector<bool> vResults;
+    BOOST_CHECK(CachingRangeProofChecker(false).VerifyRangeProofBatch(vProofs, vResults, ctx));
+    BOOST_CHECK_EQUAL(vResults.size(), nProofs);
+    for (size_t i = 0; i < nProofs; i++) {
+        BOOST_CHECK(vResults[i]);
+        BOOST_CHECK(CachingRangeProofChecker(false).VerifyRangeProof(vRangeproofs[i], vValueCommitments[i], vAssetCommitments[i], vScripts[i], ctx));
+    }
+
+    // A proof bound to the wrong script fails alone
+    vScripts[3] = CScript() << OP_FALSE;
+    BOOST_CHECK(!CachingRangeProofChecker(false).VerifyRangeProofBatch(vProofs, vResults, ctx));
+    for (size_t i = 0; i < nProofs; i++) {
+        BOOST_CHECK_EQUAL(vResults[i], i != 3);
+    }
+
+    // So does an empty proof
+    vScripts[3] = CScript() << OP_TRUE;
+    vRangeproofs[0].clear();
+    BOOST_CHECK(!CachingRangeProofChecker(false).VerifyRangeProofBatch(vProofs, vResults, ctx));
+    for (size_t i = 0; i < nProofs; i++) {
+        BOOST_CHECK_EQUAL(vResults[i], i != 0);
+    }
+
+    secp256k1_context_destroy(ctx);
+}
+
+BOOST_AUTO_TEST_CASE(surjectionproof_batch_test)
+{
+    secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY | SECP256K1_CONTEXT_SIGN);
+
+    // Blinded input assets
+    const size_t nInputs = 4;
+    std::vector<CAsset> vInputAssets;
+    std::vector<secp256k1_fixed_asset_tag> vInputTags(nInputs);
+    std::vector<secp256k1_generator> vInputGenerators(nInputs);
+    std::vector<uint256> vInputAssetBlinds;
+    for (size_t i = 0; i < nInputs; i++) {
+        vInputAssets.emplace_back(GetRandHash());
+        vInputAssetBlinds.push_back(GetRandHash());
+        memcpy(&vInputTags[i], vInputAssets[i].begin(), 32);
+        CConfidentialAsset confAsset;
+        BlindAsset(confAsset, vInputGenerators[i], vInputAssets[i], vInputAssetBlinds[i].begin());
+    }
+
+    // Outputs each spending one of the input assets
+    const size_t nOutputs = 5;
+    std::vector<secp256k1_surjectionproof> vSurjectionproofs(nOutputs);
+    std::vector<secp256k1_generator> vOutputGenerators(nOutputs);
+    for (size_t i = 0; i < nOutputs; i++) {
+        const CAsset& asset = vInputAssets[i % nInputs];
+        uint256 assetblind = GetRandHash();
+        std::vector<const unsigned char*> assetblindptrs(1, assetblind.begin());
+        CConfidentialAsset confAsset;
+        BlindAsset(confAsset, vOutputGenerators[i], asset, assetblindptrs.back());
+        CTxOutWitness txoutwit;
+        BOOST_CHECK(SurjectOutput(txoutwit, vInputTags, vInputGenerators, vInputAssetBlinds, assetblindptrs, vOutputGenerators[i], asset));
+        BOOST_CHECK(secp256k1_surjectionproof_parse(ctx, &vSurjectionproofs[i], &txoutwit.vchSurjectionproof[0], txoutwit.vchSurjectionproof.size()) == 1);
+    }
+
+    CSurjectionGeneratorTable table(vInputGenerators, ctx);
+    std::vector<const secp256k1_surjectionproof*> vProofs;
+    std::vector<const secp256k1_generator*> vGens;
+    for (size_t i = 0; i < nOutputs; i++) {
+        vProofs.push_back(&vSurjectionproofs[i]);
+        vGens.push_back(&vOutputGenerators[i]);
+    }
+
+    std::vector<bool> vResults;
+    BOOST_CHECK(CachingSurjectionProofChecker(false).VerifySurjectionProofBatch(vProofs, vGens, table, vResults, ctx));
+    BOOST_CHECK_EQUAL(vResults.size(), nOutputs);
+    for (size_t i = 0; i < nOutputs; i++) {
+        BOOST_CHECK(vResults[i]);
+        BOOST_CHECK(CachingSurjectionProofChecker(false).VerifySurjectionProof(vSurjectionproofs[i], table, vOutputGenerators[i], ctx));
+    }
+
+    // A proof checked against another output's asset commitment fails alone
+    vGens[2] = &vOutputGenerators[1];
+    BOOST_CHECK(!CachingSurjectionProofChecker(false).VerifySurjectionProofBatch(vProofs, vGens, table, vResults, ctx));
+    for (size_t i = 0; i < nOutputs; i++) {
+        BOOST_CHECK_EQUAL(vResults[i], i != 2);
+    }
+
+    // All proofs fail against a table of different inputs
+    std::vector<secp256k1_generator> vOtherGenerators(vInputGenerators.rbegin(), vInputGenerators.rend());
+    CSurjectionGeneratorTable otherTable(vOtherGenerators, ctx);
+    vGens[2] = &vOutputGenerators[2];
+    BOOST_CHECK(table.GetHash() != otherTable.GetHash());
+    BOOST_CHECK(!CachingSurjectionProofChecker(false).VerifySurjectionProofBatch(vProofs, vGens, otherTable, vResults, ctx));
+    for (size_t i = 0; i < nOutputs; i++) {
+        BOOST_CHECK(!vResults[i]);
+    }
+
+    secp256k1_context_destroy(ctx);
+}
+
+BOOST_AUTO_TEST_CASE(proof_cache_store_test)
+{
+    secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY | SECP256K1_CONTEXT_SIGN);
+
+    // A range proof checked against another script than it commits to
+    CAsset asset(GetRandHash());
+    uint256 blind = GetRandHash();
+    uint256 assetblind = GetRandHash();
+    std::vector<unsigned char*> blindptrs(1, blind.begin());
+    std::vector<const unsigned char*> assetblindptrs(1, assetblind.begin());
+    CConfidentialAsset confAsset;
+    CConfidentialValue confValue;
+    secp256k1_generator gen;
+    secp256k1_pedersen_commitment commit;
+    std::vector<unsigned char> vchRangeproof;
+    BlindAsset(confAsset, gen, asset, assetblindptrs.back());
+    CreateValueCommitment(confValue, commit, blindptrs.back(), gen, 1000);
+    BOOST_CHECK(GenerateRangeproof(vchRangeproof, blindptrs, GetRandHash(), 1000, CScript() << OP_TRUE, commit, gen, asset, assetblindptrs));
+    CScript scriptOther = CScript() << OP_FALSE;
+    BOOST_CHECK(!CachingRangeProofChecker(true).VerifyRangeProof(vchRangeproof, confValue.vchCommitment, confAsset.vchCommitment, scriptOther, ctx));
+
+    // is taken as valid once stored
+    CachingRangeProofChecker(true).StoreRangeProof(vchRangeproof, confValue.vchCommitment, confAsset.vchCommitment, scriptOther);
+    BOOST_CHECK(CachingRangeProofChecker(true).VerifyRangeProof(vchRangeproof, confValue.vchCommitment, confAsset.vchCommitment, scriptOther, ctx));
+
+    // The same for a surjection proof checked against the wrong inputs
+    std::vector<secp256k1_fixed_asset_tag> vInputTags(1);
+    std::vector<secp256k1_generator> vInputGenerators(1), vOtherGenerators(1);
+    std::vector<uint256> vInputAssetBlinds(1, GetRandHash());
+    memcpy(&vInputTags[0], asset.begin(), 32);
+    BlindAsset(confAsset, vInputGenerators[0], asset, vInputAssetBlinds[0].begin());
+    BlindAsset(confAsset, vOtherGenerators[0], CAsset(GetRandHash()), GetRandHash().begin());
+    CTxOutWitness txoutwit;
+    secp256k1_surjectionproof proof;
+    BOOST_CHECK(SurjectOutput(txoutwit, vInputTags, vInputGenerators, vInputAssetBlinds, assetblindptrs, gen, asset));
+    BOOST_CHECK(secp256k1_surjectionproof_parse(ctx, &proof, &txoutwit.vchSurjectionproof[0], txoutwit.vchSurjectionproof.size()) == 1);
+    CSurjectionGeneratorTable table(vInputGenerators, ctx), otherTable(vOtherGenerators, ctx);
+    BOOST_CHECK(CachingSurjectionProofChecker(false).VerifySurjectionProof(proof, table, gen, ctx));
+    BOOST_CHECK(!CachingSurjectionProofChecker(true).VerifySurjectionProof(proof, otherTable, gen, ctx));
+    CachingSurjectionProofChecker(true).StoreSurjectionProof(proof, otherTable, gen, ctx);
+    BOOST_CHECK(CachingSurjectionProofChecker(true).VerifySurjectionProof(proof, otherTable, gen, ctx));
+
+    secp256k1_context_destroy(ctx);
+}
+
+BOOST_AUTO_TEST_CASE(verify_cache_snapshot_test)
+{
+    boost::filesystem::path path = GetDataDir() / "verifycache.dat";
+    BOOST_CHECK(!LoadVerifyCaches());
+    BOOST_CHECK(DumpVerifyCaches());
+    BOOST_CHECK(boost::filesystem::exists(path));
+    BOOST_CHECK(LoadVerifyCaches());
+
+    // A snapshot changed on disk is not loaded
+    std::vector<char> vchFile(boost::filesystem::file_size(path));
+    FILE* file = fopen(path.string().c_str(), "rb");
+    BOOST_CHECK_EQUAL(fread(vchFile.data(), 1, vchFile.size(), file), vchFile.size());
+    fclose(file);
+    vchFile[vchFile.size() / 2] ^= 1;
+    file = fopen(path.string().c_str(), "wb");
+    BOOST_CHECK_EQUAL(fwrite(vchFile.data(), 1, vchFile.size(), file), vchFile.size());
+    fclose(file);
+    BOOST_CHECK(!LoadVerifyCaches());
+
+    // Stored entries survive a dump and load, even after the salts changed in between.
+    // An empty range proof only passes through a cache hit.
+    secp256k1_context* ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+    const std::vector<unsigned char> vchEmpty, vchValue(33, 2), vchAsset(33, 10);
+    const CScript script = CScript() << OP_TRUE;
+    CachingRangeProofChecker(true).StoreRangeProof(vchEmpty, vchValue, vchAsset, script);
+    BOOST_CHECK(CachingRangeProofChecker(true).VerifyRangeProof(vchEmpty, vchValue, vchAsset, script, ctx));
+    BOOST_CHECK(DumpVerifyCaches());
+    ResetVerifyCacheSalts();
+    BOOST_CHECK(!CachingRangeProofChecker(true).VerifyRangeProof(vchEmpty, vchValue, vchAsset, script, ctx));
+    BOOST_CHECK(LoadVerifyCaches());
+    BOOST_CHECK(CachingRangeProofChecker(true).VerifyRangeProof(vchEmpty, vchValue, vchAsset, script, ctx));
+    secp256k1_context_destroy(ctx);
+
+    // Snapshots are not loaded once their salts are too old
+    SetMockTime(GetTime() + MAX_VERIFY_CACHE_SALT_AGE - 60);
+    BOOST_CHECK(LoadVerifyCaches());
+    SetMockTime(GetTime() + 120);
+    BOOST_CHECK(!LoadVerifyCaches());
+    SetMockTime(0);
+
+    // nor is one written under another key
+    BOOST_CHECK(DumpVerifyCaches());
+    BOOST_CHECK(LoadVerifyCaches());
+    boost::filesystem::remove(GetDataDir() / "verifycache.key");
+    BOOST_CHECK(!LoadVerifyCaches());
+}
+
+// Run both amount check paths over a fully explicit transaction
+static bool CheckExplicitEquivalence(const std::vector<CTxOut>& vSpent, const CMutableTransaction& mtx)
+{
+    CTransaction tx(mtx);
+    bool fValid = false;
+    BOOST_CHECK(VerifyExplicitAmounts(vSpent, tx, fValid));
+    BOOST_CHECK_EQUAL(fValid, VerifyCommittedAmounts(vSpent, tx));
+    BOOST_CHECK_EQUAL(fValid, VerifyAmounts(vSpent, tx));
+    return fValid;
+}
+
+BOOST_AUTO_TEST_CASE(amount_check_queued_test)
+{
+    CCoinsView viewBase;
+    CCoinsViewCache cache(&viewBase);
+    CAsset asset(GetRandHash());
+    cache.AddCoin(COutPoint(ArithToUint256(1), 0), Coin(CTxOut(asset, 1000, CScript() << OP_TRUE), 1, false), false);
+
+    CKey key;
+    key.MakeNewKey(true);
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.hash = ArithToUint256(1);
+    tx.vin[0].prevout.n = 0;
+    tx.vout.push_back(CTxOut(asset, 500, CScript() << OP_TRUE));
+    tx.vout.push_back(CTxOut(asset, 500, CScript() << OP_TRUE));
+    std::vector<uint256> input_blinds(1), input_asset_blinds(1), output_blinds, output_asset_blinds;
+    std::vector<CAsset> input_assets(1, asset);
+    std::vector<CAmount> input_amounts(1, 1000);
+    std::vector<CPubKey> output_pubkeys(2, key.GetPubKey());
+    std::vector<CKey> vDummy;
+    BOOST_CHECK_EQUAL(BlindTransaction(input_blinds, input_asset_blinds, input_assets, input_amounts, output_blinds, output_asset_blinds, output_pubkeys, vDummy, vDummy, tx), 2);
+
+    // Queued, the whole amount check is one check that verifies the proofs itself.
+    // It keeps a reference to the transaction, which has to outlive it.
+    CValidationState state;
+    std::set<std::pair<uint256, COutPoint> > setPeginsSpent;
+    std::vector<CCheck*> vChecks;
+    CTransaction txValid(tx);
+    BOOST_CHECK(Consensus::CheckTxInputs(txValid, state, cache, 0, setPeginsSpent, &vChecks, false, true));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    BOOST_CHECK((*vChecks[0])());
+    delete vChecks[0];
+    vChecks.clear();
+
+    // A commitment that does not parse is only found once the check runs
+    std::fill(tx.vout[0].nValue.vchCommitment.begin() + 1, tx.vout[0].nValue.vchCommitment.end(), 0xff);
+    CTransaction txInvalid(tx);
+    BOOST_CHECK(Consensus::CheckTxInputs(txInvalid, state, cache, 0, setPeginsSpent, &vChecks, false, true));
+    BOOST_CHECK(state.IsValid());
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    BOOST_CHECK(!(*vChecks[0])());
+    BOOST_CHECK(vChecks[0]->IsAmountError());
+    delete vChecks[0];
+
+    // while without a queue CheckTxInputs parses it inline
+    BOOST_CHECK(!Consensus::CheckTxInputs(txInvalid, state, cache, 0, setPeginsSpent, NULL, false, true));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "bad-txns-in-ne-out");
+}
+
+BOOST_AUTO_TEST_CASE(explicit_amounts_test)
+{
+    CAsset assetA(GetRandHash()), assetB(GetRandHash());
+    CScript script = CScript() << OP_TRUE;
+
+    std::vector<CTxOut> vSpent;
+    vSpent.push_back(CTxOut(assetA, 100, script));
+    vSpent.push_back(CTxOut(assetB, 30, script));
+    CMutableTransaction mtx;
+    mtx.vin.resize(2);
+    mtx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    mtx.vin[1].prevout = COutPoint(GetRandHash(), 1);
+    mtx.vout.push_back(CTxOut(assetA, 90, script));
+    mtx.vout.push_back(CTxOut(assetB, 30, script));
+    mtx.vout.push_back(CTxOut(assetA, 10, CScript()));
+    BOOST_CHECK(CheckExplicitEquivalence(vSpent, mtx));
+
+    // Imbalance, in either direction or across assets
+    mtx.vout[0].nValue = 91;
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    mtx.vout[0].nValue = 89;
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    mtx.vout[0].nValue = 90;
+    mtx.vout[1].nAsset = assetA;
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    mtx.vout[1].nAsset = assetB;
+
+    // Zero and out of range amounts
+    mtx.vout.push_back(CTxOut(assetA, 0, CScript() << OP_RETURN));
+    BOOST_CHECK(CheckExplicitEquivalence(vSpent, mtx));
+    mtx.vout.back().scriptPubKey = script;
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    mtx.vout.back().nValue = -1;
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    mtx.vout.pop_back();
+    vSpent.push_back(CTxOut(assetA, 0, script));
+    mtx.vin.push_back(CTxIn(COutPoint(GetRandHash(), 2)));
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    vSpent.back().nValue = MAX_MONEY + 1;
+    mtx.vout.push_back(CTxOut(assetA, MAX_MONEY + 1, script));
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    vSpent.pop_back();
+    mtx.vin.pop_back();
+    mtx.vout.pop_back();
+    BOOST_CHECK(CheckExplicitEquivalence(vSpent, mtx));
+
+    // Explicit outputs may not carry proofs
+    mtx.wit.vtxoutwit.resize(mtx.vout.size());
+    BOOST_CHECK(CheckExplicitEquivalence(vSpent, mtx));
+    mtx.wit.vtxoutwit[1].vchRangeproof.resize(1);
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    mtx.wit.vtxoutwit[1].vchRangeproof.clear();
+    mtx.wit.vtxoutwit[1].vchSurjectionproof.resize(1);
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    mtx.wit.vtxoutwit.clear();
+
+    // New explicit issuance of an asset and its reissuance tokens
+    CAssetIssuance& issuance = mtx.vin[1].assetIssuance;
+    issuance.assetEntropy = GetRandHash();
+    issuance.nAmount = 1000;
+    issuance.nInflationKeys = 1;
+    uint256 entropy;
+    CAsset assetIssued, assetToken;
+    GenerateAssetEntropy(entropy, mtx.vin[1].prevout, issuance.assetEntropy);
+    CalculateAsset(assetIssued, entropy);
+    CalculateReissuanceToken(assetToken, entropy, false);
+    mtx.vout.push_back(CTxOut(assetIssued, 1000, script));
+    mtx.vout.push_back(CTxOut(assetToken, 1, script));
+    // Issuances need an input witness
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    mtx.wit.vtxinwit.resize(2);
+    BOOST_CHECK(CheckExplicitEquivalence(vSpent, mtx));
+    mtx.wit.vtxinwit[1].vchIssuanceAmountRangeproof.resize(1);
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    mtx.wit.vtxinwit[1].vchIssuanceAmountRangeproof.clear();
+    mtx.wit.vtxinwit[1].vchInflationKeysRangeproof.resize(1);
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    mtx.wit.vtxinwit[1].vchInflationKeysRangeproof.clear();
+    mtx.vout.back().nAsset = assetIssued;
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    mtx.vout.back().nAsset = assetToken;
+    issuance.nInflationKeys.SetNull();
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+    mtx.vout.pop_back();
+    BOOST_CHECK(CheckExplicitEquivalence(vSpent, mtx));
+    issuance.nAmount = 0;
+    mtx.vout.back().nValue = 0;
+    mtx.vout.back().scriptPubKey = CScript() << OP_RETURN;
+    BOOST_CHECK(!CheckExplicitEquivalence(vSpent, mtx));
+
+    // Reissuances and blinded amounts take the commitment path
+    bool fValid;
+    issuance.assetBlindingNonce = GetRandHash();
+    BOOST_CHECK(!VerifyExplicitAmounts(vSpent, CTransaction(mtx), fValid));
+    issuance.SetNull();
+    mtx.vout.pop_back();
+    BOOST_CHECK(VerifyExplicitAmounts(vSpent, CTransaction(mtx), fValid) && fValid);
+    secp256k1_generator gen;
+    const unsigned char blind[32] = {1};
+    BlindAsset(mtx.vout[0].nAsset, gen, assetA, blind);
+    BOOST_CHECK(!VerifyExplicitAmounts(vSpent, CTransaction(mtx), fValid));
+
+    // As do sums that do not fit in a CAmount
+    const size_t nLarge = std::numeric_limits<CAmount>::max() / MAX_MONEY + 1;
+    vSpent.assign(nLarge, CTxOut(assetA, MAX_MONEY, script));
+    mtx.vin.resize(nLarge);
+    mtx.vout.assign(nLarge, CTxOut(assetA, MAX_MONEY, script));
+    mtx.wit.SetNull();
+    BOOST_CHECK(!VerifyExplicitAmounts(vSpent, CTransaction(mtx), fValid));
+    BOOST_CHECK(VerifyCommittedAmounts(vSpent, CTransaction(mtx)));
+    BOOST_CHECK(VerifyAmounts(vSpent, CTransaction(mtx)));
+}
+
+BOOST_AUTO_TEST_CASE(explicit_amounts_random_test)
+{
+    seed_insecure_rand();
+    std::vector<CAsset> vAssets;
+    for (int i = 0; i < 3; i++) {
+        vAssets.emplace_back(GetRandHash());
+    }
+    CScript script = CScript() << OP_TRUE;
+
+    for (int n = 0; n < 250; n++) {
+        std::vector<CTxOut> vSpent;
+        CMutableTransaction mtx;
+        CAmountMap mapIn;
+        size_t nInputs = 1 + insecure_rand() % 4;
+        for (size_t i = 0; i < nInputs; i++) {
+            const CAsset& asset = vAssets[insecure_rand() % vAssets.size()];
+            CAmount nValue = 1 + insecure_rand() % 100000;
+            vSpent.push_back(CTxOut(asset, nValue, script));
+            mtx.vin.push_back(CTxIn(COutPoint(GetRandHash(), insecure_rand() % 4)));
+            mapIn[asset] += nValue;
+        }
+        if (insecure_rand() % 4 == 0) {
+            CAssetIssuance& issuance = mtx.vin[0].assetIssuance;
+            issuance.assetEntropy = GetRandHash();
+            issuance.nAmount = 1 + insecure_rand() % 100000;
+            uint256 entropy;
+            CAsset assetIssued;
+            GenerateAssetEntropy(entropy, mtx.vin[0].prevout, issuance.assetEntropy);
+            CalculateAsset(assetIssued, entropy);
+            mapIn[assetIssued] += issuance.nAmount.GetAmount();
+            mtx.wit.vtxinwit.resize(1);
+        }
+
+        // Split each asset over up to three outputs, the first of them possibly a fee
+        for (CAmountMap::const_iterator it = mapIn.begin(); it != mapIn.end(); ++it) {
+            CAmount nLeft = it->second;
+            while (nLeft > 0) {
+                CAmount nValue = (mtx.vout.size() % 3 == 2) ? nLeft : 1 + insecure_rand() % nLeft;
+                mtx.vout.push_back(CTxOut(it->first, nValue, insecure_rand() % 4 == 0 ? CScript() : script));
+                nLeft -= nValue;
+            }
+        }
+
+        bool fExpected = true;
+        switch (insecure_rand() % 8) {
+        case 0: {
+            CTxOut& out = mtx.vout[insecure_rand() % mtx.vout.size()];
+            out.nValue = out.nValue.GetAmount() + 1;
+            fExpected = false;
+            break;
+        }
+        case 1: {
+            CConfidentialAsset asset = mtx.vout.back().nAsset;
+            mtx.vout.back().nAsset = vAssets[insecure_rand() % vAssets.size()];
+            fExpected = mtx.vout.back().nAsset == asset;
+            break;
+        }
+        case 2:
+            mtx.vout.push_back(CTxOut(vAssets[0], 0, (insecure_rand() % 2) ? CScript() << OP_RETURN : script));
+            fExpected = mtx.vout.back().scriptPubKey.IsUnspendable();
+            break;
+        case 3:
+            mtx.vout.pop_back();
+            fExpected = false;
+            break;
+        }
+        bool fValid = CheckExplicitEquivalence(vSpent, mtx);
+        if (fExpected) {
+            BOOST_CHECK(fValid);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -45,12 +45,12 @@ BOOST_AUTO_TEST_CASE(withdrawspent_validity)
 {
     CCoinsViewTester coins;
     CCoinsViewCache coinsCache(&coins);
-    CCoins ret;
+    Coin ret;
 
     //Basic insert of blank outpoint pair, blank COutPoint allows for checking coinsCache
 
     std::pair<uint256, COutPoint> outpoint = std::make_pair(GetRandHash(), COutPoint(GetRandHash(), 42));
-    BOOST_CHECK(!coinsCache.GetCoins(uint256(), ret));
+    BOOST_CHECK(!coinsCache.GetCoin(COutPoint(), ret));
 
     //Checking for withdraw spentness should not create an entry
     BOOST_CHECK(!coinsCache.IsWithdrawSpent(outpoint));
@@ -138,4 +138,47 @@ BOOST_AUTO_TEST_CASE(withdrawspent_validity)
     BOOST_CHECK_EQUAL(coins2.mapCoinsWritten[outpoint4].withdrawSpent, true);
 }
 
+BOOST_AUTO_TEST_CASE(withdrawspent_db_filter)
+{
+    CCoinsViewDB coinsDB(1 << 20, true);
+    CCoinsViewCache coinsCache(&coinsDB);
+    CPeginClaimStats stats;
+
+    std::pair<uint256, COutPoint> claimed = std::make_pair(GetRandHash(), COutPoint(GetRandHash(), 42));
+    std::pair<uint256, COutPoint> unclaimed = std::make_pair(GetRandHash(), COutPoint(GetRandHash(), 42));
+
+    // Lookups of unclaimed peg-ins do not read the database
+    BOOST_CHECK(!coinsDB.IsWithdrawSpent(unclaimed));
+    coinsDB.GetPeginClaimStats(stats);
+    BOOST_CHECK_EQUAL(stats.nClaims, 0);
+    BOOST_CHECK_EQUAL(stats.nLookups, 1);
+    BOOST_CHECK_EQUAL(stats.nReads, 0);
+
+    coinsCache.SetWithdrawSpent(claimed, true);
+    BOOST_CHECK(coinsCache.Flush());
+    BOOST_CHECK(coinsDB.IsWithdrawSpent(claimed));
+    BOOST_CHECK(!coinsDB.IsWithdrawSpent(unclaimed));
+    coinsDB.GetPeginClaimStats(stats);
+    BOOST_CHECK_EQUAL(stats.nClaims, 1);
+    // SetWithdrawSpent looked the claim up as well
+    BOOST_CHECK_EQUAL(stats.nLookups, 4);
+    BOOST_CHECK_EQUAL(stats.nReads - stats.nFalsePositives, 1);
+
+    // Claiming more than the filter holds rebuilds it without losing any claim
+    for (unsigned int i = 0; i < PEGIN_FILTER_MIN_CLAIMS; i++)
+        coinsCache.SetWithdrawSpent(std::make_pair(GetRandHash(), COutPoint(GetRandHash(), i)), true);
+    BOOST_CHECK(coinsCache.Flush());
+    coinsDB.GetPeginClaimStats(stats);
+    BOOST_CHECK_EQUAL(stats.nClaims, PEGIN_FILTER_MIN_CLAIMS + 1);
+    BOOST_CHECK_EQUAL(stats.nFilterCapacity, 2 * (PEGIN_FILTER_MIN_CLAIMS + 1));
+    BOOST_CHECK(coinsDB.IsWithdrawSpent(claimed));
+
+    // Claims undone by a disconnected block are erased
+    coinsCache.SetWithdrawSpent(claimed, false);
+    BOOST_CHECK(coinsCache.Flush());
+    BOOST_CHECK(!coinsDB.IsWithdrawSpent(claimed));
+    coinsDB.GetPeginClaimStats(stats);
+    BOOST_CHECK_EQUAL(stats.nClaims, PEGIN_FILTER_MIN_CLAIMS);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
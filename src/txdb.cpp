@@ -8,17 +8,28 @@
 #include "chainparams.h"
 #include "hash.h"
 #include "pow.h"
+#include "ui_interface.h"
 #include "uint256.h"
+#include "util.h"
 
 #include <stdint.h>
 
 #include <boost/thread.hpp>
 
+static const char DB_COIN = 'C';
+//! Per-transaction records of chainstates older than DB_COIN, see CCoinsViewDB::Upgrade
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
 static const char DB_LOCKS = 'k';
-static const char DB_BLOCK_INDEX = 'b';
+static const char DB_BLOCK_INDEX = 'i';
+static const char DB_BLOCK_CHALLENGE = 'h';
+//! Block index entries with the full challenge inline, see UpgradeBlockIndex
+static const char DB_BLOCK_INDEX_LEGACY = 'b';
+//! Stored under DB_BLOCK_INDEX_LEGACY with a null hash. Versions that load the
+//! block index from there fail to read it and refuse the database, instead of
+//! finding it empty.
+static const unsigned char BLOCK_INDEX_VERSION = 2;
 static const char DB_WITHDRAW_FLAG = 'w';
 static const char DB_INVALID_BLOCK_Q = 'q';
 static const char DB_PAK = 'p';
@@ -29,20 +40,89 @@ static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
 
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+namespace {
+
+struct CoinEntry {
+    COutPoint* outpoint;
+    char key;
+    CoinEntry(const COutPoint* ptr) : outpoint(const_cast<COutPoint*>(ptr)), key(DB_COIN)  {}
+
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        s << key;
+        s << outpoint->hash;
+        s << VARINT(outpoint->n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        s >> key;
+        s >> outpoint->hash;
+        s >> VARINT(outpoint->n);
+    }
+};
+
+} // namespace
+
+//! False positive rate of the peg-in claim filter
+static const double PEGIN_FILTER_FP_RATE = 0.0001;
+
+static std::vector<unsigned char> PeginFilterKey(const std::pair<uint256, COutPoint> &outpoint)
 {
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << outpoint;
+    return std::vector<unsigned char>(ss.begin(), ss.end());
 }
 
-bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
-    return db.Read(std::make_pair(DB_COINS, txid), coins);
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true), peginFilter(PEGIN_FILTER_MIN_CLAIMS, PEGIN_FILTER_FP_RATE), nPeginLookups(0), nPeginReads(0), nPeginFalsePositives(0)
+{
+    LoadPeginClaims();
 }
 
-bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
-    return db.Exists(std::make_pair(DB_COINS, txid));
+void CCoinsViewDB::LoadPeginClaims()
+{
+    std::vector<std::vector<unsigned char> > vClaims;
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(DB_WITHDRAW_FLAG);
+    std::pair<char, std::pair<uint256, COutPoint> > key;
+    while (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_WITHDRAW_FLAG) {
+        vClaims.push_back(PeginFilterKey(key.second));
+        pcursor->Next();
+    }
+
+    nPeginClaims = vClaims.size();
+    nPeginFilterCapacity = std::max(PEGIN_FILTER_MIN_CLAIMS, (unsigned int)(2 * vClaims.size()));
+    peginFilter = CRollingBloomFilter(nPeginFilterCapacity, PEGIN_FILTER_FP_RATE);
+    for (const std::vector<unsigned char>& vKey : vClaims)
+        peginFilter.insert(vKey);
+    nPeginFilterInserts = vClaims.size();
+}
+
+bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    return db.Read(CoinEntry(&outpoint), coin);
+}
+
+bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    return db.Exists(CoinEntry(&outpoint));
 }
 
 bool CCoinsViewDB::IsWithdrawSpent(const std::pair<uint256, COutPoint> &outpoint) const {
-    return db.Exists(std::make_pair(DB_WITHDRAW_FLAG, outpoint));
+    nPeginLookups++;
+    if (!peginFilter.contains(PeginFilterKey(outpoint)))
+        return false;
+    nPeginReads++;
+    bool fSpent = db.Exists(std::make_pair(DB_WITHDRAW_FLAG, outpoint));
+    if (!fSpent)
+        nPeginFalsePositives++;
+    return fSpent;
+}
+
+void CCoinsViewDB::GetPeginClaimStats(CPeginClaimStats &stats) const {
+    stats.nClaims = nPeginClaims;
+    stats.nFilterCapacity = nPeginFilterCapacity;
+    stats.nLookups = nPeginLookups;
+    stats.nReads = nPeginReads;
+    stats.nFalsePositives = nPeginFalsePositives;
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
@@ -56,18 +136,31 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
+    std::vector<std::vector<unsigned char> > vNewClaims;
+    int64_t nClaimsChange = 0;
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             if (it->second.flags & CCoinsCacheEntry::WITHDRAW) {
-                if (!it->second.withdrawSpent)
+                // The filter has no false negatives, so only claims it matches can be stored already
+                std::vector<unsigned char> vKey = PeginFilterKey(it->first);
+                bool fStored = peginFilter.contains(vKey) && db.Exists(std::make_pair(DB_WITHDRAW_FLAG, it->first));
+                if (!it->second.withdrawSpent) {
                     batch.Erase(std::make_pair(DB_WITHDRAW_FLAG, it->first));
-                else
+                    if (fStored)
+                        nClaimsChange--;
+                } else {
                     batch.Write(std::make_pair(DB_WITHDRAW_FLAG, it->first), '1');
+                    if (!fStored) {
+                        nClaimsChange++;
+                        vNewClaims.push_back(std::move(vKey));
+                    }
+                }
             } else {
-                if (it->second.coins.IsPruned())
-                    batch.Erase(std::make_pair(DB_COINS, it->first.first));
+                CoinEntry entry(&it->first.second);
+                if (it->second.coin.IsSpent())
+                    batch.Erase(entry);
                 else
-                    batch.Write(std::make_pair(DB_COINS, it->first.first), it->second.coins);
+                    batch.Write(entry, it->second.coin);
             }
             changed++;
         }
@@ -78,8 +171,20 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     if (!hashBlock.IsNull())
         batch.Write(DB_BEST_BLOCK, hashBlock);
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
-    return db.WriteBatch(batch);
+    LogPrint("coindb", "Committing %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    if (!db.WriteBatch(batch))
+        return false;
+
+    nPeginClaims += nClaimsChange;
+    if (nPeginFilterInserts + vNewClaims.size() > nPeginFilterCapacity) {
+        LoadPeginClaims();
+        LogPrint("coindb", "Rebuilt peg-in claim filter for %u claims\n", nPeginFilterCapacity);
+    } else {
+        for (const std::vector<unsigned char>& vKey : vNewClaims)
+            peginFilter.insert(vKey);
+        nPeginFilterInserts += vNewClaims.size();
+    }
+    return true;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
@@ -111,25 +216,31 @@ CCoinsViewCursor *CCoinsViewDB::Cursor() const
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
-    i->pcursor->Seek(DB_COINS);
+    i->pcursor->Seek(DB_COIN);
     // Cache key of first record
-    i->pcursor->GetKey(i->keyTmp);
+    if (i->pcursor->Valid()) {
+        CoinEntry entry(&i->keyTmp.second);
+        i->pcursor->GetKey(entry);
+        i->keyTmp.first = entry.key;
+    } else {
+        i->keyTmp.first = 0; // Make sure Valid() and GetKey() return false
+    }
     return i;
 }
 
-bool CCoinsViewDBCursor::GetKey(uint256 &key) const
+bool CCoinsViewDBCursor::GetKey(COutPoint &key) const
 {
     // Return cached key
-    if (keyTmp.first == DB_COINS) {
+    if (keyTmp.first == DB_COIN) {
         key = keyTmp.second;
         return true;
     }
     return false;
 }
 
-bool CCoinsViewDBCursor::GetValue(CCoins &coins) const
+bool CCoinsViewDBCursor::GetValue(Coin &coin) const
 {
-    return pcursor->GetValue(coins);
+    return pcursor->GetValue(coin);
 }
 
 unsigned int CCoinsViewDBCursor::GetValueSize() const
@@ -139,14 +250,130 @@ unsigned int CCoinsViewDBCursor::GetValueSize() const
 
 bool CCoinsViewDBCursor::Valid() const
 {
-    return keyTmp.first == DB_COINS;
+    return keyTmp.first == DB_COIN;
 }
 
 void CCoinsViewDBCursor::Next()
 {
     pcursor->Next();
-    if (!pcursor->Valid() || !pcursor->GetKey(keyTmp))
+    CoinEntry entry(&keyTmp.second);
+    if (!pcursor->Valid() || !pcursor->GetKey(entry)) {
         keyTmp.first = 0; // Invalidate cached key after last record so that Valid() and GetKey() return false
+    } else {
+        keyTmp.first = entry.key;
+    }
+}
+
+size_t CCoinsViewDB::EstimateSize() const
+{
+    return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
+}
+
+namespace {
+
+//! Per-transaction record of the unspent outputs, as stored under DB_COINS
+class CLegacyCoins
+{
+public:
+    bool fCoinBase;
+    std::vector<CTxOut> vout;
+    int nHeight;
+
+    CLegacyCoins() : fCoinBase(false), vout(0), nHeight(0) { }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        unsigned int nCode = 0;
+        // version
+        int nVersionDummy;
+        ::Unserialize(s, VARINT(nVersionDummy));
+        // header code
+        ::Unserialize(s, VARINT(nCode));
+        fCoinBase = nCode & 1;
+        std::vector<bool> vAvail(2, false);
+        vAvail[0] = (nCode & 2) != 0;
+        vAvail[1] = (nCode & 4) != 0;
+        unsigned int nMaskCode = (nCode / 8) + ((nCode & 6) != 0 ? 0 : 1);
+        // spentness bitmask
+        while (nMaskCode > 0) {
+            unsigned char chAvail = 0;
+            ::Unserialize(s, chAvail);
+            for (unsigned int p = 0; p < 8; p++) {
+                bool f = (chAvail & (1 << p)) != 0;
+                vAvail.push_back(f);
+            }
+            if (chAvail != 0)
+                nMaskCode--;
+        }
+        // txouts themself
+        vout.assign(vAvail.size(), CTxOut());
+        for (unsigned int i = 0; i < vAvail.size(); i++) {
+            if (vAvail[i])
+                ::Unserialize(s, REF(CTxOutCompressor(vout[i])));
+        }
+        // coinbase height
+        ::Unserialize(s, VARINT(nHeight));
+    }
+};
+
+} // namespace
+
+/**
+ * Split the per-transaction records of chainstates written before DB_COIN
+ * into one record per unspent output. Every batch converts its records
+ * atomically, so an interrupted upgrade resumes where it stopped.
+ */
+bool CCoinsViewDB::Upgrade()
+{
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    pcursor->Seek(std::make_pair(DB_COINS, uint256()));
+
+    CDBBatch batch(db);
+    size_t nTransactions = 0, nOutputs = 0;
+    int nReported = -1;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_COINS)
+            break;
+        if (nTransactions == 0) {
+            LogPrintf("Upgrading chainstate to store unspent outputs individually...\n");
+            uiInterface.ShowProgress(_("Upgrading UTXO database"), 0);
+        }
+        CLegacyCoins coins;
+        if (!pcursor->GetValue(coins))
+            return error("%s: failed to read value", __func__);
+        COutPoint outpoint(key.second, 0);
+        for (size_t i = 0; i < coins.vout.size(); i++) {
+            if (!coins.vout[i].IsNull() && !coins.vout[i].scriptPubKey.IsUnspendable()) {
+                outpoint.n = i;
+                batch.Write(CoinEntry(&outpoint), Coin(std::move(coins.vout[i]), coins.nHeight, coins.fCoinBase));
+                nOutputs++;
+            }
+        }
+        batch.Erase(key);
+        if (++nTransactions % 10000 == 0) {
+            if (!db.WriteBatch(batch))
+                return error("%s: failed to write upgraded entries", __func__);
+            batch.Clear();
+            // Records are ordered by txid, whose leading bytes tell how far along we are
+            int nProgress = (0x100 * key.second.begin()[0] + key.second.begin()[1]) * 100 / 0x10000;
+            uiInterface.ShowProgress(_("Upgrading UTXO database"), nProgress);
+            if (nProgress / 10 > nReported) {
+                nReported = nProgress / 10;
+                LogPrintf("[%d%%]...\n", nProgress);
+            }
+        }
+        pcursor->Next();
+    }
+    if (nTransactions == 0)
+        return true;
+    if (!db.WriteBatch(batch, true))
+        return error("%s: failed to write upgraded entries", __func__);
+    uiInterface.ShowProgress("", 100);
+    LogPrintf("Upgraded %u transactions to %u unspent outputs, compacting the database...\n", nTransactions, nOutputs);
+    db.CompactRange(std::make_pair(DB_COINS, uint256()), std::make_pair(DB_COINS, uint256S(std::string(64, 'f'))));
+    return true;
 }
 
 bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
@@ -155,10 +382,29 @@ bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockF
         batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
     }
     batch.Write(DB_LAST_BLOCK, nLastFile);
+    std::set<uint256> setNewChallenges;
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
-        batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+        CDiskBlockIndex diskindex(*it);
+        // Entries without a solution in memory have been written before,
+        // carry the solution over from the stored record.
+        if (!(*it)->psolution && !ReadBlockProofSolution((*it)->GetBlockHash(), diskindex.solution))
+            return error("%s: missing proof solution of block %s", __func__, (*it)->GetBlockHash().ToString());
+        if ((*it)->pchallenge && !setStoredChallenges.count(diskindex.hashChallenge) && setNewChallenges.insert(diskindex.hashChallenge).second)
+            batch.Write(std::make_pair(DB_BLOCK_CHALLENGE, diskindex.hashChallenge), *(const CScriptBase*)((*it)->pchallenge.get()));
+        batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), diskindex);
     }
-    return WriteBatch(batch, true);
+    if (!WriteBatch(batch, true))
+        return false;
+    setStoredChallenges.insert(setNewChallenges.begin(), setNewChallenges.end());
+    return true;
+}
+
+bool CBlockTreeDB::ReadBlockProofSolution(const uint256 &hash, CScript &solution) {
+    CDiskBlockIndex diskindex;
+    if (!Read(std::make_pair(DB_BLOCK_INDEX, hash), diskindex))
+        return false;
+    solution = diskindex.solution;
+    return true;
 }
 
 bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
@@ -202,8 +448,128 @@ bool CBlockTreeDB::WriteInvalidBlockQueue(const std::vector<uint256> &vBlocks) {
     return Write(std::make_pair(DB_INVALID_BLOCK_Q, uint256S("0")), vBlocks);
 }
 
+namespace {
+
+/** Block index entry as stored under DB_BLOCK_INDEX_LEGACY */
+class CLegacyDiskBlockIndex : public CDiskBlockIndex
+{
+public:
+    CProof proof;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        int nVersion = s.GetVersion();
+        if (!(s.GetType() & SER_GETHASH))
+            READWRITE(VARINT(nVersion));
+
+        READWRITE(VARINT(nHeight));
+        READWRITE(VARINT(nStatus));
+        READWRITE(VARINT(nTx));
+        if (nStatus & (BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO))
+            READWRITE(VARINT(nFile));
+        if (nStatus & BLOCK_HAVE_DATA)
+            READWRITE(VARINT(nDataPos));
+        if (nStatus & BLOCK_HAVE_UNDO)
+            READWRITE(VARINT(nUndoPos));
+
+        // block header
+        READWRITE(this->nVersion);
+        READWRITE(hashPrev);
+        READWRITE(hashMerkleRoot);
+        READWRITE(nTime);
+        READWRITE(proof);
+    }
+};
+
+} // namespace
+
+/**
+ * Move entries that store the full challenge inline to DB_BLOCK_INDEX,
+ * storing each challenge once under DB_BLOCK_CHALLENGE. Every batch moves
+ * its entries atomically, so an interrupted upgrade resumes where it
+ * stopped. The first batch writes BLOCK_INDEX_VERSION if it is missing.
+ */
+bool CBlockTreeDB::UpgradeBlockIndex(std::map<uint256, std::shared_ptr<const CScript> >& mapChallenges)
+{
+    const std::pair<char, uint256> keyVersion(DB_BLOCK_INDEX_LEGACY, uint256());
+    CDBBatch batch(*this);
+    bool fHaveVersion = Exists(keyVersion);
+    if (!fHaveVersion)
+        batch.Write(keyVersion, BLOCK_INDEX_VERSION);
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(keyVersion);
+
+    size_t nEntries = 0;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX_LEGACY)
+            break;
+        if (key == keyVersion) {
+            pcursor->Next();
+            continue;
+        }
+        if (nEntries == 0)
+            LogPrintf("Upgrading block index to store block challenges by reference...\n");
+        CLegacyDiskBlockIndex diskindex;
+        if (!pcursor->GetValue(diskindex))
+            return error("%s: failed to read value", __func__);
+        diskindex.hashChallenge = GetBlockChallengeHash(diskindex.proof.challenge);
+        if (!mapChallenges.count(diskindex.hashChallenge)) {
+            mapChallenges[diskindex.hashChallenge] = InternBlockChallenge(diskindex.proof.challenge);
+            batch.Write(std::make_pair(DB_BLOCK_CHALLENGE, diskindex.hashChallenge), *(CScriptBase*)(&diskindex.proof.challenge));
+        }
+        diskindex.solution = diskindex.proof.solution;
+        batch.Write(std::make_pair(DB_BLOCK_INDEX, key.second), static_cast<const CDiskBlockIndex&>(diskindex));
+        batch.Erase(key);
+        if (++nEntries % 10000 == 0) {
+            if (!WriteBatch(batch))
+                return error("%s: failed to write upgraded entries", __func__);
+            batch.Clear();
+        }
+        pcursor->Next();
+    }
+    if (nEntries == 0) {
+        if (!fHaveVersion && !WriteBatch(batch, true))
+            return error("%s: failed to write the block index version", __func__);
+        return true;
+    }
+    if (!WriteBatch(batch, true))
+        return error("%s: failed to write upgraded entries", __func__);
+    LogPrintf("Upgraded %u block index entries, compacting the database...\n", nEntries);
+    CompactRange(std::make_pair(DB_BLOCK_INDEX_LEGACY, uint256()), std::make_pair(DB_BLOCK_INDEX, uint256S(std::string(64, 'f'))));
+    return true;
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
+    // Load the challenges the entries refer to
+    std::map<uint256, std::shared_ptr<const CScript> > mapChallenges;
+    {
+        std::unique_ptr<CDBIterator> pcursor(NewIterator());
+        pcursor->Seek(std::make_pair(DB_BLOCK_CHALLENGE, uint256()));
+        while (pcursor->Valid()) {
+            std::pair<char, uint256> key;
+            if (!pcursor->GetKey(key) || key.first != DB_BLOCK_CHALLENGE)
+                break;
+            CScript challenge;
+            if (!pcursor->GetValue(*(CScriptBase*)(&challenge)))
+                return error("LoadBlockIndex() : failed to read challenge");
+            mapChallenges[key.second] = InternBlockChallenge(challenge);
+            pcursor->Next();
+        }
+    }
+
+    if (!UpgradeBlockIndex(mapChallenges))
+        return false;
+
+    setStoredChallenges.clear();
+    for (std::map<uint256, std::shared_ptr<const CScript> >::const_iterator it = mapChallenges.begin(); it != mapChallenges.end(); ++it)
+        setStoredChallenges.insert(it->first);
+
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
@@ -215,6 +581,11 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
         if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
             CDiskBlockIndex diskindex;
             if (pcursor->GetValue(diskindex)) {
+                std::map<uint256, std::shared_ptr<const CScript> >::const_iterator itChallenge = mapChallenges.find(diskindex.hashChallenge);
+                if (itChallenge == mapChallenges.end())
+                    return error("LoadBlockIndex() : unknown challenge %s", diskindex.hashChallenge.ToString());
+                diskindex.pchallenge = itChallenge->second;
+
                 // Construct block index object
                 CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
                 pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
@@ -225,7 +596,7 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
                 pindexNew->nVersion       = diskindex.nVersion;
                 pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
                 pindexNew->nTime          = diskindex.nTime;
-                pindexNew->proof          = diskindex.proof;
+                pindexNew->pchallenge     = diskindex.pchallenge;
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
 
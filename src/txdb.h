@@ -6,11 +6,14 @@
 #ifndef BITCOIN_TXDB_H
 #define BITCOIN_TXDB_H
 
+#include "bloom.h"
 #include "coins.h"
 #include "dbwrapper.h"
 #include "chain.h"
 
 #include <map>
+#include <memory>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -41,6 +44,8 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Minimum number of peg-in claims the claim filter of the coin DB is sized for
+static const unsigned int PEGIN_FILTER_MIN_CLAIMS = 10000;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -67,20 +72,55 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/** Peg-in claims stored in the coin database, and how lookups of them were answered */
+struct CPeginClaimStats
+{
+    uint64_t nClaims;
+    unsigned int nFilterCapacity;
+    uint64_t nLookups;
+    uint64_t nReads;
+    uint64_t nFalsePositives;
+
+    CPeginClaimStats() : nClaims(0), nFilterCapacity(0), nLookups(0), nReads(0), nFalsePositives(0) {}
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    /**
+     * Every claimed peg-in in the database, so that lookups of unclaimed ones
+     * are answered without reading the disk. The filter remembers at least its
+     * last nPeginFilterCapacity insertions, and is rebuilt from the database
+     * before it gets more than that, so it never forgets a claim.
+     */
+    CRollingBloomFilter peginFilter;
+    unsigned int nPeginFilterCapacity;
+    unsigned int nPeginFilterInserts;
+    uint64_t nPeginClaims;
+    mutable uint64_t nPeginLookups;
+    mutable uint64_t nPeginReads;
+    mutable uint64_t nPeginFalsePositives;
+
+    //! (Re)build peginFilter and nPeginClaims from the database
+    void LoadPeginClaims();
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
-    bool GetCoins(const uint256 &txid, CCoins &coins) const;
-    bool HaveCoins(const uint256 &txid) const;
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const;
+    bool HaveCoin(const COutPoint &outpoint) const;
     bool IsWithdrawSpent(const std::pair<uint256, COutPoint> &outpoint) const;
     uint256 GetBestBlock() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     CCoinsViewCursor *Cursor() const;
+
+    //! Convert per-transaction records of an older chainstate to per-output ones
+    bool Upgrade();
+    size_t EstimateSize() const;
+
+    void GetPeginClaimStats(CPeginClaimStats &stats) const;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -89,8 +129,8 @@ class CCoinsViewDBCursor: public CCoinsViewCursor
 public:
     ~CCoinsViewDBCursor() {}
 
-    bool GetKey(uint256 &key) const;
-    bool GetValue(CCoins &coins) const;
+    bool GetKey(COutPoint &key) const;
+    bool GetValue(Coin &coin) const;
     unsigned int GetValueSize() const;
 
     bool Valid() const;
@@ -100,7 +140,7 @@ private:
     CCoinsViewDBCursor(CDBIterator* pcursorIn, const uint256 &hashBlockIn):
         CCoinsViewCursor(hashBlockIn), pcursor(pcursorIn) {}
     std::unique_ptr<CDBIterator> pcursor;
-    std::pair<char, uint256> keyTmp;
+    std::pair<char, COutPoint> keyTmp;
 
     friend class CCoinsViewDB;
 };
@@ -116,6 +156,7 @@ private:
 public:
     bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &fileinfo);
+    bool ReadBlockProofSolution(const uint256 &hash, CScript &solution);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindex);
     bool ReadReindexing(bool &fReindex);
@@ -128,6 +169,11 @@ public:
     bool WriteInvalidBlockQueue(const std::vector<uint256> &vBlocks);
     bool ReadPAKList(std::vector<std::vector<unsigned char> >& offline_list, std::vector<std::vector<unsigned char> >& online_list, bool& reject);
     bool WritePAKList(const std::vector<std::vector<unsigned char> >& offline_list, const std::vector<std::vector<unsigned char> >& online_list, bool reject);
+private:
+    //! Challenges known to be stored, so WriteBatchSync only writes new ones
+    std::set<uint256> setStoredChallenges;
+
+    bool UpgradeBlockIndex(std::map<uint256, std::shared_ptr<const CScript> >& mapChallenges);
 };
 
 #endif // BITCOIN_TXDB_H
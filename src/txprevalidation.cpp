@@ -0,0 +1,218 @@
+// Copyright (c) 2017 The Elements Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txprevalidation.h"
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "policy/policy.h"
+#include "script/interpreter.h"
+#include "script/sigcache.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+std::unique_ptr<CTxPreValidationQueue> g_txprevalidation;
+
+bool CTxPreValidationJob::TakeSnapshot()
+{
+    AssertLockHeld(cs_main);
+    const CTransaction& txRef = *tx;
+
+    const uint256& genesis = Params().ParentGenesisBlockHash();
+    for (const CTxOut& out : txRef.vout) {
+        if (out.scriptPubKey.IsPegoutScript(genesis)) {
+            paklist = std::make_shared<const CPAKList>(g_paklist_config ? *g_paklist_config : g_paklist_blockchain);
+            break;
+        }
+    }
+
+    // The checks AcceptToMemoryPool makes before verifying anything. A
+    // transaction failing them is left for it to turn down right away.
+    // IsStandardTx checks peg-out proofs, so it waits for the proofs of a
+    // transaction with peg-outs to be cached.
+    std::string reason;
+    if (txRef.IsCoinBase() || !txRef.HasValidFee())
+        return false;
+    if (fRequireStandard && !paklist && !IsStandardTx(txRef, reason, IsWitnessEnabled(chainActive.Tip(), Params().GetConsensus())))
+        return false;
+    if (!CheckFinalTx(txRef, STANDARD_LOCKTIME_VERIFY_FLAGS))
+        return false;
+
+    nScriptVerifyFlags = GetMempoolScriptVerifyFlags();
+    vSpent.assign(txRef.vin.size(), CTxOut());
+    {
+        LOCK(mempool.cs);
+        if (mempool.exists(txRef.GetHash()))
+            return false;
+        CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+        CCoinsViewCache view(&viewMemPool);
+        for (size_t i = 0; i < txRef.vin.size(); i++) {
+            const CTxIn& txin = txRef.vin[i];
+            if (txin.m_is_pegin)
+                continue;
+            // Do not leave the coins of a transaction that may well be
+            // turned down in the cache; AcceptToMemoryPool loads them again.
+            bool fHadInCache = pcoinsTip->HaveCoinInCache(txin.prevout);
+            const Coin& coin = view.AccessCoin(txin.prevout);
+            if (!fHadInCache)
+                pcoinsTip->Uncache(txin.prevout);
+            if (coin.IsSpent() || mempool.isSpent(txin.prevout))
+                return false;
+            vSpent[i] = coin.out;
+        }
+        if (fRequireStandard && !AreInputsStandard(txRef, view))
+            return false;
+
+        // The size leaves out sigops, so that the fee checks never turn
+        // down a transaction AcceptToMemoryPool would take.
+        CAmount nModifiedFees = txRef.GetFee(policyAsset);
+        double nPriorityDummy = 0;
+        mempool.ApplyDeltas(txRef.GetHash(), nPriorityDummy, nModifiedFees);
+        int64_t nSize = GetVirtualTransactionSize(txRef);
+        if (nModifiedFees < mempool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize))
+            return false;
+        if (nModifiedFees < ::minRelayTxFee.GetFee(nSize))
+            return false;
+    }
+    return true;
+}
+
+bool PreValidateTransaction(const CTransaction& tx, std::vector<CTxOut>& vSpent, const CPAKList* paklist, unsigned int nScriptVerifyFlags, CValidationState& state)
+{
+    assert(vSpent.size() == tx.vin.size());
+
+    if (!CheckTransaction(tx, state))
+        return false;
+    if (tx.IsCoinBase())
+        return state.DoS(100, false, REJECT_INVALID, "coinbase");
+    if (!tx.HasValidFee())
+        return state.DoS(0, false, REJECT_INVALID, "bad-fees");
+
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        if (tx.vin[i].m_is_pegin) {
+            if (tx.wit.vtxinwit.size() <= i || !IsValidPeginWitness(tx.wit.vtxinwit[i].m_pegin_witness, tx.vin[i].prevout, false))
+                return state.DoS(0, false, REJECT_PEGIN, "bad-pegin-witness");
+            vSpent[i] = GetPeginOutputFromWitness(tx.wit.vtxinwit[i].m_pegin_witness);
+        }
+    }
+
+    if (!VerifyAmounts(vSpent, tx, NULL, true))
+        return state.DoS(100, false, REJECT_INVALID, "bad-txns-in-ne-out", false, "value in != value out");
+
+    // Same outcome as CheckInputs and AcceptToMemoryPool for a failing input
+    PrecomputedTransactionData txdata(tx);
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        CScriptCheck check(vSpent[i], tx, i, nScriptVerifyFlags, true, &txdata);
+        if (check())
+            continue;
+        if (!tx.HasWitness()) {
+            // Possibly stripped of its witness: do not cache the rejection
+            CScriptCheck checkNoWitness(vSpent[i], tx, i, nScriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, &txdata);
+            CScriptCheck checkNoCleanStack(vSpent[i], tx, i, nScriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, &txdata);
+            if (checkNoWitness() && !checkNoCleanStack())
+                state.SetCorruptionPossible();
+        }
+        CScriptCheck checkMandatory(vSpent[i], tx, i, nScriptVerifyFlags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, true, &txdata);
+        if (checkMandatory())
+            return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
+        return state.DoS(100, false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
+    }
+
+    if (paklist) {
+        const uint256& genesis = Params().ParentGenesisBlockHash();
+        for (const CTxOut& out : tx.vout) {
+            if (out.scriptPubKey.IsPegoutScript(genesis) && !CachingHasValidWhitelistPegoutProof(out.scriptPubKey, genesis, *paklist))
+                return state.DoS(0, false, REJECT_NONSTANDARD, "invalid-pegout-proof");
+        }
+    }
+    return true;
+}
+
+CTxPreValidationQueue::CTxPreValidationQueue(size_t nMaxQueueIn) :
+    nMaxQueue(nMaxQueueIn), nRunning(0), nDone(0), nValid(0), nRejectedFull(0),
+    nTimeWait(0), nTimeVerify(0), nCommitted(0), nTimeCommit(0)
+{
+}
+
+bool CTxPreValidationQueue::Add(const std::shared_ptr<CTxPreValidationJob>& job)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (queue.size() >= nMaxQueue) {
+            nRejectedFull++;
+            return false;
+        }
+        job->nTimeQueued = GetTimeMicros();
+        queue.push_back(job);
+    }
+    cond.notify_one();
+    return true;
+}
+
+void CTxPreValidationQueue::AddCommitTime(int64_t nMicros)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    nCommitted++;
+    nTimeCommit += nMicros;
+}
+
+void CTxPreValidationQueue::Thread()
+{
+    while (true) {
+        std::shared_ptr<CTxPreValidationJob> job;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty())
+                cond.wait(lock); // Interruption point
+            job = queue.front();
+            queue.pop_front();
+            nRunning++;
+        }
+
+        int64_t nTimeStart = GetTimeMicros();
+        try {
+            job->fValid = PreValidateTransaction(*job->tx, job->vSpent, job->paklist.get(), job->nScriptVerifyFlags, job->state);
+        } catch (const std::exception& e) {
+            LogPrintf("%s: %s: %s\n", __func__, job->tx->GetHash().ToString(), e.what());
+            job->fValid = false;
+            job->state = CValidationState();
+            job->state.Error(e.what());
+        }
+        int64_t nTimeEnd = GetTimeMicros();
+        LogPrint("mempool", "Pre-validated %s in %.2fms (%s)\n", job->tx->GetHash().ToString(),
+            0.001 * (nTimeEnd - nTimeStart), job->fValid ? "valid" : "invalid");
+
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nRunning--;
+            nDone++;
+            if (job->fValid)
+                nValid++;
+            nTimeWait += nTimeStart - job->nTimeQueued;
+            nTimeVerify += nTimeEnd - nTimeStart;
+        }
+        job->fPreValidated = true;
+        job->fDone = true;
+        if (job->fnDone)
+            job->fnDone();
+    }
+}
+
+CTxPreValidationStats CTxPreValidationQueue::GetStats()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    CTxPreValidationStats stats;
+    stats.nQueued = queue.size();
+    stats.nRunning = nRunning;
+    stats.nDone = nDone;
+    stats.nValid = nValid;
+    stats.nRejectedFull = nRejectedFull;
+    stats.nTimeWait = nTimeWait;
+    stats.nTimeVerify = nTimeVerify;
+    stats.nCommitted = nCommitted;
+    stats.nTimeCommit = nTimeCommit;
+    return stats;
+}
@@ -0,0 +1,138 @@
+// Copyright (c) 2017 The Elements Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXPREVALIDATION_H
+#define BITCOIN_TXPREVALIDATION_H
+
+#include "consensus/validation.h"
+#include "primitives/block.h"
+#include "primitives/transaction.h"
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+//! -txprevalidationthreads default (0 = verify loose transactions in AcceptToMemoryPool only)
+static const int DEFAULT_TXPREVALIDATION_THREADS = 2;
+//! Maximum number of transaction pre-validation threads
+static const int MAX_TXPREVALIDATION_THREADS = 16;
+//! Maximum number of transactions waiting for a pre-validation thread
+static const size_t MAX_TXPREVALIDATION_QUEUE = 1000;
+//! Maximum number of a peer's transactions waiting to be committed, beyond which its messages are left unread
+static const size_t MAX_PENDING_TX_PER_PEER = 100;
+
+/**
+ * A loose transaction on its way to the mempool. The outputs it spends, and
+ * the PAK list if it has peg-outs, are copied under cs_main when it is
+ * queued, so that pre-validation needs no locks.
+ */
+class CTxPreValidationJob
+{
+public:
+    const CTransactionRef tx;
+    //! Output spent by each input; peg-in inputs are left null
+    std::vector<CTxOut> vSpent;
+    std::shared_ptr<const CPAKList> paklist;
+    //! The script verification flags AcceptToMemoryPool uses
+    unsigned int nScriptVerifyFlags;
+    //! Called from the pre-validation thread once fDone is set
+    std::function<void()> fnDone;
+
+    int64_t nTimeQueued;
+    std::atomic<bool> fDone;
+    //! Set once a pre-validation thread has checked the transaction
+    bool fPreValidated;
+    bool fValid;
+    //! Why the transaction is invalid, as AcceptToMemoryPool would put it
+    CValidationState state;
+
+    explicit CTxPreValidationJob(const CTransactionRef& txIn) : tx(txIn), nScriptVerifyFlags(0), nTimeQueued(0), fDone(false), fPreValidated(false), fValid(false) {}
+
+    /**
+     * Make the cheap policy checks of AcceptToMemoryPool (standardness,
+     * finality, fees, conflicts with the mempool) and copy the outputs spent
+     * by the transaction from the chainstate and the mempool. Returns false
+     * if the transaction fails a check or any of its outputs is missing or
+     * spent, in which case AcceptToMemoryPool will turn it down without
+     * having to verify it. Requires cs_main.
+     */
+    bool TakeSnapshot();
+};
+
+/**
+ * Check the proofs, peg-in witnesses and scripts of a transaction against the
+ * outputs it spends, storing the valid results in the signature, range proof,
+ * surjection proof, peg-in witness and PAK proof caches. AcceptToMemoryPool
+ * then mostly finds its checks answered by the caches. Does not need cs_main;
+ * the peg-in depth check is left to AcceptToMemoryPool. The peg-in entries of
+ * vSpent are filled in from the peg-in witnesses. On failure, state is set
+ * the way AcceptToMemoryPool would set it, so that the transaction can be
+ * turned down without being verified again. Scripts are checked against
+ * nScriptVerifyFlags, which must be the flags AcceptToMemoryPool uses.
+ */
+bool PreValidateTransaction(const CTransaction& tx, std::vector<CTxOut>& vSpent, const CPAKList* paklist, unsigned int nScriptVerifyFlags, CValidationState& state);
+
+struct CTxPreValidationStats
+{
+    size_t nQueued;
+    size_t nRunning;
+    uint64_t nDone;
+    uint64_t nValid;
+    uint64_t nRejectedFull;
+    //! Cumulative time spent in the queue, in pre-validation and in the final stage, in microseconds
+    int64_t nTimeWait;
+    int64_t nTimeVerify;
+    uint64_t nCommitted;
+    int64_t nTimeCommit;
+};
+
+/**
+ * Queue of loose transactions pre-validated by a pool of threads, so that
+ * the expensive part of mempool acceptance runs without cs_main and without
+ * holding up the message handler. The final stage, AcceptToMemoryPool under
+ * cs_main, is run by the message handler once a job is done, in the order
+ * each peer sent its transactions.
+ */
+class CTxPreValidationQueue
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<std::shared_ptr<CTxPreValidationJob> > queue;
+    const size_t nMaxQueue;
+
+    size_t nRunning;
+    uint64_t nDone;
+    uint64_t nValid;
+    uint64_t nRejectedFull;
+    int64_t nTimeWait;
+    int64_t nTimeVerify;
+    uint64_t nCommitted;
+    int64_t nTimeCommit;
+
+public:
+    explicit CTxPreValidationQueue(size_t nMaxQueueIn = MAX_TXPREVALIDATION_QUEUE);
+
+    /** Queue a job. Returns false if the queue is full. */
+    bool Add(const std::shared_ptr<CTxPreValidationJob>& job);
+
+    /** Record the time the final stage took for a transaction. */
+    void AddCommitTime(int64_t nMicros);
+
+    /** Pre-validate queued jobs until interrupted. */
+    void Thread();
+
+    CTxPreValidationStats GetStats();
+};
+
+/** Created in init when -txprevalidationthreads is non-zero. */
+extern std::unique_ptr<CTxPreValidationQueue> g_txprevalidation;
+
+#endif // BITCOIN_TXPREVALIDATION_H
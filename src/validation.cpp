@@ -6,6 +6,7 @@
 #include "validation.h"
 
 #include "arith_uint256.h"
+#include "blind.h"
 #include "callrpc.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -14,9 +15,14 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/common.h"
 #include "crypto/hmac_sha256.h"
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
 #include "init.h"
 #include "issuance.h"
+#include "mainchain.h"
+#include "memusage.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "pow.h"
@@ -43,6 +49,9 @@
 #include "warnings.h"
 
 #include <atomic>
+#include <list>
+#include <map>
+#include <memory>
 #include <sstream>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -214,6 +223,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
     return chain.Genesis();
 }
 
+CCoinsViewDB *pcoinsdbview = NULL;
 CCoinsViewCache *pcoinsTip = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
@@ -413,15 +423,15 @@ bool CheckSequenceLocks(const CTransaction &tx, int flags, LockPoints* lp, bool
                 prevheights[txinIndex] = -1;
                 continue;
             }
-            CCoins coins;
-            if (!viewMemPool.GetCoins(txin.prevout.hash, coins)) {
+            Coin coin;
+            if (!viewMemPool.GetCoin(txin.prevout, coin)) {
                 return error("%s: Missing input", __func__);
             }
-            if (coins.nHeight == MEMPOOL_HEIGHT) {
+            if (coin.nHeight == MEMPOOL_HEIGHT) {
                 // Assume all mempool transaction confirm in the next block
                 prevheights[txinIndex] = tip->nHeight + 1;
             } else {
-                prevheights[txinIndex] = coins.nHeight;
+                prevheights[txinIndex] = coin.nHeight;
             }
         }
         lockPair = CalculateSequenceLocks(tx, flags, &prevheights, index);
@@ -481,7 +491,7 @@ unsigned int GetP2SHSigOpCount(const CTransaction& tx, const CCoinsViewCache& in
         if (tx.vin[i].m_is_pegin) {
             continue;
         }
-        const CTxOut &prevout = inputs.GetOutputFor(tx.vin[i]);
+        const CTxOut &prevout = inputs.AccessCoin(tx.vin[i].prevout).out;
         if (prevout.scriptPubKey.IsPayToScriptHash())
             nSigOps += prevout.scriptPubKey.GetSigOpCount(tx.vin[i].scriptSig);
     }
@@ -504,7 +514,7 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& i
         if (tx.vin[i].m_is_pegin && (tx.wit.vtxinwit.size() <= i || !IsValidPeginWitness(tx.wit.vtxinwit[i].m_pegin_witness, tx.vin[i].prevout))) {
             continue;
         }
-        const CTxOut &prevout = tx.vin[i].m_is_pegin ? GetPeginOutputFromWitness(tx.wit.vtxinwit[i].m_pegin_witness) : inputs.GetOutputFor(tx.vin[i]);
+        const CTxOut &prevout = tx.vin[i].m_is_pegin ? GetPeginOutputFromWitness(tx.wit.vtxinwit[i].m_pegin_witness) : inputs.AccessCoin(tx.vin[i].prevout).out;
         nSigOps += CountWitnessSigOps(tx.vin[i].scriptSig, prevout.scriptPubKey, tx.wit.vtxinwit.size() > i ? &tx.wit.vtxinwit[i].scriptWitness : NULL, flags);
     }
     return nSigOps;
@@ -602,6 +612,31 @@ private:
 public:
     CRangeCheck(const CConfidentialValue* val_, const std::vector<unsigned char>& rangeproof_, const std::vector<unsigned char>& assetCommitment_, const CScript& scriptPubKey_, const bool storeIn) : val(val_), rangeproof(rangeproof_), assetCommitment(assetCommitment_), scriptPubKey(scriptPubKey_), store(storeIn) {}
 
+    bool operator()();
+    //! Add the proof to the cache as valid without verifying it
+    void Seed() const;
+
+    friend class CRangeCheckBatch;
+};
+
+/** Closure representing a batch of range checks, possibly from several transactions. */
+class CRangeCheckBatch : public CCheck
+{
+private:
+    std::vector<CRangeCheck*> vChecks;
+    const bool store;
+
+public:
+    CRangeCheckBatch(std::vector<CRangeCheck*>& vChecks_, const bool storeIn) : store(storeIn) {
+        vChecks.swap(vChecks_);
+    }
+
+    ~CRangeCheckBatch() {
+        for (CRangeCheck* check : vChecks) {
+            delete check;
+        }
+    }
+
     bool operator()();
 };
 
@@ -626,13 +661,67 @@ class CSurjectionCheck : public CCheck
 {
 private:
     secp256k1_surjectionproof proof;
-    std::vector<secp256k1_generator> vTags;
+    // Shared between all surjection checks of the same transaction
+    std::shared_ptr<const CSurjectionGeneratorTable> table;
     secp256k1_generator gen;
     const bool store;
 public:
-    CSurjectionCheck(secp256k1_surjectionproof& proofIn, std::vector<secp256k1_generator>& tags_in, secp256k1_generator& genIn, const bool storeIn) : proof(proofIn), vTags(tags_in), gen(genIn), store(storeIn) {}
+    CSurjectionCheck(secp256k1_surjectionproof& proofIn, const std::shared_ptr<const CSurjectionGeneratorTable>& tableIn, secp256k1_generator& genIn, const bool storeIn) : proof(proofIn), table(tableIn), gen(genIn), store(storeIn) {}
 
     bool operator()();
+    //! Add the proof to the cache as valid without verifying it
+    void Seed() const;
+
+    friend class CSurjectionCheckBatch;
+    friend class CProofCheckCollector;
+};
+
+/** Closure representing the surjection checks of one transaction, verified against its shared generator table. */
+class CSurjectionCheckBatch : public CCheck
+{
+private:
+    std::vector<CSurjectionCheck*> vChecks;
+    const bool store;
+
+public:
+    CSurjectionCheckBatch(std::vector<CSurjectionCheck*>& vChecks_, const bool storeIn) : store(storeIn) {
+        vChecks.swap(vChecks_);
+    }
+
+    ~CSurjectionCheckBatch() {
+        for (CSurjectionCheck* check : vChecks) {
+            delete check;
+        }
+    }
+
+    bool operator()();
+};
+
+class CProofCheckCollector;
+
+/**
+ * Closure representing the whole amount check of one transaction: commitment
+ * parsing, issuance derivation and the balance tally. Works on a snapshot of
+ * the spent outputs so it needs no access to the coins view. Its range and
+ * surjection checks go to the collector, if one is set, to be batched with
+ * the rest of the block's; otherwise they are verified here, in one batch.
+ */
+class CAmountCheck : public CCheck
+{
+private:
+    const CTransaction* ptx;
+    std::vector<CTxOut> vSpent;
+    const bool store;
+    CProofCheckCollector* collector;
+
+public:
+    CAmountCheck(const CTransaction& txIn, std::vector<CTxOut>& vSpentIn, const bool storeIn) : ptx(&txIn), store(storeIn), collector(NULL) {
+        vSpent.swap(vSpentIn);
+    }
+
+    bool operator()();
+
+    friend class CProofCheckCollector;
 };
 
 // Destroys the check in the case of no queue, or passes its ownership to the queue.
@@ -663,6 +752,134 @@ bool CRangeCheck::operator()()
     return true;
 };
 
+void CRangeCheck::Seed() const
+{
+    if (!val->IsExplicit()) {
+        CachingRangeProofChecker(true).StoreRangeProof(rangeproof, val->vchCommitment, assetCommitment, scriptPubKey);
+    }
+}
+
+bool CRangeCheckBatch::operator()()
+{
+    std::vector<CRangeProofRef> vProofs;
+    vProofs.reserve(vChecks.size());
+    for (const CRangeCheck* check : vChecks) {
+        if (!check->val->IsExplicit()) {
+            vProofs.push_back(CRangeProofRef{&check->rangeproof, &check->val->vchCommitment, &check->assetCommitment, &check->scriptPubKey});
+        }
+    }
+
+    std::vector<bool> vResults;
+    if (!CachingRangeProofChecker(store).VerifyRangeProofBatch(vProofs, vResults, secp256k1_ctx_verify_amounts)) {
+        for (size_t i = 0; i < vResults.size(); i++) {
+            if (!vResults[i]) {
+                LogPrintf("%s: range proof %u of %u in batch is invalid\n", __func__, i, vResults.size());
+            }
+        }
+        error = SCRIPT_ERR_RANGEPROOF;
+        return false;
+    }
+
+    return true;
+}
+
+bool CSurjectionCheckBatch::operator()()
+{
+    if (vChecks.empty()) {
+        return true;
+    }
+
+    std::vector<const secp256k1_surjectionproof*> vProofs;
+    std::vector<const secp256k1_generator*> vGens;
+    vProofs.reserve(vChecks.size());
+    vGens.reserve(vChecks.size());
+    for (const CSurjectionCheck* check : vChecks) {
+        assert(check->table == vChecks[0]->table);
+        vProofs.push_back(&check->proof);
+        vGens.push_back(&check->gen);
+    }
+
+    std::vector<bool> vResults;
+    if (!CachingSurjectionProofChecker(store).VerifySurjectionProofBatch(vProofs, vGens, *vChecks[0]->table, vResults, secp256k1_ctx_verify_amounts)) {
+        for (size_t i = 0; i < vResults.size(); i++) {
+            if (!vResults[i]) {
+                LogPrintf("%s: surjection proof %u of %u in batch is invalid\n", __func__, i, vResults.size());
+            }
+        }
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Collects the range and surjection checks of a whole block, so that they
+ * can be verified in batches rather than one queued check at a time. Owns
+ * the collected checks until they are handed out as batches.
+ */
+class CProofCheckCollector
+{
+private:
+    // Amount checks extract into the collector from the check queue threads
+    CCriticalSection cs;
+    std::vector<CRangeCheck*> vRangeChecks;
+    // One group per transaction, all sharing the same generator table
+    std::vector<std::vector<CSurjectionCheck*> > vSurjectionChecks;
+
+public:
+    ~CProofCheckCollector() {
+        for (CRangeCheck* check : vRangeChecks) {
+            delete check;
+        }
+        for (std::vector<CSurjectionCheck*>& group : vSurjectionChecks) {
+            for (CSurjectionCheck* check : group) {
+                delete check;
+            }
+        }
+    }
+
+    //! Move the range and surjection checks out of vChecks, and have its amount checks hand over theirs when they run
+    void Extract(std::vector<CCheck*>& vChecks)
+    {
+        LOCK(cs);
+        std::vector<CCheck*>::iterator it = vChecks.begin();
+        for (CCheck* check : vChecks) {
+            if (CAmountCheck* amountcheck = dynamic_cast<CAmountCheck*>(check)) {
+                amountcheck->collector = this;
+                *it++ = check;
+            } else if (CRangeCheck* rangecheck = dynamic_cast<CRangeCheck*>(check)) {
+                vRangeChecks.push_back(rangecheck);
+            } else if (CSurjectionCheck* surjectioncheck = dynamic_cast<CSurjectionCheck*>(check)) {
+                if (vSurjectionChecks.empty() || vSurjectionChecks.back()[0]->table != surjectioncheck->table) {
+                    vSurjectionChecks.push_back(std::vector<CSurjectionCheck*>());
+                }
+                vSurjectionChecks.back().push_back(surjectioncheck);
+            } else {
+                *it++ = check;
+            }
+        }
+        vChecks.erase(it, vChecks.end());
+    }
+
+    //! Split the collected range checks into batches, aiming for at least one batch per check queue worker, and the surjection checks into one batch per transaction
+    std::vector<CCheck*> MakeBatches(unsigned int nWorkers, const bool cacheStore)
+    {
+        LOCK(cs);
+        std::vector<CCheck*> vBatches;
+        size_t nBatchSize = std::max<size_t>(1, std::min<size_t>(MAX_RANGEPROOF_BATCH_SIZE, vRangeChecks.size() / std::max(1U, nWorkers)));
+        for (size_t i = 0; i < vRangeChecks.size(); i += nBatchSize) {
+            std::vector<CRangeCheck*> vBatch(vRangeChecks.begin() + i, vRangeChecks.begin() + std::min(i + nBatchSize, vRangeChecks.size()));
+            vBatches.push_back(new CRangeCheckBatch(vBatch, cacheStore));
+        }
+        vRangeChecks.clear();
+        for (std::vector<CSurjectionCheck*>& group : vSurjectionChecks) {
+            vBatches.push_back(new CSurjectionCheckBatch(group, cacheStore));
+        }
+        vSurjectionChecks.clear();
+        return vBatches;
+    }
+};
+
 bool CBalanceCheck::operator()()
 {
     if (!secp256k1_pedersen_verify_tally(secp256k1_ctx_verify_amounts, vpCommitsIn.data(), vpCommitsIn.size(), vpCommitsOut.data(), vpCommitsOut.size())) {
@@ -676,7 +893,45 @@ bool CBalanceCheck::operator()()
 
 bool CSurjectionCheck::operator()()
 {
-    return CachingSurjectionProofChecker(store).VerifySurjectionProof(proof, vTags, gen, secp256k1_ctx_verify_amounts);
+    return CachingSurjectionProofChecker(store).VerifySurjectionProof(proof, *table, gen, secp256k1_ctx_verify_amounts);
+}
+
+void CSurjectionCheck::Seed() const
+{
+    CachingSurjectionProofChecker(true).StoreSurjectionProof(proof, *table, gen, secp256k1_ctx_verify_amounts);
+}
+
+bool CAmountCheck::operator()()
+{
+    std::vector<CCheck*> vChecks;
+    if (!VerifyAmounts(vSpent, *ptx, &vChecks, store)) {
+        for (CCheck* check : vChecks) {
+            delete check;
+        }
+        fAmountError = true;
+        error = SCRIPT_ERR_PEDERSEN_TALLY;
+        return false;
+    }
+
+    if (collector) {
+        collector->Extract(vChecks);
+    } else {
+        CProofCheckCollector proofChecks;
+        proofChecks.Extract(vChecks);
+        std::vector<CCheck*> vBatches = proofChecks.MakeBatches(1, store);
+        vChecks.insert(vChecks.end(), vBatches.begin(), vBatches.end());
+    }
+
+    bool fOk = true;
+    for (CCheck* check : vChecks) {
+        if (fOk && !(*check)()) {
+            fOk = false;
+            fAmountError = true;
+            error = check->GetScriptError();
+        }
+        delete check;
+    }
+    return fOk;
 }
 
 } // namespace
@@ -710,8 +965,9 @@ static bool VerifyIssuanceAmount(secp256k1_pedersen_commitment& commit, secp256k
     assert(value.IsValid());
 
     // Generate asset generator
-    ret = secp256k1_generator_generate(secp256k1_ctx_verify_amounts, &gen, asset.begin());
-    assert(ret == 1);
+    unsigned char vchGenerator[CConfidentialAsset::nCommittedSize];
+    ret = GetAssetGenerator(gen, asset, vchGenerator);
+    assert(ret);
 
     // Build value commitment
     if (value.IsExplicit()) {
@@ -730,8 +986,7 @@ static bool VerifyIssuanceAmount(secp256k1_pedersen_commitment& commit, secp256k
     else {
         assert(value.IsCommitment());
         // Verify range proof
-        std::vector<unsigned char> vchAssetCommitment(CConfidentialAsset::nExplicitSize);
-        secp256k1_generator_serialize(secp256k1_ctx_verify_amounts, &vchAssetCommitment[0], &gen);
+        std::vector<unsigned char> vchAssetCommitment(vchGenerator, vchGenerator + sizeof(vchGenerator));
         if (QueueCheck(pvChecks, new CRangeCheck(&value, vchRangeproof, vchAssetCommitment, CScript(), cacheStore)) != SCRIPT_ERR_OK) {
             return false;
         }
@@ -745,9 +1000,135 @@ static bool VerifyIssuanceAmount(secp256k1_pedersen_commitment& commit, secp256k
     return true;
 }
 
+std::vector<CTxOut> GetSpentOutputs(const CCoinsViewCache& cache, const CTransaction& tx)
+{
+    std::vector<CTxOut> vSpent;
+    vSpent.reserve(tx.vin.size());
+    for (size_t i = 0; i < tx.vin.size(); ++i) {
+        // Assumes IsValidPeginWitness has been called successfully
+        vSpent.push_back(tx.vin[i].m_is_pegin ? GetPeginOutputFromWitness(tx.wit.vtxinwit[i].m_pegin_witness) : cache.AccessCoin(tx.vin[i].prevout).out);
+    }
+    return vSpent;
+}
+
 bool VerifyAmounts(const CCoinsViewCache& cache, const CTransaction& tx, std::vector<CCheck*>* pvChecks, const bool cacheStore)
+{
+    return VerifyAmounts(GetSpentOutputs(cache, tx), tx, pvChecks, cacheStore);
+}
+
+bool VerifyAmounts(const std::vector<CTxOut>& vSpent, const CTransaction& tx, std::vector<CCheck*>* pvChecks, const bool cacheStore)
+{
+    bool fValid;
+    if (VerifyExplicitAmounts(vSpent, tx, fValid)) {
+        return fValid;
+    }
+    return VerifyCommittedAmounts(vSpent, tx, pvChecks, cacheStore);
+}
+
+// Helper function for VerifyExplicitAmounts(), not exported
+static bool AddExplicitAmount(CAmountMap& mapTotal, const CAsset& asset, CAmount nAmount)
+{
+    CAmount& nTotal = mapTotal[asset];
+    if (nTotal > std::numeric_limits<CAmount>::max() - nAmount)
+        return false;
+    nTotal += nAmount;
+    return true;
+}
+
+bool VerifyExplicitAmounts(const std::vector<CTxOut>& vSpent, const CTransaction& tx, bool& fValid)
+{
+    assert(!tx.IsCoinBase());
+    if (vSpent.size() != tx.vin.size())
+        return false;
+
+    // Anything that is not explicit, including a reissuance which must spend
+    // a blinded token, takes the commitment path.
+    for (size_t i = 0; i < tx.vin.size(); ++i) {
+        if (!vSpent[i].nValue.IsExplicit() || !vSpent[i].nAsset.IsExplicit())
+            return false;
+        const CAssetIssuance& issuance = tx.vin[i].assetIssuance;
+        if (issuance.IsNull())
+            continue;
+        if (!issuance.assetBlindingNonce.IsNull())
+            return false;
+        if (!(issuance.nAmount.IsNull() || issuance.nAmount.IsExplicit()) || !(issuance.nInflationKeys.IsNull() || issuance.nInflationKeys.IsExplicit()))
+            return false;
+    }
+    for (size_t i = 0; i < tx.vout.size(); ++i) {
+        if (!tx.vout[i].nValue.IsExplicit() || !tx.vout[i].nAsset.IsExplicit())
+            return false;
+    }
+
+    // Every amount is now known, so the commitments balance if and only if
+    // the amounts of each asset do. Sums that could overflow are left to the
+    // commitment path rather than rejected.
+    CAmountMap mapIn, mapOut;
+    fValid = false;
+    for (size_t i = 0; i < tx.vin.size(); ++i) {
+        CAmount nAmount = vSpent[i].nValue.GetAmount();
+        if (!MoneyRange(nAmount) || nAmount == 0)
+            return true;
+        if (!AddExplicitAmount(mapIn, vSpent[i].nAsset.GetAsset(), nAmount))
+            return false;
+
+        const CAssetIssuance& issuance = tx.vin[i].assetIssuance;
+        if (issuance.IsNull())
+            continue;
+        if (i >= tx.wit.vtxinwit.size())
+            return true;
+
+        CAsset assetID;
+        CAsset assetTokenID;
+        uint256 entropy;
+        GenerateAssetEntropy(entropy, tx.vin[i].prevout, issuance.assetEntropy);
+        CalculateAsset(assetID, entropy);
+        CalculateReissuanceToken(assetTokenID, entropy, false);
+
+        if (!issuance.nAmount.IsNull()) {
+            nAmount = issuance.nAmount.GetAmount();
+            if (!MoneyRange(nAmount) || nAmount == 0 || !tx.wit.vtxinwit[i].vchIssuanceAmountRangeproof.empty())
+                return true;
+            if (!AddExplicitAmount(mapIn, assetID, nAmount))
+                return false;
+        }
+        if (!issuance.nInflationKeys.IsNull()) {
+            nAmount = issuance.nInflationKeys.GetAmount();
+            if (!MoneyRange(nAmount) || nAmount == 0 || !tx.wit.vtxinwit[i].vchInflationKeysRangeproof.empty())
+                return true;
+            if (!AddExplicitAmount(mapIn, assetTokenID, nAmount))
+                return false;
+        }
+    }
+
+    for (size_t i = 0; i < tx.vout.size(); ++i) {
+        if (!tx.vout[i].nNonce.IsValid())
+            return true;
+        const CTxOutWitness* ptxoutwit = tx.wit.vtxoutwit.size() <= i? NULL: &tx.wit.vtxoutwit[i];
+        if (ptxoutwit && (!ptxoutwit->vchRangeproof.empty() || !ptxoutwit->vchSurjectionproof.empty()))
+            return true;
+
+        CAmount nAmount = tx.vout[i].nValue.GetAmount();
+        if (!MoneyRange(nAmount))
+            return true;
+        if (nAmount == 0) {
+            // No spendable 0-value outputs
+            if (!tx.vout[i].scriptPubKey.IsUnspendable())
+                return true;
+            continue;
+        }
+        if (!AddExplicitAmount(mapOut, tx.vout[i].nAsset.GetAsset(), nAmount))
+            return false;
+    }
+
+    fValid = mapIn == mapOut;
+    return true;
+}
+
+bool VerifyCommittedAmounts(const std::vector<CTxOut>& vSpent, const CTransaction& tx, std::vector<CCheck*>* pvChecks, const bool cacheStore)
 {
     assert(!tx.IsCoinBase());
+    if (vSpent.size() != tx.vin.size())
+        return false;
 
     std::vector<secp256k1_pedersen_commitment> vData;
     std::vector<secp256k1_pedersen_commitment *> vpCommitsIn, vpCommitsOut;
@@ -771,8 +1152,7 @@ bool VerifyAmounts(const CCoinsViewCache& cache, const CTransaction& tx, std::ve
     // Tally up value commitments, check balance
     for (size_t i = 0; i < tx.vin.size(); ++i)
     {
-        // Assumes IsValidPeginWitness has been called successfully
-        const CTxOut out = tx.vin[i].m_is_pegin ? GetPeginOutputFromWitness(tx.wit.vtxinwit[i].m_pegin_witness) : cache.GetOutputFor(tx.vin[i]);
+        const CTxOut& out = vSpent[i];
         const CConfidentialValue& val = out.nValue;
         const CConfidentialAsset& asset = out.nAsset;
 
@@ -780,8 +1160,8 @@ bool VerifyAmounts(const CCoinsViewCache& cache, const CTransaction& tx, std::ve
             return false;
 
         if (asset.IsExplicit()) {
-            ret = secp256k1_generator_generate(secp256k1_ctx_verify_amounts, &gen, asset.GetAsset().begin());
-            assert(ret != 0);
+            ret = GetAssetGenerator(gen, asset.GetAsset());
+            assert(ret);
         }
         else if (asset.IsCommitment()) {
             if (secp256k1_generator_parse(secp256k1_ctx_verify_amounts, &gen, &asset.vchCommitment[0]) != 1)
@@ -919,8 +1299,8 @@ bool VerifyAmounts(const CCoinsViewCache& cache, const CTransaction& tx, std::ve
             return false;
 
         if (asset.IsExplicit()) {
-            ret = secp256k1_generator_generate(secp256k1_ctx_verify_amounts, &gen, asset.GetAsset().begin());
-            assert(ret != 0);
+            ret = GetAssetGenerator(gen, asset.GetAsset());
+            assert(ret);
         }
         else if (asset.IsCommitment()) {
             if (secp256k1_generator_parse(secp256k1_ctx_verify_amounts, &gen, &asset.vchCommitment[0]) != 1)
@@ -978,9 +1358,8 @@ bool VerifyAmounts(const CCoinsViewCache& cache, const CTransaction& tx, std::ve
             continue;
         }
         if (asset.IsExplicit()) {
-            int ret = secp256k1_generator_generate(secp256k1_ctx_verify_amounts, &gen, asset.GetAsset().begin());
-            assert(ret != 0);
-            secp256k1_generator_serialize(secp256k1_ctx_verify_amounts, &vchAssetCommitment[0], &gen);
+            ret = GetAssetGenerator(gen, asset.GetAsset(), &vchAssetCommitment[0]);
+            assert(ret);
         }
         if (!ptxoutwit) {
             return false;
@@ -990,7 +1369,8 @@ bool VerifyAmounts(const CCoinsViewCache& cache, const CTransaction& tx, std::ve
         }
     }
 
-    // Surjection proofs
+    // Surjection proofs, all checked against one table of the input generators
+    std::shared_ptr<const CSurjectionGeneratorTable> targetTable;
     for (size_t i = 0; i < tx.vout.size(); i++)
     {
         const CConfidentialAsset& asset = tx.vout[i].nAsset;
@@ -1011,7 +1391,10 @@ bool VerifyAmounts(const CCoinsViewCache& cache, const CTransaction& tx, std::ve
         if (secp256k1_surjectionproof_parse(secp256k1_ctx_verify_amounts, &proof, &ptxoutwit->vchSurjectionproof[0], ptxoutwit->vchSurjectionproof.size()) != 1)
             return false;
 
-        if (QueueCheck(pvChecks, new CSurjectionCheck(proof, targetGenerators, gen, cacheStore)) != SCRIPT_ERR_OK) {
+        if (!targetTable) {
+            targetTable = std::make_shared<const CSurjectionGeneratorTable>(targetGenerators, secp256k1_ctx_verify_amounts);
+        }
+        if (QueueCheck(pvChecks, new CSurjectionCheck(proof, targetTable, gen, cacheStore)) != SCRIPT_ERR_OK) {
             return false;
         }
     }
@@ -1041,9 +1424,9 @@ void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     if (expired != 0)
         LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
 
-    std::vector<uint256> vNoSpendsRemaining;
+    std::vector<COutPoint> vNoSpendsRemaining;
     pool.TrimToSize(limit, &vNoSpendsRemaining);
-    BOOST_FOREACH(const uint256& removed, vNoSpendsRemaining)
+    BOOST_FOREACH(const COutPoint& removed, vNoSpendsRemaining)
         pcoinsTip->Uncache(removed);
 }
 
@@ -1068,9 +1451,18 @@ static bool IsCurrentForFeeEstimation()
     return true;
 }
 
+unsigned int GetMempoolScriptVerifyFlags()
+{
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!Params().RequireStandard()) {
+        scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
+    return scriptVerifyFlags;
+}
+
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool fLimitFree,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<uint256>& vHashTxnToUncache)
+                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
@@ -1130,35 +1522,31 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
         CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
         view.SetBackend(viewMemPool);
 
-        // do we already have it?
-        bool fHadTxInCache = pcoinsTip->HaveCoinsInCache(hash);
-        if (view.HaveCoins(hash)) {
-            if (!fHadTxInCache)
-                vHashTxnToUncache.push_back(hash);
-            return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
-        }
-
         // do all inputs exist?
-        // Note that this does not check for the presence of actual outputs (see the next check for that),
-        // and only helps with filling in pfMissingInputs (to determine missing vs spent).
         BOOST_FOREACH(const CTxIn txin, tx.vin) {
             // Don't look for coins that only exist in parent chain
             if (txin.m_is_pegin) {
                 continue;
             }
-            if (!pcoinsTip->HaveCoinsInCache(txin.prevout.hash))
-                vHashTxnToUncache.push_back(txin.prevout.hash);
-            if (!view.HaveCoins(txin.prevout.hash)) {
-                if (pfMissingInputs)
+            if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                coins_to_uncache.push_back(txin.prevout);
+            }
+            if (!view.HaveCoin(txin.prevout)) {
+                // Are inputs missing because we already have the tx?
+                for (size_t out = 0; out < tx.vout.size(); out++) {
+                    // Optimistically just do efficient check of cache for outputs
+                    if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out))) {
+                        return state.Invalid(false, REJECT_ALREADY_KNOWN, "txn-already-known");
+                    }
+                }
+                // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
+                if (pfMissingInputs) {
                     *pfMissingInputs = true;
+                }
                 return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
             }
         }
 
-        // are the actual inputs available?
-        if (!view.HaveInputs(tx))
-            return state.Invalid(false, REJECT_DUPLICATE, "bad-txns-inputs-spent");
-
         // Extract peg-in inputs, pass set to mempool entry. Validity of pegins checked in CheckInputs
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             if (tx.vin[i].m_is_pegin) {
@@ -1202,7 +1590,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
 
         if (!tx.HasValidFee())
             return state.DoS(0, false, REJECT_INVALID, "bad-fees");
-        CAmount nFees = tx.GetFee()[policyAsset];
+        CAmount nFees = tx.GetFee(policyAsset);
 
         // nModifiedFees includes any fee deltas from PrioritiseTransaction
         CAmount nModifiedFees = nFees;
@@ -1221,8 +1609,8 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             if (txin.m_is_pegin) {
                 continue;
             }
-            const CCoins *coins = view.AccessCoins(txin.prevout.hash);
-            if (coins->IsCoinBase()) {
+            const Coin &coin = view.AccessCoin(txin.prevout);
+            if (coin.IsCoinBase()) {
                 fSpendsCoinbase = true;
                 break;
             }
@@ -1412,10 +1800,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             }
         }
 
-        unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
-        if (!Params().RequireStandard()) {
-            scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
-        }
+        unsigned int scriptVerifyFlags = GetMempoolScriptVerifyFlags();
 
         std::set<std::pair<uint256, COutPoint> > setPeginsSpent2;
 
@@ -1498,10 +1883,10 @@ bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
                         bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
 {
-    std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    std::vector<COutPoint> coins_to_uncache;
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, coins_to_uncache);
     if (!res) {
-        BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
+        BOOST_FOREACH(const COutPoint& hashTx, coins_to_uncache)
             pcoinsTip->Uncache(hashTx);
     }
     // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
@@ -1555,10 +1940,9 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
     if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
         int nHeight = -1;
         {
-            const CCoinsViewCache& view = *pcoinsTip;
-            const CCoins* coins = view.AccessCoins(hash);
-            if (coins)
-                nHeight = coins->nHeight;
+            const Coin& coin = AccessByTxid(*pcoinsTip, hash);
+            if (!coin.IsSpent())
+                nHeight = coin.nHeight;
         }
         if (nHeight > 0)
             pindexSlow = chainActive[nHeight];
@@ -1641,6 +2025,36 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadBlockHeader(CBlockHeader& header, const CBlockIndex* pindex)
+{
+    header = pindex->GetBlockHeader();
+    if (pindex->psolution) {
+        header.proof.solution = *pindex->psolution;
+        return true;
+    }
+    if (pblocktree->ReadBlockProofSolution(pindex->GetBlockHash(), header.proof.solution))
+        return true;
+
+    // Fall back to the header stored in front of the block data
+    CDiskBlockPos pos = pindex->GetBlockPos();
+    if (pos.IsNull())
+        return error("%s: no proof solution for block %s", __func__, pindex->GetBlockHash().ToString());
+    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+    CBlockHeader diskheader;
+    try {
+        filein >> diskheader;
+    }
+    catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    if (diskheader.GetHash() != pindex->GetBlockHash())
+        return error("%s: GetHash() doesn't match index for %s at %s", __func__, pindex->ToString(), pos.ToString());
+    header.proof.solution = diskheader.proof.solution;
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     if (nHeight == 0)
@@ -1814,29 +2228,18 @@ void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, CTxUndo &txund
                     std::pair<uint256, COutPoint> outpoint = std::make_pair(uint256(tx.wit.vtxinwit[i].m_pegin_witness.stack[2]), txin.prevout);
                     inputs.SetWithdrawSpent(outpoint, true);
                     // Dummy undo
-                    txundo.vprevout.push_back(CTxInUndo());
+                    txundo.vprevout.emplace_back();
 
             } else {
-                CCoinsModifier coins = inputs.ModifyCoins(txin.prevout.hash);
-                unsigned nPos = txin.prevout.n;
-
-                if (nPos >= coins->vout.size() || coins->vout[nPos].IsNull())
-                    assert(false);
-
                 // mark an outpoint spent, and construct undo information
-                txundo.vprevout.push_back(CTxInUndo(coins->vout[nPos]));
-                coins->Spend(nPos);
-                if (coins->vout.size() == 0) {
-                    CTxInUndo& undo = txundo.vprevout.back();
-                    undo.nHeight = coins->nHeight;
-                    undo.fCoinBase = coins->fCoinBase;
-                    undo.nVersion = coins->nVersion;
-                }
+                txundo.vprevout.emplace_back();
+                bool is_spent = inputs.SpendCoin(txin.prevout, &txundo.vprevout.back());
+                assert(is_spent);
             }
         }
     }
     // add outputs
-    inputs.ModifyNewCoins(tx.GetHash(), tx.IsCoinBase())->FromTx(tx, nHeight);
+    AddCoins(inputs, tx, nHeight);
 }
 
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight)
@@ -1888,19 +2291,19 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
                 }
                 setPeginsSpent.insert(pegin);
             } else {
-                const CCoins *coins = inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
 
                 // If prev is coinbase, check that it's matured
-                if (coins->IsCoinBase()) {
-                    if (nSpendHeight - coins->nHeight < COINBASE_MATURITY)
+                if (coin.IsCoinBase()) {
+                    if (nSpendHeight - coin.nHeight < COINBASE_MATURITY)
                         return state.Invalid(false,
                             REJECT_INVALID, "bad-txns-premature-spend-of-coinbase",
-                            strprintf("tried to spend coinbase at depth %d", nSpendHeight - coins->nHeight));
+                            strprintf("tried to spend coinbase at depth %d", nSpendHeight - coin.nHeight));
                 }
 
                 // Check for negative or overflow input values
-                const CConfidentialValue& value = coins->vout[prevout.n].nValue;
+                const CConfidentialValue& value = coin.out.nValue;
                 if (value.IsExplicit()) {
                     nValueIn += value.GetAmount();
                     if (!MoneyRange(value.GetAmount()) || !MoneyRange(nValueIn))
@@ -1914,9 +2317,14 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
         if (!tx.HasValidFee()) {
             return state.DoS(100, false, REJECT_INVALID, "bad-txns-fee-outofrange");
         }
-        if (fScriptChecks && !VerifyAmounts(inputs, tx, pvChecks, cacheStore)) {
-            return state.DoS(100, false, REJECT_INVALID, "bad-txns-in-ne-out", false,
-                strprintf("value in (%s) != value out", FormatMoney(nValueIn)));
+        if (fScriptChecks) {
+            std::vector<CTxOut> vSpent = GetSpentOutputs(inputs, tx);
+            if (pvChecks) {
+                pvChecks->push_back(new CAmountCheck(tx, vSpent, cacheStore));
+            } else if (!VerifyAmounts(vSpent, tx, NULL, cacheStore)) {
+                return state.DoS(100, false, REJECT_INVALID, "bad-txns-in-ne-out", false,
+                    strprintf("value in (%s) != value out", FormatMoney(nValueIn)));
+            }
         }
 
     return true;
@@ -1946,22 +2354,17 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
                 // If input is peg-in, create "coin" to evaluate against
-                CCoins pegin_coin;
+                // from m_pegin_witness
+                Coin pegin_coin;
                 if (tx.vin[i].m_is_pegin) {
-                    CMutableTransaction mtx;
-                    mtx.vout.resize(prevout.n);
-                    mtx.vout.push_back(GetPeginOutputFromWitness(tx.wit.vtxinwit[i].m_pegin_witness));
-                    CTransaction tx(mtx);
                     // Height of "output" in script evaluation will be 0
-                    pegin_coin.FromTx(tx, 0);
+                    pegin_coin = Coin(GetPeginOutputFromWitness(tx.wit.vtxinwit[i].m_pegin_witness), 0, false);
                 }
-
-                // from m_pegin_witness
-                const CCoins* coins = tx.vin[i].m_is_pegin ? &pegin_coin : inputs.AccessCoins(prevout.hash);
-                assert(coins);
+                const Coin& coin = tx.vin[i].m_is_pegin ? pegin_coin : inputs.AccessCoin(prevout);
+                assert(!coin.IsSpent());
 
                 // Verify signature
-                CCheck* check = new CScriptCheck(*coins, tx, i, flags, cacheStore, &txdata);
+                CCheck* check = new CScriptCheck(coin.out, tx, i, flags, cacheStore, &txdata);
                 ScriptError serror = QueueCheck(pvChecks, check);
                 if (serror != SCRIPT_ERR_OK) {
                     if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
@@ -1971,7 +2374,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // arguments; if so, don't trigger DoS protection to
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
-                        CScriptCheck check2(*coins, tx, i,
+                        CScriptCheck check2(coin.out, tx, i,
                                 flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &txdata);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(serror)));
@@ -2068,38 +2471,40 @@ bool AbortNode(CValidationState& state, const std::string& strMessage, const std
 
 } // anon namespace
 
+static bool IsGenesisTransaction(const uint256& txid)
+{
+    for (const auto& tx : Params().GenesisBlock().vtx) {
+        if (tx->GetHash() == txid)
+            return true;
+    }
+    return false;
+}
+
 /**
- * Apply the undo operation of a CTxInUndo to the given chain state.
- * @param undo The undo object.
+ * Restore the output spent by a transaction input to the given chain state.
+ * @param undo The coin as it was before it was spent.
  * @param view The coins view to which to apply the changes.
  * @param out The out point that corresponds to the tx input.
  * @return True on success.
  */
-bool ApplyTxInUndo(const CTxInUndo& undo, CCoinsViewCache& view, const COutPoint& out, const CTxIn& txin, const CScriptWitness& pegin_witness)
+bool ApplyTxInUndo(Coin&& undo, CCoinsViewCache& view, const COutPoint& out, const CTxIn& txin, const CScriptWitness& pegin_witness)
 {
     bool fClean = true;
 
     if (!txin.m_is_pegin) {
-        CCoinsModifier coins = view.ModifyCoins(out.hash);
-        if (undo.nHeight != 0 ||
-                // Special-case genesis since nHeight is always 0, assume DB is clean
-                (Params().GenesisBlock().vtx[0]->GetHash() == out.hash && coins->IsPruned())) {
-            // undo data contains height: this is the last output of the prevout tx being spent
-            if (!coins->IsPruned())
-                fClean = fClean && error("%s: undo data overwriting existing transaction", __func__);
-            coins->Clear();
-            coins->fCoinBase = undo.fCoinBase;
-            coins->nHeight = undo.nHeight;
-            coins->nVersion = undo.nVersion;
-        } else {
-            if (coins->IsPruned())
-                fClean = fClean && error("%s: undo data adding output to missing transaction", __func__);
-        }
-        if (coins->IsAvailable(out.n))
+        if (view.HaveCoin(out))
             fClean = fClean && error("%s: undo data overwriting existing output", __func__);
-        if (coins->vout.size() < out.n+1)
-            coins->vout.resize(out.n+1);
-        coins->vout[out.n] = undo.txout;
+        if (undo.nHeight == 0 && !IsGenesisTransaction(out.hash)) {
+            // Missing undo metadata (height and coinbase). Older versions included this
+            // information only in undo records for the last spend of a transactions'
+            // outputs. This implies that it must be present for some other output of the same tx.
+            const Coin& alternate = AccessByTxid(view, out.hash);
+            if (alternate.IsSpent())
+                return error("%s: undo data adding output to missing transaction", __func__);
+            undo.nHeight = alternate.nHeight;
+            undo.fCoinBase = alternate.fCoinBase;
+        }
+        view.AddCoin(out, std::move(undo), !fClean);
     } else {
         if (!IsValidPeginWitness(pegin_witness, txin.prevout)) {
             fClean = fClean && error("%s: peg-in occurred without proof", __func__);
@@ -2142,34 +2547,28 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
         uint256 hash = tx.GetHash();
 
         // Check that all outputs are available and match the outputs in the block itself
-        // exactly.
-        {
-        CCoinsModifier outs = view.ModifyCoins(hash);
-        outs->ClearUnspendable();
-
-        CCoins outsBlock(tx, pindex->nHeight);
-        // The CCoins serialization does not serialize negative numbers.
-        // No network rules currently depend on the version here, so an inconsistency is harmless
-        // but it must be corrected before txout nversion ever influences a network rule.
-        if (outsBlock.nVersion < 0)
-            outs->nVersion = outsBlock.nVersion;
-        if (*outs != outsBlock)
-            fClean = fClean && error("DisconnectBlock(): added transaction mismatch? database corrupted");
-
-        // remove outputs
-        outs->Clear();
+        // exactly. The chainstate does not keep the nonces of the outputs.
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            if (!tx.vout[o].scriptPubKey.IsUnspendable()) {
+                COutPoint out(hash, o);
+                Coin coin;
+                bool is_spent = view.SpendCoin(out, &coin);
+                CTxOut txout = tx.vout[o];
+                txout.nNonce.SetNull();
+                if (!is_spent || txout != coin.out || pindex->nHeight != coin.nHeight || tx.IsCoinBase() != coin.fCoinBase)
+                    fClean = fClean && error("DisconnectBlock(): transaction output mismatch? database corrupted");
+            }
         }
 
         // restore inputs
         if (i > 0) { // not coinbases
-            const CTxUndo &txundo = blockUndo.vtxundo[i-1];
+            CTxUndo &txundo = blockUndo.vtxundo[i-1];
             if (txundo.vprevout.size() != tx.vin.size())
                 return error("DisconnectBlock(): transaction and undo data inconsistent");
             for (unsigned int j = tx.vin.size(); j-- > 0;) {
                 const COutPoint &out = tx.vin[j].prevout;
-                const CTxInUndo &undo = txundo.vprevout[j];
                 const CScriptWitness &pegin_wit = tx.wit.vtxinwit.size() > j ? tx.wit.vtxinwit[j].m_pegin_witness : CScriptWitness();
-                if (!ApplyTxInUndo(undo, view, out, tx.vin[j], pegin_wit))
+                if (!ApplyTxInUndo(std::move(txundo.vprevout[j]), view, out, tx.vin[j], pegin_wit))
                     fClean = false;
             }
         }
@@ -2218,6 +2617,40 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+namespace {
+
+/** Verification of a block header proof, see CheckBlockHeaderProofs */
+class CBlockProofCheck : public CCheck
+{
+private:
+    const CBlockHeader* pheader;
+    const Consensus::Params* pparams;
+
+public:
+    CBlockProofCheck(const CBlockHeader& header, const Consensus::Params& params) : pheader(&header), pparams(&params) {}
+
+    bool operator()()
+    {
+        return CheckProof(*pheader, *pparams);
+    }
+};
+
+} // namespace
+
+bool CheckBlockHeaderProofs(const std::vector<const CBlockHeader*>& headers, const Consensus::Params& consensusParams)
+{
+    if (!nScriptCheckThreads || headers.size() < 2)
+        return true;
+
+    CCheckQueueControl<CCheck> control(&scriptcheckqueue);
+    std::vector<CCheck*> vChecks;
+    vChecks.reserve(headers.size());
+    for (const CBlockHeader* pheader : headers)
+        vChecks.push_back(new CBlockProofCheck(*pheader, consensusParams));
+    control.Add(vChecks);
+    return control.Wait();
+}
+
 /* This function has two major purposes:
  * 1) Checks that the RPC connection to the parent chain node
  * can be attained, and is returning back reasonable answers.
@@ -2328,7 +2761,7 @@ bool BitcoindRPCCheck(const bool init)
 }
 
 /* Takes federation redeeem script and adds HMAC_SHA256(pubkey, scriptPubKey) as a tweak to each pubkey */
-CScript calculate_contract(const CScript& federationRedeemScript, const CScript& scriptPubKey) {
+static CScript ComputeContract(const CScript& federationRedeemScript, const CScript& scriptPubKey) {
     CScript scriptDestination(federationRedeemScript);
 
     // Script is either OP_TRUE or:
@@ -2409,7 +2842,139 @@ CScript calculate_contract(const CScript& federationRedeemScript, const CScript&
     assert(false);
 }
 
-bool IsValidPeginWitness(const CScriptWitness& pegin_witness, const COutPoint& prevout, bool check_depth) {
+namespace {
+
+/**
+ * Tweaked federation scripts by claim script, most recently used first.
+ * Every tweak costs an HMAC and several EC operations per federation key,
+ * and the same claim scripts are tweaked over and over by peg-in validation
+ * and the peg-in RPCs.
+ */
+class CContractCache
+{
+private:
+    typedef std::list<std::pair<CScript, CScript> > list_type;
+
+    CCriticalSection cs;
+    CScript federationRedeemScript;
+    list_type listContracts;
+    std::map<CScript, list_type::iterator> mapContracts;
+
+public:
+    bool Get(const CScript& federationScript, const CScript& scriptPubKey, CScript& contract)
+    {
+        LOCK(cs);
+        if (federationScript != federationRedeemScript)
+            return false;
+        std::map<CScript, list_type::iterator>::iterator it = mapContracts.find(scriptPubKey);
+        if (it == mapContracts.end())
+            return false;
+        listContracts.splice(listContracts.begin(), listContracts, it->second);
+        contract = it->second->second;
+        return true;
+    }
+
+    void Set(const CScript& federationScript, const CScript& scriptPubKey, const CScript& contract)
+    {
+        LOCK(cs);
+        if (federationScript != federationRedeemScript) {
+            // -fedpegscript changed (or chain params were reselected)
+            listContracts.clear();
+            mapContracts.clear();
+            federationRedeemScript = federationScript;
+        }
+        if (mapContracts.count(scriptPubKey))
+            return;
+        listContracts.push_front(std::make_pair(scriptPubKey, contract));
+        mapContracts[scriptPubKey] = listContracts.begin();
+        if (listContracts.size() > MAX_CONTRACT_CACHE_SIZE) {
+            mapContracts.erase(listContracts.back().first);
+            listContracts.pop_back();
+        }
+    }
+};
+
+CContractCache contractCache;
+
+} // namespace
+
+CScript calculate_contract(const CScript& federationRedeemScript, const CScript& scriptPubKey) {
+    CScript contract;
+    if (contractCache.Get(federationRedeemScript, scriptPubKey, contract))
+        return contract;
+    contract = ComputeContract(federationRedeemScript, scriptPubKey);
+    contractCache.Set(federationRedeemScript, scriptPubKey, contract);
+    return contract;
+}
+
+namespace {
+
+/**
+ * Peg-in witnesses whose structure has already been validated: the parent
+ * chain transaction, its merkle proof and PoW, and the tweaked fedpeg script.
+ * Entries are SHA256(nonce || prevout || witness stack || peg parameters).
+ * Only the depth check is re-run on a hit.
+ */
+class CPeginWitnessCache
+{
+private:
+    uint256 nonce;
+    CuckooCache::cache<uint256, SignatureCacheHasher> setValid;
+    boost::shared_mutex cs_peginwitnesscache;
+
+public:
+    CPeginWitnessCache()
+    {
+        GetRandBytes(nonce.begin(), 32);
+    }
+
+    void ComputeEntry(uint256& entry, const CScriptWitness& pegin_witness, const COutPoint& prevout)
+    {
+        const Consensus::Params& consensus = Params().GetConsensus();
+        CSHA256 hasher;
+        hasher.Write(nonce.begin(), 32).Write(prevout.hash.begin(), 32);
+        unsigned char n[4];
+        WriteLE32(n, prevout.n);
+        hasher.Write(n, 4);
+        for (const std::vector<unsigned char>& item : pegin_witness.stack) {
+            WriteLE32(n, item.size());
+            hasher.Write(n, 4).Write(item.data(), item.size());
+        }
+        hasher.Write(Params().ParentGenesisBlockHash().begin(), 32).Write(consensus.pegged_asset.begin(), 32);
+        hasher.Write(consensus.fedpegScript.data(), consensus.fedpegScript.size()).Finalize(entry.begin());
+    }
+
+    bool Get(const uint256& entry)
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_peginwitnesscache);
+        return setValid.contains(entry, false);
+    }
+
+    void Set(uint256& entry)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_peginwitnesscache);
+        setValid.insert(entry);
+    }
+
+    uint32_t setup_bytes(size_t n)
+    {
+        return setValid.setup_bytes(n);
+    }
+};
+
+CPeginWitnessCache peginWitnessCache;
+
+} // namespace
+
+void InitPeginWitnessCache()
+{
+    size_t nElems = peginWitnessCache.setup_bytes(PEGIN_WITNESS_CACHE_BYTES);
+    LogPrintf("Using %zu KiB for peg-in witness cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >> 10, nElems);
+}
+
+/** Checks everything about a peg-in witness except its depth in the parent chain, which is returned */
+static bool CheckPeginWitnessStructure(const CScriptWitness& pegin_witness, const COutPoint& prevout, uint256& parent_block_hash) {
 
     // Format on stack is as follows:
     // 1) value - the value of the pegin output
@@ -2524,9 +3089,41 @@ bool IsValidPeginWitness(const CScriptWitness& pegin_witness, const COutPoint& p
         return false;
     }
 
+    parent_block_hash = merkle_block.header.GetHash();
+    return true;
+}
+
+bool IsValidPeginWitness(const CScriptWitness& pegin_witness, const COutPoint& prevout, bool check_depth) {
+    // Must include all elements
+    if (pegin_witness.stack.size() != 6) {
+        return false;
+    }
+
+    uint256 entry;
+    peginWitnessCache.ComputeEntry(entry, pegin_witness, prevout);
+    uint256 parent_block_hash;
+    if (peginWitnessCache.Get(entry)) {
+        // Only the header of the merkle block is needed for the depth check
+        try {
+            CDataStream headerStream(pegin_witness.stack[5], SER_NETWORK, PROTOCOL_VERSION);
+            Sidechain::Bitcoin::CBlockHeader header;
+            headerStream >> header;
+            parent_block_hash = header.GetHash();
+        } catch (std::exception& e) {
+            return false;
+        }
+    } else {
+        if (!CheckPeginWitnessStructure(pegin_witness, prevout, parent_block_hash)) {
+            return false;
+        }
+        peginWitnessCache.Set(entry);
+    }
+
     // Finally, validate peg-in via rpc call
     if (check_depth && GetBoolArg("-validatepegin", DEFAULT_VALIDATE_PEGIN)) {
-        return IsConfirmedBitcoinBlock(merkle_block.header.GetHash(), Params().GetConsensus().pegin_min_depth);
+        if (g_mainchain_tracker)
+            return g_mainchain_tracker->IsConfirmed(parent_block_hash, Params().GetConsensus().pegin_min_depth);
+        return IsConfirmedBitcoinBlock(parent_block_hash, Params().GetConsensus().pegin_min_depth);
     }
     return true;
 }
@@ -2613,7 +3210,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             for (const auto& tx : block.vtx) {
 
                 // Directly add new coins to DB
-                view.ModifyNewCoins(tx->GetHash(), tx->IsCoinBase())->FromTx(*tx, pindex->nHeight);
+                AddCoins(view, *tx, pindex->nHeight);
                 vPos.push_back(std::make_pair(tx->GetHash(), pos));
                 pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
             }
@@ -2697,10 +3294,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     if (fEnforceBIP30) {
         for (const auto& tx : block.vtx) {
-            const CCoins* coins = view.AccessCoins(tx->GetHash());
-            if (coins && !coins->IsPruned())
-                return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
-                                 REJECT_INVALID, "bad-txns-BIP30");
+            for (size_t o = 0; o < tx->vout.size(); o++) {
+                if (view.HaveCoin(COutPoint(tx->GetHash(), o))) {
+                    return state.DoS(100, error("ConnectBlock(): tried to overwrite transaction"),
+                                     REJECT_INVALID, "bad-txns-BIP30");
+                }
+            }
         }
     }
 
@@ -2731,6 +3330,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     CBlockUndo blockundo;
 
+    // Range and surjection proofs of the whole block, verified in batches once the amount checks have run.
+    // Declared first, as queued amount checks extract into it until control is destroyed.
+    CProofCheckCollector proofChecks;
     CCheckQueueControl<CCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     std::vector<int> prevheights;
@@ -2747,6 +3349,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // Used when ConnectBlock() results are unneeded for mempool ejection
     std::set<std::pair<uint256, COutPoint> > setPeginsSpentDummy;
 
+    bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
+
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = *(block.vtx[i]);
@@ -2767,7 +3371,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                 if (tx.vin[j].m_is_pegin) {
                     prevheights[j] = -1;
                 } else {
-                    prevheights[j] = view.AccessCoins(tx.vin[j].prevout.hash)->nHeight;
+                    prevheights[j] = view.AccessCoin(tx.vin[j].prevout).nHeight;
                 }
             }
 
@@ -2790,10 +3394,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!tx.IsCoinBase())
         {
             std::vector<CCheck*> vChecks;
-            bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
             if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, txdata[i], setPeginsSpent == NULL ? setPeginsSpentDummy : *setPeginsSpent, nScriptCheckThreads ? &vChecks : NULL))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
+            proofChecks.Extract(vChecks);
             control.Add(vChecks);
         }
 
@@ -2824,7 +3428,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                blockReward[policyAsset]),
                                REJECT_INVALID, "bad-cb-amount");
 
-    if (!control.Wait())
+    // The amount checks only hand over their proof checks as they run, so those are queued in a second round
+    bool fChecksOk = control.Wait();
+    if (fChecksOk) {
+        control.Add(proofChecks.MakeBatches(nScriptCheckThreads, fCacheResults));
+        fChecksOk = control.Wait();
+    }
+    if (!fChecksOk)
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
     LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
@@ -2944,15 +3554,15 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
                 vFiles.push_back(std::make_pair(*it, &vinfoBlockFile[*it]));
                 setDirtyFileInfo.erase(it++);
             }
-            std::vector<const CBlockIndex*> vBlocks;
-            vBlocks.reserve(setDirtyBlockIndex.size());
-            for (std::set<CBlockIndex*>::iterator it = setDirtyBlockIndex.begin(); it != setDirtyBlockIndex.end(); ) {
-                vBlocks.push_back(*it);
-                setDirtyBlockIndex.erase(it++);
-            }
+            std::vector<CBlockIndex*> vDirtyBlocks(setDirtyBlockIndex.begin(), setDirtyBlockIndex.end());
+            std::vector<const CBlockIndex*> vBlocks(vDirtyBlocks.begin(), vDirtyBlocks.end());
+            setDirtyBlockIndex.clear();
             if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
                 return AbortNode(state, "Failed to write to block index database");
             }
+            // The proof solutions are on disk now, see ReadBlockHeader
+            for (CBlockIndex* pindex : vDirtyBlocks)
+                pindex->psolution.reset();
         }
         // Finally remove any pruned files
         if (fFlushForPrune)
@@ -2961,7 +3571,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
     }
     // Flush best chain related state. This can only be done if the blocks / block index write was also done.
     if (fDoFullFlush) {
-        // Typical CCoins structures on disk are around 128 bytes in size.
+        // Coin structures on disk are up to around 128 bytes in size with
+        // blinded values and assets.
         // Pushing a new one to the database can cause it to be written
         // twice (once in the log, and once in the tables). This is already
         // an overestimation, as most will delete an existing entry or
@@ -5212,7 +5823,66 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! Version 2 adds the chain tip and a validation digest for every transaction
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+
+/**
+ * Digest stored with a transaction in mempool.dat, which tells LoadMempool
+ * that this node accepted the transaction, as it is including its witness,
+ * on top of hashTip.
+ */
+static uint256 MempoolValidationDigest(const uint256& key, const uint256& hashTip, const CTransaction& tx)
+{
+    uint256 digest;
+    uint256 wtxid = tx.GetHashWithWitness();
+    CHMAC_SHA256(key.begin(), key.size()).Write(hashTip.begin(), hashTip.size()).Write(wtxid.begin(), wtxid.size()).Finalize(digest.begin());
+    return digest;
+}
+
+/**
+ * Add the peg-in witnesses and the range and surjection proofs of a
+ * transaction this node has verified before to their caches, so that
+ * accepting it again does not verify them. Peg-in depths are still checked.
+ */
+static void SeedVerifiedTransaction(const CTransaction& tx)
+{
+    AssertLockHeld(cs_main);
+    if (tx.IsCoinBase())
+        return;
+
+    CCoinsViewMemPool viewMemPool(pcoinsTip, mempool);
+    CCoinsViewCache view(&viewMemPool);
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        if (tx.vin[i].m_is_pegin) {
+            if (tx.wit.vtxinwit.size() <= i || tx.wit.vtxinwit[i].m_pegin_witness.stack.size() != 6)
+                return;
+        } else if (!view.HaveCoin(tx.vin[i].prevout)) {
+            return;
+        }
+    }
+
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        if (tx.vin[i].m_is_pegin) {
+            uint256 entry;
+            peginWitnessCache.ComputeEntry(entry, tx.wit.vtxinwit[i].m_pegin_witness, tx.vin[i].prevout);
+            peginWitnessCache.Set(entry);
+        }
+    }
+
+    std::vector<CCheck*> vChecks;
+    if (VerifyAmounts(GetSpentOutputs(view, tx), tx, &vChecks, true)) {
+        for (const CCheck* check : vChecks) {
+            if (const CRangeCheck* rangecheck = dynamic_cast<const CRangeCheck*>(check)) {
+                rangecheck->Seed();
+            } else if (const CSurjectionCheck* surjectioncheck = dynamic_cast<const CSurjectionCheck*>(check)) {
+                surjectioncheck->Seed();
+            }
+        }
+    }
+    for (CCheck* check : vChecks) {
+        delete check;
+    }
+}
 
 bool LoadMempool(void)
 {
@@ -5227,14 +5897,30 @@ bool LoadMempool(void)
     int64_t count = 0;
     int64_t skipped = 0;
     int64_t failed = 0;
+    int64_t seeded = 0;
     int64_t nNow = GetTime();
+    int64_t nStart = GetTimeMicros();
 
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != 1 && version != MEMPOOL_DUMP_VERSION) {
             return false;
         }
+
+        // Digests are only trusted if they were made for the current tip with our key
+        bool fTrustDigests = false;
+        uint256 key;
+        if (version >= 2) {
+            uint256 hashTip;
+            file >> hashTip;
+            LOCK(cs_main);
+            fTrustDigests = chainActive.Tip() && chainActive.Tip()->GetBlockHash() == hashTip && GetVerifyCacheKey(key);
+            if (!fTrustDigests) {
+                LogPrintf("Mempool file was written at a different chain tip or by another node, verifying all transactions\n");
+            }
+        }
+
         uint64_t num;
         file >> num;
         double prioritydummy = 0;
@@ -5242,9 +5928,13 @@ bool LoadMempool(void)
             CTransactionRef tx;
             int64_t nTime;
             int64_t nFeeDelta;
+            uint256 digest;
             file >> tx;
             file >> nTime;
             file >> nFeeDelta;
+            if (version >= 2) {
+                file >> digest;
+            }
 
             CAmount amountdelta = nFeeDelta;
             if (amountdelta) {
@@ -5253,6 +5943,10 @@ bool LoadMempool(void)
             CValidationState state;
             if (nTime + nExpiryTimeout > nNow) {
                 LOCK(cs_main);
+                if (fTrustDigests && digest == MempoolValidationDigest(key, chainActive.Tip()->GetBlockHash(), *tx)) {
+                    SeedVerifiedTransaction(*tx);
+                    ++seeded;
+                }
                 AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, nTime);
                 if (state.IsValid()) {
                     ++count;
@@ -5276,7 +5970,7 @@ bool LoadMempool(void)
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, skipped);
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired, %i with proofs already verified, in %.2fs\n", count, failed, skipped, seeded, (GetTimeMicros() - nStart) * 0.000001);
     return true;
 }
 
@@ -5286,15 +5980,22 @@ void DumpMempool(void)
 
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
+    uint256 hashTip;
 
     {
-        LOCK(mempool.cs);
+        LOCK2(cs_main, mempool.cs);
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second.second;
         }
         vinfo = mempool.infoAll();
+        if (chainActive.Tip())
+            hashTip = chainActive.Tip()->GetBlockHash();
     }
 
+    // Without a key the digests are left null, and the next start verifies everything
+    uint256 key;
+    bool fHaveKey = GetVerifyCacheKey(key);
+
     int64_t mid = GetTimeMicros();
 
     try {
@@ -5307,12 +6008,14 @@ void DumpMempool(void)
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
+        file << hashTip;
 
         file << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
             file << *(i.tx);
             file << (int64_t)i.nTime;
             file << (int64_t)i.nFeeDelta;
+            file << (fHaveKey ? MempoolValidationDigest(key, hashTip, *i.tx) : uint256());
             mapDeltas.erase(i.tx->GetHash());
         }
 
@@ -5344,6 +6047,19 @@ double GuessVerificationProgress(CBlockIndex *pindex, int64_t blockInterval) {
     return std::min(1.0, progress);
 }
 
+size_t BlockIndexDynamicUsage()
+{
+    AssertLockHeld(cs_main);
+    size_t nUsage = memusage::DynamicUsage(mapBlockIndex) + BlockChallengesDynamicUsage();
+    for (BlockMap::const_iterator it = mapBlockIndex.begin(); it != mapBlockIndex.end(); ++it) {
+        const CBlockIndex* pindex = it->second;
+        nUsage += memusage::MallocUsage(sizeof(CBlockIndex));
+        if (pindex->psolution)
+            nUsage += memusage::DynamicUsage(pindex->psolution) + memusage::DynamicUsage(*pindex->psolution);
+    }
+    return nUsage;
+}
+
 class CMainCleanup
 {
 public:
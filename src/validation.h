@@ -37,6 +37,7 @@
 class CBlockIndex;
 class CBlockTreeDB;
 class CBloomFilter;
+class CCoinsViewDB;
 class CChainParams;
 class CInv;
 class CConnman;
@@ -147,6 +148,11 @@ static const int MAX_UNCONNECTING_HEADERS = 10;
 
 static const bool DEFAULT_PEERBLOOMFILTERS = false;
 
+/** Size of the cache of structurally valid peg-in witnesses (1 MiB, about 32k entries) */
+static const size_t PEGIN_WITNESS_CACHE_BYTES = 1 << 20;
+/** Number of claim scripts whose tweaked fedpeg script is remembered by calculate_contract */
+static const size_t MAX_CONTRACT_CACHE_SIZE = 1000;
+
 struct BlockHasher
 {
     size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
@@ -244,6 +250,20 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
  */
 bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& block, CValidationState& state, const CChainParams& chainparams, const CBlockIndex** ppindex=NULL);
 
+/**
+ * Verify the proofs of a batch of headers on the script check threads.
+ * Valid proofs are stored in the block proof cache, so accepting the headers
+ * afterwards only looks them up. Does nothing without script check threads.
+ * Callers should only pass headers whose challenge matches their parent's, as
+ * others fail CheckChallenge regardless of their proof. Verification stops at
+ * the first invalid proof.
+ *
+ * Call without cs_main held.
+ *
+ * @return false if a proof was found to be invalid
+ */
+bool CheckBlockHeaderProofs(const std::vector<const CBlockHeader*>& headers, const Consensus::Params& consensusParams);
+
 /** Check whether enough disk space is available for an incoming block */
 bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 /** Open a block file (blk?????.dat) */
@@ -264,6 +284,8 @@ void UnloadBlockIndex();
 void ThreadScriptCheck();
 /** Check if bitcoind connection via RPC is correctly working*/
 bool BitcoindRPCCheck(bool init);
+/** Initialize the cache of structurally valid peg-in witnesses */
+void InitPeginWitnessCache();
 /** Checks pegin witness for validity */
 bool IsValidPeginWitness(const CScriptWitness& pegin_witness, const COutPoint& prevout, bool check_depth = true);
 /** Extracts an output from pegin witness for evaluation as a normal output */
@@ -289,6 +311,9 @@ CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
 /** Guess verification progress (as a fraction between 0.0=genesis and 1.0=current tip). */
 double GuessVerificationProgress(CBlockIndex* pindex, int64_t blockInterval);
 
+/** Memory used by the block index (mapBlockIndex and its entries). */
+size_t BlockIndexDynamicUsage();
+
 /**
  * Prune block and undo files (blk???.dat and undo???.dat) so that the disk space used is less than a user-defined target.
  * The user sets the target (in MB) on the command line or in config file.  This will be run on startup and whenever new
@@ -325,6 +350,9 @@ void PruneAndFlush();
 /** Prune block files up to a given height */
 void PruneBlockFilesManual(int nPruneUpToHeight);
 
+/** Script verification flags AcceptToMemoryPool checks loose transactions against */
+unsigned int GetMempoolScriptVerifyFlags();
+
 /** (try to) add transaction to memory pool
  * plTxnReplaced will be appended to with all transactions replaced from mempool **/
 bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
@@ -392,6 +420,8 @@ namespace Consensus {
 /**
  * Check whether all inputs of this transaction are valid (no double spends and amounts)
  * This does not modify the UTXO set. This does not check scripts and sigs.
+ * If pvChecks is set, the amount check is queued on it to run against a
+ * snapshot of the spent outputs, rather than run here.
  * Preconditions: tx.IsCoinBase() is false.
  */
 bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& inputs, int nSpendHeight, std::set<std::pair<uint256, COutPoint> >& setPeginsSpent, std::vector<CCheck*> *pvChecks, const bool cacheStore, bool fScriptChecks, const bool check_depth = true);
@@ -412,6 +442,30 @@ bool CheckTxInputs(const CTransaction& tx, CValidationState& state, const CCoins
 */
 bool VerifyAmounts(const CCoinsViewCache& cache, const CTransaction& tx, std::vector<CCheck*>* pvChecks = NULL, const bool cacheStore = false);
 
+/**
+ * As above, against a snapshot of the outputs spent by tx, in input order, as
+ * returned by GetSpentOutputs(). Needs no access to the coins view, so the
+ * check can run on the script check threads.
+ */
+bool VerifyAmounts(const std::vector<CTxOut>& vSpent, const CTransaction& tx, std::vector<CCheck*>* pvChecks = NULL, const bool cacheStore = false);
+
+/**
+ * The balance check of VerifyAmounts() for transactions whose spent outputs,
+ * new issuances and outputs are all explicit: amounts are summed per asset
+ * instead of committed to and tallied. Consensus-equivalent to
+ * VerifyCommittedAmounts() on such transactions.
+ *
+ * @param[out] fValid  whether the amounts verify, if the return value is true
+ * @return  False if tx needs the commitment path instead
+ */
+bool VerifyExplicitAmounts(const std::vector<CTxOut>& vSpent, const CTransaction& tx, bool& fValid);
+
+/** The general path of VerifyAmounts(), for any mix of explicit and blinded amounts */
+bool VerifyCommittedAmounts(const std::vector<CTxOut>& vSpent, const CTransaction& tx, std::vector<CCheck*>* pvChecks = NULL, const bool cacheStore = false);
+
+/** The outputs spent by a non-coinbase transaction, with peg-in inputs taken from their witness */
+std::vector<CTxOut> GetSpentOutputs(const CCoinsViewCache& cache, const CTransaction& tx);
+
 /**
  * Verify the amounts of coinbase transactions. It will fail for any blinded amount or type.
  * Each output must be explicit in both nValue and nAsset.
@@ -494,8 +548,8 @@ private:
     PrecomputedTransactionData *txdata;
 
 public:
-    CScriptCheck(const CCoins& txFromIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
-        scriptPubKey(txFromIn.vout[txToIn.vin[nInIn].prevout.n].scriptPubKey), amount(txFromIn.vout[txToIn.vin[nInIn].prevout.n].nValue),
+    CScriptCheck(const CTxOut& outIn, const CTransaction& txToIn, unsigned int nInIn, unsigned int nFlagsIn, bool cacheIn, PrecomputedTransactionData* txdataIn) :
+        scriptPubKey(outIn.scriptPubKey), amount(outIn.nValue),
         ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), cacheStore(cacheIn), txdata(txdataIn) { }
 
     bool operator()();
@@ -507,6 +561,8 @@ public:
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/** Get the full header of a block index entry, loading the proof solution from the block tree database or the block file if needed. */
+bool ReadBlockHeader(CBlockHeader& header, const CBlockIndex* pindex);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -550,7 +606,11 @@ std::vector<unsigned char> GenerateCoinbaseCommitment(CBlock& block, const CBloc
 /** Extract pak commitment from coinbase, if it exists. List must be ordered, but not necessarily consecutive in output index */
 boost::optional<CPAKList> GetPAKKeysFromCommitment(const CTransaction& coinbase);
 
-/** Calculates script necessary for p2ch peg-in transactions */
+/**
+ * Calculates script necessary for p2ch peg-in transactions. Results are kept
+ * in an LRU cache of MAX_CONTRACT_CACHE_SIZE claim scripts, which is dropped
+ * when called with a different federation script.
+ */
 CScript calculate_contract(const CScript& federationRedeemScript, const CScript& witnessProgram);
 
 /** RAII wrapper for VerifyDB: Verify consistency of the block and coin databases */
@@ -576,6 +636,9 @@ bool ResetBlockFailureFlags(CBlockIndex *pindex);
 /** The currently-connected chain of blocks (protected by cs_main). */
 extern CChain chainActive;
 
+/** Global variable that points to the coins database (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
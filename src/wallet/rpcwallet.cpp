@@ -16,6 +16,7 @@
 #include "init.h"
 #include "validation.h"
 #include "issuance.h"
+#include "mainchain.h"
 #include "net.h"
 #include "policy/policy.h"
 #include "policy/policy.h"
@@ -94,7 +95,7 @@ UniValue PushAssetBalance(CAmountMap& balance, CWallet* wallet, std::string stra
 {
     UniValue obj(UniValue::VOBJ);
     if (strasset == "") {
-        for(std::map<CAsset, CAmount>::const_iterator it = balance.begin(); it != balance.end(); ++it) {
+        for(CAmountMap::const_iterator it = balance.begin(); it != balance.end(); ++it) {
             // Unknown assets
             if (it->first.IsNull())
                 continue;
@@ -2114,7 +2115,7 @@ UniValue gettransaction(const JSONRPCRequest& request)
     CAmountMap nCredit = wtx.GetCredit(filter);
     CAmountMap nDebit = wtx.GetDebit(filter);
     assert(wtx.tx->HasValidFee());
-    CAmount nFee = (wtx.IsFromMe(filter) ? -wtx.tx->GetFee()[policyAsset] : 0);
+    CAmount nFee = (wtx.IsFromMe(filter) ? -wtx.tx->GetFee(policyAsset) : 0);
     CAmountMap nNet = nCredit - nDebit;
     nNet[policyAsset] -= nFee;
 
@@ -2617,6 +2618,54 @@ UniValue settxfee(const JSONRPCRequest& request)
     return true;
 }
 
+static UniValue ScanStatusToJSON(const CWalletScanStatus& scan)
+{
+    UniValue rescan(UniValue::VOBJ);
+    rescan.push_back(Pair("inprogress", scan.fScanning));
+    rescan.push_back(Pair("startheight", scan.nStartHeight));
+    rescan.push_back(Pair("stopheight", scan.nStopHeight));
+    rescan.push_back(Pair("height", scan.nHeight));
+    rescan.push_back(Pair("progress", scan.dProgress));
+    rescan.push_back(Pair("duration", scan.nDuration));
+    rescan.push_back(Pair("blocks", scan.nBlocks));
+    rescan.push_back(Pair("transactions", scan.nTransactions));
+    rescan.push_back(Pair("unblinded", scan.nOutputsUnblinded));
+    rescan.push_back(Pair("blockspersecond", scan.nBlocks * 1000.0 / std::max<int64_t>(1, scan.nDuration)));
+    rescan.push_back(Pair("threads", scan.nThreads));
+    return rescan;
+}
+
+// Requires cs_main and the wallet lock
+static void PushWalletInfo(UniValue& obj, const JSONRPCRequest& request)
+{
+    // Read again under the lock, in case the rescan finished in the meantime
+    CWalletScanStatus scan = pwalletMain->GetScanStatus();
+
+    obj.push_back(Pair("walletversion", pwalletMain->GetVersion()));
+
+    std::string asset = "";
+    if (request.params.size() > 0 && request.params[0].isStr()) {
+        asset = request.params[0].get_str();
+    }
+    CAmountMap balance = pwalletMain->GetBalance();
+    CAmountMap unBalance = pwalletMain->GetUnconfirmedBalance();
+    CAmountMap imBalance = pwalletMain->GetImmatureBalance();
+    obj.push_back(Pair("balance", PushAssetBalance(balance, pwalletMain, asset)));
+    obj.push_back(Pair("unconfirmed_balance", PushAssetBalance(unBalance, pwalletMain, asset)));
+    obj.push_back(Pair("immature_balance",    PushAssetBalance(imBalance, pwalletMain, asset)));
+    obj.push_back(Pair("txcount",       (int)pwalletMain->mapWallet.size()));
+    obj.push_back(Pair("keypoololdest", pwalletMain->GetOldestKeyPoolTime()));
+    obj.push_back(Pair("keypoolsize",   (int)pwalletMain->GetKeyPoolSize()));
+    if (pwalletMain->IsCrypted())
+        obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
+    obj.push_back(Pair("paytxfee",      ValueFromAmount(payTxFee.GetFeePerK())));
+    CKeyID masterKeyID = pwalletMain->GetHDChain().masterKeyID;
+    if (!masterKeyID.IsNull())
+         obj.push_back(Pair("hdmasterkeyid", masterKeyID.GetHex()));
+    if (scan.nThreads > 0)
+        obj.push_back(Pair("rescan", ScanStatusToJSON(scan)));
+}
+
 UniValue getwalletinfo(const JSONRPCRequest& request)
 {
     if (!EnsureWalletIsAvailable(request.fHelp))
@@ -2639,36 +2688,43 @@ UniValue getwalletinfo(const JSONRPCRequest& request)
             "  \"unlocked_until\": ttt,        (numeric) the timestamp in seconds since epoch (midnight Jan 1 1970 GMT) that the wallet is unlocked for transfers, or 0 if the wallet is locked\n"
             "  \"paytxfee\": x.xxxx,           (numeric) the transaction fee configuration, set in " + CURRENCY_UNIT + "/kB\n"
             "  \"hdmasterkeyid\": \"<hash160>\" (string) the Hash160 of the HD master pubkey\n"
+            "  \"rescan\": {                  (json object) the current or most recent rescan, if any. While a rescan\n"
+            "                                  holds the wallet, this is the only field returned\n"
+            "    \"inprogress\": true|false,  (boolean) whether the rescan is still running\n"
+            "    \"startheight\": n,          (numeric) height of the first block scanned\n"
+            "    \"stopheight\": n,           (numeric) height of the last block to scan\n"
+            "    \"height\": n,               (numeric) height of the last block scanned so far\n"
+            "    \"progress\": x.xxx,         (numeric) fraction of the rescan done\n"
+            "    \"duration\": n,             (numeric) milliseconds elapsed\n"
+            "    \"blocks\": n,               (numeric) blocks scanned\n"
+            "    \"transactions\": n,         (numeric) transactions scanned\n"
+            "    \"unblinded\": n,            (numeric) confidential wallet outputs unblinded\n"
+            "    \"blockspersecond\": x.x,    (numeric) scan throughput\n"
+            "    \"threads\": n               (numeric) number of worker threads\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getwalletinfo", "")
             + HelpExampleRpc("getwalletinfo", "")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
+    // A rescan holds cs_main and the wallet lock for its whole duration, so
+    // look at its progress first, and do not wait for it to finish
+    CWalletScanStatus scan = pwalletMain->GetScanStatus();
     UniValue obj(UniValue::VOBJ);
-    obj.push_back(Pair("walletversion", pwalletMain->GetVersion()));
-
-    std::string asset = "";
-    if (request.params.size() > 0 && request.params[0].isStr()) {
-        asset = request.params[0].get_str();
+    if (scan.fScanning) {
+        TRY_LOCK(cs_main, lockMain);
+        TRY_LOCK(pwalletMain->cs_wallet, lockWallet);
+        if (!lockMain || !lockWallet) {
+            obj.push_back(Pair("rescan", ScanStatusToJSON(scan)));
+            return obj;
+        }
+        PushWalletInfo(obj, request);
+        return obj;
     }
-    CAmountMap balance = pwalletMain->GetBalance();
-    CAmountMap unBalance = pwalletMain->GetUnconfirmedBalance();
-    CAmountMap imBalance = pwalletMain->GetImmatureBalance();
-    obj.push_back(Pair("balance", PushAssetBalance(balance, pwalletMain, asset)));
-    obj.push_back(Pair("unconfirmed_balance", PushAssetBalance(unBalance, pwalletMain, asset)));
-    obj.push_back(Pair("immature_balance",    PushAssetBalance(imBalance, pwalletMain, asset)));
-    obj.push_back(Pair("txcount",       (int)pwalletMain->mapWallet.size()));
-    obj.push_back(Pair("keypoololdest", pwalletMain->GetOldestKeyPoolTime()));
-    obj.push_back(Pair("keypoolsize",   (int)pwalletMain->GetKeyPoolSize()));
-    if (pwalletMain->IsCrypted())
-        obj.push_back(Pair("unlocked_until", nWalletUnlockTime));
-    obj.push_back(Pair("paytxfee",      ValueFromAmount(payTxFee.GetFeePerK())));
-    CKeyID masterKeyID = pwalletMain->GetHDChain().masterKeyID;
-    if (!masterKeyID.IsNull())
-         obj.push_back(Pair("hdmasterkeyid", masterKeyID.GetHex()));
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+    PushWalletInfo(obj, request);
     return obj;
 }
 
@@ -3191,7 +3247,7 @@ UniValue bumpfee(const JSONRPCRequest& request)
     }
 
     // calculate the old fee and fee-rate
-    CAmount nOldFee = wtx.tx->GetFee()[Params().GetConsensus().pegged_asset];
+    CAmount nOldFee = wtx.tx->GetFee(Params().GetConsensus().pegged_asset);
     CFeeRate nOldFeeRate(nOldFee, txSize);
     CAmount nNewFee;
     CFeeRate nNewFeeRate;
@@ -4257,7 +4313,9 @@ UniValue createrawpegin(const JSONRPCRequest& request)
 
     // Additional block lee-way to avoid bitcoin block races
     if (GetBoolArg("-validatepegin", DEFAULT_VALIDATE_PEGIN)) {
-        ret.push_back(Pair("mature", IsConfirmedBitcoinBlock(merkleBlock.header.GetHash(), Params().GetConsensus().pegin_min_depth+2)));
+        const uint256 hashBlock = merkleBlock.header.GetHash();
+        const int nMinDepth = Params().GetConsensus().pegin_min_depth + 2;
+        ret.push_back(Pair("mature", g_mainchain_tracker ? g_mainchain_tracker->IsConfirmed(hashBlock, nMinDepth) : IsConfirmedBitcoinBlock(hashBlock, nMinDepth)));
     }
 
     return ret;
@@ -4,11 +4,14 @@
 
 #include "wallet/wallet.h"
 
+#include <future>
 #include <set>
 #include <stdint.h>
 #include <utility>
 #include <vector>
 
+#include "chainparams.h"
+#include "consensus/consensus.h"
 #include "rpc/server.h"
 #include "test/test_bitcoin.h"
 #include "validation.h"
@@ -19,6 +22,7 @@
 #include <univalue.h>
 
 extern UniValue importmulti(const JSONRPCRequest& request);
+extern UniValue getwalletinfo(const JSONRPCRequest& request);
 
 // how many times to run all the tests to have a chance to catch errors that only show up with particular random shuffles
 #define RUN_TESTS 100
@@ -428,4 +432,202 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain100Setup)
     }*/
 }
 
+BOOST_FIXTURE_TEST_CASE(parallel_rescan, TestChain100Setup)
+{
+    CScript scriptPubKey = GetScriptForRawPubKey(coinbaseKey.GetPubKey());
+    CKey blindingKey;
+    blindingKey.MakeNewKey(true);
+    uint256 blindingKeyBin(std::vector<unsigned char>(blindingKey.begin(), blindingKey.end()));
+
+    // Mine a few blocks, each spending a genesis output into two outputs
+    // blinded to us
+    std::vector<CTransaction> spends;
+    for (unsigned int n = 0; n < 3; n++) {
+        const CTxOut& prevout = coinbaseTxns[0].vout[n];
+        CAmount nValue = prevout.nValue.GetAmount();
+        CMutableTransaction mtx;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = COutPoint(coinbaseTxns[0].GetHash(), n);
+        mtx.vout.push_back(CTxOut(prevout.nAsset.GetAsset(), 11 * CENT, scriptPubKey));
+        mtx.vout.push_back(CTxOut(prevout.nAsset.GetAsset(), nValue - 11 * CENT, scriptPubKey));
+        std::vector<uint256> input_blinds(1), input_asset_blinds(1), output_blinds, output_asset_blinds;
+        std::vector<CAsset> input_assets(1, prevout.nAsset.GetAsset());
+        std::vector<CAmount> input_amounts(1, nValue);
+        std::vector<CPubKey> output_pubkeys(2, blindingKey.GetPubKey());
+        std::vector<CKey> vDummy;
+        BOOST_REQUIRE_EQUAL(BlindTransaction(input_blinds, input_asset_blinds, input_assets, input_amounts, output_blinds, output_asset_blinds, output_pubkeys, vDummy, vDummy, mtx), 2);
+
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(prevout.scriptPubKey, mtx, 0, SIGHASH_ALL, prevout.nValue, SIGVERSION_BASE);
+        BOOST_REQUIRE(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        mtx.vin[0].scriptSig << vchSig;
+        CreateAndProcessBlock({mtx}, scriptPubKey);
+        spends.push_back(CTransaction(mtx));
+    }
+    LOCK(cs_main);
+    BOOST_REQUIRE_EQUAL(chainActive.Height(), COINBASE_MATURITY + 3);
+
+    // Every pipeline width finds the same transactions, in chain order, with
+    // the output blinding data precomputed by the workers
+    const int vThreads[] = {1, 3, MAX_RESCAN_THREADS};
+    for (int nThreads : vThreads) {
+        nRescanThreads = nThreads;
+        CWallet wallet;
+        LOCK(wallet.cs_wallet);
+        wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+        BOOST_CHECK(wallet.AddSpecificBlindingKey(CScriptID(scriptPubKey), blindingKeyBin));
+        BOOST_CHECK_EQUAL(chainActive.Genesis(), wallet.ScanForWalletTransactions(chainActive.Genesis()));
+        BOOST_CHECK_EQUAL(wallet.mapWallet.size(), 1 + spends.size());
+
+        BOOST_REQUIRE(wallet.mapWallet.count(coinbaseTxns[0].GetHash()));
+        int64_t nOrderPos = wallet.mapWallet[coinbaseTxns[0].GetHash()].nOrderPos;
+        for (const CTransaction& spend : spends) {
+            BOOST_REQUIRE(wallet.mapWallet.count(spend.GetHash()));
+            const CWalletTx& wtx = wallet.mapWallet[spend.GetHash()];
+            BOOST_CHECK(wtx.nOrderPos > nOrderPos);
+            nOrderPos = wtx.nOrderPos;
+            BOOST_REQUIRE_EQUAL(wtx.vBlindingData.size(), spend.vout.size());
+            BOOST_CHECK_EQUAL(wtx.vBlindingData[0].status, CWalletBlindingData::KNOWN);
+            BOOST_CHECK_EQUAL(wtx.vBlindingData[0].amount, 11 * CENT);
+            BOOST_CHECK(wtx.vBlindingData[0].pubkey == blindingKey.GetPubKey());
+            BOOST_CHECK_EQUAL(wtx.vBlindingData[1].status, CWalletBlindingData::KNOWN);
+        }
+
+        CWalletScanStatus status = wallet.GetScanStatus();
+        BOOST_CHECK(!status.fScanning);
+        BOOST_CHECK_EQUAL(status.nThreads, nThreads);
+        BOOST_CHECK_EQUAL(status.nStartHeight, 0);
+        BOOST_CHECK_EQUAL(status.nStopHeight, chainActive.Height());
+        BOOST_CHECK_EQUAL(status.nHeight, chainActive.Height());
+        BOOST_CHECK_EQUAL(status.nBlocks, (uint64_t)chainActive.Height() + 1);
+        BOOST_CHECK_EQUAL(status.nTransactions, status.nBlocks + Params().GenesisBlock().vtx.size() - 1 + spends.size());
+        BOOST_CHECK_EQUAL(status.nOutputsUnblinded, 2 * spends.size());
+    }
+    nRescanThreads = DEFAULT_RESCAN_THREADS;
+}
+
+BOOST_FIXTURE_TEST_CASE(getwalletinfo_during_rescan, TestChain100Setup)
+{
+    CWallet wallet;
+    CWallet* pwalletOld = pwalletMain;
+    pwalletMain = &wallet;
+
+    // Ask for the wallet info from another thread while the rescan holds
+    // cs_main and the wallet lock, when it shows its progress dialog
+    UniValue during;
+    bool fAnswered = false;
+    wallet.ShowProgress.connect([&](const std::string& title, int nProgress) {
+        if (nProgress != 0)
+            return;
+        std::future<UniValue> result = std::async(std::launch::async, [] {
+            JSONRPCRequest request;
+            return getwalletinfo(request);
+        });
+        fAnswered = result.wait_for(std::chrono::seconds(30)) == std::future_status::ready;
+        during = result.get();
+    });
+    {
+        LOCK2(cs_main, wallet.cs_wallet);
+        wallet.ScanForWalletTransactions(chainActive.Genesis());
+    }
+    wallet.ShowProgress.disconnect_all_slots();
+
+    // It did not wait for the rescan, and only reported its progress
+    BOOST_CHECK(fAnswered);
+    BOOST_CHECK(during["walletversion"].isNull());
+    BOOST_CHECK(during["rescan"]["inprogress"].get_bool());
+    BOOST_CHECK_EQUAL(during["rescan"]["stopheight"].get_int(), COINBASE_MATURITY);
+    BOOST_CHECK_EQUAL(during["rescan"]["blocks"].get_int(), 0);
+
+    // Once it is done, everything is there again
+    JSONRPCRequest request;
+    UniValue after = getwalletinfo(request);
+    BOOST_CHECK(!after["walletversion"].isNull());
+    BOOST_CHECK(!after["rescan"]["inprogress"].get_bool());
+    BOOST_CHECK_EQUAL(after["rescan"]["blocks"].get_int(), COINBASE_MATURITY + 1);
+
+    pwalletMain = pwalletOld;
+}
+
+BOOST_AUTO_TEST_CASE(blinding_data_cache)
+{
+    LOCK(pwalletMain->cs_wallet);
+
+    CAsset asset(GetRandHash());
+    CScript scriptOurs = CScript() << OP_TRUE;
+    CScript scriptTheirs = CScript() << OP_TRUE << OP_DROP << OP_TRUE;
+    CKey keyTheirs;
+    keyTheirs.MakeNewKey(true);
+
+    // One explicit output, one blinded to us and one blinded to someone else
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vout.push_back(CTxOut(asset, 10, scriptOurs));
+    mtx.vout.push_back(CTxOut(asset, 20, scriptOurs));
+    mtx.vout.push_back(CTxOut(asset, 30, scriptTheirs));
+    std::vector<uint256> input_blinds(1), input_asset_blinds(1), output_blinds, output_asset_blinds;
+    std::vector<CAsset> input_assets(1, asset);
+    std::vector<CAmount> input_amounts(1, 60);
+    std::vector<CPubKey> output_pubkeys;
+    output_pubkeys.push_back(CPubKey());
+    output_pubkeys.push_back(pwalletMain->GetBlindingKey(&scriptOurs).GetPubKey());
+    output_pubkeys.push_back(keyTheirs.GetPubKey());
+    std::vector<CKey> vDummy;
+    BOOST_CHECK_EQUAL(BlindTransaction(input_blinds, input_asset_blinds, input_assets, input_amounts, output_blinds, output_asset_blinds, output_pubkeys, vDummy, vDummy, mtx), 2);
+
+    CWalletTx wtx(pwalletMain, MakeTransactionRef(mtx));
+    BOOST_CHECK_EQUAL(wtx.GetOutputValueOut(0), 10);
+    BOOST_CHECK_EQUAL(wtx.GetOutputValueOut(1), 20);
+    BOOST_CHECK(wtx.GetOutputAsset(1) == asset);
+    BOOST_CHECK(wtx.GetOutputBlindingFactor(1) == output_blinds[1]);
+    BOOST_CHECK_EQUAL(wtx.GetOutputValueOut(2), -1);
+    BOOST_CHECK_EQUAL(wtx.vBlindingData[2].status, CWalletBlindingData::NOT_OURS);
+
+    // The cache, including the "not ours" marker, survives serialization without leaking into mapValue
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << wtx;
+    BOOST_CHECK(wtx.mapValue.count("blindingcache") == 0);
+    CWalletTx wtxLoaded;
+    ss >> wtxLoaded;
+    wtxLoaded.BindWallet(pwalletMain);
+    BOOST_CHECK(wtxLoaded.mapValue.count("blindingcache") == 0);
+    BOOST_REQUIRE_EQUAL(wtxLoaded.vBlindingData.size(), 3U);
+    BOOST_CHECK_EQUAL(wtxLoaded.vBlindingData[1].status, CWalletBlindingData::KNOWN);
+    BOOST_CHECK_EQUAL(wtxLoaded.vBlindingData[1].amount, 20);
+    BOOST_CHECK(wtxLoaded.vBlindingData[1].pubkey == output_pubkeys[1]);
+    BOOST_CHECK_EQUAL(wtxLoaded.vBlindingData[2].status, CWalletBlindingData::NOT_OURS);
+    BOOST_CHECK_EQUAL(wtxLoaded.vBlindingData[2].nBlindingKeySetId, pwalletMain->GetBlindingKeySetId());
+
+    // Learning the other blinding key makes the output unblindable
+    uint256 keyTheirsBin(std::vector<unsigned char>(keyTheirs.begin(), keyTheirs.end()));
+    BOOST_CHECK(pwalletMain->AddSpecificBlindingKey(CScriptID(scriptTheirs), keyTheirsBin));
+    BOOST_CHECK(wtxLoaded.vBlindingData[2].nBlindingKeySetId != pwalletMain->GetBlindingKeySetId());
+    BOOST_CHECK_EQUAL(wtxLoaded.GetOutputValueOut(2), 30);
+    BOOST_CHECK_EQUAL(wtxLoaded.vBlindingData[2].status, CWalletBlindingData::KNOWN);
+
+    // The legacy mapValue["blindingdata"] records are migrated on load
+    CWalletTx wtxLegacy(pwalletMain, MakeTransactionRef(mtx));
+    std::string legacy(138 * 3, '\0');
+    CAmount amount = 20;
+    legacy[138] = 1;
+    memcpy(&legacy[138 + 1], &amount, 8);
+    memcpy(&legacy[138 + 9], output_blinds[1].begin(), 32);
+    memcpy(&legacy[138 + 41], output_asset_blinds[1].begin(), 32);
+    memcpy(&legacy[138 + 73], asset.begin(), 32);
+    memcpy(&legacy[138 + 105], output_pubkeys[1].begin(), 33);
+    wtxLegacy.mapValue["blindingdata"] = legacy;
+    CDataStream ssLegacy(SER_DISK, CLIENT_VERSION);
+    ssLegacy << wtxLegacy;
+    ssLegacy >> wtxLoaded;
+    BOOST_CHECK(wtxLoaded.mapValue.count("blindingdata") == 0);
+    BOOST_REQUIRE_EQUAL(wtxLoaded.vBlindingData.size(), 3U);
+    BOOST_CHECK_EQUAL(wtxLoaded.vBlindingData[0].status, CWalletBlindingData::UNCOMPUTED);
+    BOOST_CHECK_EQUAL(wtxLoaded.vBlindingData[1].status, CWalletBlindingData::KNOWN);
+    BOOST_CHECK_EQUAL(wtxLoaded.vBlindingData[1].amount, 20);
+    BOOST_CHECK(wtxLoaded.vBlindingData[1].blindingfactor == output_blinds[1]);
+    BOOST_CHECK(wtxLoaded.vBlindingData[1].asset == asset);
+    BOOST_CHECK(wtxLoaded.vBlindingData[1].pubkey == output_pubkeys[1]);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -29,8 +29,10 @@
 #include "utilmoneystr.h"
 
 #include <assert.h>
+#include <deque>
 
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
@@ -42,6 +44,7 @@ CWallet* pwalletMain = NULL;
 /** Transaction fee set by the user */
 CFeeRate payTxFee(DEFAULT_TRANSACTION_FEE);
 unsigned int nTxConfirmTarget = DEFAULT_TX_CONFIRM_TARGET;
+int nRescanThreads = DEFAULT_RESCAN_THREADS;
 bool bSpendZeroConfChange = DEFAULT_SPEND_ZEROCONF_CHANGE;
 bool fSendFreeTransactions = DEFAULT_SEND_FREE_TRANSACTIONS;
 
@@ -618,6 +621,7 @@ void CWallet::SyncMetaData(pair<TxSpends::iterator, TxSpends::iterator> range)
         if (copyFrom == copyTo) continue;
         if (!copyFrom->IsEquivalentTo(*copyTo)) continue;
         copyTo->mapValue = copyFrom->mapValue;
+        copyTo->vBlindingData = copyFrom->vBlindingData;
         copyTo->vOrderForm = copyFrom->vOrderForm;
         // fTimeReceivedIsTxTime not copied on purpose
         // nTimeReceived not copied on purpose
@@ -1126,6 +1130,13 @@ bool CWallet::LoadToWallet(const CWalletTx& wtxIn)
  * posInBlock signals or by checking mempool presence when necessary.
  */
 bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate)
+{
+    AssertLockHeld(cs_wallet);
+    bool fExisted = mapWallet.count(tx.GetHash()) != 0;
+    return AddToWalletIfInvolvingMe(tx, pIndex, posInBlock, fUpdate, !fExisted && IsMine(tx), std::vector<CWalletBlindingData>());
+}
+
+bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate, bool fIsMine, const std::vector<CWalletBlindingData>& vBlindingData)
 {
     {
         AssertLockHeld(cs_wallet);
@@ -1145,9 +1156,10 @@ bool CWallet::AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex
 
         bool fExisted = mapWallet.count(tx.GetHash()) != 0;
         if (fExisted && !fUpdate) return false;
-        if (fExisted || IsMine(tx) || IsFromMe(tx))
+        if (fExisted || fIsMine || IsFromMe(tx))
         {
             CWalletTx wtx(this, MakeTransactionRef(tx));
+            wtx.vBlindingData = vBlindingData;
 
             // Get merkle branch if transaction was found in a block
             if (posInBlock != -1)
@@ -1546,7 +1558,7 @@ void CWalletTx::GetAmounts(list<COutputEntry>& listReceived,
     CAmountMap nDebit = GetDebit(filter);
     if (nDebit > CAmountMap()) // debit>0 means we signed/sent this transaction
     {
-        nFee = tx->GetFee()[policyAsset];
+        nFee = tx->GetFee(policyAsset);
     }
 
     CTxDestination addressUnaccounted = CNoDestination();
@@ -1667,11 +1679,197 @@ void CWalletTx::GetAccountAmounts(const string& strAccount, CAmount& nReceived,
     }
 }
 
+namespace {
+
+/** What a rescan worker found out about one transaction. */
+struct CRescanTx
+{
+    bool fIsMine;
+    std::vector<CWalletBlindingData> vBlindingData;
+
+    CRescanTx() : fIsMine(false) {}
+};
+
+/** A block travelling through the rescan pipeline. */
+struct CRescanBlock
+{
+    enum State {
+        FREE,
+        READ,
+        PREPARED,
+    };
+
+    State state;
+    size_t nIndex;
+    bool fRead;
+    CBlock block;
+    std::vector<CRescanTx> vtx;
+    uint64_t nOutputsUnblinded;
+
+    CRescanBlock() : state(FREE), nIndex(0), fRead(false), nOutputsUnblinded(0) {}
+};
+
+/**
+ * Pipelined rescan over a fixed list of blocks: one thread reads blocks from
+ * disk ahead of the wallet, a pool of workers runs IsMine and unblinds the
+ * outputs of transactions paying to us, and the caller applies the results to
+ * the wallet strictly in chain order through Next()/Release().
+ *
+ * The caller must hold cs_main and cs_wallet for the lifetime of the
+ * pipeline. The workers rely on that to read the blinding keys without
+ * taking cs_wallet themselves; keystore lookups take only cs_KeyStore.
+ */
+class CWalletRescanPipeline
+{
+private:
+    const CWallet& wallet;
+    const std::vector<CBlockIndex*>& vBlocks;
+    const Consensus::Params& consensusParams;
+    const uint64_t nBlindingKeySetId;
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::vector<CRescanBlock> vSlots;
+    std::deque<size_t> queueRead;
+    size_t nRead;
+    size_t nCommitted;
+    bool fInterrupt;
+    boost::thread_group threadGroup;
+
+    CRescanBlock& Slot(size_t nIndex) { return vSlots[nIndex % vSlots.size()]; }
+
+    void ReadBlocks()
+    {
+        RenameThread("bitcoin-rescanrd");
+        for (size_t i = 0; i < vBlocks.size(); i++) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fInterrupt && i >= nCommitted + vSlots.size())
+                    cond.wait(lock);
+                if (fInterrupt)
+                    return;
+            }
+            // The slot was released by the committer and is not visible to anyone else until queued
+            CRescanBlock& slot = Slot(i);
+            slot.nIndex = i;
+            slot.vtx.clear();
+            slot.nOutputsUnblinded = 0;
+            slot.fRead = ReadBlockFromDisk(slot.block, vBlocks[i], consensusParams);
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                slot.state = CRescanBlock::READ;
+                queueRead.push_back(i);
+                nRead++;
+            }
+            cond.notify_all();
+        }
+    }
+
+    void PrepareTransaction(const CTransaction& tx, CRescanTx& result, uint64_t& nOutputsUnblinded) const
+    {
+        BOOST_FOREACH(const CTxOut& txout, tx.vout) {
+            if (wallet.IsMine(txout) != ISMINE_NO) {
+                result.fIsMine = true;
+                break;
+            }
+        }
+        if (!result.fIsMine)
+            return;
+
+        // Issuance entries are left for CWalletTx to compute on demand
+        result.vBlindingData.resize(tx.vout.size() + GetNumIssuances(tx));
+        for (size_t i = 0; i < tx.vout.size(); i++) {
+            const CTxOut& txout = tx.vout[i];
+            const std::vector<unsigned char>& vchRangeproof = tx.wit.vtxoutwit.size() <= i ? std::vector<unsigned char>() : tx.wit.vtxoutwit[i].vchRangeproof;
+            CWalletBlindingData& data = result.vBlindingData[i];
+            wallet.ComputeBlindingData(txout.nValue, txout.nAsset, txout.nNonce, txout.scriptPubKey, vchRangeproof, nBlindingKeySetId, data);
+            if (data.status == CWalletBlindingData::KNOWN && !(txout.nValue.IsExplicit() && txout.nAsset.IsExplicit()))
+                nOutputsUnblinded++;
+        }
+    }
+
+    void PrepareBlocks()
+    {
+        RenameThread("bitcoin-rescan");
+        while (true) {
+            size_t nIndex;
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fInterrupt && queueRead.empty() && nRead < vBlocks.size())
+                    cond.wait(lock);
+                if (fInterrupt || queueRead.empty())
+                    return;
+                nIndex = queueRead.front();
+                queueRead.pop_front();
+            }
+            CRescanBlock& slot = Slot(nIndex);
+            if (slot.fRead) {
+                slot.vtx.resize(slot.block.vtx.size());
+                for (size_t i = 0; i < slot.block.vtx.size(); i++)
+                    PrepareTransaction(*slot.block.vtx[i], slot.vtx[i], slot.nOutputsUnblinded);
+            }
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                slot.state = CRescanBlock::PREPARED;
+            }
+            cond.notify_all();
+        }
+    }
+
+public:
+    CWalletRescanPipeline(const CWallet& walletIn, const std::vector<CBlockIndex*>& vBlocksIn, const Consensus::Params& params, int nThreads) :
+        wallet(walletIn), vBlocks(vBlocksIn), consensusParams(params), nBlindingKeySetId(walletIn.GetBlindingKeySetId()),
+        vSlots(4 * nThreads + 16), nRead(0), nCommitted(0), fInterrupt(false)
+    {
+        threadGroup.create_thread(boost::bind(&CWalletRescanPipeline::ReadBlocks, this));
+        for (int i = 0; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&CWalletRescanPipeline::PrepareBlocks, this));
+    }
+
+    ~CWalletRescanPipeline()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fInterrupt = true;
+        }
+        cond.notify_all();
+        threadGroup.join_all();
+    }
+
+    /** Wait for the next block in chain order to be prepared. */
+    CRescanBlock& Next()
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        CRescanBlock& slot = Slot(nCommitted);
+        while (slot.state != CRescanBlock::PREPARED)
+            cond.wait(lock);
+        assert(slot.nIndex == nCommitted);
+        return slot;
+    }
+
+    /** Hand the block returned by Next() back to the reader. */
+    void Release()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            Slot(nCommitted).state = CRescanBlock::FREE;
+            nCommitted++;
+        }
+        cond.notify_all();
+    }
+};
+
+} // namespace
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  *
+ * Blocks are read and checked against the wallet's keys by a pool of
+ * -rescanthreads workers, and added to the wallet in chain order by the
+ * calling thread.
+ *
  * Returns pointer to the first block in the last contiguous range that was
  * successfully scanned.
  *
@@ -1691,39 +1889,97 @@ CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool f
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
             pindex = chainActive.Next(pindex);
 
+        std::vector<CBlockIndex*> vBlocks;
+        for (; pindex; pindex = chainActive.Next(pindex))
+            vBlocks.push_back(pindex);
+
+        int nThreads = nRescanThreads;
+        if (nThreads <= 0)
+            nThreads += GetNumCores();
+        nThreads = std::max(1, std::min(nThreads, MAX_RESCAN_THREADS));
+
+        {
+            LOCK(cs_scanstatus);
+            scanStatus = CWalletScanStatus();
+            scanStatus.fScanning = true;
+            scanStatus.nThreads = nThreads;
+            scanStatus.nStartHeight = vBlocks.empty() ? -1 : vBlocks.front()->nHeight;
+            scanStatus.nStopHeight = vBlocks.empty() ? -1 : vBlocks.back()->nHeight;
+            scanStatus.nStartTime = GetTimeMillis();
+        }
+
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = GuessVerificationProgress(pindex, chainParams.GetConsensus().nPowTargetSpacing);
+        double dProgressStart = GuessVerificationProgress(vBlocks.empty() ? NULL : vBlocks.front(), chainParams.GetConsensus().nPowTargetSpacing);
         double dProgressTip = GuessVerificationProgress(chainActive.Tip(), chainParams.GetConsensus().nPowTargetSpacing);
-        while (pindex)
-        {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
-                double progress = GuessVerificationProgress(pindex, chainParams.GetConsensus().nPowTargetSpacing);
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((progress - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-            }
+        try {
+            if (!vBlocks.empty()) {
+                CWalletRescanPipeline pipeline(*this, vBlocks, chainParams.GetConsensus(), nThreads);
+                for (size_t i = 0; i < vBlocks.size(); i++) {
+                    pindex = vBlocks[i];
+                    double progress = GuessVerificationProgress(pindex, chainParams.GetConsensus().nPowTargetSpacing);
+                    if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0) {
+                        ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((progress - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+                    }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus())) {
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(*block.vtx[posInBlock], pindex, posInBlock, fUpdate);
-                }
-                if (!ret) {
-                    ret = pindex;
+                    CRescanBlock& scanned = pipeline.Next();
+                    if (scanned.fRead) {
+                        const CBlock& block = scanned.block;
+                        for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
+                            const CRescanTx& hint = scanned.vtx[posInBlock];
+                            AddToWalletIfInvolvingMe(*block.vtx[posInBlock], pindex, posInBlock, fUpdate, hint.fIsMine, hint.vBlindingData);
+                        }
+                        if (!ret) {
+                            ret = pindex;
+                        }
+                    } else {
+                        ret = nullptr;
+                    }
+                    {
+                        LOCK(cs_scanstatus);
+                        scanStatus.nHeight = pindex->nHeight;
+                        scanStatus.dProgress = dProgressTip - dProgressStart > 0.0 ? std::min(1.0, (progress - dProgressStart) / (dProgressTip - dProgressStart)) : 1.0;
+                        scanStatus.nBlocks++;
+                        scanStatus.nTransactions += scanned.block.vtx.size();
+                        scanStatus.nOutputsUnblinded += scanned.nOutputsUnblinded;
+                    }
+                    pipeline.Release();
+
+                    if (GetTime() >= nNow + 60) {
+                        nNow = GetTime();
+                        CWalletScanStatus status = GetScanStatus();
+                        LogPrintf("Still rescanning. At block %d. Progress=%f (%.1f blocks/s)\n", pindex->nHeight, progress,
+                            status.nBlocks * 1000.0 / std::max<int64_t>(1, GetTimeMillis() - status.nStartTime));
+                    }
                 }
-            } else {
-                ret = nullptr;
-            }
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                double progress = GuessVerificationProgress(pindex, chainParams.GetConsensus().nPowTargetSpacing);
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, progress);
             }
+        } catch (...) {
+            LOCK(cs_scanstatus);
+            scanStatus.fScanning = false;
+            throw;
         }
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
+
+        {
+            LOCK(cs_scanstatus);
+            scanStatus.fScanning = false;
+            scanStatus.dProgress = 1.0;
+            scanStatus.nDuration = GetTimeMillis() - scanStatus.nStartTime;
+            LogPrint("wallet", "Rescanned %u blocks (%u transactions, %u outputs unblinded) in %dms using %d threads\n",
+                scanStatus.nBlocks, scanStatus.nTransactions, scanStatus.nOutputsUnblinded, scanStatus.nDuration, nThreads);
+        }
     }
     return ret;
 }
 
+CWalletScanStatus CWallet::GetScanStatus() const
+{
+    LOCK(cs_scanstatus);
+    CWalletScanStatus status = scanStatus;
+    if (status.fScanning)
+        status.nDuration = GetTimeMillis() - status.nStartTime;
+    return status;
+}
+
 void CWallet::ReacceptWalletTransactions()
 {
     // If transactions aren't being broadcasted, don't let them into local mempool either
@@ -2023,121 +2279,121 @@ bool CWalletTx::IsEquivalentTo(const CWalletTx& _tx) const
 
 void CWalletTx::SetBlindingData(unsigned int mapIndex, CAmount amountIn, CPubKey pubkeyIn, uint256 blindingfactorIn, const CAsset& assetIn, uint256 assetBlindingFactorIn) const
 {
-    if (mapValue["blindingdata"].size() < (mapIndex + 1) * 138) {
-        mapValue["blindingdata"].resize((tx->vout.size() + GetNumIssuances(*tx)) * 138);
+    if (vBlindingData.size() <= mapIndex) {
+        vBlindingData.resize(std::max<size_t>(mapIndex + 1, tx->vout.size() + GetNumIssuances(*tx)));
     }
 
-    unsigned char* it = (unsigned char*)(&mapValue["blindingdata"][0]) + 138 * mapIndex;
+    CWalletBlindingData& data = vBlindingData[mapIndex];
+    data.status = CWalletBlindingData::KNOWN;
+    data.amount = amountIn;
+    data.pubkey = (pubkeyIn.IsValid() && pubkeyIn.size() == 33) ? pubkeyIn : CPubKey();
+    data.blindingfactor = blindingfactorIn;
+    data.asset = assetIn;
+    data.assetBlindingFactor = assetBlindingFactorIn;
+}
 
-    *it = 1;
-    memcpy(&*(it + 1), &amountIn, 8);
-    memcpy(&*(it + 9), blindingfactorIn.begin(), 32);
-    memcpy(&*(it + 41), assetBlindingFactorIn.begin(), 32);
-    memcpy(&*(it + 73), assetIn.begin(), 32);
-    if (pubkeyIn.IsValid() && pubkeyIn.size() == 33) {
-        memcpy(&*(it + 105), pubkeyIn.begin(), 33);
-    } else {
-        memset(&*(it + 105), 0, 33);
+void CWalletTx::WriteBlindingData(int nType, int nVersion) const
+{
+    bool fAnyComputed = false;
+    for (const CWalletBlindingData& data : vBlindingData) {
+        fAnyComputed |= data.status != CWalletBlindingData::UNCOMPUTED;
     }
-
+    if (!fAnyComputed) {
+        mapValue.erase("blindingcache");
+        return;
+    }
+    CDataStream ss(nType, nVersion);
+    ss << vBlindingData;
+    mapValue["blindingcache"] = std::string(ss.begin(), ss.end());
 }
 
-void CWalletTx::GetBlindingData(const unsigned int mapIndex, const std::vector<unsigned char>& vchRangeproof, const CConfidentialValue& confValue, const CConfidentialAsset& confAsset, const CConfidentialNonce nonce, const CScript& scriptPubKey, CAmount* pamountOut, CPubKey* ppubkeyOut, uint256* pblindingfactorOut, CAsset* pAssetOut, uint256* passetBlindingFactorOut) const
+void CWalletTx::ReadBlindingData(int nType, int nVersion)
 {
-    // Blinding data is cached in a serialized record mapWallet["blindingdata"].
-    // It contains a concatenation byte vectors, 74 bytes per txout or pseudo-input.
-    // Each consists of:
-    // * 1 byte boolean marker (has the output been computed)?
-    // * 8 bytes amount (-1 if unknown)
-    // * 32 bytes blinding factor
-    // * 32 bytes asset blinding factor
-    // * 32 bytes asset
-    // * 33 bytes blinding pubkey (ECDH pubkey of the destination)
-    // This is really ugly, and should use CDataStream serialization instead.
+    vBlindingData.clear();
 
-    if (mapValue["blindingdata"].size() < (mapIndex + 1) * 138) {
-        mapValue["blindingdata"].resize((tx->vout.size() + GetNumIssuances(*tx)) * 138);
+    mapValue_t::const_iterator it = mapValue.find("blindingcache");
+    if (it != mapValue.end()) {
+        try {
+            CDataStream ss(it->second.data(), it->second.data() + it->second.size(), nType, nVersion);
+            ss >> vBlindingData;
+        } catch (const std::exception&) {
+            // Only a cache, so just unblind again
+            vBlindingData.clear();
+        }
     }
 
-    unsigned char* it = (unsigned char*)(&mapValue["blindingdata"][0]) + 138 * mapIndex;
-
-    CAmount amount = -1;
-    CPubKey pubkey;
-    uint256 blindingfactor;
-    CAsset asset;
-    uint256 assetBlindingFactor;
-
-    if (*it == 1) {
-        memcpy(&amount, &*(it + 1), 8);
-        memcpy(blindingfactor.begin(), &*(it + 9), 32);
-        memcpy(assetBlindingFactor.begin(), &*(it + 41), 32);
-        memcpy(asset.begin(), &*(it + 73), 32);
-        pubkey.Set(it + 105, it + 138);
-    } else {
-        pwallet->ComputeBlindingData(confValue, confAsset, nonce, scriptPubKey, vchRangeproof, amount, pubkey, blindingfactor,
-            asset, assetBlindingFactor);
-        *it = 1;
-        memcpy(&*(it + 1), &amount, 8);
-        memcpy(&*(it + 9), blindingfactor.begin(), 32);
-        memcpy(&*(it + 41), assetBlindingFactor.begin(), 32);
-        memcpy(&*(it + 73), asset.begin(), 32);
-        if (pubkey.IsValid() && pubkey.size() == 33) {
-            memcpy(&*(it + 105), pubkey.begin(), 33);
-        } else {
-            memset(&*(it + 105), 0, 33);
+    // Earlier versions stored a 138 byte record per output and pseudo-input:
+    // a computed marker, amount, blinding factor, asset blinding factor, asset
+    // and blinding pubkey. Only carry over what was actually unblinded.
+    it = mapValue.find("blindingdata");
+    if (it != mapValue.end()) {
+        if (vBlindingData.empty()) {
+            vBlindingData.resize(it->second.size() / 138);
+            for (size_t i = 0; i < vBlindingData.size(); i++) {
+                const unsigned char* rec = (const unsigned char*)it->second.data() + 138 * i;
+                CAmount amount;
+                memcpy(&amount, rec + 1, 8);
+                if (rec[0] != 1 || amount == -1) {
+                    continue;
+                }
+                CWalletBlindingData& data = vBlindingData[i];
+                data.status = CWalletBlindingData::KNOWN;
+                data.amount = amount;
+                memcpy(data.blindingfactor.begin(), rec + 9, 32);
+                memcpy(data.assetBlindingFactor.begin(), rec + 41, 32);
+                memcpy(data.asset.begin(), rec + 73, 32);
+                data.pubkey.Set(rec + 105, rec + 138);
+            }
         }
+        mapValue.erase("blindingdata");
+    }
+}
+
+const CWalletBlindingData& CWalletTx::GetBlindingData(const unsigned int mapIndex, const std::vector<unsigned char>& vchRangeproof, const CConfidentialValue& confValue, const CConfidentialAsset& confAsset, const CConfidentialNonce nonce, const CScript& scriptPubKey) const
+{
+    if (vBlindingData.size() <= mapIndex) {
+        vBlindingData.resize(std::max<size_t>(mapIndex + 1, tx->vout.size() + GetNumIssuances(*tx)));
     }
 
-    if (pamountOut) *pamountOut = amount;
-    if (ppubkeyOut) *ppubkeyOut = pubkey;
-    if (pblindingfactorOut) *pblindingfactorOut = blindingfactor;
-    if (passetBlindingFactorOut) *passetBlindingFactorOut = assetBlindingFactor;
-    if (pAssetOut) *pAssetOut = asset;
+    CWalletBlindingData& data = vBlindingData[mapIndex];
+    if (data.status == CWalletBlindingData::KNOWN) {
+        return data;
+    }
+    uint64_t nBlindingKeySetId = pwallet->GetBlindingKeySetId();
+    if (data.status == CWalletBlindingData::NOT_OURS && data.nBlindingKeySetId == nBlindingKeySetId) {
+        return data;
+    }
+
+    pwallet->ComputeBlindingData(confValue, confAsset, nonce, scriptPubKey, vchRangeproof, nBlindingKeySetId, data);
+    return data;
 }
 
-CAmount CWalletTx::GetOutputValueOut(unsigned int nOut) const {
+const CWalletBlindingData& CWalletTx::GetOutputBlindingData(unsigned int nOut) const
+{
     assert(nOut < tx->vout.size());
     const CTxOut& out = tx->vout[nOut];
     const CTxWitness& wit = tx->wit;
-    CAmount ret;
-    GetBlindingData(nOut, wit.vtxoutwit.size() <= nOut ? std::vector<unsigned char>() : wit.vtxoutwit[nOut].vchRangeproof, out.nValue, out.nAsset, out.nNonce, out.scriptPubKey, &ret, NULL, NULL, NULL, NULL);
-    return ret;
+    return GetBlindingData(nOut, wit.vtxoutwit.size() <= nOut ? std::vector<unsigned char>() : wit.vtxoutwit[nOut].vchRangeproof, out.nValue, out.nAsset, out.nNonce, out.scriptPubKey);
+}
+
+CAmount CWalletTx::GetOutputValueOut(unsigned int nOut) const {
+    return GetOutputBlindingData(nOut).amount;
 }
 
 uint256 CWalletTx::GetOutputBlindingFactor(unsigned int nOut) const {
-    assert(nOut < tx->vout.size());
-    const CTxOut& out = tx->vout[nOut];
-    const CTxWitness& wit = tx->wit;
-    uint256 ret;
-    GetBlindingData(nOut, wit.vtxoutwit.size() <= nOut ? std::vector<unsigned char>() : wit.vtxoutwit[nOut].vchRangeproof, out.nValue, out.nAsset, out.nNonce, out.scriptPubKey, NULL, NULL, &ret, NULL, NULL);
-    return ret;
+    return GetOutputBlindingData(nOut).blindingfactor;
 }
 
 uint256 CWalletTx::GetOutputAssetBlindingFactor(unsigned int nOut) const {
-    assert(nOut < tx->vout.size());
-    const CTxOut& out = tx->vout[nOut];
-    const CTxWitness& wit = tx->wit;
-    uint256 ret;
-    GetBlindingData(nOut, wit.vtxoutwit.size() <= nOut ? std::vector<unsigned char>() : wit.vtxoutwit[nOut].vchRangeproof, out.nValue, out.nAsset, out.nNonce, out.scriptPubKey, NULL, NULL, NULL, NULL, &ret);
-    return ret;
+    return GetOutputBlindingData(nOut).assetBlindingFactor;
 }
 
 CAsset CWalletTx::GetOutputAsset(unsigned int nOut) const {
-    assert(nOut < tx->vout.size());
-    const CTxOut& out = tx->vout[nOut];
-    const CTxWitness& wit = tx->wit;
-    CAsset ret;
-    GetBlindingData(nOut, wit.vtxoutwit.size() <= nOut ? std::vector<unsigned char>() : wit.vtxoutwit[nOut].vchRangeproof, out.nValue, out.nAsset, out.nNonce, out.scriptPubKey, NULL, NULL, NULL, &ret, NULL);
-    return ret;
+    return GetOutputBlindingData(nOut).asset;
 }
 
 CPubKey CWalletTx::GetOutputBlindingPubKey(unsigned int nOut) const {
-    assert(nOut < tx->vout.size());
-    const CTxOut& out = tx->vout[nOut];
-    const CTxWitness& wit = tx->wit;
-    CPubKey ret;
-    GetBlindingData(nOut, wit.vtxoutwit.size() <= nOut ? std::vector<unsigned char>() : wit.vtxoutwit[nOut].vchRangeproof, out.nValue, out.nAsset, out.nNonce, out.scriptPubKey, NULL, &ret, NULL, NULL, NULL);
-    return ret;
+    return GetOutputBlindingData(nOut).pubkey;
 }
 
 void CWalletTx::GetIssuanceAssets(unsigned int vinIndex, CAsset* out_asset, CAsset* out_reissuance_token) const {
@@ -2200,10 +2456,8 @@ uint256 CWalletTx::GetIssuanceBlindingFactor(unsigned int vinIndex, bool fIssuan
     const std::vector<unsigned char>& rangeproof = wit.vtxinwit.size() <= vinIndex ? std::vector<unsigned char>() : (fIssuanceToken ? wit.vtxinwit[vinIndex].vchInflationKeysRangeproof : wit.vtxinwit[vinIndex].vchIssuanceAmountRangeproof);
     unsigned int mapValueInd = GetPseudoInputOffset(vinIndex, fIssuanceToken)+tx->vout.size();
 
-    uint256 ret;
     CScript blindingScript(CScript() << OP_RETURN << std::vector<unsigned char>(tx->vin[vinIndex].prevout.hash.begin(), tx->vin[vinIndex].prevout.hash.end()) << tx->vin[vinIndex].prevout.n);
-    GetBlindingData(mapValueInd, rangeproof, fIssuanceToken ? issuance.nInflationKeys : issuance.nAmount, CConfidentialAsset(asset), CConfidentialNonce(), blindingScript, NULL, NULL, &ret, NULL, NULL);
-    return ret;
+    return GetBlindingData(mapValueInd, rangeproof, fIssuanceToken ? issuance.nInflationKeys : issuance.nAmount, CConfidentialAsset(asset), CConfidentialNonce(), blindingScript).blindingfactor;
 }
 
 CAmount CWalletTx::GetIssuanceAmount(unsigned int vinIndex, bool fIssuanceToken) const {
@@ -2218,10 +2472,8 @@ CAmount CWalletTx::GetIssuanceAmount(unsigned int vinIndex, bool fIssuanceToken)
     unsigned int mapValueInd = GetPseudoInputOffset(vinIndex, fIssuanceToken)+tx->vout.size();
     const std::vector<unsigned char>& rangeproof = wit.vtxinwit.size() <= vinIndex ? std::vector<unsigned char>() : (fIssuanceToken ? wit.vtxinwit[vinIndex].vchInflationKeysRangeproof : wit.vtxinwit[vinIndex].vchIssuanceAmountRangeproof);
 
-    CAmount ret;
     CScript blindingScript(CScript() << OP_RETURN << std::vector<unsigned char>(tx->vin[vinIndex].prevout.hash.begin(), tx->vin[vinIndex].prevout.hash.end()) << tx->vin[vinIndex].prevout.n);
-    GetBlindingData(mapValueInd, rangeproof, fIssuanceToken ? issuance.nInflationKeys : issuance.nAmount, CConfidentialAsset(asset), CConfidentialNonce(), blindingScript, &ret, NULL, NULL, NULL, NULL);
-    return ret;
+    return GetBlindingData(mapValueInd, rangeproof, fIssuanceToken ? issuance.nInflationKeys : issuance.nAmount, CConfidentialAsset(asset), CConfidentialNonce(), blindingScript).amount;
 }
 
 std::vector<uint256> CWallet::ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman)
@@ -2506,7 +2758,7 @@ bool CWallet::SelectCoinsMinConf(const CAmountMap& mapTargetValue, const int nCo
     std::map<CAsset, SelectCoin > mapCoinLowestLarger;
     // For all positive assets
     std::set<CAsset> setAssetsToMatch;
-    for(std::map<CAsset, CAmount>::const_iterator it = mapTargetValue.begin(); it != mapTargetValue.end(); it++) {
+    for(CAmountMap::const_iterator it = mapTargetValue.begin(); it != mapTargetValue.end(); it++) {
         if (it->second <= 0)
             continue;
         setAssetsToMatch.insert(it->first);
@@ -2992,7 +3244,7 @@ bool CWallet::CreateTransaction(const vector<CRecipient>& vecSend, CWalletTx& wt
                 const CAmountMap mapChange = mapValueIn - mapValueToSelect;
                 assert(!hasNegativeValue(mapChange));
                 unsigned int changeCounter = 0;
-                for(std::map<CAsset, CAmount>::const_iterator it = mapChange.begin(); it != mapChange.end(); ++it) {
+                for(CAmountMap::const_iterator it = mapChange.begin(); it != mapChange.end(); ++it) {
                     if (it->second > 0)
                     {
                         // Fill a vout to ourself
@@ -4257,6 +4509,8 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"),
                                                             CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions on startup"));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Set the number of threads checking and unblinding outputs during rescans (1 to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
+        MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup"));
     if (showDebug)
         strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), DEFAULT_SEND_FREE_TRANSACTIONS));
@@ -4576,6 +4830,7 @@ bool CWallet::ParameterInteraction()
         }
     }
     nTxConfirmTarget = GetArg("-txconfirmtarget", DEFAULT_TX_CONFIRM_TARGET);
+    nRescanThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
     bSpendZeroConfChange = GetBoolArg("-spendzeroconfchange", DEFAULT_SPEND_ZEROCONF_CHANGE);
     fSendFreeTransactions = GetBoolArg("-sendfreetransactions", DEFAULT_SEND_FREE_TRANSACTIONS);
 
@@ -4742,9 +4997,21 @@ bool CWallet::LoadSpecificBlindingKey(const CScriptID& scriptid, const uint256&
 {
     AssertLockHeld(cs_wallet); // mapSpecificBlindingKeys
     mapSpecificBlindingKeys[scriptid] = key;
+    BlindingKeysChanged();
     return true;
 }
 
+uint64_t CWallet::GetBlindingKeySetId() const
+{
+    if (!fBlindingKeySetIdValid) {
+        CHashWriter ss(SER_GETHASH, 0);
+        ss << blinding_derivation_key << mapSpecificBlindingKeys;
+        nBlindingKeySetId = ss.GetHash().GetCheapHash();
+        fBlindingKeySetIdValid = true;
+    }
+    return nBlindingKeySetId;
+}
+
 bool CWallet::AddSpecificBlindingKey(const CScriptID& scriptid, const uint256& key)
 {
     AssertLockHeld(cs_wallet); // mapSpecificBlindingKeys
@@ -4784,24 +5051,18 @@ void CWallet::ComputeBlindingData(const CConfidentialValue& confValue, const CCo
     assetBlindingFactor.SetNull();
 }
 
-void CWalletTx::WipeUnknownBlindingData() const
+void CWallet::ComputeBlindingData(const CConfidentialValue& confValue, const CConfidentialAsset& confAsset, const CConfidentialNonce& nonce, const CScript& scriptPubKey, const std::vector<unsigned char>& vchRangeproof, uint64_t nBlindingKeySetId, CWalletBlindingData& data) const
 {
-    for (unsigned int n = 0; n < tx->vout.size(); n++) {
-        if (GetOutputValueOut(n) == -1) {
-            mapValue["blindingdata"][138 * n] = 0;
-        }
+    ComputeBlindingData(confValue, confAsset, nonce, scriptPubKey, vchRangeproof, data.amount, data.pubkey, data.blindingfactor,
+        data.asset, data.assetBlindingFactor);
+    if (!data.pubkey.IsValid() || data.pubkey.size() != 33) {
+        data.pubkey = CPubKey();
     }
-    for (unsigned int n = 0; n < tx->vin.size(); n++) {
-        if (!tx->vin[n].assetIssuance.nAmount.IsNull()) {
-            if (GetIssuanceAmount(n, false) == -1) {
-                mapValue["blindingdata"][138 * (tx->vout.size() + GetPseudoInputOffset(n, false))] = 0;
-            }
-        }
-        if (!tx->vin[n].assetIssuance.nInflationKeys.IsNull()) {
-            if (GetIssuanceAmount(n, true) == -1) {
-                mapValue["blindingdata"][138 * (tx->vout.size() + GetPseudoInputOffset(n, true))] = 0;
-            }
-        }
+    if (data.amount == -1) {
+        data.status = CWalletBlindingData::NOT_OURS;
+        data.nBlindingKeySetId = nBlindingKeySetId;
+    } else {
+        data.status = CWalletBlindingData::KNOWN;
     }
 }
 
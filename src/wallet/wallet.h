@@ -41,6 +41,7 @@ extern CFeeRate payTxFee;
 extern unsigned int nTxConfirmTarget;
 extern bool bSpendZeroConfChange;
 extern bool fSendFreeTransactions;
+extern int nRescanThreads;
 
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 100;
 //! -paytxfee default
@@ -69,6 +70,10 @@ static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
+//! -rescanthreads default (0 = one per core)
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Maximum number of wallet rescan worker threads
+static const int MAX_RESCAN_THREADS = 16;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -253,6 +258,44 @@ public:
     bool IsCoinBase() const { return tx->IsCoinBase(); }
 };
 
+/** Unblinded data of one output or issuance pseudo-input of a wallet transaction. */
+class CWalletBlindingData
+{
+public:
+    enum Status : uint8_t {
+        UNCOMPUTED = 0,
+        KNOWN = 1,
+        //! Could not be unblinded with the wallet's blinding keys as of nBlindingKeySetId
+        NOT_OURS = 2,
+    };
+
+    uint8_t status;
+    uint64_t nBlindingKeySetId;
+    CAmount amount;
+    CPubKey pubkey;
+    uint256 blindingfactor;
+    CAsset asset;
+    uint256 assetBlindingFactor;
+
+    CWalletBlindingData() : status(UNCOMPUTED), nBlindingKeySetId(0), amount(-1) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(status);
+        if (status == KNOWN) {
+            READWRITE(amount);
+            READWRITE(pubkey);
+            READWRITE(blindingfactor);
+            READWRITE(asset);
+            READWRITE(assetBlindingFactor);
+        } else if (status == NOT_OURS) {
+            READWRITE(nBlindingKeySetId);
+        }
+    }
+};
+
 /** 
  * A transaction with a bunch of additional info that only the owner cares about.
  * It includes any unrecorded transactions needed to link it back to the block chain.
@@ -277,10 +320,8 @@ public:
     std::string strFromAccount;
     int64_t nOrderPos; //!< position in ordered transaction list
 
-    // For each output
-    mutable std::vector<uint256> vBlindingFactors;
-    mutable std::vector<CAmount> vAmountsOut;
-    mutable std::vector<CPubKey> vBlindingKeys;
+    //! Unblinded data for each output, followed by each issuance pseudo-input
+    mutable std::vector<CWalletBlindingData> vBlindingData;
 
     // memory only
     mutable bool fDebitCached;
@@ -341,6 +382,7 @@ public:
         nImmatureWatchCreditCached.clear();
         nChangeCached.clear();
         nOrderPos = -1;
+        vBlindingData.clear();
     }
 
     ADD_SERIALIZE_METHODS;
@@ -359,6 +401,8 @@ public:
 
             if (nTimeSmart)
                 mapValue["timesmart"] = strprintf("%u", nTimeSmart);
+
+            WriteBlindingData(s.GetType(), s.GetVersion());
         }
 
         READWRITE(*(CMerkleTx*)this);
@@ -378,6 +422,8 @@ public:
             ReadOrderPos(nOrderPos, mapValue);
 
             nTimeSmart = mapValue.count("timesmart") ? (unsigned int)atoi64(mapValue["timesmart"]) : 0;
+
+            ReadBlindingData(s.GetType(), s.GetVersion());
         }
 
         mapValue.erase("fromaccount");
@@ -385,6 +431,7 @@ public:
         mapValue.erase("spent");
         mapValue.erase("n");
         mapValue.erase("timesmart");
+        mapValue.erase("blindingcache");
     }
 
     //! make sure balances are recalculated
@@ -399,7 +446,6 @@ public:
         fImmatureWatchCreditCached = false;
         fDebitCached = false;
         fChangeCached = false;
-        WipeUnknownBlindingData();
     }
 
     void BindWallet(CWallet *pwalletIn)
@@ -448,7 +494,13 @@ public:
     void SetBlindingData(unsigned int nOut, CAmount amountIn, CPubKey pubkeyIn, uint256 blindingfactorIn, const CAsset& assetIn, uint256 assetBlindingFactorIn) const;
 
 private:
+    //! Store vBlindingData in mapValue["blindingcache"] for serialization
+    void WriteBlindingData(int nType, int nVersion) const;
+    //! Load vBlindingData from mapValue, including the legacy mapValue["blindingdata"] format
+    void ReadBlindingData(int nType, int nVersion);
+
     /* Computes, stores and returns the unblinded info, or retrieves if already computed previously.
+    * Outputs found not to be ours are only recomputed once the wallet's blinding keys change.
     * @param[in]    mapIndex - Where to store the blinding data. Issuance data is stored after the output data, with additional index offset calculated via GetPseudoInputOffset
     * @param[in]    vchRangeproof - The rangeproof to unwind
     * @param[in]    confValue - The value to unblind
@@ -456,8 +508,8 @@ private:
     * @param[in]    nonce - The nonce used to ECDH with the blinding key. This is null for issuance as blinding key is directly used as nonce
     * @param[in]    scriptPubKey - The script being committed to by the rangeproof
     */
-    void GetBlindingData(const unsigned int mapIndex, const std::vector<unsigned char>& vchRangeproof, const CConfidentialValue& confValue, const CConfidentialAsset& confAsset, const CConfidentialNonce nonce, const CScript& scriptPubKey, CAmount* pamountOut, CPubKey* ppubkeyOut, uint256* pblindingfactorOut, CAsset* pAssetOut, uint256* passetBlindingFactorOut) const;
-    void WipeUnknownBlindingData() const;
+    const CWalletBlindingData& GetBlindingData(const unsigned int mapIndex, const std::vector<unsigned char>& vchRangeproof, const CConfidentialValue& confValue, const CConfidentialAsset& confAsset, const CConfidentialNonce nonce, const CScript& scriptPubKey) const;
+    const CWalletBlindingData& GetOutputBlindingData(unsigned int nOut) const;
 
 public:
     //! Returns either the value out (if it is known) or -1
@@ -613,6 +665,27 @@ private:
 };
 
 
+/** Progress and throughput of the current or most recent wallet rescan. */
+struct CWalletScanStatus
+{
+    bool fScanning;
+    int nThreads;
+    int nStartHeight;
+    int nStopHeight;
+    //! Height of the last block handed to the wallet
+    int nHeight;
+    double dProgress;
+    int64_t nStartTime;
+    int64_t nDuration;
+    uint64_t nBlocks;
+    uint64_t nTransactions;
+    //! Outputs of wallet transactions unblinded by the worker threads
+    uint64_t nOutputsUnblinded;
+
+    CWalletScanStatus() : fScanning(false), nThreads(0), nStartHeight(-1), nStopHeight(-1), nHeight(-1), dProgress(0.0),
+        nStartTime(0), nDuration(0), nBlocks(0), nTransactions(0), nOutputsUnblinded(0) {}
+};
+
 /** 
  * A CWallet is an extension of a keystore, which also maintains a set of transactions and balances,
  * and provides the ability to create new transactions.
@@ -641,6 +714,13 @@ private:
     int64_t nLastResend;
     bool fBroadcastTransactions;
 
+    mutable uint64_t nBlindingKeySetId;
+    mutable bool fBlindingKeySetIdValid;
+
+    //! Protects scanStatus, which is read without cs_wallet while a rescan holds it
+    mutable CCriticalSection cs_scanstatus;
+    CWalletScanStatus scanStatus;
+
     /**
      * Used to keep track of spent outpoints, and
      * detect and report conflicts (double-spends or
@@ -656,6 +736,9 @@ private:
 
     void SyncMetaData(std::pair<TxSpends::iterator, TxSpends::iterator>);
 
+    /* AddToWalletIfInvolvingMe with IsMine and output blinding data already computed by a rescan worker. */
+    bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate, bool fIsMine, const std::vector<CWalletBlindingData>& vBlindingData);
+
     /* the HD chain data model (external chain counters) */
     CHDChain hdChain;
 
@@ -742,6 +825,7 @@ public:
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
         blinding_derivation_key = uint256();
+        fBlindingKeySetIdValid = false;
         offline_key = CPubKey();
         online_key = CPubKey();
         offline_counter = -1;
@@ -767,6 +851,12 @@ public:
     //! There can be exceptions in mapSpecificBlindingKeys.
     uint256 blinding_derivation_key;
 
+    //! Identifies blinding_derivation_key and mapSpecificBlindingKeys, so that cached
+    //! unblinding failures can be told apart from ones made with a different key set
+    uint64_t GetBlindingKeySetId() const;
+    //! Must be called whenever blinding_derivation_key or mapSpecificBlindingKeys change
+    void BlindingKeysChanged() { fBlindingKeySetIdValid = false; }
+
     //! (DEPRECATED) The Offline PAK in the wallet
     CPubKey offline_key;
 
@@ -870,6 +960,7 @@ public:
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock) override;
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
     CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    CWalletScanStatus GetScanStatus() const;
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
@@ -1052,6 +1143,8 @@ public:
     CPubKey GetBlindingPubKey(const CScript& script) const;
 
     void ComputeBlindingData(const CConfidentialValue& confValue, const CConfidentialAsset& confAsset, const CConfidentialNonce& nonce, const CScript& scriptPubKey, const std::vector<unsigned char>& vchRangeproof, CAmount& amount, CPubKey& pubkey, uint256& blindingfactor, CAsset& asset, uint256& assetBlindingFactor) const;
+    //! Fill in data for one output, marking it NOT_OURS as of nBlindingKeySetId if it can't be unblinded
+    void ComputeBlindingData(const CConfidentialValue& confValue, const CConfidentialAsset& confAsset, const CConfidentialNonce& nonce, const CScript& scriptPubKey, const std::vector<unsigned char>& vchRangeproof, uint64_t nBlindingKeySetId, CWalletBlindingData& data) const;
 
     /** Mark a transaction as replaced by another transaction (e.g., BIP 125). */
     bool MarkReplaced(const uint256& originalHash, const uint256& newHash);
@@ -578,6 +578,7 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             uint256 key;
             ssValue >> key;
             pwallet->blinding_derivation_key = key;
+            pwallet->BlindingKeysChanged();
         }
         else if (strType == "specificblindingkey")
         {
@@ -740,6 +741,7 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         uint256 keybin;
         memcpy(keybin.begin(), key.begin(), key.size());
         pwallet->blinding_derivation_key = keybin;
+        pwallet->BlindingKeysChanged();
         if (!WriteBlindingDerivationKey(pwallet->blinding_derivation_key)) {
             result = DB_LOAD_FAIL;
         }